@@ -1,5 +1,6 @@
 local colors = require("colors")
 local settings = require("settings")
+local supervisor = require("supervisor")
 
 local M = {
   _registry = {},
@@ -37,6 +38,25 @@ local function file_exists(path)
   return true
 end
 
+-- Resident popup_context: answers cursor queries from a cached display/space
+-- layout. A space or display change only marks the layout stale; the next
+-- query asks the helper to read it again, so switching spaces runs nothing.
+supervisor.add("popup_context", popup_context_helper_path .. " -d", nil, true)
+
+local layout_stale = false
+
+local context_watcher = sbar.add("item", "center_popup.context_watcher", {
+  drawing = false,
+  updates = true,
+  icon = { drawing = false },
+  label = { drawing = false },
+  background = { drawing = false },
+})
+
+context_watcher:subscribe({ "space_change", "display_change" }, function(_)
+  layout_stale = true
+end)
+
 local function popup_item_names(anchor)
   if not anchor then return {} end
   local ok, result = pcall(function() return anchor:query() end)
@@ -83,7 +103,12 @@ local function resolve_popup_context(callback)
     callback(nil)
     return
   end
-  sbar.exec(popup_context_helper_path, function(out, exit_code)
+  local command = popup_context_helper_path
+  if layout_stale then
+    command = command .. " --invalidate"
+    layout_stale = false
+  end
+  sbar.exec(command, function(out, exit_code)
     if tonumber(exit_code) ~= 0 or type(out) ~= "table" then
       callback(nil)
       return
@@ -0,0 +1,242 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parses the combined aerospace query into fixed size structs and lays the
+// workspaces out into the bar's slots. Slots are compared against the
+// previous layout so only the ones that changed are sent to the bar.
+
+// Must match MAX_WORKSPACES / MAX_WINDOWS_PER_WS in items/aerospace.lua
+#define AEROSPACE_SLOTS 10
+#define AEROSPACE_SLOT_WINDOWS 5
+
+#define AEROSPACE_MAX_WORKSPACES 64
+#define AEROSPACE_NAME_SIZE 32
+#define AEROSPACE_APP_SIZE 64
+
+#define AEROSPACE_SECTION_FOCUSED_WS "---FOCUSED_WS---"
+#define AEROSPACE_SECTION_FOCUSED_WIN "---FOCUSED_WIN---"
+
+struct aerospace_window {
+  char app[AEROSPACE_APP_SIZE];
+  uint32_t id;
+};
+
+struct aerospace_workspace {
+  char name[AEROSPACE_NAME_SIZE];
+  // Windows beyond the slot capacity are counted but not kept
+  uint32_t window_count;
+  struct aerospace_window windows[AEROSPACE_SLOT_WINDOWS];
+};
+
+struct aerospace_state {
+  uint32_t count;
+  struct aerospace_workspace workspaces[AEROSPACE_MAX_WORKSPACES];
+  char focused[AEROSPACE_NAME_SIZE];
+  uint32_t focused_window;
+};
+
+// What a slot shows; zeroed when unused so slots compare with memcmp
+struct aerospace_slot {
+  bool used;
+  bool focused;
+  char name[AEROSPACE_NAME_SIZE];
+  uint32_t window_count;
+  bool window_focused[AEROSPACE_SLOT_WINDOWS];
+  char apps[AEROSPACE_SLOT_WINDOWS][AEROSPACE_APP_SIZE];
+};
+
+static inline char* aerospace_trim(char* text) {
+  while (*text == ' ' || *text == '\t') text++;
+  size_t len = strlen(text);
+  while (len > 0 && (text[len - 1] == ' '
+                     || text[len - 1] == '\t'
+                     || text[len - 1] == '\n'
+                     || text[len - 1] == '\r')) {
+    text[--len] = '\0';
+  }
+  return text;
+}
+
+// Copies a name as is, truncated to the field; it is escaped when written
+static inline void aerospace_copy_name(char* dst, size_t size, const char* src) {
+  size_t len = 0;
+  for (; *src && len + 1 < size; src++) dst[len++] = *src;
+  dst[len] = '\0';
+}
+
+// Appends text to the trigger payload at len, returning the new length.
+// The quotes cannot pass through the bar's message format and | separates
+// the fields, so they are percent-encoded along with % itself; the Lua side
+// decodes every field. App names keep their exact spelling for the
+// app_icons lookup.
+static inline size_t aerospace_append_escaped(char* buffer,
+                                              size_t size,
+                                              size_t len,
+                                              const char* text) {
+  static const char hex[] = "0123456789ABCDEF";
+  for (const char* c = text; *c && len + 1 < size; c++) {
+    if (*c == '"' || *c == '\'' || *c == '|' || *c == '%') {
+      if (len + 4 > size) break;
+      buffer[len++] = '%';
+      buffer[len++] = hex[(unsigned char)*c >> 4];
+      buffer[len++] = hex[(unsigned char)*c & 0xf];
+    } else {
+      buffer[len++] = *c;
+    }
+  }
+  if (len < size) buffer[len] = '\0';
+  return len;
+}
+
+static inline struct aerospace_workspace* aerospace_workspace_get(struct aerospace_state* state,
+                                                                  const char* name) {
+  for (uint32_t i = 0; i < state->count; i++) {
+    if (strcmp(state->workspaces[i].name, name) == 0) return &state->workspaces[i];
+  }
+  if (state->count == AEROSPACE_MAX_WORKSPACES) return NULL;
+
+  struct aerospace_workspace* workspace = &state->workspaces[state->count++];
+  memset(workspace, 0, sizeof(struct aerospace_workspace));
+  aerospace_copy_name(workspace->name, sizeof(workspace->name), name);
+  return workspace;
+}
+
+// One "<workspace>|||<app>|||<window id>" line of list-windows
+static inline void aerospace_parse_window(struct aerospace_state* state, char* line) {
+  char* app = strstr(line, "|||");
+  if (!app) return;
+  *app = '\0';
+  app += 3;
+  char* id = strstr(app, "|||");
+  if (id) {
+    *id = '\0';
+    id += 3;
+  }
+
+  char* name = aerospace_trim(line);
+  app = aerospace_trim(app);
+  if (*name == '\0' || *app == '\0') return;
+
+  struct aerospace_workspace* workspace = aerospace_workspace_get(state, name);
+  if (!workspace) return;
+  if (workspace->window_count < AEROSPACE_SLOT_WINDOWS) {
+    struct aerospace_window* window = &workspace->windows[workspace->window_count];
+    aerospace_copy_name(window->app, sizeof(window->app), app);
+    window->id = id ? (uint32_t)strtoul(aerospace_trim(id), NULL, 10) : 0;
+  }
+  workspace->window_count++;
+}
+
+// Reads the output of the combined query: the list-windows lines, then the
+// focused workspace and the focused window id, each after its marker line.
+static inline void aerospace_parse(struct aerospace_state* state, FILE* input) {
+  memset(state, 0, sizeof(struct aerospace_state));
+
+  enum { SECTION_WINDOWS, SECTION_FOCUSED_WS, SECTION_FOCUSED_WIN } section = SECTION_WINDOWS;
+  char line[512];
+  while (fgets(line, sizeof(line), input)) {
+    char* text = aerospace_trim(line);
+    if (strcmp(text, AEROSPACE_SECTION_FOCUSED_WS) == 0) {
+      section = SECTION_FOCUSED_WS;
+    } else if (strcmp(text, AEROSPACE_SECTION_FOCUSED_WIN) == 0) {
+      section = SECTION_FOCUSED_WIN;
+    } else if (section == SECTION_WINDOWS) {
+      aerospace_parse_window(state, text);
+    } else if (section == SECTION_FOCUSED_WS) {
+      aerospace_copy_name(state->focused, sizeof(state->focused), text);
+    } else {
+      state->focused_window = (uint32_t)strtoul(text, NULL, 10);
+    }
+  }
+}
+
+static int aerospace_compare_names(const void* a, const void* b) {
+  return strcmp(((const struct aerospace_workspace*)a)->name,
+                ((const struct aerospace_workspace*)b)->name);
+}
+
+// Workspaces with windows in name order, plus the focused one even if it is
+// empty, assigned to the slots from the left.
+static inline void aerospace_layout(struct aerospace_state* state,
+                                    struct aerospace_slot slots[AEROSPACE_SLOTS]) {
+  if (state->focused[0] != '\0') aerospace_workspace_get(state, state->focused);
+  qsort(state->workspaces,
+        state->count,
+        sizeof(struct aerospace_workspace),
+        aerospace_compare_names);
+
+  memset(slots, 0, AEROSPACE_SLOTS * sizeof(struct aerospace_slot));
+  for (uint32_t i = 0; i < state->count && i < AEROSPACE_SLOTS; i++) {
+    const struct aerospace_workspace* workspace = &state->workspaces[i];
+    struct aerospace_slot* slot = &slots[i];
+    slot->used = true;
+    slot->focused = strcmp(workspace->name, state->focused) == 0;
+    memcpy(slot->name, workspace->name, sizeof(slot->name));
+
+    slot->window_count = workspace->window_count < AEROSPACE_SLOT_WINDOWS
+                         ? workspace->window_count
+                         : AEROSPACE_SLOT_WINDOWS;
+    for (uint32_t j = 0; j < slot->window_count; j++) {
+      const struct aerospace_window* window = &workspace->windows[j];
+      memcpy(slot->apps[j], window->app, sizeof(slot->apps[j]));
+      slot->window_focused[j] = window->id != 0 && window->id == state->focused_window;
+    }
+  }
+}
+
+// Appends SLOT_<n>="<name>|<focused>|<window focus flags>|<app>|<app>..."
+// (empty for an unused slot) to the trigger message.
+static inline void aerospace_write_slot(char* buffer,
+                                        size_t size,
+                                        uint32_t index,
+                                        const struct aerospace_slot* slot) {
+  size_t len = strlen(buffer);
+  if (len >= size) return;
+  len += snprintf(buffer + len, size - len, " SLOT_%u=\"", index + 1);
+  if (slot->used && len < size) {
+    char flags[AEROSPACE_SLOT_WINDOWS + 1];
+    for (uint32_t j = 0; j < slot->window_count; j++) {
+      flags[j] = slot->window_focused[j] ? '1' : '0';
+    }
+    flags[slot->window_count] = '\0';
+    len = aerospace_append_escaped(buffer, size, len, slot->name);
+    if (len < size) {
+      len += snprintf(buffer + len, size - len, "|%d|%s", slot->focused ? 1 : 0, flags);
+    }
+    for (uint32_t j = 0; j < slot->window_count && len < size; j++) {
+      len += snprintf(buffer + len, size - len, "|");
+      if (len < size) len = aerospace_append_escaped(buffer, size, len, slot->apps[j]);
+    }
+  }
+  if (len < size) snprintf(buffer + len, size - len, "\"");
+}
+
+// Builds the trigger for the slots that differ from previous and updates
+// previous. Returns false if nothing changed.
+static inline bool aerospace_diff(struct aerospace_slot previous[AEROSPACE_SLOTS],
+                                  const struct aerospace_slot current[AEROSPACE_SLOTS],
+                                  const char* event,
+                                  char* buffer,
+                                  size_t size) {
+  snprintf(buffer, size, "--trigger '%s' CHANGED=\"", event);
+  bool changed = false;
+  for (uint32_t i = 0; i < AEROSPACE_SLOTS; i++) {
+    if (memcmp(&previous[i], &current[i], sizeof(struct aerospace_slot)) == 0) continue;
+    size_t len = strlen(buffer);
+    if (len < size) snprintf(buffer + len, size - len, changed ? ",%u" : "%u", i + 1);
+    changed = true;
+  }
+  if (!changed) return false;
+
+  size_t len = strlen(buffer);
+  if (len < size) snprintf(buffer + len, size - len, "\"");
+  for (uint32_t i = 0; i < AEROSPACE_SLOTS; i++) {
+    if (memcmp(&previous[i], &current[i], sizeof(struct aerospace_slot)) == 0) continue;
+    aerospace_write_slot(buffer, size, i, &current[i]);
+    previous[i] = current[i];
+  }
+  return true;
+}
@@ -0,0 +1,127 @@
+#include <dispatch/dispatch.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aerospace.h"
+#include "../impact.h"
+#include "../sketchybar.h"
+
+// Resident aerospace query: runs the combined aerospace query when poked
+// with SIGUSR1 and triggers <event> with only the bar slots that changed.
+// Pokes arriving within the settle delay are coalesced into one query.
+
+#define SETTLE_MSEC 40
+
+struct watcher {
+  const char* event;
+  char command[1024];
+  bool print;
+  bool pending;
+  struct aerospace_slot slots[AEROSPACE_SLOTS];
+};
+
+static bool build_command(char* buffer, size_t size, const char* aerospace) {
+  if (strchr(aerospace, '\'')) return false;
+  int len = snprintf(buffer,
+                     size,
+                     "'%1$s' list-windows --all --format '%%{workspace}|||%%{app-name}|||%%{window-id}' 2>/dev/null; "
+                     "echo '" AEROSPACE_SECTION_FOCUSED_WS "'; "
+                     "'%1$s' list-workspaces --focused 2>/dev/null; "
+                     "echo '" AEROSPACE_SECTION_FOCUSED_WIN "'; "
+                     "'%1$s' list-windows --focused --format '%%{window-id}' 2>/dev/null",
+                     aerospace                                                        );
+  return len > 0 && (size_t)len < size;
+}
+
+static void refresh(void* context) {
+  struct watcher* watcher = context;
+  watcher->pending = false;
+
+  FILE* output = popen(watcher->command, "r");
+  if (!output) return;
+  struct aerospace_state state;
+  aerospace_parse(&state, output);
+  pclose(output);
+
+  struct aerospace_slot slots[AEROSPACE_SLOTS];
+  aerospace_layout(&state, slots);
+
+  char trigger[8192];
+  if (!aerospace_diff(watcher->slots, slots, watcher->event, trigger, sizeof(trigger))) {
+    return;
+  }
+  if (watcher->print) {
+    printf("%s\n", trigger);
+    fflush(stdout);
+  } else {
+    sketchybar(trigger);
+  }
+}
+
+static void poke(void* context) {
+  struct watcher* watcher = context;
+  if (watcher->pending) return;
+  watcher->pending = true;
+  dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, SETTLE_MSEC * NSEC_PER_MSEC),
+                   dispatch_get_main_queue(),
+                   watcher,
+                   refresh                                                        );
+}
+
+static void usage(const char* name) {
+  printf("Usage: %s \"<event-name>\" [--aerospace <path>] [--print] [--once]\n", name);
+}
+
+int main(int argc, char** argv) {
+  impact_apply();
+  if (argc < 2) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  static struct watcher watcher = { 0 };
+  watcher.event = argv[1];
+  const char* aerospace = "aerospace";
+  bool once = false;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--aerospace") == 0 && i + 1 < argc) {
+      aerospace = argv[++i];
+    } else if (strcmp(argv[i], "--print") == 0) {
+      watcher.print = true;
+    } else if (strcmp(argv[i], "--once") == 0) {
+      once = true;
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (!build_command(watcher.command, sizeof(watcher.command), aerospace)) {
+    fprintf(stderr, "Invalid aerospace path: %s\n", aerospace);
+    exit(1);
+  }
+
+  // Nothing was sent yet: the first query reports every slot
+  memset(watcher.slots, 0xff, sizeof(watcher.slots));
+  if (once) {
+    refresh(&watcher);
+    return 0;
+  }
+
+  signal(SIGUSR1, SIG_IGN);
+  dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL,
+                                                    SIGUSR1,
+                                                    0,
+                                                    dispatch_get_main_queue()  );
+  dispatch_set_context(source, &watcher);
+  dispatch_source_set_event_handler_f(source, poke);
+  dispatch_resume(source);
+
+  poke(&watcher);
+  dispatch_main();
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../aerospace.h"
+#include "../../sketchybar.h"
+
+// Replays recorded outputs of the combined aerospace query, separated by
+// "===" lines, through the parser, the slot layout and the diff. Prints the
+// trigger of each query and the arguments the bar receives once the message
+// is split the way sketchybar.h sends it: `make test` diffs the output
+// against aerospace.expected.
+
+static void print_arguments(char* trigger) {
+  char formatted[8192 + 2];
+  uint32_t length = format_message(trigger, formatted);
+  printf("  bar receives:");
+  for (uint32_t i = 0; i < length && formatted[i]; i += strlen(formatted + i) + 1) {
+    printf(" [%s]", formatted + i);
+  }
+  printf("\n");
+}
+
+static void replay(struct aerospace_slot previous[AEROSPACE_SLOTS], char* query, int index) {
+  FILE* input = fmemopen(query, strlen(query), "r");
+  if (!input) return;
+  struct aerospace_state state;
+  aerospace_parse(&state, input);
+  fclose(input);
+
+  struct aerospace_slot slots[AEROSPACE_SLOTS];
+  aerospace_layout(&state, slots);
+
+  char trigger[8192];
+  printf("query %d: ", index);
+  if (!aerospace_diff(previous, slots, "aerospace_state_change", trigger, sizeof(trigger))) {
+    printf("(unchanged)\n");
+    return;
+  }
+  printf("%s\n", trigger);
+  print_arguments(trigger);
+}
+
+int main(void) {
+  struct aerospace_slot previous[AEROSPACE_SLOTS];
+  memset(previous, 0, sizeof(previous));
+
+  static char query[16384];
+  size_t len = 0;
+  int index = 1;
+  char line[512];
+  while (fgets(line, sizeof(line), stdin)) {
+    if (strcmp(line, "===\n") == 0) {
+      replay(previous, query, index++);
+      len = 0;
+      query[0] = '\0';
+      continue;
+    }
+    len += snprintf(query + len, sizeof(query) - len, "%s", line);
+  }
+  replay(previous, query, index);
+  return 0;
+}
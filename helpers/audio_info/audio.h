@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../json.h"
+
+// Audio state as plain values, read from CoreAudio by audio_info.c. The
+// JSON output and the change trigger only depend on these structs.
+
+struct audio_device {
+  bool present;
+  char name[128];
+  char transport[32];
+  double sample_rate;
+  uint32_t channels;
+};
+
+struct audio_state {
+  // 0-100, -1 if the device has no volume control
+  int volume;
+  bool muted;
+  int input_volume;
+  struct audio_device output;
+  struct audio_device input;
+};
+
+static inline void audio_write_device(struct json_writer* json,
+                                      const char* prefix,
+                                      const struct audio_device* device) {
+  if (!device->present) return;
+  char key[32];
+  snprintf(key, sizeof(key), "%s_device", prefix);
+  json_field_string(json, key, device->name);
+  snprintf(key, sizeof(key), "%s_transport", prefix);
+  json_field_string(json, key, device->transport);
+  if (device->sample_rate > 0) {
+    snprintf(key, sizeof(key), "%s_sample_rate", prefix);
+    json_field_double(json, key, device->sample_rate);
+  }
+  if (device->channels > 0) {
+    snprintf(key, sizeof(key), "%s_channels", prefix);
+    json_field_int(json, key, device->channels);
+  }
+}
+
+static inline bool audio_write_json(FILE* out, const struct audio_state* state) {
+  char buffer[1024];
+  struct json_writer json;
+  json_init(&json, buffer, sizeof(buffer), out);
+  json_object_begin(&json);
+  json_field_int(&json, "volume", state->volume < 0 ? 0 : state->volume);
+  json_field_bool(&json, "muted", state->muted);
+  if (state->input_volume >= 0) {
+    json_field_int(&json, "input_volume", state->input_volume);
+  }
+  audio_write_device(&json, "out", &state->output);
+  audio_write_device(&json, "in", &state->input);
+  json_object_end(&json);
+  return json_finish(&json, true);
+}
+
+// Trigger values are double quoted, so quotes are dropped from names
+static inline void audio_copy_quoted(char* dst, size_t size, const char* src) {
+  size_t len = 0;
+  for (; *src && len + 1 < size; src++) {
+    if (*src == '"' || *src == '\'') continue;
+    dst[len++] = *src;
+  }
+  dst[len] = '\0';
+}
+
+// Builds the trigger for a state that differs from previous. CHANGED lists
+// what changed ("volume", "mute", "input_volume", "output", "input"); the
+// other variables always carry the full current values.
+static inline bool audio_diff(const struct audio_state* previous,
+                              const struct audio_state* current,
+                              const char* event,
+                              char* buffer,
+                              size_t size) {
+  // ",volume,mute,input_volume,output,input" at most
+  char changed[64];
+  int len = 0;
+  changed[0] = '\0';
+  if (previous->volume != current->volume) {
+    len += snprintf(changed + len, sizeof(changed) - len, ",volume");
+  }
+  if (previous->muted != current->muted) {
+    len += snprintf(changed + len, sizeof(changed) - len, ",mute");
+  }
+  if (previous->input_volume != current->input_volume) {
+    len += snprintf(changed + len, sizeof(changed) - len, ",input_volume");
+  }
+  if (memcmp(&previous->output, &current->output, sizeof(struct audio_device)) != 0) {
+    len += snprintf(changed + len, sizeof(changed) - len, ",output");
+  }
+  if (memcmp(&previous->input, &current->input, sizeof(struct audio_device)) != 0) {
+    len += snprintf(changed + len, sizeof(changed) - len, ",input");
+  }
+  if (changed[0] == '\0') return false;
+
+  char output[128];
+  char input[128];
+  audio_copy_quoted(output, sizeof(output), current->output.present ? current->output.name : "");
+  audio_copy_quoted(input, sizeof(input), current->input.present ? current->input.name : "");
+  snprintf(buffer,
+           size,
+           "--trigger '%s' CHANGED=%s VOLUME=%d MUTED=%s INPUT_VOLUME=%d "
+           "OUTPUT_DEVICE=\"%s\" INPUT_DEVICE=\"%s\"",
+           event,
+           changed + 1,
+           current->volume < 0 ? 0 : current->volume,
+           current->muted ? "true" : "false",
+           current->input_volume,
+           output,
+           input                                                         );
+  return true;
+}
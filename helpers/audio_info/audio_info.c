@@ -0,0 +1,360 @@
+#include <CoreAudio/CoreAudio.h>
+#include <AudioToolbox/AudioServices.h>
+#include <dispatch/dispatch.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "../impact.h"
+#include "../sketchybar.h"
+
+// Audio state of the default output and input devices in one call, read
+// from CoreAudio instead of osascript and system_profiler.
+//
+// Usage: audio_info [--set-volume <0-100> | --toggle-mute | --watch <event>]
+//
+// --watch stays resident and triggers <event> whenever the volume, the mute
+// state or one of the default devices changes.
+
+static AudioObjectPropertyAddress property(AudioObjectPropertySelector selector,
+                                           AudioObjectPropertyScope scope) {
+  AudioObjectPropertyAddress address = {
+    selector,
+    scope,
+    kAudioObjectPropertyElementMain
+  };
+  return address;
+}
+
+static bool get_property(AudioObjectID object,
+                         AudioObjectPropertySelector selector,
+                         AudioObjectPropertyScope scope,
+                         void* data,
+                         UInt32 size                          ) {
+  AudioObjectPropertyAddress address = property(selector, scope);
+  if (!AudioObjectHasProperty(object, &address)) return false;
+  return AudioObjectGetPropertyData(object, &address, 0, NULL, &size, data) == noErr;
+}
+
+static bool set_property(AudioObjectID object,
+                         AudioObjectPropertySelector selector,
+                         AudioObjectPropertyScope scope,
+                         const void* data,
+                         UInt32 size                          ) {
+  AudioObjectPropertyAddress address = property(selector, scope);
+  Boolean settable = false;
+  if (!AudioObjectHasProperty(object, &address)
+      || AudioObjectIsPropertySettable(object, &address, &settable) != noErr
+      || !settable) {
+    return false;
+  }
+  return AudioObjectSetPropertyData(object, &address, 0, NULL, size, data) == noErr;
+}
+
+static AudioDeviceID default_device(AudioObjectPropertyScope scope) {
+  AudioDeviceID device = kAudioObjectUnknown;
+  AudioObjectPropertySelector selector = scope == kAudioObjectPropertyScopeOutput
+                                         ? kAudioHardwarePropertyDefaultOutputDevice
+                                         : kAudioHardwarePropertyDefaultInputDevice;
+  get_property(kAudioObjectSystemObject,
+               selector,
+               kAudioObjectPropertyScopeGlobal,
+               &device,
+               sizeof(device)                  );
+  return device;
+}
+
+// Volume as 0-100, or -1 if the device has no volume control
+static int device_volume(AudioDeviceID device, AudioObjectPropertyScope scope) {
+  Float32 volume = 0;
+  if (get_property(device,
+                   kAudioHardwareServiceDeviceProperty_VirtualMainVolume,
+                   scope,
+                   &volume,
+                   sizeof(volume)                                         )
+      || get_property(device,
+                      kAudioDevicePropertyVolumeScalar,
+                      scope,
+                      &volume,
+                      sizeof(volume)                   )) {
+    return (int)lroundf(volume * 100.f);
+  }
+  return -1;
+}
+
+static const char* transport_name(UInt32 transport) {
+  switch (transport) {
+    case kAudioDeviceTransportTypeBuiltIn: return "Built-in";
+    case kAudioDeviceTransportTypeBluetooth:
+    case kAudioDeviceTransportTypeBluetoothLE: return "Bluetooth";
+    case kAudioDeviceTransportTypeUSB: return "USB";
+    case kAudioDeviceTransportTypeDisplayPort: return "DisplayPort";
+    case kAudioDeviceTransportTypeHDMI: return "HDMI";
+    case kAudioDeviceTransportTypeThunderbolt: return "Thunderbolt";
+    case kAudioDeviceTransportTypeAirPlay: return "AirPlay";
+    case kAudioDeviceTransportTypeAggregate: return "Aggregate";
+    case kAudioDeviceTransportTypeVirtual: return "Virtual";
+    default: return "Unknown";
+  }
+}
+
+static uint32_t device_channels(AudioDeviceID device, AudioObjectPropertyScope scope) {
+  AudioObjectPropertyAddress address = property(kAudioDevicePropertyStreamConfiguration,
+                                                scope                                   );
+  UInt32 size = 0;
+  if (AudioObjectGetPropertyDataSize(device, &address, 0, NULL, &size) != noErr
+      || size == 0) {
+    return 0;
+  }
+
+  AudioBufferList* buffers = malloc(size);
+  if (!buffers) return 0;
+  uint32_t channels = 0;
+  if (AudioObjectGetPropertyData(device, &address, 0, NULL, &size, buffers) == noErr) {
+    for (UInt32 i = 0; i < buffers->mNumberBuffers; i++) {
+      channels += buffers->mBuffers[i].mNumberChannels;
+    }
+  }
+  free(buffers);
+  return channels;
+}
+
+static void read_device(struct audio_device* info,
+                        AudioDeviceID device,
+                        AudioObjectPropertyScope scope) {
+  memset(info, 0, sizeof(struct audio_device));
+  if (device == kAudioObjectUnknown) return;
+  info->present = true;
+
+  CFStringRef name = NULL;
+  if (get_property(device,
+                   kAudioObjectPropertyName,
+                   kAudioObjectPropertyScopeGlobal,
+                   &name,
+                   sizeof(name)                    ) && name) {
+    CFStringGetCString(name, info->name, sizeof(info->name), kCFStringEncodingUTF8);
+    CFRelease(name);
+  }
+
+  UInt32 transport = 0;
+  get_property(device,
+               kAudioDevicePropertyTransportType,
+               kAudioObjectPropertyScopeGlobal,
+               &transport,
+               sizeof(transport)                 );
+  strlcpy(info->transport, transport_name(transport), sizeof(info->transport));
+
+  Float64 sample_rate = 0;
+  if (get_property(device,
+                   kAudioDevicePropertyNominalSampleRate,
+                   kAudioObjectPropertyScopeGlobal,
+                   &sample_rate,
+                   sizeof(sample_rate)                   )) {
+    info->sample_rate = sample_rate;
+  }
+  info->channels = device_channels(device, scope);
+}
+
+static void read_state(struct audio_state* state) {
+  memset(state, 0, sizeof(struct audio_state));
+  AudioDeviceID output = default_device(kAudioObjectPropertyScopeOutput);
+  AudioDeviceID input = default_device(kAudioObjectPropertyScopeInput);
+
+  state->volume = -1;
+  state->input_volume = -1;
+  if (output != kAudioObjectUnknown) {
+    state->volume = device_volume(output, kAudioObjectPropertyScopeOutput);
+    UInt32 muted = 0;
+    get_property(output,
+                 kAudioDevicePropertyMute,
+                 kAudioObjectPropertyScopeOutput,
+                 &muted,
+                 sizeof(muted)                   );
+    state->muted = muted != 0;
+  }
+  if (input != kAudioObjectUnknown) {
+    state->input_volume = device_volume(input, kAudioObjectPropertyScopeInput);
+  }
+  read_device(&state->output, output, kAudioObjectPropertyScopeOutput);
+  read_device(&state->input, input, kAudioObjectPropertyScopeInput);
+}
+
+static bool set_volume(int percent) {
+  AudioDeviceID output = default_device(kAudioObjectPropertyScopeOutput);
+  if (output == kAudioObjectUnknown) return false;
+  if (percent < 0) percent = 0;
+  if (percent > 100) percent = 100;
+
+  Float32 volume = (Float32)percent / 100.f;
+  return set_property(output,
+                      kAudioHardwareServiceDeviceProperty_VirtualMainVolume,
+                      kAudioObjectPropertyScopeOutput,
+                      &volume,
+                      sizeof(volume)                                         )
+         || set_property(output,
+                         kAudioDevicePropertyVolumeScalar,
+                         kAudioObjectPropertyScopeOutput,
+                         &volume,
+                         sizeof(volume)                   );
+}
+
+static bool toggle_mute(void) {
+  AudioDeviceID output = default_device(kAudioObjectPropertyScopeOutput);
+  if (output == kAudioObjectUnknown) return false;
+
+  UInt32 muted = 0;
+  if (!get_property(output,
+                    kAudioDevicePropertyMute,
+                    kAudioObjectPropertyScopeOutput,
+                    &muted,
+                    sizeof(muted)                   )) {
+    return false;
+  }
+  muted = !muted;
+  return set_property(output,
+                      kAudioDevicePropertyMute,
+                      kAudioObjectPropertyScopeOutput,
+                      &muted,
+                      sizeof(muted)                   );
+}
+
+// Resident mode. CoreAudio calls the listeners on its own threads; they only
+// schedule a refresh on the main queue, where the state is read and diffed.
+struct watcher {
+  const char* event;
+  bool pending;
+  AudioDeviceID output;
+  AudioDeviceID input;
+  struct audio_state state;
+};
+
+static OSStatus property_changed(AudioObjectID object,
+                                 UInt32 count,
+                                 const AudioObjectPropertyAddress* addresses,
+                                 void* context                               );
+
+static const AudioObjectPropertySelector device_selectors[] = {
+  kAudioHardwareServiceDeviceProperty_VirtualMainVolume,
+  kAudioDevicePropertyVolumeScalar,
+  kAudioDevicePropertyMute,
+  kAudioDevicePropertyNominalSampleRate,
+};
+
+static void listen_device(struct watcher* watcher,
+                          AudioDeviceID device,
+                          AudioObjectPropertyScope scope,
+                          bool add                      ) {
+  if (device == kAudioObjectUnknown) return;
+  for (size_t i = 0; i < sizeof(device_selectors) / sizeof(device_selectors[0]); i++) {
+    AudioObjectPropertyAddress address = property(device_selectors[i], scope);
+    if (device_selectors[i] == kAudioDevicePropertyNominalSampleRate) {
+      address.mScope = kAudioObjectPropertyScopeGlobal;
+    }
+    if (!AudioObjectHasProperty(device, &address)) continue;
+    if (add) AudioObjectAddPropertyListener(device, &address, property_changed, watcher);
+    else AudioObjectRemovePropertyListener(device, &address, property_changed, watcher);
+  }
+}
+
+// Moves the device listeners along when a default device changes
+static void follow_devices(struct watcher* watcher) {
+  AudioDeviceID output = default_device(kAudioObjectPropertyScopeOutput);
+  AudioDeviceID input = default_device(kAudioObjectPropertyScopeInput);
+  if (output != watcher->output) {
+    listen_device(watcher, watcher->output, kAudioObjectPropertyScopeOutput, false);
+    listen_device(watcher, output, kAudioObjectPropertyScopeOutput, true);
+    watcher->output = output;
+  }
+  if (input != watcher->input) {
+    listen_device(watcher, watcher->input, kAudioObjectPropertyScopeInput, false);
+    listen_device(watcher, input, kAudioObjectPropertyScopeInput, true);
+    watcher->input = input;
+  }
+}
+
+static void refresh(void* context) {
+  struct watcher* watcher = context;
+  watcher->pending = false;
+  follow_devices(watcher);
+
+  struct audio_state state;
+  read_state(&state);
+  char trigger[1024];
+  if (audio_diff(&watcher->state, &state, watcher->event, trigger, sizeof(trigger))) {
+    sketchybar(trigger);
+  }
+  watcher->state = state;
+}
+
+static void schedule_refresh(void* context) {
+  struct watcher* watcher = context;
+  if (watcher->pending) return;
+  watcher->pending = true;
+  // Coalesces the burst of notifications a device switch produces
+  dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, 20 * NSEC_PER_MSEC),
+                   dispatch_get_main_queue(),
+                   watcher,
+                   refresh                                               );
+}
+
+static OSStatus property_changed(AudioObjectID object,
+                                 UInt32 count,
+                                 const AudioObjectPropertyAddress* addresses,
+                                 void* context                               ) {
+  (void)object;
+  (void)count;
+  (void)addresses;
+  dispatch_async_f(dispatch_get_main_queue(), context, schedule_refresh);
+  return noErr;
+}
+
+static int watch(const char* event) {
+  static struct watcher watcher = { 0 };
+  watcher.event = event;
+  watcher.output = kAudioObjectUnknown;
+  watcher.input = kAudioObjectUnknown;
+  // Nothing was sent yet: impossible volumes make the first refresh report
+  // the full state
+  watcher.state.volume = -2;
+  watcher.state.input_volume = -2;
+
+  const AudioObjectPropertySelector system_selectors[] = {
+    kAudioHardwarePropertyDefaultOutputDevice,
+    kAudioHardwarePropertyDefaultInputDevice,
+    kAudioHardwarePropertyDevices,
+  };
+  for (size_t i = 0; i < sizeof(system_selectors) / sizeof(system_selectors[0]); i++) {
+    AudioObjectPropertyAddress address = property(system_selectors[i],
+                                                  kAudioObjectPropertyScopeGlobal);
+    AudioObjectAddPropertyListener(kAudioObjectSystemObject,
+                                   &address,
+                                   property_changed,
+                                   &watcher                 );
+  }
+
+  refresh(&watcher);
+  dispatch_main();
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  impact_apply();
+  if (argc == 3 && strcmp(argv[1], "--watch") == 0) return watch(argv[2]);
+
+  if (argc == 3 && strcmp(argv[1], "--set-volume") == 0) {
+    if (!set_volume(atoi(argv[2]))) return 1;
+  } else if (argc == 2 && strcmp(argv[1], "--toggle-mute") == 0) {
+    if (!toggle_mute()) return 1;
+  } else if (argc != 1) {
+    printf("Usage: %s [--set-volume <0-100> | --toggle-mute | --watch <event>]\n", argv[0]);
+    return 1;
+  }
+
+  // Every invocation answers with the resulting state
+  struct audio_state state;
+  read_state(&state);
+  return audio_write_json(stdout, &state) ? 0 : 1;
+}
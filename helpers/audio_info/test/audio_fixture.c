@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../audio.h"
+
+// Fake device backend: reads a sequence of audio states from a fixture
+// instead of CoreAudio and runs them through the path of the resident mode,
+// printing the trigger of each refresh and the JSON a one-shot call would
+// answer with. `make test` diffs the output against audio.expected.
+//
+//   audio_fixture < audio.input
+//
+// A state line is
+// "<volume> <muted> <input volume>|<output device>|<input device>", a device
+// "<name>;<transport>;<sample rate>;<channels>" or empty if there is none.
+// Lines starting with # are comments.
+
+static void read_device(struct audio_device* device, char* text) {
+  memset(device, 0, sizeof(struct audio_device));
+  if (!text || !text[0]) return;
+  device->present = true;
+
+  char* name = strsep(&text, ";");
+  char* transport = strsep(&text, ";");
+  char* sample_rate = strsep(&text, ";");
+  char* channels = strsep(&text, ";");
+  snprintf(device->name, sizeof(device->name), "%s", name);
+  if (transport) snprintf(device->transport, sizeof(device->transport), "%s", transport);
+  if (sample_rate) device->sample_rate = atof(sample_rate);
+  if (channels) device->channels = (uint32_t)atoi(channels);
+}
+
+static bool read_state(struct audio_state* state, char* line) {
+  memset(state, 0, sizeof(struct audio_state));
+  char* levels = strsep(&line, "|");
+  int muted = 0;
+  if (sscanf(levels, "%d %d %d", &state->volume, &muted, &state->input_volume) != 3) {
+    return false;
+  }
+  state->muted = muted != 0;
+  read_device(&state->output, strsep(&line, "|"));
+  read_device(&state->input, strsep(&line, "|"));
+  return true;
+}
+
+int main(void) {
+  // As in watch(): impossible volumes make the first refresh report the
+  // full state
+  struct audio_state previous = { 0 };
+  previous.volume = -2;
+  previous.input_volume = -2;
+
+  char line[512];
+  int number = 0;
+  while (fgets(line, sizeof(line), stdin)) {
+    number++;
+    line[strcspn(line, "\n")] = '\0';
+    if (!line[0] || line[0] == '#') continue;
+
+    struct audio_state state;
+    if (!read_state(&state, line)) {
+      fprintf(stderr, "audio.input:%d: invalid state\n", number);
+      return 1;
+    }
+
+    char trigger[1024];
+    if (audio_diff(&previous, &state, "volume_change", trigger, sizeof(trigger))) {
+      printf("%s\n", trigger);
+    } else {
+      printf("(unchanged)\n");
+    }
+    if (!audio_write_json(stdout, &state)) return 1;
+    previous = state;
+  }
+  return 0;
+}
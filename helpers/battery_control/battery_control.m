@@ -9,72 +9,30 @@
  *   battery_control adapter on   - Enable adapter (normal power)
  *   battery_control adapter off  - Disable adapter (force discharge)
  *   battery_control caps         - Show SMC capabilities
+ *   battery_control daemon [--limit <percent>] [--hysteresis <percent>]
+ *                                - Stay resident with one SMC session
+ *   battery_control limit <percent> [hysteresis] | limit off
+ *                                - Change the daemon's charge limit
+ *   battery_control quit         - Stop the daemon
+ *
+ * While the daemon runs, the other commands are forwarded to it over a
+ * unix socket instead of opening the SMC again.
  */
 
 #import <Foundation/Foundation.h>
 #import <IOKit/IOKitLib.h>
+#import <IOKit/ps/IOPowerSources.h>
+#import <IOKit/ps/IOPSKeys.h>
+#include <signal.h>
+#include <stdlib.h>
 
-// SMC constants
-#define KERNEL_INDEX_SMC 2
-#define SMC_CMD_READ_BYTES 5
-#define SMC_CMD_WRITE_BYTES 6
-#define SMC_CMD_READ_KEYINFO 9
-
-typedef struct {
-    char major;
-    char minor;
-    char build;
-    char reserved[1];
-    UInt16 release;
-} SMCKeyData_vers_t;
-
-typedef struct {
-    UInt16 version;
-    UInt16 length;
-    UInt32 cpuPLimit;
-    UInt32 gpuPLimit;
-    UInt32 memPLimit;
-} SMCKeyData_pLimitData_t;
-
-typedef struct {
-    UInt32 dataSize;
-    UInt32 dataType;
-    char dataAttributes;
-} SMCKeyData_keyInfo_t;
-
-typedef char SMCBytes_t[32];
-
-typedef struct {
-    UInt32 key;
-    SMCKeyData_vers_t vers;
-    SMCKeyData_pLimitData_t pLimitData;
-    SMCKeyData_keyInfo_t keyInfo;
-    char result;
-    char status;
-    char data8;
-    UInt32 data32;
-    SMCBytes_t bytes;
-} SMCKeyData_t;
+#include "../json.h"
+#include "../socket.h"
+#include "charge_limit.h"
+#include "smc.h"
 
 static io_connect_t conn = 0;
 
-static UInt32 _strtoul(const char *str, int size, int base) {
-    (void)base; // unused, always treat as ASCII FourCC
-    UInt32 total = 0;
-    for (int i = 0; i < size; i++) {
-        total = (total << 8) | (UInt8)str[i];
-    }
-    return total;
-}
-
-static void _ultostr(char *str, UInt32 val) {
-    str[0] = (char)(val >> 24);
-    str[1] = (char)(val >> 16);
-    str[2] = (char)(val >> 8);
-    str[3] = (char)val;
-    str[4] = '\0';
-}
-
 static kern_return_t SMCOpen(void) {
     mach_port_t masterPort;
     kern_return_t result = IOMasterPort(MACH_PORT_NULL, &masterPort);
@@ -98,228 +56,434 @@ static kern_return_t SMCClose(void) {
     return IOServiceClose(conn);
 }
 
-static kern_return_t SMCCall(int index, SMCKeyData_t *inputStructure, SMCKeyData_t *outputStructure) {
-    size_t structureInputSize = sizeof(SMCKeyData_t);
+// One IOKit round trip to the AppleSMC user client
+static bool SMCCall(void *context, SMCKeyData_t *inputStructure, SMCKeyData_t *outputStructure) {
+    (void)context;
     size_t structureOutputSize = sizeof(SMCKeyData_t);
-    return IOConnectCallStructMethod(conn, index, inputStructure, structureInputSize,
-                                     outputStructure, &structureOutputSize);
+    return IOConnectCallStructMethod(conn, KERNEL_INDEX_SMC, inputStructure, sizeof(SMCKeyData_t),
+                                     outputStructure, &structureOutputSize) == kIOReturnSuccess;
 }
 
-static kern_return_t SMCReadKey(const char *key, SMCKeyData_t *val) {
-    SMCKeyData_t inputStructure = {0};
-    SMCKeyData_t outputStructure = {0};
+// The SMC session: key info cache and capabilities, see smc.h
+static smc_t smc = { .call = SMCCall };
 
-    inputStructure.key = _strtoul(key, 4, 0);
-    inputStructure.data8 = SMC_CMD_READ_KEYINFO;
+// Charging status
+static BOOL isChargingEnabled(void) {
+    return smc_charging_enabled(&smc);
+}
 
-    kern_return_t result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-    if (result != kIOReturnSuccess) return result;
+// Charging and adapter status in one batch
+static void readControlState(BOOL *charging, BOOL *adapter) {
+    bool chargingEnabled, adapterEnabled;
+    smc_read_control_state(&smc, &chargingEnabled, &adapterEnabled);
+    *charging = chargingEnabled;
+    *adapter = adapterEnabled;
+}
 
-    inputStructure.keyInfo.dataSize = outputStructure.keyInfo.dataSize;
-    inputStructure.data8 = SMC_CMD_READ_BYTES;
+// Enable adapter (normal power from charger)
+static BOOL enableAdapter(void) {
+    return smc_set_adapter(&smc, true);
+}
 
-    result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-    if (result != kIOReturnSuccess) return result;
+// Disable adapter (force discharge even when plugged in)
+static BOOL disableAdapter(void) {
+    return smc_set_adapter(&smc, false);
+}
+
+// Enable charging (also disables forced discharge, following battery.sh logic)
+static BOOL enableCharging(void) {
+    return smc_set_charging(&smc, true);
+}
 
-    memcpy(val, &outputStructure, sizeof(SMCKeyData_t));
-    return kIOReturnSuccess;
+// Disable charging
+static BOOL disableCharging(void) {
+    return smc_set_charging(&smc, false);
 }
 
-static kern_return_t SMCWriteKey(const char *key, const UInt8 *bytes, UInt32 dataSize) {
-    SMCKeyData_t inputStructure = {0};
-    SMCKeyData_t outputStructure = {0};
+static void printUsage(FILE *out) {
+    fprintf(out, "Usage: battery_control <command> [args]\n");
+    fprintf(out, "Commands:\n");
+    fprintf(out, "  status       - Show current charging status (JSON)\n");
+    fprintf(out, "  enable       - Enable charging\n");
+    fprintf(out, "  disable      - Disable charging\n");
+    fprintf(out, "  adapter on   - Enable adapter (normal power)\n");
+    fprintf(out, "  adapter off  - Disable adapter (force discharge)\n");
+    fprintf(out, "  caps         - Show SMC capabilities\n");
+    fprintf(out, "  daemon [--limit <percent>] [--hysteresis <percent>]\n");
+    fprintf(out, "               - Run resident and hold the charge limit\n");
+    fprintf(out, "  limit <percent> [hysteresis] | limit off\n");
+    fprintf(out, "               - Change the daemon's charge limit\n");
+    fprintf(out, "  quit         - Stop the daemon\n");
+}
 
-    inputStructure.key = _strtoul(key, 4, 0);
-    inputStructure.data8 = SMC_CMD_READ_KEYINFO;
+#define DEFAULT_HYSTERESIS 2
 
-    kern_return_t result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-    if (result != kIOReturnSuccess) return result;
+// The daemon runs as root through sudo, so the per-user temp dir of
+// socket_path would be root's and out of reach of the user's clients. The
+// socket lives in the root-owned /var/run instead and is handed to the
+// invoking user.
+#define SOCKET_PATH "/var/run/sketchybar_battery_control.socket"
 
-    inputStructure.keyInfo.dataSize = outputStructure.keyInfo.dataSize;
-    inputStructure.data8 = SMC_CMD_WRITE_BYTES;
-    memcpy(inputStructure.bytes, bytes, dataSize);
+// Charge limit state, only used while running as daemon
+static BOOL daemon_mode = NO;
+static struct charge_limit charge_limit = { 0 };
 
-    result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-    return result;
+static void beginJSON(struct json_writer *json, char *buffer, size_t size, FILE *out) {
+    json_init(json, buffer, size, out);
+    json_object_begin(json);
 }
 
-static BOOL SMCKeyExists(const char *key) {
-    SMCKeyData_t inputStructure = {0};
-    SMCKeyData_t outputStructure = {0};
+static void finishJSON(struct json_writer *json) {
+    json_object_end(json);
+    json_finish(json, true);
+}
 
-    inputStructure.key = _strtoul(key, 4, 0);
-    inputStructure.data8 = SMC_CMD_READ_KEYINFO;
+// {"success":true,"action":"<action>"} reply of the state changing commands
+static void writeAction(FILE *out, const char *action) {
+    char buffer[128];
+    struct json_writer json;
+    beginJSON(&json, buffer, sizeof(buffer), out);
+    json_field_bool(&json, "success", true);
+    json_field_string(&json, "action", action);
+    finishJSON(&json);
+}
 
-    kern_return_t result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
+// Percentage of the internal battery as reported by IOPS, -1 if unknown
+static int readBatteryPercent(void) {
+    CFTypeRef info = IOPSCopyPowerSourcesInfo();
+    if (!info) return -1;
+    CFArrayRef list = IOPSCopyPowerSourcesList(info);
+    if (!list) {
+        CFRelease(info);
+        return -1;
+    }
 
-    // Key exists if call succeeds and dataSize > 0
-    return result == kIOReturnSuccess && outputStructure.keyInfo.dataSize > 0;
+    int percent = -1;
+    for (CFIndex i = 0; i < CFArrayGetCount(list); i++) {
+        CFDictionaryRef desc = IOPSGetPowerSourceDescription(info, CFArrayGetValueAtIndex(list, i));
+        if (!desc) continue;
+        CFStringRef type = CFDictionaryGetValue(desc, CFSTR(kIOPSTypeKey));
+        if (!type || CFStringCompare(type, CFSTR(kIOPSInternalBatteryType), 0) != kCFCompareEqualTo) continue;
+
+        CFNumberRef current = CFDictionaryGetValue(desc, CFSTR(kIOPSCurrentCapacityKey));
+        CFNumberRef max = CFDictionaryGetValue(desc, CFSTR(kIOPSMaxCapacityKey));
+        int current_value = 0, max_value = 0;
+        if (current && max
+            && CFNumberGetValue(current, kCFNumberIntType, &current_value)
+            && CFNumberGetValue(max, kCFNumberIntType, &max_value)
+            && max_value > 0) {
+            percent = (int)((double)current_value * 100.0 / (double)max_value + 0.5);
+        }
+        break;
+    }
+    CFRelease(list);
+    CFRelease(info);
+    return percent;
 }
 
-static NSString *SMCReadHex(const char *key) {
-    SMCKeyData_t inputStructure = {0};
-    SMCKeyData_t outputStructure = {0};
+// Runs the limit controller against the current battery level
+static void applyChargeLimit(void) {
+    int percent = readBatteryPercent();
+    switch (charge_limit_update(&charge_limit, percent, isChargingEnabled())) {
+        case CHARGE_ENABLE:
+            if (!enableCharging()) fprintf(stderr, "Failed to enable charging at %d%%\n", percent);
+            break;
+        case CHARGE_DISABLE:
+            if (!disableCharging()) fprintf(stderr, "Failed to disable charging at %d%%\n", percent);
+            break;
+        case CHARGE_KEEP:
+            break;
+    }
+}
 
-    inputStructure.key = _strtoul(key, 4, 0);
-    inputStructure.data8 = SMC_CMD_READ_KEYINFO;
+// Executes one command, writing the JSON result to out and diagnostics to
+// err. Shared between the one-shot CLI and requests served by the daemon.
+static int runCommand(int argc, char *argv[], FILE *out, FILE *err) {
+    if (argc < 1) {
+        printUsage(err);
+        return 1;
+    }
 
-    kern_return_t result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-    if (result != kIOReturnSuccess) return nil;
+    NSString *command = [NSString stringWithUTF8String:argv[0]];
+    int exitCode = 0;
+
+    if ([command isEqualToString:@"status"]) {
+        BOOL charging = YES, adapter = YES;
+        readControlState(&charging, &adapter);
+        char buffer[512];
+        struct json_writer json;
+        beginJSON(&json, buffer, sizeof(buffer), out);
+        json_field_bool(&json, "charging_enabled", charging);
+        json_field_bool(&json, "adapter_enabled", adapter);
+        json_field_string(&json, "smc_type", smc_type(&smc));
+        json_field_bool(&json, "supports_tahoe", smc.tahoe);
+        json_field_bool(&json, "supports_legacy", smc.legacy);
+        json_field_bool(&json, "supports_adapter_control", smc.chie || smc.ch0i || smc.ch0j);
+        if (daemon_mode) {
+            json_field_string(&json, "limit_state", charge_limit_state(&charge_limit));
+            if (charge_limit.enabled) {
+                json_field_int(&json, "limit", charge_limit.target);
+                json_field_int(&json, "hysteresis", charge_limit.hysteresis);
+            }
+        }
+        finishJSON(&json);
+    } else if ([command isEqualToString:@"enable"]) {
+        if (enableCharging()) {
+            writeAction(out, "enable_charging");
+        } else {
+            fprintf(err, "Failed to enable charging\n");
+            exitCode = 1;
+        }
+    } else if ([command isEqualToString:@"disable"]) {
+        if (disableCharging()) {
+            writeAction(out, "disable_charging");
+        } else {
+            fprintf(err, "Failed to disable charging\n");
+            exitCode = 1;
+        }
+    } else if ([command isEqualToString:@"adapter"]) {
+        if (argc < 2) {
+            fprintf(err, "Usage: battery_control adapter <on|off>\n");
+            exitCode = 1;
+        } else {
+            NSString *setting = [NSString stringWithUTF8String:argv[1]];
+            // Match battery.sh semantics:
+            // adapter on  = enable_discharging (force battery use)
+            // adapter off = disable_discharging (normal adapter power)
+            if ([setting isEqualToString:@"on"]) {
+                if (disableAdapter()) {
+                    writeAction(out, "force_discharge");
+                } else {
+                    fprintf(err, "Failed to force discharge\n");
+                    exitCode = 1;
+                }
+            } else if ([setting isEqualToString:@"off"]) {
+                if (enableAdapter()) {
+                    writeAction(out, "normal_power");
+                } else {
+                    fprintf(err, "Failed to enable normal power\n");
+                    exitCode = 1;
+                }
+            } else {
+                fprintf(err, "Invalid adapter setting: %s\n", argv[1]);
+                exitCode = 1;
+            }
+        }
+    } else if ([command isEqualToString:@"limit"]) {
+        if (!daemon_mode) {
+            fprintf(err, "The charge limit is held by the daemon: battery_control daemon --limit <percent>\n");
+            exitCode = 1;
+        } else if (argc < 2) {
+            fprintf(err, "Usage: battery_control limit <percent> [hysteresis] | limit off\n");
+            exitCode = 1;
+        } else if (strcmp(argv[1], "off") == 0) {
+            // Never leave the battery stuck at the old limit
+            charge_limit_clear(&charge_limit);
+            if (!isChargingEnabled()) enableCharging();
+            writeAction(out, "limit_off");
+        } else {
+            int target = atoi(argv[1]);
+            int hysteresis = argc > 2 ? atoi(argv[2]) : DEFAULT_HYSTERESIS;
+            if (charge_limit_set(&charge_limit, target, hysteresis)) {
+                applyChargeLimit();
+                char buffer[128];
+                struct json_writer json;
+                beginJSON(&json, buffer, sizeof(buffer), out);
+                json_field_bool(&json, "success", true);
+                json_field_string(&json, "action", "limit");
+                json_field_int(&json, "limit", target);
+                json_field_int(&json, "hysteresis", hysteresis);
+                finishJSON(&json);
+            } else {
+                fprintf(err, "Invalid limit: %s\n", argv[1]);
+                exitCode = 1;
+            }
+        }
+    } else if ([command isEqualToString:@"caps"]) {
+        char buffer[256];
+        struct json_writer json;
+        beginJSON(&json, buffer, sizeof(buffer), out);
+        json_field_bool(&json, "tahoe", smc.tahoe);
+        json_field_bool(&json, "legacy", smc.legacy);
+        json_field_bool(&json, "chie", smc.chie);
+        json_field_bool(&json, "ch0i", smc.ch0i);
+        json_field_bool(&json, "ch0j", smc.ch0j);
+        json_field_string(&json, "smc_type", smc_type(&smc));
+        finishJSON(&json);
+    } else if ([command isEqualToString:@"debug"]) {
+        // Debug: try to read a known key and show raw result
+        fprintf(out, "Testing SMC key reads...\n");
+        SMCValue_t values[SMC_KEY_COUNT];
+        for (int i = 0; i < SMC_KEY_COUNT; i++) values[i] = (SMCValue_t){ .key = (smc_key_t)i };
+        smc_read_keys(&smc, values, SMC_KEY_COUNT);
+        for (int i = 0; i < SMC_KEY_COUNT; i++) {
+            if (!values[i].valid) {
+                fprintf(out, "  %s: not found\n", smc_key_names[i]);
+                continue;
+            }
+            fprintf(out, "  %s: dataSize=%u, value=", smc_key_names[i], values[i].dataSize);
+            for (UInt32 j = 0; j < values[i].dataSize; j++) fprintf(out, "%02x", values[i].bytes[j]);
+            fprintf(out, "\n");
+        }
+    } else {
+        fprintf(err, "Unknown command: %s\n", argv[0]);
+        printUsage(err);
+        exitCode = 1;
+    }
 
-    UInt32 dataSize = outputStructure.keyInfo.dataSize;
-    if (dataSize == 0) return nil;
+    return exitCode;
+}
 
-    inputStructure.keyInfo.dataSize = dataSize;
-    inputStructure.data8 = SMC_CMD_READ_BYTES;
+// Serves one forwarded command line. The reply carries the command output,
+// or its diagnostics if the command failed.
+static void serveRequest(int fd, char *request) {
+    char *args[8];
+    int count = socket_split_args(request, args, 8);
 
-    result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-    if (result != kIOReturnSuccess) return nil;
+    if (count == 1 && strcmp(args[0], "quit") == 0) {
+        socket_reply(fd, 0, NULL, 0);
+        CFRunLoopStop(CFRunLoopGetMain());
+        return;
+    }
 
-    NSMutableString *hex = [NSMutableString string];
-    for (UInt32 i = 0; i < dataSize; i++) {
-        [hex appendFormat:@"%02x", (unsigned char)outputStructure.bytes[i]];
+    char *output = NULL, *errors = NULL;
+    size_t output_len = 0, errors_len = 0;
+    FILE *out = open_memstream(&output, &output_len);
+    FILE *err = open_memstream(&errors, &errors_len);
+    int exitCode = 1;
+    if (out && err) {
+        @autoreleasepool {
+            exitCode = runCommand(count, args, out, err);
+        }
     }
-    return hex;
-}
+    if (out) fclose(out);
+    if (err) fclose(err);
 
-// Capability detection
-static BOOL supports_tahoe = NO;
-static BOOL supports_legacy = NO;
-static BOOL supports_chie = NO;
-static BOOL supports_ch0i = NO;
-static BOOL supports_ch0j = NO;
-
-static void detectCapabilities(void) {
-    supports_tahoe = SMCKeyExists("CHTE");
-    supports_legacy = SMCKeyExists("CH0B");
-    supports_chie = SMCKeyExists("CHIE");
-    supports_ch0i = SMCKeyExists("CH0I");
-    supports_ch0j = SMCKeyExists("CH0J");
+    if (exitCode == 0) socket_reply(fd, exitCode, output, output_len);
+    else socket_reply(fd, exitCode, errors, errors_len);
+    free(output);
+    free(errors);
 }
 
-static NSString *getSmcType(void) {
-    if (supports_tahoe) return @"tahoe";
-    if (supports_legacy) return @"legacy";
-    return @"unknown";
+// Forwards the command line to a running daemon. Returns -1 if none is
+// listening, otherwise the exit code of the forwarded command (1 if the
+// daemon did not answer).
+static int forwardCommand(const char *path, int argc, char *argv[]) {
+    char request[256];
+    socket_join_args(argc - 1, argv + 1, request, sizeof(request));
+    return socket_forward(path, request, stdout, stderr);
 }
 
-// Charging status
-static BOOL isChargingEnabled(void) {
-    if (supports_tahoe) {
-        NSString *hex = SMCReadHex("CHTE");
-        return [hex isEqualToString:@"00000000"];
-    } else if (supports_legacy) {
-        NSString *hex = SMCReadHex("CH0B");
-        return [hex isEqualToString:@"00"];
-    }
-    return YES; // Assume enabled if unknown
+static void powerSourceChanged(void *context) {
+    (void)context;
+    applyChargeLimit();
 }
 
-// Adapter status
-static BOOL isAdapterEnabled(void) {
-    NSString *hex = nil;
-    if (supports_chie) {
-        hex = SMCReadHex("CHIE");
-        return [hex isEqualToString:@"00"];
-    } else if (supports_ch0j) {
-        hex = SMCReadHex("CH0J");
-        return [hex isEqualToString:@"00"];
-    } else if (supports_ch0i) {
-        hex = SMCReadHex("CH0I");
-        return [hex isEqualToString:@"00"];
-    }
-    return YES; // Assume enabled if unknown
+// Stops the run loop on termination signals so the charge state can be
+// restored on the way out.
+static dispatch_source_t stopOnSignal(int sig) {
+    signal(sig, SIG_IGN);
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL,
+                                                      sig, 0, dispatch_get_main_queue());
+    dispatch_source_set_event_handler(source, ^{
+        CFRunLoopStop(CFRunLoopGetMain());
+    });
+    dispatch_resume(source);
+    return source;
 }
 
-// Enable adapter (normal power from charger)
-static BOOL enableAdapter(void) {
-    kern_return_t result = kIOReturnError;
-    UInt8 byte = 0x00;
-    if (supports_chie) {
-        result = SMCWriteKey("CHIE", &byte, 1);
-    } else if (supports_ch0j) {
-        result = SMCWriteKey("CH0J", &byte, 1);
-    } else if (supports_ch0i) {
-        result = SMCWriteKey("CH0I", &byte, 1);
+static int runDaemon(const char *path, int argc, char *argv[]) {
+    int target = 0;
+    int hysteresis = DEFAULT_HYSTERESIS;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--limit") == 0) target = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--hysteresis") == 0) hysteresis = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "Unknown daemon option: %s\n", argv[i]);
+            return 1;
+        }
     }
-    return result == kIOReturnSuccess;
-}
-
-// Disable adapter (force discharge even when plugged in)
-static BOOL disableAdapter(void) {
-    kern_return_t result = kIOReturnError;
-    if (supports_chie) {
-        UInt8 byte = 0x08;
-        result = SMCWriteKey("CHIE", &byte, 1);
-    } else if (supports_ch0j) {
-        UInt8 byte = 0x01;
-        result = SMCWriteKey("CH0J", &byte, 1);
-    } else if (supports_ch0i) {
-        UInt8 byte = 0x01;
-        result = SMCWriteKey("CH0I", &byte, 1);
+    if (target > 0 && !charge_limit_set(&charge_limit, target, hysteresis)) {
+        fprintf(stderr, "Invalid limit: %d (hysteresis %d)\n", target, hysteresis);
+        return 1;
     }
-    return result == kIOReturnSuccess;
-}
 
-// Enable charging (also disables forced discharge, following battery.sh logic)
-static BOOL enableCharging(void) {
-    kern_return_t result;
-
-    // First, disable forced discharge (enable adapter)
-    enableAdapter();
-
-    // Then enable charging
-    if (supports_tahoe) {
-        UInt8 bytes[] = {0x00, 0x00, 0x00, 0x00};
-        result = SMCWriteKey("CHTE", bytes, 4);
-    } else if (supports_legacy) {
-        UInt8 byte = 0x00;
-        result = SMCWriteKey("CH0B", &byte, 1);
-        if (result == kIOReturnSuccess) {
-            result = SMCWriteKey("CH0C", &byte, 1);
+    // Replace a daemon that is already running, e.g. after a config reload
+    char response[16];
+    if (socket_request(path, "quit", response, sizeof(response))) usleep(100000);
+
+    int listen_fd = socket_listen(path, 0600);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    // Started through sudo: hand the socket to the invoking user
+    const char *sudo_uid = getenv("SUDO_UID");
+    const char *sudo_gid = getenv("SUDO_GID");
+    if (sudo_uid && sudo_gid) {
+        if (chown(path, (uid_t)atoi(sudo_uid), (gid_t)atoi(sudo_gid)) != 0) {
+            fprintf(stderr, "Failed to hand over %s: %s\n", path, strerror(errno));
         }
-    } else {
-        return NO;
     }
-    return result == kIOReturnSuccess;
-}
 
-// Disable charging
-static BOOL disableCharging(void) {
-    kern_return_t result;
-    if (supports_tahoe) {
-        UInt8 bytes[] = {0x01, 0x00, 0x00, 0x00};
-        result = SMCWriteKey("CHTE", bytes, 4);
-    } else if (supports_legacy) {
-        UInt8 byte = 0x02;
-        result = SMCWriteKey("CH0B", &byte, 1);
-        if (result == kIOReturnSuccess) {
-            result = SMCWriteKey("CH0C", &byte, 1);
-        }
-    } else {
-        return NO;
+    daemon_mode = YES;
+
+    dispatch_source_t accept_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,
+                                                             listen_fd, 0, dispatch_get_main_queue());
+    dispatch_source_set_event_handler(accept_source, ^{
+        char request[256];
+        int fd = socket_accept_request(listen_fd, request, sizeof(request));
+        if (fd >= 0) serveRequest(fd, request);
+    });
+    dispatch_resume(accept_source);
+
+    CFRunLoopSourceRef power_source = IOPSNotificationCreateRunLoopSource(powerSourceChanged, NULL);
+    if (!power_source) {
+        fprintf(stderr, "Failed to register for power source notifications\n");
+        close(listen_fd);
+        unlink(path);
+        return 1;
     }
-    return result == kIOReturnSuccess;
-}
+    CFRunLoopAddSource(CFRunLoopGetMain(), power_source, kCFRunLoopDefaultMode);
+    CFRelease(power_source);
+
+    dispatch_source_t signal_sources[] = {
+        stopOnSignal(SIGTERM), stopOnSignal(SIGINT), stopOnSignal(SIGHUP),
+    };
+    signal(SIGPIPE, SIG_IGN);
+
+    applyChargeLimit();
+    CFRunLoopRun();
+
+    // Leaving charging disabled without anyone to re-enable it would pin
+    // the battery at the limit until the next daemon start.
+    if (charge_limit.enabled && !isChargingEnabled()) enableCharging();
 
-static void printUsage(void) {
-    fprintf(stderr, "Usage: battery_control <command> [args]\n");
-    fprintf(stderr, "Commands:\n");
-    fprintf(stderr, "  status       - Show current charging status (JSON)\n");
-    fprintf(stderr, "  enable       - Enable charging\n");
-    fprintf(stderr, "  disable      - Disable charging\n");
-    fprintf(stderr, "  adapter on   - Enable adapter (normal power)\n");
-    fprintf(stderr, "  adapter off  - Disable adapter (force discharge)\n");
-    fprintf(stderr, "  caps         - Show SMC capabilities\n");
+    for (size_t i = 0; i < sizeof(signal_sources) / sizeof(signal_sources[0]); i++) {
+        dispatch_source_cancel(signal_sources[i]);
+    }
+    dispatch_source_cancel(accept_source);
+    close(listen_fd);
+    unlink(path);
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
     @autoreleasepool {
         if (argc < 2) {
-            printUsage();
+            printUsage(stderr);
             return 1;
         }
 
+        const char *path = SOCKET_PATH;
+        BOOL runAsDaemon = strcmp(argv[1], "daemon") == 0;
+
+        if (!runAsDaemon) {
+            int exitCode = forwardCommand(path, argc, argv);
+            if (exitCode >= 0) return exitCode;
+            if (strcmp(argv[1], "quit") == 0) return 0;
+        }
+
         kern_return_t result = SMCOpen();
         if (result != kIOReturnSuccess) {
             fprintf(stderr, "Failed to open SMC connection: 0x%x\n", result);
@@ -327,109 +491,10 @@ int main(int argc, char *argv[]) {
             return 1;
         }
 
-        detectCapabilities();
-
-        NSString *command = [NSString stringWithUTF8String:argv[1]];
-        int exitCode = 0;
-
-        if ([command isEqualToString:@"status"]) {
-            NSDictionary *status = @{
-                @"charging_enabled": @(isChargingEnabled()),
-                @"adapter_enabled": @(isAdapterEnabled()),
-                @"smc_type": getSmcType(),
-                @"supports_tahoe": @(supports_tahoe),
-                @"supports_legacy": @(supports_legacy),
-                @"supports_adapter_control": @(supports_chie || supports_ch0i || supports_ch0j),
-            };
-            NSError *error = nil;
-            NSData *json = [NSJSONSerialization dataWithJSONObject:status options:0 error:&error];
-            if (json) {
-                fwrite(json.bytes, 1, json.length, stdout);
-                printf("\n");
-            } else {
-                fprintf(stderr, "JSON error: %s\n", error.localizedDescription.UTF8String);
-                exitCode = 1;
-            }
-        } else if ([command isEqualToString:@"enable"]) {
-            if (enableCharging()) {
-                printf("{\"success\":true,\"action\":\"enable_charging\"}\n");
-            } else {
-                fprintf(stderr, "Failed to enable charging\n");
-                exitCode = 1;
-            }
-        } else if ([command isEqualToString:@"disable"]) {
-            if (disableCharging()) {
-                printf("{\"success\":true,\"action\":\"disable_charging\"}\n");
-            } else {
-                fprintf(stderr, "Failed to disable charging\n");
-                exitCode = 1;
-            }
-        } else if ([command isEqualToString:@"adapter"]) {
-            if (argc < 3) {
-                fprintf(stderr, "Usage: battery_control adapter <on|off>\n");
-                exitCode = 1;
-            } else {
-                NSString *setting = [NSString stringWithUTF8String:argv[2]];
-                // Match battery.sh semantics:
-                // adapter on  = enable_discharging (force battery use)
-                // adapter off = disable_discharging (normal adapter power)
-                if ([setting isEqualToString:@"on"]) {
-                    if (disableAdapter()) {
-                        printf("{\"success\":true,\"action\":\"force_discharge\"}\n");
-                    } else {
-                        fprintf(stderr, "Failed to force discharge\n");
-                        exitCode = 1;
-                    }
-                } else if ([setting isEqualToString:@"off"]) {
-                    if (enableAdapter()) {
-                        printf("{\"success\":true,\"action\":\"normal_power\"}\n");
-                    } else {
-                        fprintf(stderr, "Failed to enable normal power\n");
-                        exitCode = 1;
-                    }
-                } else {
-                    fprintf(stderr, "Invalid adapter setting: %s\n", argv[2]);
-                    exitCode = 1;
-                }
-            }
-        } else if ([command isEqualToString:@"caps"]) {
-            NSDictionary *caps = @{
-                @"tahoe": @(supports_tahoe),
-                @"legacy": @(supports_legacy),
-                @"chie": @(supports_chie),
-                @"ch0i": @(supports_ch0i),
-                @"ch0j": @(supports_ch0j),
-                @"smc_type": getSmcType(),
-            };
-            NSError *error = nil;
-            NSData *json = [NSJSONSerialization dataWithJSONObject:caps options:NSJSONWritingPrettyPrinted error:&error];
-            if (json) {
-                fwrite(json.bytes, 1, json.length, stdout);
-                printf("\n");
-            }
-        } else if ([command isEqualToString:@"debug"]) {
-            // Debug: try to read a known key and show raw result
-            printf("Testing SMC key reads...\n");
-            const char *keys[] = {"CHTE", "CH0B", "CH0C", "CHIE", "CH0I", "CH0J", "BCLM", "CHWA", "CH0K", "CHLC", "BFCL"};
-            int numKeys = sizeof(keys) / sizeof(keys[0]);
-            for (int i = 0; i < numKeys; i++) {
-                SMCKeyData_t inputStructure = {0};
-                SMCKeyData_t outputStructure = {0};
-                inputStructure.key = _strtoul(keys[i], 4, 0);
-                inputStructure.data8 = SMC_CMD_READ_KEYINFO;
-                kern_return_t result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-                if (result == kIOReturnSuccess && outputStructure.keyInfo.dataSize > 0) {
-                    NSString *hex = SMCReadHex(keys[i]);
-                    printf("  %s: dataSize=%u, value=%s\n", keys[i], outputStructure.keyInfo.dataSize, hex ? [hex UTF8String] : "?");
-                } else {
-                    printf("  %s: not found (result=0x%x)\n", keys[i], result);
-                }
-            }
-        } else {
-            fprintf(stderr, "Unknown command: %s\n", argv[1]);
-            printUsage();
-            exitCode = 1;
-        }
+        smc_detect(&smc);
+
+        int exitCode = runAsDaemon ? runDaemon(path, argc, argv)
+                              : runCommand(argc - 1, argv + 1, stdout, stderr);
 
         SMCClose();
         return exitCode;
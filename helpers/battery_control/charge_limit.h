@@ -0,0 +1,63 @@
+/*
+ * charge_limit.h - Charge limit controller with hysteresis
+ *
+ * Charging is disabled once the battery reaches the target and enabled
+ * again only after it dropped below target - hysteresis, so the SMC is not
+ * toggled on every percent step around the limit. The controller only
+ * decides; the daemon applies the action to the SMC.
+ */
+
+#ifndef CHARGE_LIMIT_H
+#define CHARGE_LIMIT_H
+
+#include <stdbool.h>
+
+enum charge_action {
+    CHARGE_KEEP,
+    CHARGE_ENABLE,
+    CHARGE_DISABLE,
+};
+
+struct charge_limit {
+    bool enabled;
+    int target;
+    int hysteresis;
+    // Reached the target and waiting to drop below the lower bound
+    bool holding;
+};
+
+static inline bool charge_limit_set(struct charge_limit *limit, int target, int hysteresis) {
+    if (target < 20 || target > 100 || hysteresis < 0 || hysteresis >= target) return false;
+    limit->enabled = target < 100;
+    limit->target = target;
+    limit->hysteresis = hysteresis;
+    limit->holding = false;
+    return true;
+}
+
+static inline void charge_limit_clear(struct charge_limit *limit) {
+    limit->enabled = false;
+    limit->holding = false;
+}
+
+static inline enum charge_action charge_limit_update(struct charge_limit *limit,
+                                                     int percent,
+                                                     bool charging_enabled) {
+    if (!limit->enabled || percent < 0) return CHARGE_KEEP;
+
+    if (percent >= limit->target) {
+        limit->holding = true;
+    } else if (percent < limit->target - limit->hysteresis) {
+        limit->holding = false;
+    }
+
+    if (limit->holding) return charging_enabled ? CHARGE_DISABLE : CHARGE_KEEP;
+    return charging_enabled ? CHARGE_KEEP : CHARGE_ENABLE;
+}
+
+static inline const char *charge_limit_state(struct charge_limit *limit) {
+    if (!limit->enabled) return "off";
+    return limit->holding ? "holding" : "charging";
+}
+
+#endif /* CHARGE_LIMIT_H */
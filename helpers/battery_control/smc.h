@@ -1,12 +1,17 @@
 /*
- * smc.h - SMC key definitions for battery control
+ * smc.h - SMC key table and key access for battery control
  * Based on smcFanControl and battery CLI research
+ *
+ * The key access only depends on a call function: the AppleSMC user client
+ * in battery_control.m, a mock key store in the tests.
  */
 
 #ifndef SMC_H
 #define SMC_H
 
-#include <IOKit/IOKitLib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 #define SMC_KEY_SIZE 4
 #define SMC_VAL_SIZE 32
@@ -14,19 +19,19 @@
 // SMC data types
 typedef struct {
     char key[SMC_KEY_SIZE + 1];
-    UInt32 dataSize;
+    uint32_t dataSize;
     char dataType[SMC_KEY_SIZE + 1];
-    UInt8 bytes[SMC_VAL_SIZE];
+    uint8_t bytes[SMC_VAL_SIZE];
 } SMCVal_t;
 
 typedef struct {
-    UInt32 key;
+    uint32_t key;
     SMCVal_t val;
-    UInt32 keyInfo;
-    UInt8 result;
-    UInt8 status;
-    UInt8 data8;
-    UInt32 data32;
+    uint32_t keyInfo;
+    uint8_t result;
+    uint8_t status;
+    uint8_t data8;
+    uint32_t data32;
 } SMCParamStruct;
 
 // SMC commands
@@ -37,22 +42,273 @@ enum {
 };
 
 // SMC key codes (FourCC)
-#define SMC_KEY(s) ((UInt32)(s[0]) << 24 | (UInt32)(s[1]) << 16 | (UInt32)(s[2]) << 8 | (UInt32)(s[3]))
+#define SMC_KEY(s) ((uint32_t)(s[0]) << 24 | (uint32_t)(s[1]) << 16 | (uint32_t)(s[2]) << 8 | (uint32_t)(s[3]))
 
-// Charging control keys
-// Tahoe (M1/M2/M3/M4 Apple Silicon)
-#define KEY_CHTE "CHTE"  // Charging enable/disable (4 bytes: 00000000=on, 01000000=off)
+// Typed key table. The key info (size, type) is cached per entry, so each
+// key is looked up at most once per process.
+typedef enum {
+    // Charging control keys
+    // Tahoe (M1/M2/M3/M4 Apple Silicon)
+    SMC_CHTE,  // Charging enable/disable (4 bytes: 00000000=on, 01000000=off)
 
-// Legacy (Intel)
-#define KEY_CH0B "CH0B"  // Charging control B (1 byte: 00=on, 02=off)
-#define KEY_CH0C "CH0C"  // Charging control C (1 byte: 00=on, 02=off)
+    // Legacy (Intel)
+    SMC_CH0B,  // Charging control B (1 byte: 00=on, 02=off)
+    SMC_CH0C,  // Charging control C (1 byte: 00=on, 02=off)
 
-// Adapter/discharge control
-#define KEY_CHIE "CHIE"  // Adapter control (newer, 1 byte: 00=on, 08=off/discharge)
-#define KEY_CH0I "CH0I"  // Adapter control (legacy, 1 byte: 00=on, 01=off/discharge)
-#define KEY_CH0J "CH0J"  // Adapter control (alt, 1 byte: 00=on, 01=off/discharge)
+    // Adapter/discharge control
+    SMC_CHIE,  // Adapter control (newer, 1 byte: 00=on, 08=off/discharge)
+    SMC_CH0I,  // Adapter control (legacy, 1 byte: 00=on, 01=off/discharge)
+    SMC_CH0J,  // Adapter control (alt, 1 byte: 00=on, 01=off/discharge)
 
-// MagSafe LED control
-#define KEY_ACLC "ACLC"  // LED color (00=reset, 01=off, 03=green, 04=orange)
+    // MagSafe LED control
+    SMC_ACLC,  // LED color (00=reset, 01=off, 03=green, 04=orange)
+
+    // Only inspected by `battery_control debug`
+    SMC_BCLM,
+    SMC_CHWA,
+    SMC_CH0K,
+    SMC_CHLC,
+    SMC_BFCL,
+
+    SMC_KEY_COUNT
+} smc_key_t;
+
+static const char *smc_key_names[SMC_KEY_COUNT] = {
+    [SMC_CHTE] = "CHTE",
+    [SMC_CH0B] = "CH0B",
+    [SMC_CH0C] = "CH0C",
+    [SMC_CHIE] = "CHIE",
+    [SMC_CH0I] = "CH0I",
+    [SMC_CH0J] = "CH0J",
+    [SMC_ACLC] = "ACLC",
+    [SMC_BCLM] = "BCLM",
+    [SMC_CHWA] = "CHWA",
+    [SMC_CH0K] = "CH0K",
+    [SMC_CHLC] = "CHLC",
+    [SMC_BFCL] = "BFCL",
+};
+
+// Structure of the AppleSMC user client call
+#define KERNEL_INDEX_SMC 2
+#define SMC_CMD_READ_BYTES 5
+#define SMC_CMD_WRITE_BYTES 6
+#define SMC_CMD_READ_KEYINFO 9
+
+typedef struct {
+    char major;
+    char minor;
+    char build;
+    char reserved[1];
+    uint16_t release;
+} SMCKeyData_vers_t;
+
+typedef struct {
+    uint16_t version;
+    uint16_t length;
+    uint32_t cpuPLimit;
+    uint32_t gpuPLimit;
+    uint32_t memPLimit;
+} SMCKeyData_pLimitData_t;
+
+typedef struct {
+    uint32_t dataSize;
+    uint32_t dataType;
+    char dataAttributes;
+} SMCKeyData_keyInfo_t;
+
+typedef char SMCBytes_t[32];
+
+typedef struct {
+    uint32_t key;
+    SMCKeyData_vers_t vers;
+    SMCKeyData_pLimitData_t pLimitData;
+    SMCKeyData_keyInfo_t keyInfo;
+    char result;
+    char status;
+    char data8;
+    uint32_t data32;
+    SMCBytes_t bytes;
+} SMCKeyData_t;
+
+// One round trip to the SMC; false if the call failed
+typedef bool (*smc_call_t)(void *context, SMCKeyData_t *input, SMCKeyData_t *output);
+
+// Key info never changes while the machine is up, so it is looked up once
+// per key instead of before every read and write.
+typedef struct {
+    uint32_t code;
+    bool resolved;
+    bool exists;
+    SMCKeyData_keyInfo_t info;
+} SMCKeyInfo_t;
+
+typedef struct {
+    smc_key_t key;
+    bool valid;
+    uint32_t dataSize;
+    uint8_t bytes[SMC_VAL_SIZE];
+} SMCValue_t;
+
+typedef struct {
+    smc_call_t call;
+    void *context;
+    SMCKeyInfo_t keys[SMC_KEY_COUNT];
+
+    // Capabilities, from smc_detect
+    bool tahoe;
+    bool legacy;
+    bool chie;
+    bool ch0i;
+    bool ch0j;
+} smc_t;
+
+static inline uint32_t smc_fourcc(const char *name) {
+    return SMC_KEY(((const uint8_t *)name));
+}
+
+static inline const SMCKeyInfo_t *smc_key_info(smc_t *smc, smc_key_t key) {
+    SMCKeyInfo_t *entry = &smc->keys[key];
+    if (entry->resolved) return entry;
+
+    SMCKeyData_t input = {0};
+    SMCKeyData_t output = {0};
+    entry->code = smc_fourcc(smc_key_names[key]);
+    input.key = entry->code;
+    input.data8 = SMC_CMD_READ_KEYINFO;
+    if (!smc->call(smc->context, &input, &output)) return entry; // Retried on the next use
+
+    // Key exists if call succeeds and dataSize > 0
+    entry->info = output.keyInfo;
+    entry->exists = entry->info.dataSize > 0 && entry->info.dataSize <= SMC_VAL_SIZE;
+    entry->resolved = true;
+    return entry;
+}
+
+static inline bool smc_key_exists(smc_t *smc, smc_key_t key) {
+    return smc_key_info(smc, key)->exists;
+}
+
+// Reads a batch of keys with a single round trip per present key, the key
+// info coming from the cache. Keys that are missing (or SMC_KEY_COUNT
+// placeholders) are marked invalid. Returns the number of values read.
+static inline int smc_read_keys(smc_t *smc, SMCValue_t *values, int count) {
+    int read = 0;
+    for (int i = 0; i < count; i++) {
+        SMCValue_t *value = &values[i];
+        value->valid = false;
+        if (value->key >= SMC_KEY_COUNT) continue;
+
+        const SMCKeyInfo_t *entry = smc_key_info(smc, value->key);
+        if (!entry->exists) continue;
+
+        SMCKeyData_t input = {0};
+        SMCKeyData_t output = {0};
+        input.key = entry->code;
+        input.keyInfo.dataSize = entry->info.dataSize;
+        input.data8 = SMC_CMD_READ_BYTES;
+        if (!smc->call(smc->context, &input, &output)) continue;
+
+        value->dataSize = entry->info.dataSize;
+        memcpy(value->bytes, output.bytes, value->dataSize);
+        value->valid = true;
+        read++;
+    }
+    return read;
+}
+
+static inline bool smc_write_key(smc_t *smc, smc_key_t key, const uint8_t *bytes, uint32_t dataSize) {
+    const SMCKeyInfo_t *entry = smc_key_info(smc, key);
+    if (!entry->exists || dataSize > entry->info.dataSize) return false;
+
+    SMCKeyData_t input = {0};
+    SMCKeyData_t output = {0};
+    input.key = entry->code;
+    input.keyInfo.dataSize = entry->info.dataSize;
+    input.data8 = SMC_CMD_WRITE_BYTES;
+    memcpy(input.bytes, bytes, dataSize);
+    return smc->call(smc->context, &input, &output);
+}
+
+// Capability detection
+static inline void smc_detect(smc_t *smc) {
+    smc->tahoe = smc_key_exists(smc, SMC_CHTE);
+    smc->legacy = smc_key_exists(smc, SMC_CH0B);
+    smc->chie = smc_key_exists(smc, SMC_CHIE);
+    smc->ch0i = smc_key_exists(smc, SMC_CH0I);
+    smc->ch0j = smc_key_exists(smc, SMC_CH0J);
+}
+
+static inline const char *smc_type(const smc_t *smc) {
+    if (smc->tahoe) return "tahoe";
+    if (smc->legacy) return "legacy";
+    return "unknown";
+}
+
+// Keys reporting the charging and adapter state, SMC_KEY_COUNT if unsupported
+static inline smc_key_t smc_charging_key(const smc_t *smc) {
+    if (smc->tahoe) return SMC_CHTE;
+    if (smc->legacy) return SMC_CH0B;
+    return SMC_KEY_COUNT;
+}
+
+static inline smc_key_t smc_adapter_key(const smc_t *smc) {
+    if (smc->chie) return SMC_CHIE;
+    if (smc->ch0j) return SMC_CH0J;
+    if (smc->ch0i) return SMC_CH0I;
+    return SMC_KEY_COUNT;
+}
+
+// Both state keys read all zero bytes when enabled (CHTE 00000000, CH0B 00,
+// CHIE/CH0J/CH0I 00)
+static inline bool smc_value_enabled(const SMCValue_t *value) {
+    if (value->key >= SMC_KEY_COUNT) return true; // Assume enabled if unknown
+    if (!value->valid) return false;
+    for (uint32_t i = 0; i < value->dataSize; i++) {
+        if (value->bytes[i] != 0x00) return false;
+    }
+    return true;
+}
+
+static inline bool smc_charging_enabled(smc_t *smc) {
+    SMCValue_t value = { .key = smc_charging_key(smc) };
+    smc_read_keys(smc, &value, 1);
+    return smc_value_enabled(&value);
+}
+
+// Charging and adapter state in one batch
+static inline void smc_read_control_state(smc_t *smc, bool *charging, bool *adapter) {
+    SMCValue_t values[] = {
+        { .key = smc_charging_key(smc) },
+        { .key = smc_adapter_key(smc) },
+    };
+    smc_read_keys(smc, values, 2);
+    *charging = smc_value_enabled(&values[0]);
+    *adapter = smc_value_enabled(&values[1]);
+}
+
+// Adapter on: normal power from the charger; off: force discharge even
+// when plugged in
+static inline bool smc_set_adapter(smc_t *smc, bool enabled) {
+    smc_key_t key = smc_adapter_key(smc);
+    if (key == SMC_KEY_COUNT) return false;
+    uint8_t byte = enabled ? 0x00 : (key == SMC_CHIE ? 0x08 : 0x01);
+    return smc_write_key(smc, key, &byte, 1);
+}
+
+// Enabling charging also ends a forced discharge, following battery.sh
+static inline bool smc_set_charging(smc_t *smc, bool enabled) {
+    if (enabled) smc_set_adapter(smc, true);
+
+    if (smc->tahoe) {
+        uint8_t bytes[] = {enabled ? 0x00 : 0x01, 0x00, 0x00, 0x00};
+        return smc_write_key(smc, SMC_CHTE, bytes, 4);
+    }
+    if (smc->legacy) {
+        uint8_t byte = enabled ? 0x00 : 0x02;
+        return smc_write_key(smc, SMC_CH0B, &byte, 1)
+               && smc_write_key(smc, SMC_CH0C, &byte, 1);
+    }
+    return false;
+}
 
 #endif /* SMC_H */
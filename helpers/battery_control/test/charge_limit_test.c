@@ -0,0 +1,73 @@
+#include "../charge_limit.h"
+#include "mock_smc.h"
+
+// The charge limit controller driving a mock tahoe SMC the way the daemon's
+// applyChargeLimit does, over a battery level trace: `make test` diffs the
+// printed actions and SMC writes against charge_limit.expected.
+
+static const char *action_names[] = {
+    [CHARGE_KEEP] = "keep",
+    [CHARGE_ENABLE] = "enable",
+    [CHARGE_DISABLE] = "disable",
+};
+
+static void apply(struct charge_limit *limit, smc_t *smc, int percent) {
+    enum charge_action action = charge_limit_update(limit, percent, smc_charging_enabled(smc));
+    printf("%3d%% %-7s -> %s\n", percent, action_names[action], charge_limit_state(limit));
+    if (action != CHARGE_KEEP) smc_set_charging(smc, action == CHARGE_ENABLE);
+}
+
+static void trace(const char *what, struct charge_limit *limit, smc_t *smc,
+                  mock_smc_t *mock, const int *percents, int count) {
+    printf("%s\n", what);
+    mock->write_calls = 0;
+    for (int i = 0; i < count; i++) apply(limit, smc, percents[i]);
+    printf("writes: %d\n", mock->write_calls);
+}
+
+int main(void) {
+    mock_smc_t mock = { .trace = true };
+    mock_smc_add(&mock, "CHTE", 4);
+    mock_smc_add(&mock, "CHIE", 1);
+    smc_t smc = { .call = mock_smc_call, .context = &mock };
+    smc_detect(&smc);
+
+    struct charge_limit limit = { 0 };
+    printf("set 80/2: %d, set 10/2: %d, set 80/80: %d, set 101/2: %d\n",
+           charge_limit_set(&limit, 80, 2),
+           charge_limit_set(&limit, 10, 2),
+           charge_limit_set(&limit, 80, 80),
+           charge_limit_set(&limit, 101, 2));
+
+    // Charging up to the limit, then plugged in around it: the SMC is only
+    // written when crossing the bounds, not on every percent step
+    charge_limit_set(&limit, 80, 2);
+    static const int around[] = { 76, 78, 79, 80, 81, 80, 79, 78, 79, 80, 77, 78, 80 };
+    trace("limit 80, hysteresis 2", &limit, &smc, &mock, around, sizeof(around) / sizeof(around[0]));
+
+    // Unknown level (no internal battery reading) leaves the SMC alone
+    static const int unknown[] = { -1, -1 };
+    trace("unknown level", &limit, &smc, &mock, unknown, 2);
+
+    // Charging disabled behind the daemon's back is enabled again below
+    // the lower bound
+    uint8_t off[] = { 0x01, 0x00, 0x00, 0x00 };
+    mock.trace = false;
+    smc_write_key(&smc, SMC_CHTE, off, 4);
+    mock.trace = true;
+    static const int external[] = { 70 };
+    trace("disabled externally", &limit, &smc, &mock, external, 1);
+
+    // Hysteresis 0 toggles on the limit itself
+    charge_limit_set(&limit, 60, 0);
+    static const int tight[] = { 59, 60, 59, 60 };
+    trace("limit 60, hysteresis 0", &limit, &smc, &mock, tight, 4);
+
+    // 100 and off never hold
+    charge_limit_set(&limit, 100, 5);
+    static const int full[] = { 99, 100 };
+    trace("limit 100", &limit, &smc, &mock, full, 2);
+    charge_limit_clear(&limit);
+    trace("limit off", &limit, &smc, &mock, full, 2);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * mock_smc.h - In-memory SMC key store for the tests
+ *
+ * Answers the key info, read and write commands of smc.h like the AppleSMC
+ * user client and counts the round trips per command.
+ */
+
+#ifndef MOCK_SMC_H
+#define MOCK_SMC_H
+
+#include <stdio.h>
+
+#include "../smc.h"
+
+#define MOCK_SMC_MAX_KEYS 8
+
+typedef struct {
+    char name[SMC_KEY_SIZE + 1];
+    uint32_t dataSize;
+    uint8_t bytes[SMC_VAL_SIZE];
+} mock_smc_key_t;
+
+typedef struct {
+    mock_smc_key_t keys[MOCK_SMC_MAX_KEYS];
+    int count;
+
+    int keyinfo_calls;
+    int read_calls;
+    int write_calls;
+    // Prints every write when set
+    bool trace;
+} mock_smc_t;
+
+static inline void mock_smc_add(mock_smc_t *mock, const char *name, uint32_t dataSize) {
+    mock_smc_key_t *key = &mock->keys[mock->count++];
+    memcpy(key->name, name, SMC_KEY_SIZE + 1);
+    key->dataSize = dataSize;
+    memset(key->bytes, 0, sizeof(key->bytes));
+}
+
+static inline mock_smc_key_t *mock_smc_find(mock_smc_t *mock, uint32_t code) {
+    for (int i = 0; i < mock->count; i++) {
+        if (smc_fourcc(mock->keys[i].name) == code) return &mock->keys[i];
+    }
+    return NULL;
+}
+
+static inline void mock_smc_print_bytes(const uint8_t *bytes, uint32_t dataSize) {
+    for (uint32_t i = 0; i < dataSize; i++) printf("%02x", bytes[i]);
+}
+
+#define MOCK_SMC_KEY_NOT_FOUND 132
+
+// smc_call_t of the store. Like the user client, the call itself succeeds
+// for a missing key and reports kSMCKeyNotFound with an empty key info.
+static inline bool mock_smc_call(void *context, SMCKeyData_t *input, SMCKeyData_t *output) {
+    mock_smc_t *mock = context;
+    mock_smc_key_t *key = mock_smc_find(mock, input->key);
+    switch (input->data8) {
+        case SMC_CMD_READ_KEYINFO:
+            mock->keyinfo_calls++;
+            if (!key) {
+                output->result = MOCK_SMC_KEY_NOT_FOUND;
+                return true;
+            }
+            output->keyInfo.dataSize = key->dataSize;
+            return true;
+        case SMC_CMD_READ_BYTES:
+            mock->read_calls++;
+            if (!key || input->keyInfo.dataSize != key->dataSize) return false;
+            memcpy(output->bytes, key->bytes, key->dataSize);
+            return true;
+        case SMC_CMD_WRITE_BYTES:
+            mock->write_calls++;
+            if (!key || input->keyInfo.dataSize != key->dataSize) return false;
+            memcpy(key->bytes, input->bytes, key->dataSize);
+            if (mock->trace) {
+                printf("  write %s=", key->name);
+                mock_smc_print_bytes(key->bytes, key->dataSize);
+                printf("\n");
+            }
+            return true;
+    }
+    return false;
+}
+
+static inline void mock_smc_reset_calls(mock_smc_t *mock) {
+    mock->keyinfo_calls = 0;
+    mock->read_calls = 0;
+    mock->write_calls = 0;
+}
+
+#endif /* MOCK_SMC_H */
@@ -0,0 +1,88 @@
+#include "mock_smc.h"
+
+// The key table and key access of smc.h against mock key stores laid out
+// like an Apple Silicon, an Intel and an unsupported Mac: `make test` diffs
+// the output against smc.expected.
+
+static void print_calls(const char *what, mock_smc_t *mock) {
+    printf("%s: keyinfo=%d read=%d write=%d\n",
+           what, mock->keyinfo_calls, mock->read_calls, mock->write_calls);
+    mock_smc_reset_calls(mock);
+}
+
+static void print_key(mock_smc_t *mock, const char *name) {
+    mock_smc_key_t *key = mock_smc_find(mock, smc_fourcc(name));
+    printf("  %s=", name);
+    mock_smc_print_bytes(key->bytes, key->dataSize);
+    printf("\n");
+}
+
+static void print_state(smc_t *smc) {
+    bool charging, adapter;
+    smc_read_control_state(smc, &charging, &adapter);
+    printf("  charging=%d adapter=%d\n", charging, adapter);
+}
+
+static void run(const char *machine, mock_smc_t *mock) {
+    smc_t smc = { .call = mock_smc_call, .context = mock };
+    printf("%s\n", machine);
+
+    smc_detect(&smc);
+    printf("  type=%s tahoe=%d legacy=%d chie=%d ch0i=%d ch0j=%d\n",
+           smc_type(&smc), smc.tahoe, smc.legacy, smc.chie, smc.ch0i, smc.ch0j);
+    print_calls("  detect", mock);
+
+    print_state(&smc);
+    print_calls("  status", mock);
+    print_state(&smc);
+    print_calls("  status again", mock);
+
+    printf("  disable charging: %d\n", smc_set_charging(&smc, false));
+    print_calls("  disable", mock);
+    printf("  force discharge: %d\n", smc_set_adapter(&smc, false));
+    print_calls("  adapter off", mock);
+    print_state(&smc);
+    mock_smc_reset_calls(mock);
+    for (int i = 0; i < mock->count; i++) print_key(mock, mock->keys[i].name);
+
+    printf("  enable charging: %d\n", smc_set_charging(&smc, true));
+    print_calls("  enable", mock);
+    print_state(&smc);
+    mock_smc_reset_calls(mock);
+
+    uint8_t wide[8] = { 0 };
+    printf("  oversized write: %d\n", smc_write_key(&smc, SMC_CHTE, wide, sizeof(wide)));
+    print_calls("  oversized", mock);
+
+    SMCValue_t values[SMC_KEY_COUNT];
+    for (int i = 0; i < SMC_KEY_COUNT; i++) values[i] = (SMCValue_t){ .key = (smc_key_t)i };
+    int read = smc_read_keys(&smc, values, SMC_KEY_COUNT);
+    printf("  debug: %d of %d keys read\n", read, SMC_KEY_COUNT);
+    print_calls("  debug", mock);
+}
+
+int main(void) {
+    mock_smc_t tahoe = { 0 };
+    mock_smc_add(&tahoe, "CHTE", 4);
+    mock_smc_add(&tahoe, "CHIE", 1);
+    mock_smc_add(&tahoe, "ACLC", 1);
+    run("tahoe", &tahoe);
+
+    mock_smc_t legacy = { 0 };
+    mock_smc_add(&legacy, "CH0B", 1);
+    mock_smc_add(&legacy, "CH0C", 1);
+    mock_smc_add(&legacy, "CH0I", 1);
+    mock_smc_add(&legacy, "BCLM", 1);
+    run("legacy", &legacy);
+
+    mock_smc_t unsupported = { 0 };
+    mock_smc_add(&unsupported, "ACLC", 1);
+    run("unsupported", &unsupported);
+
+    // FourCC codes of the key table
+    printf("CHTE=%08x CH0B=%08x BFCL=%08x\n",
+           smc_fourcc(smc_key_names[SMC_CHTE]),
+           smc_fourcc(smc_key_names[SMC_CH0B]),
+           smc_fourcc(smc_key_names[SMC_BFCL]));
+    return 0;
+}
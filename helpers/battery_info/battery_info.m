@@ -2,18 +2,16 @@
 #import <IOKit/IOKitLib.h>
 #import <IOKit/ps/IOPowerSources.h>
 #import <IOKit/ps/IOPSKeys.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
 
-static void set_string(NSMutableDictionary *dict, NSString *key, NSString *value) {
-  if (value && value.length > 0) dict[key] = value;
-}
-
-static void set_number(NSMutableDictionary *dict, NSString *key, NSNumber *value) {
-  if (value) dict[key] = value;
-}
-
-static void set_bool(NSMutableDictionary *dict, NSString *key, BOOL value, BOOL has_value) {
-  if (has_value) dict[key] = @(value);
-}
+#include "../impact.h"
+#include "../json.h"
+#include "../sketchybar.h"
+#include "../trace.h"
+#include "battery_log.h"
+#include "power.h"
 
 static NSNumber *number_from_cf(CFTypeRef value) {
   if (!value || CFGetTypeID(value) != CFNumberGetTypeID()) return nil;
@@ -22,42 +20,63 @@ static NSNumber *number_from_cf(CFTypeRef value) {
   return @(out);
 }
 
-static NSNumber *bool_from_cf(CFTypeRef value, BOOL *has_value) {
-  if (has_value) *has_value = NO;
-  if (!value || CFGetTypeID(value) != CFBooleanGetTypeID()) return nil;
-  if (has_value) *has_value = YES;
-  return @(((CFBooleanRef)value) == kCFBooleanTrue);
-}
-
 static NSString *string_from_cf(CFTypeRef value) {
   if (!value || CFGetTypeID(value) != CFStringGetTypeID()) return nil;
   return (__bridge NSString *)value;
 }
 
-static NSArray<NSNumber *> *number_array_from_cf(CFTypeRef value) {
-  if (!value || CFGetTypeID(value) != CFArrayGetTypeID()) return nil;
-  CFArrayRef arr = (CFArrayRef)value;
-  CFIndex count = CFArrayGetCount(arr);
-  if (count <= 0) return @[];
-  NSMutableArray<NSNumber *> *out = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
-  for (CFIndex i = 0; i < count; i++) {
-    CFTypeRef elem = CFArrayGetValueAtIndex(arr, i);
-    NSNumber *n = number_from_cf(elem);
-    if (n) [out addObject:n];
+// JSON fields are written straight from the CF values; missing or mistyped
+// values are skipped.
+static BOOL int_from_cf(CFTypeRef value, int64_t *out) {
+  if (!value || CFGetTypeID(value) != CFNumberGetTypeID()) return NO;
+  return CFNumberGetValue((CFNumberRef)value, kCFNumberSInt64Type, out);
+}
+
+static void write_cf_number(struct json_writer *json, const char *key, CFTypeRef value) {
+  int64_t number;
+  if (int_from_cf(value, &number)) json_field_int(json, key, number);
+}
+
+static void write_cf_bool(struct json_writer *json, const char *key, CFTypeRef value) {
+  if (!value || CFGetTypeID(value) != CFBooleanGetTypeID()) return;
+  json_field_bool(json, key, (CFBooleanRef)value == kCFBooleanTrue);
+}
+
+static void write_cf_string(struct json_writer *json, const char *key, CFTypeRef value) {
+  if (!value || CFGetTypeID(value) != CFStringGetTypeID()) return;
+  if (CFStringGetLength((CFStringRef)value) == 0) return;
+
+  char buffer[256];
+  const char *text = CFStringGetCStringPtr((CFStringRef)value, kCFStringEncodingUTF8);
+  if (!text && CFStringGetCString((CFStringRef)value, buffer, sizeof(buffer), kCFStringEncodingUTF8)) {
+    text = buffer;
   }
-  return out;
+  if (text) json_field_string(json, key, text);
+}
+
+static void write_rounded(struct json_writer *json, const char *key, double value) {
+  json_field_double(json, key, round(value * 10.0) / 10.0);
+}
+
+static int bool_state_from_cf(CFTypeRef value) {
+  if (!value || CFGetTypeID(value) != CFBooleanGetTypeID()) return -1;
+  return ((CFBooleanRef)value) == kCFBooleanTrue ? 1 : 0;
 }
 
-static void add_power_source_info(NSMutableDictionary *info) {
+// Summary of the internal battery as reported by IOPS
+static BOOL read_live_power_state(struct power_state *state) {
+  power_state_init(state);
+
   CFTypeRef blob = IOPSCopyPowerSourcesInfo();
-  if (!blob) return;
+  if (!blob) return NO;
 
   CFArrayRef list = IOPSCopyPowerSourcesList(blob);
   if (!list) {
     CFRelease(blob);
-    return;
+    return NO;
   }
 
+  BOOL found = NO;
   CFIndex count = CFArrayGetCount(list);
   for (CFIndex i = 0; i < count; i++) {
     CFTypeRef ps = CFArrayGetValueAtIndex(list, i);
@@ -72,6 +91,7 @@ static void add_power_source_info(NSMutableDictionary *info) {
     if (type && ![type isEqualToString:@"InternalBattery"]) {
       continue;
     }
+    found = YES;
 
     NSNumber *cur = number_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSCurrentCapacityKey)));
     NSNumber *max = number_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSMaxCapacityKey)));
@@ -79,38 +99,25 @@ static void add_power_source_info(NSMutableDictionary *info) {
       int64_t pct = (int64_t)llround((double)cur.longLongValue * 100.0 / (double)max.longLongValue);
       if (pct < 0) pct = 0;
       if (pct > 100) pct = 100;
-      set_number(info, @"percent", @(pct));
+      state->percent = (int)pct;
     }
 
-    BOOL has_b = NO;
-    NSNumber *is_charging = bool_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSIsChargingKey)), &has_b);
-    if (has_b) set_bool(info, @"is_charging", is_charging.boolValue, YES);
-
-    has_b = NO;
-    NSNumber *is_charged = bool_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSIsChargedKey)), &has_b);
-    if (has_b) set_bool(info, @"is_charged", is_charged.boolValue, YES);
+    state->is_charging = bool_state_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSIsChargingKey)));
+    state->is_charged = bool_state_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSIsChargedKey)));
 
     NSNumber *time_to_empty = number_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSTimeToEmptyKey)));
     if (time_to_empty && time_to_empty.longLongValue >= 0) {
-      set_number(info, @"time_to_empty_min", time_to_empty);
+      state->time_to_empty_min = (int)time_to_empty.longLongValue;
     }
 
     NSNumber *time_to_full = number_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSTimeToFullChargeKey)));
     if (time_to_full && time_to_full.longLongValue >= 0) {
-      set_number(info, @"time_to_full_min", time_to_full);
+      state->time_to_full_min = (int)time_to_full.longLongValue;
     }
 
-    NSString *state = string_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSPowerSourceStateKey)));
-    if (state) {
-      // kIOPSACPowerValue / kIOPSBatteryPowerValue may be C-strings; compare by value.
-      if ([state isEqualToString:@"AC Power"]) {
-        set_string(info, @"power_source", @"AC");
-      } else if ([state isEqualToString:@"Battery Power"]) {
-        set_string(info, @"power_source", @"Battery");
-      } else {
-        set_string(info, @"power_source", state);
-      }
-    }
+    NSString *source = string_from_cf(CFDictionaryGetValue(desc, CFSTR(kIOPSPowerSourceStateKey)));
+    // kIOPSACPowerValue / kIOPSBatteryPowerValue may be C-strings; compared by value.
+    if (source) power_state_set_source(state, source.UTF8String);
 
     // Only one internal battery expected; stop after first match.
     break;
@@ -118,192 +125,314 @@ static void add_power_source_info(NSMutableDictionary *info) {
 
   CFRelease(list);
   CFRelease(blob);
+  return found;
 }
 
-static void add_smart_battery_info(NSMutableDictionary *info) {
-  io_service_t service = IOServiceGetMatchingService(kIOMainPortDefault, IOServiceMatching("AppleSmartBattery"));
-  if (!service) return;
-
-  CFMutableDictionaryRef props = NULL;
-  kern_return_t kr = IORegistryEntryCreateCFProperties(service, &props, kCFAllocatorDefault, 0);
-  IOObjectRelease(service);
-  if (kr != KERN_SUCCESS || !props) return;
+// Power state as recorded in traces (trace.h)
+struct power_input {
+  int32_t found;
+  struct power_state state;
+};
+
+static BOOL read_power_state(struct power_state *state) {
+  struct power_input input = { 0 };
+  if (trace_replaying()) {
+    if (!trace_read(TRACE_BATTERY, &input, sizeof(input))) return NO;
+  } else {
+    input.found = read_live_power_state(&input.state);
+    trace_record(TRACE_BATTERY, &input, sizeof(input));
+  }
+  *state = input.state;
+  return input.found;
+}
 
-  NSNumber *cycle = number_from_cf(CFDictionaryGetValue(props, CFSTR("CycleCount")));
-  set_number(info, @"cycle_count", cycle);
+static int32_t smart_battery_int(io_service_t service, CFStringRef key, BOOL *ok) {
+  CFTypeRef value = IORegistryEntryCreateCFProperty(service, key, kCFAllocatorDefault, 0);
+  int64_t out = 0;
+  *ok = value && CFGetTypeID(value) == CFNumberGetTypeID()
+        && CFNumberGetValue((CFNumberRef)value, kCFNumberSInt64Type, &out);
+  if (value) CFRelease(value);
+  return (int32_t)out;
+}
 
-  NSNumber *design = number_from_cf(CFDictionaryGetValue(props, CFSTR("DesignCapacity")));
-  set_number(info, @"design_capacity", design);
+// One log sample for the current reading. The raw capacity gives a
+// fractional percent, so the fit has more than one point per percent step
+// to work with.
+static void read_live_sample(const struct power_state *state, struct battery_sample *sample) {
+  sample->time = (int64_t)time(NULL);
+  sample->percent = (float)state->percent;
+  if (state->is_charging == 1) {
+    sample->state = BATTERY_CHARGING;
+  } else if (strcmp(state->power_source, "AC") == 0) {
+    sample->state = BATTERY_IDLE;
+  } else {
+    sample->state = BATTERY_DISCHARGING;
+  }
 
-  NSNumber *design_cycles = number_from_cf(CFDictionaryGetValue(props, CFSTR("DesignCycleCount9C")));
-  set_number(info, @"design_cycle_count", design_cycles);
+  io_service_t service = IOServiceGetMatchingService(kIOMainPortDefault, IOServiceMatching("AppleSmartBattery"));
+  if (service) {
+    BOOL has_cur = NO, has_max = NO, ok = NO;
+    int32_t raw_cur = smart_battery_int(service, CFSTR("AppleRawCurrentCapacity"), &has_cur);
+    int32_t raw_max = smart_battery_int(service, CFSTR("AppleRawMaxCapacity"), &has_max);
+    if (has_cur && has_max && raw_max > 0) {
+      sample->percent = (float)((double)raw_cur * 100.0 / (double)raw_max);
+    }
+    sample->voltage_mv = smart_battery_int(service, CFSTR("Voltage"), &ok);
+    sample->amperage_ma = smart_battery_int(service, CFSTR("Amperage"), &ok);
+    IOObjectRelease(service);
+  }
+}
 
-  // Common state flags.
-  BOOL has_b = NO;
-  NSNumber *critical = bool_from_cf(CFDictionaryGetValue(props, CFSTR("AtCriticalLevel")), &has_b);
-  if (has_b) set_bool(info, @"critical", critical.boolValue, YES);
+// Appends the current reading to the sample log and fills the estimates.
+static void record_sample(struct battery_log *log, struct power_state *state) {
+  if (!log->header || state->percent < 0) return;
 
-  has_b = NO;
-  NSNumber *battery_installed = bool_from_cf(CFDictionaryGetValue(props, CFSTR("BatteryInstalled")), &has_b);
-  if (has_b) set_bool(info, @"battery_installed", battery_installed.boolValue, YES);
+  struct battery_sample sample = { 0 };
+  if (trace_replaying()) {
+    if (!trace_read(TRACE_BATTERY_SAMPLE, &sample, sizeof(sample))) return;
+  } else {
+    read_live_sample(state, &sample);
+    trace_record(TRACE_BATTERY_SAMPLE, &sample, sizeof(sample));
+  }
+  battery_log_append(log, &sample);
 
-  has_b = NO;
-  NSNumber *fully_charged = bool_from_cf(CFDictionaryGetValue(props, CFSTR("FullyCharged")), &has_b);
-  if (has_b) set_bool(info, @"fully_charged", fully_charged.boolValue, YES);
+  struct battery_estimate estimate;
+  battery_log_estimate(log, &estimate);
+  state->est_time_to_empty_min = estimate.time_to_empty_min;
+  state->est_time_to_full_min = estimate.time_to_full_min;
+}
 
-  has_b = NO;
-  NSNumber *external_connected = bool_from_cf(CFDictionaryGetValue(props, CFSTR("ExternalConnected")), &has_b);
-  if (has_b) set_bool(info, @"external_connected", external_connected.boolValue, YES);
+static void write_power_source_info(struct json_writer *json, struct battery_log *log) {
+  struct power_state state;
+  if (!read_power_state(&state)) return;
+  record_sample(log, &state);
+
+  if (state.percent >= 0) json_field_int(json, "percent", state.percent);
+  if (state.is_charging >= 0) json_field_bool(json, "is_charging", state.is_charging == 1);
+  if (state.is_charged >= 0) json_field_bool(json, "is_charged", state.is_charged == 1);
+  if (state.time_to_empty_min >= 0) json_field_int(json, "time_to_empty_min", state.time_to_empty_min);
+  if (state.time_to_full_min >= 0) json_field_int(json, "time_to_full_min", state.time_to_full_min);
+  if (state.est_time_to_empty_min >= 0) json_field_int(json, "est_time_to_empty_min", state.est_time_to_empty_min);
+  if (state.est_time_to_full_min >= 0) json_field_int(json, "est_time_to_full_min", state.est_time_to_full_min);
+  if (state.power_source[0]) json_field_string(json, "power_source", state.power_source);
+}
 
-  has_b = NO;
-  NSNumber *external_charge_capable = bool_from_cf(CFDictionaryGetValue(props, CFSTR("ExternalChargeCapable")), &has_b);
-  if (has_b) set_bool(info, @"external_charge_capable", external_charge_capable.boolValue, YES);
+// Watch mode: stay resident, wake only on IOPS power source notifications and
+// push a trigger when the summary the bar shows actually changes (power.h).
+struct watch_context {
+  struct power_watch watch;
+  struct power_source source;
+};
+
+// Source of the watch: the IOPS summary with the estimates of the log
+static bool read_watch_state(void *context, struct power_state *state) {
+  if (!read_power_state(state)) return false;
+  record_sample((struct battery_log *)context, state);
+  return true;
+}
 
-  NSNumber *max = number_from_cf(CFDictionaryGetValue(props, CFSTR("MaxCapacity")));
-  set_number(info, @"max_capacity", max);
+static void emit_if_changed(struct watch_context *ctx) {
+  @autoreleasepool {
+    char message[512];
+    if (power_watch_poll(&ctx->watch, &ctx->source, message, sizeof(message))) sketchybar(message);
+  }
+}
 
-  NSNumber *cur = number_from_cf(CFDictionaryGetValue(props, CFSTR("CurrentCapacity")));
-  set_number(info, @"current_capacity", cur);
+// Every notification is one iteration of a trace
+static void handle_power_event(struct watch_context *ctx) {
+  trace_tick();
+  emit_if_changed(ctx);
+}
 
-  NSNumber *raw_cur = number_from_cf(CFDictionaryGetValue(props, CFSTR("AppleRawCurrentCapacity")));
-  set_number(info, @"raw_current_capacity", raw_cur);
+static void power_source_changed(void *info) {
+  handle_power_event((struct watch_context *)info);
+}
 
-  NSNumber *raw_max = number_from_cf(CFDictionaryGetValue(props, CFSTR("AppleRawMaxCapacity")));
-  set_number(info, @"raw_max_capacity", raw_max);
+// IOPS only notifies on whole percent steps; the periodic sample keeps the
+// log dense enough for the estimate between them.
+#define SAMPLE_INTERVAL 60.0
 
-  NSNumber *nominal = number_from_cf(CFDictionaryGetValue(props, CFSTR("NominalChargeCapacity")));
-  set_number(info, @"nominal_capacity", nominal);
+static void sample_timer_fired(CFRunLoopTimerRef timer, void *info) {
+  (void)timer;
+  handle_power_event((struct watch_context *)info);
+}
 
-  NSNumber *voltage = number_from_cf(CFDictionaryGetValue(props, CFSTR("Voltage")));
-  set_number(info, @"voltage_mv", voltage);
+static int run_watch(const char *event, struct battery_log *log) {
+  static struct watch_context ctx;
+  ctx.watch.event = event;
+  ctx.source = (struct power_source){ .context = log, .read = read_watch_state };
+
+  // Replay runs the recorded events back to back instead of waiting for
+  // notifications
+  if (trace_replaying()) {
+    char event_message[256];
+    snprintf(event_message, sizeof(event_message), "--add event '%s'", event);
+    sketchybar(event_message);
+    while (trace_tick()) emit_if_changed(&ctx);
+    return 0;
+  }
 
-  NSNumber *amperage = number_from_cf(CFDictionaryGetValue(props, CFSTR("Amperage")));
-  set_number(info, @"amperage_ma", amperage);
+  CFRunLoopSourceRef source = IOPSNotificationCreateRunLoopSource(power_source_changed, &ctx);
+  if (!source) {
+    fprintf(stderr, "Failed to register for power source notifications\n");
+    return 1;
+  }
+  CFRunLoopAddSource(CFRunLoopGetCurrent(), source, kCFRunLoopDefaultMode);
+  CFRelease(source);
+
+  if (log->header) {
+    CFRunLoopTimerContext timer_context = { 0, &ctx, NULL, NULL, NULL };
+    CFRunLoopTimerRef timer = CFRunLoopTimerCreate(kCFAllocatorDefault,
+                                                   CFAbsoluteTimeGetCurrent() + SAMPLE_INTERVAL,
+                                                   SAMPLE_INTERVAL,
+                                                   0,
+                                                   0,
+                                                   sample_timer_fired,
+                                                   &timer_context);
+    CFRunLoopTimerSetTolerance(timer, SAMPLE_INTERVAL / 10.0);
+    CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
+    CFRelease(timer);
+  }
 
-  NSNumber *instant_amperage = number_from_cf(CFDictionaryGetValue(props, CFSTR("InstantAmperage")));
-  set_number(info, @"instant_amperage_ma", instant_amperage);
+  alarm(0);
+  char event_message[256];
+  snprintf(event_message, sizeof(event_message), "--add event '%s'", event);
+  sketchybar(event_message);
 
-  NSNumber *failure = number_from_cf(CFDictionaryGetValue(props, CFSTR("PermanentFailureStatus")));
-  set_number(info, @"permanent_failure_status", failure);
+  handle_power_event(&ctx);
+  CFRunLoopRun();
+  return 0;
+}
 
-  has_b = NO;
-  NSNumber *is_charging = bool_from_cf(CFDictionaryGetValue(props, CFSTR("IsCharging")), &has_b);
-  if (has_b) set_bool(info, @"is_charging_smart", is_charging.boolValue, YES);
+static void write_smart_battery_info(struct json_writer *json) {
+  io_service_t service = IOServiceGetMatchingService(kIOMainPortDefault, IOServiceMatching("AppleSmartBattery"));
+  if (!service) return;
 
-  NSString *serial = string_from_cf(CFDictionaryGetValue(props, CFSTR("Serial")));
-  set_string(info, @"serial", serial);
+  CFMutableDictionaryRef props = NULL;
+  kern_return_t kr = IORegistryEntryCreateCFProperties(service, &props, kCFAllocatorDefault, 0);
+  IOObjectRelease(service);
+  if (kr != KERN_SUCCESS || !props) return;
 
-  NSString *device = string_from_cf(CFDictionaryGetValue(props, CFSTR("DeviceName")));
-  set_string(info, @"device_name", device);
+  write_cf_number(json, "cycle_count", CFDictionaryGetValue(props, CFSTR("CycleCount")));
+  write_cf_number(json, "design_capacity", CFDictionaryGetValue(props, CFSTR("DesignCapacity")));
+  write_cf_number(json, "design_cycle_count", CFDictionaryGetValue(props, CFSTR("DesignCycleCount9C")));
 
-  NSNumber *fw = number_from_cf(CFDictionaryGetValue(props, CFSTR("GasGaugeFirmwareVersion")));
-  set_number(info, @"gas_gauge_fw", fw);
+  // Common state flags.
+  write_cf_bool(json, "critical", CFDictionaryGetValue(props, CFSTR("AtCriticalLevel")));
+  write_cf_bool(json, "battery_installed", CFDictionaryGetValue(props, CFSTR("BatteryInstalled")));
+  write_cf_bool(json, "fully_charged", CFDictionaryGetValue(props, CFSTR("FullyCharged")));
+  write_cf_bool(json, "external_connected", CFDictionaryGetValue(props, CFSTR("ExternalConnected")));
+  write_cf_bool(json, "external_charge_capable", CFDictionaryGetValue(props, CFSTR("ExternalChargeCapable")));
+
+  write_cf_number(json, "max_capacity", CFDictionaryGetValue(props, CFSTR("MaxCapacity")));
+  write_cf_number(json, "current_capacity", CFDictionaryGetValue(props, CFSTR("CurrentCapacity")));
+  write_cf_number(json, "raw_current_capacity", CFDictionaryGetValue(props, CFSTR("AppleRawCurrentCapacity")));
+  write_cf_number(json, "raw_max_capacity", CFDictionaryGetValue(props, CFSTR("AppleRawMaxCapacity")));
+  write_cf_number(json, "nominal_capacity", CFDictionaryGetValue(props, CFSTR("NominalChargeCapacity")));
+  write_cf_number(json, "voltage_mv", CFDictionaryGetValue(props, CFSTR("Voltage")));
+  write_cf_number(json, "amperage_ma", CFDictionaryGetValue(props, CFSTR("Amperage")));
+  write_cf_number(json, "instant_amperage_ma", CFDictionaryGetValue(props, CFSTR("InstantAmperage")));
+  write_cf_number(json, "permanent_failure_status", CFDictionaryGetValue(props, CFSTR("PermanentFailureStatus")));
+  write_cf_bool(json, "is_charging_smart", CFDictionaryGetValue(props, CFSTR("IsCharging")));
+  write_cf_string(json, "serial", CFDictionaryGetValue(props, CFSTR("Serial")));
+  write_cf_string(json, "device_name", CFDictionaryGetValue(props, CFSTR("DeviceName")));
+  write_cf_number(json, "gas_gauge_fw", CFDictionaryGetValue(props, CFSTR("GasGaugeFirmwareVersion")));
 
   // Raw time fields (often 65535 when unknown).
-  NSNumber *time_remaining = number_from_cf(CFDictionaryGetValue(props, CFSTR("TimeRemaining")));
-  set_number(info, @"time_remaining_raw", time_remaining);
-  NSNumber *avg_empty = number_from_cf(CFDictionaryGetValue(props, CFSTR("AvgTimeToEmpty")));
-  set_number(info, @"avg_time_to_empty_raw", avg_empty);
-  NSNumber *avg_full = number_from_cf(CFDictionaryGetValue(props, CFSTR("AvgTimeToFull")));
-  set_number(info, @"avg_time_to_full_raw", avg_full);
+  write_cf_number(json, "time_remaining_raw", CFDictionaryGetValue(props, CFSTR("TimeRemaining")));
+  write_cf_number(json, "avg_time_to_empty_raw", CFDictionaryGetValue(props, CFSTR("AvgTimeToEmpty")));
+  write_cf_number(json, "avg_time_to_full_raw", CFDictionaryGetValue(props, CFSTR("AvgTimeToFull")));
 
-  NSNumber *pack_reserve = number_from_cf(CFDictionaryGetValue(props, CFSTR("PackReserve")));
-  set_number(info, @"pack_reserve", pack_reserve);
+  write_cf_number(json, "pack_reserve", CFDictionaryGetValue(props, CFSTR("PackReserve")));
 
   CFTypeRef adapter_val = CFDictionaryGetValue(props, CFSTR("AdapterDetails"));
   if (adapter_val && CFGetTypeID(adapter_val) == CFDictionaryGetTypeID()) {
     CFDictionaryRef adapter = (CFDictionaryRef)adapter_val;
-    NSNumber *watts = number_from_cf(CFDictionaryGetValue(adapter, CFSTR("Watts")));
-    set_number(info, @"adapter_watts", watts);
-    NSNumber *adapter_voltage = number_from_cf(CFDictionaryGetValue(adapter, CFSTR("AdapterVoltage")));
-    set_number(info, @"adapter_voltage_mv", adapter_voltage);
-    NSNumber *adapter_current = number_from_cf(CFDictionaryGetValue(adapter, CFSTR("Current")));
-    set_number(info, @"adapter_current_ma", adapter_current);
-    NSString *desc = string_from_cf(CFDictionaryGetValue(adapter, CFSTR("Description")));
-    set_string(info, @"adapter_desc", desc);
+    write_cf_number(json, "adapter_watts", CFDictionaryGetValue(adapter, CFSTR("Watts")));
+    write_cf_number(json, "adapter_voltage_mv", CFDictionaryGetValue(adapter, CFSTR("AdapterVoltage")));
+    write_cf_number(json, "adapter_current_ma", CFDictionaryGetValue(adapter, CFSTR("Current")));
+    write_cf_string(json, "adapter_desc", CFDictionaryGetValue(adapter, CFSTR("Description")));
   }
 
   CFTypeRef charger_val = CFDictionaryGetValue(props, CFSTR("ChargerData"));
   if (charger_val && CFGetTypeID(charger_val) == CFDictionaryGetTypeID()) {
     CFDictionaryRef charger = (CFDictionaryRef)charger_val;
-    set_number(info, @"charger_voltage_mv", number_from_cf(CFDictionaryGetValue(charger, CFSTR("ChargingVoltage"))));
-    set_number(info, @"charger_current_ma", number_from_cf(CFDictionaryGetValue(charger, CFSTR("ChargingCurrent"))));
-    set_number(info, @"charger_id", number_from_cf(CFDictionaryGetValue(charger, CFSTR("ChargerID"))));
-    set_number(info, @"charger_not_charging_reason", number_from_cf(CFDictionaryGetValue(charger, CFSTR("NotChargingReason"))));
-    set_number(info, @"charger_slow_charging_reason", number_from_cf(CFDictionaryGetValue(charger, CFSTR("SlowChargingReason"))));
-    set_number(info, @"charger_inhibit_reason", number_from_cf(CFDictionaryGetValue(charger, CFSTR("ChargerInhibitReason"))));
+    write_cf_number(json, "charger_voltage_mv", CFDictionaryGetValue(charger, CFSTR("ChargingVoltage")));
+    write_cf_number(json, "charger_current_ma", CFDictionaryGetValue(charger, CFSTR("ChargingCurrent")));
+    write_cf_number(json, "charger_id", CFDictionaryGetValue(charger, CFSTR("ChargerID")));
+    write_cf_number(json, "charger_not_charging_reason", CFDictionaryGetValue(charger, CFSTR("NotChargingReason")));
+    write_cf_number(json, "charger_slow_charging_reason", CFDictionaryGetValue(charger, CFSTR("SlowChargingReason")));
+    write_cf_number(json, "charger_inhibit_reason", CFDictionaryGetValue(charger, CFSTR("ChargerInhibitReason")));
   }
 
   CFTypeRef batt_val = CFDictionaryGetValue(props, CFSTR("BatteryData"));
   if (batt_val && CFGetTypeID(batt_val) == CFDictionaryGetTypeID()) {
     CFDictionaryRef batt = (CFDictionaryRef)batt_val;
-    NSArray<NSNumber *> *cells = number_array_from_cf(CFDictionaryGetValue(batt, CFSTR("CellVoltage")));
-    if (cells && cells.count > 0) {
-      info[@"cell_voltage_mv"] = cells;
+    CFTypeRef cells = CFDictionaryGetValue(batt, CFSTR("CellVoltage"));
+    if (cells && CFGetTypeID(cells) == CFArrayGetTypeID()) {
+      // Collected first: the writer streams, and a battery without readable
+      // cells gets no cell fields rather than an empty array
+      int64_t volts[16];
+      int count = 0;
       int64_t min_v = INT64_MAX;
       int64_t max_v = INT64_MIN;
-      for (NSNumber *n in cells) {
-        int64_t v = n.longLongValue;
+      for (CFIndex i = 0; i < CFArrayGetCount((CFArrayRef)cells) && count < 16; i++) {
+        int64_t v;
+        if (!int_from_cf(CFArrayGetValueAtIndex((CFArrayRef)cells, i), &v)) continue;
+        volts[count++] = v;
         if (v < min_v) min_v = v;
         if (v > max_v) max_v = v;
       }
-      if (min_v != INT64_MAX && max_v != INT64_MIN) {
-        set_number(info, @"cell_voltage_min_mv", @(min_v));
-        set_number(info, @"cell_voltage_max_mv", @(max_v));
-        set_number(info, @"cell_voltage_delta_mv", @(max_v - min_v));
+      if (count > 0) {
+        json_key(json, "cell_voltage_mv");
+        json_array_begin(json);
+        for (int i = 0; i < count; i++) json_int(json, volts[i]);
+        json_array_end(json);
+        json_field_int(json, "cell_voltage_min_mv", min_v);
+        json_field_int(json, "cell_voltage_max_mv", max_v);
+        json_field_int(json, "cell_voltage_delta_mv", max_v - min_v);
       }
     }
 
-    NSNumber *soc = number_from_cf(CFDictionaryGetValue(batt, CFSTR("StateOfCharge")));
-    set_number(info, @"soc_percent", soc);
-    set_number(info, @"daily_min_soc", number_from_cf(CFDictionaryGetValue(batt, CFSTR("DailyMinSoc"))));
-    set_number(info, @"daily_max_soc", number_from_cf(CFDictionaryGetValue(batt, CFSTR("DailyMaxSoc"))));
+    write_cf_number(json, "soc_percent", CFDictionaryGetValue(batt, CFSTR("StateOfCharge")));
+    write_cf_number(json, "daily_min_soc", CFDictionaryGetValue(batt, CFSTR("DailyMinSoc")));
+    write_cf_number(json, "daily_max_soc", CFDictionaryGetValue(batt, CFSTR("DailyMaxSoc")));
   }
 
   CFTypeRef telemetry_val = CFDictionaryGetValue(props, CFSTR("PowerTelemetryData"));
   if (telemetry_val && CFGetTypeID(telemetry_val) == CFDictionaryGetTypeID()) {
     CFDictionaryRef tele = (CFDictionaryRef)telemetry_val;
-    NSNumber *sys_v = number_from_cf(CFDictionaryGetValue(tele, CFSTR("SystemVoltageIn")));
-    NSNumber *sys_i = number_from_cf(CFDictionaryGetValue(tele, CFSTR("SystemCurrentIn")));
-    NSNumber *sys_p = number_from_cf(CFDictionaryGetValue(tele, CFSTR("SystemPowerIn")));
-    set_number(info, @"telemetry_system_voltage_in_mv", sys_v);
-    set_number(info, @"telemetry_system_current_in_ma", sys_i);
-    if (sys_p) {
-      double w = (double)sys_p.longLongValue / 1000.0;
-      double rounded = round(w * 10.0) / 10.0;
-      set_number(info, @"telemetry_system_power_in_w", @(rounded));
+    write_cf_number(json, "telemetry_system_voltage_in_mv", CFDictionaryGetValue(tele, CFSTR("SystemVoltageIn")));
+    write_cf_number(json, "telemetry_system_current_in_ma", CFDictionaryGetValue(tele, CFSTR("SystemCurrentIn")));
+    int64_t sys_p;
+    if (int_from_cf(CFDictionaryGetValue(tele, CFSTR("SystemPowerIn")), &sys_p)) {
+      write_rounded(json, "telemetry_system_power_in_w", (double)sys_p / 1000.0);
     }
-    set_number(info, @"telemetry_system_load", number_from_cf(CFDictionaryGetValue(tele, CFSTR("SystemLoad"))));
-    set_number(info, @"telemetry_battery_power", number_from_cf(CFDictionaryGetValue(tele, CFSTR("BatteryPower"))));
+    write_cf_number(json, "telemetry_system_load", CFDictionaryGetValue(tele, CFSTR("SystemLoad")));
+    write_cf_number(json, "telemetry_battery_power", CFDictionaryGetValue(tele, CFSTR("BatteryPower")));
   }
 
-  NSString *health = string_from_cf(CFDictionaryGetValue(props, CFSTR("BatteryHealth")));
-  set_string(info, @"health", health);
+  write_cf_string(json, "health", CFDictionaryGetValue(props, CFSTR("BatteryHealth")));
 
-  NSNumber *temp_raw = number_from_cf(CFDictionaryGetValue(props, CFSTR("Temperature")));
-  if (temp_raw) {
-    set_number(info, @"temperature_raw", temp_raw);
+  int64_t temp_raw;
+  if (int_from_cf(CFDictionaryGetValue(props, CFSTR("Temperature")), &temp_raw)) {
+    json_field_int(json, "temperature_raw", temp_raw);
     // Best-effort conversion: many Macs expose Temperature as 0.1 Kelvin.
-    double raw = (double)temp_raw.longLongValue;
-    if (raw > 1000.0) {
-      double c = (raw / 10.0) - 273.15;
-      double rounded = round(c * 10.0) / 10.0;
-      set_number(info, @"temperature_c", @(rounded));
-    }
+    double raw = (double)temp_raw;
+    if (raw > 1000.0) write_rounded(json, "temperature_c", (raw / 10.0) - 273.15);
   }
 
-  if (voltage && amperage) {
-    double v = (double)voltage.longLongValue / 1000.0;
-    double a = (double)amperage.longLongValue / 1000.0;
-    double w = v * a;
-    double rounded = round(w * 10.0) / 10.0;
-    set_number(info, @"power_w", @(rounded));
+  int64_t voltage, amperage;
+  if (int_from_cf(CFDictionaryGetValue(props, CFSTR("Voltage")), &voltage)
+      && int_from_cf(CFDictionaryGetValue(props, CFSTR("Amperage")), &amperage)) {
+    write_rounded(json, "power_w", ((double)voltage / 1000.0) * ((double)amperage / 1000.0));
   }
 
-  if (raw_max && design && design.longLongValue > 0) {
-    double pct = ((double)raw_max.longLongValue / (double)design.longLongValue) * 100.0;
-    double rounded = round(pct * 10.0) / 10.0;
-    set_number(info, @"health_percent", @(rounded));
+  int64_t raw_max, design;
+  if (int_from_cf(CFDictionaryGetValue(props, CFSTR("AppleRawMaxCapacity")), &raw_max)
+      && int_from_cf(CFDictionaryGetValue(props, CFSTR("DesignCapacity")), &design)
+      && design > 0) {
+    write_rounded(json, "health_percent", ((double)raw_max / (double)design) * 100.0);
   }
 
   CFRelease(props);
@@ -311,22 +440,44 @@ static void add_smart_battery_info(NSMutableDictionary *info) {
 
 int main(int argc, char **argv) {
   @autoreleasepool {
-    (void)argc;
-    (void)argv;
+    impact_apply();
+    const char *watch_event = NULL;
+    char log_path[1024] = "";
+    for (int i = 1; i + 1 < argc; i += 2) {
+      if (strcmp(argv[i], "--watch") == 0) {
+        watch_event = argv[i + 1];
+      } else if (strcmp(argv[i], "--log") == 0) {
+        strlcpy(log_path, argv[i + 1], sizeof(log_path));
+      } else {
+        fprintf(stderr, "Usage: battery_info [--watch <event>] [--log <path>]\n");
+        return 1;
+      }
+    }
+    if (!log_path[0]) battery_log_default_path(log_path, sizeof(log_path));
+
+    // A replayed trace (trace.h) appends to the log too: point --log at a
+    // scratch file for reproducible estimates
+    if (watch_event && !trace_init()) return 1;
 
-    NSMutableDictionary *info = [NSMutableDictionary dictionary];
-    add_power_source_info(info);
-    add_smart_battery_info(info);
+    // Estimates are best effort; the helper still works without its log
+    struct battery_log log;
+    battery_log_open(&log, log_path);
 
-    NSError *error = nil;
-    NSData *json = [NSJSONSerialization dataWithJSONObject:info options:0 error:&error];
-    if (!json) {
-      fprintf(stderr, "Failed to encode JSON: %s\n", error.localizedDescription.UTF8String);
+    if (watch_event) return run_watch(watch_event, &log);
+
+    char buffer[4096];
+    struct json_writer json;
+    json_init(&json, buffer, sizeof(buffer), stdout);
+    json_object_begin(&json);
+    write_power_source_info(&json, &log);
+    write_smart_battery_info(&json);
+    json_object_end(&json);
+    battery_log_close(&log);
+
+    if (!json_finish(&json, false)) {
+      fprintf(stderr, "Failed to write JSON\n");
       return 1;
     }
-    fwrite(json.bytes, 1, json.length, stdout);
   }
   return 0;
 }
-
-
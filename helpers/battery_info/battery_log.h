@@ -0,0 +1,213 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Fixed-record ring log of battery samples, memory mapped so it survives
+// helper restarts and appending is a single store into the mapping. The
+// discharge/charge rate is estimated from the newest run of samples.
+
+#define BATTERY_LOG_MAGIC 0x474c4253 // "SBLG"
+#define BATTERY_LOG_VERSION 1
+#define BATTERY_LOG_CAPACITY 2048
+
+// Samples closer together than this are only recorded on a state change
+#define BATTERY_LOG_MIN_INTERVAL 30
+
+// Regression window, and the gap (sleep, helper down) that ends a run
+#define BATTERY_ESTIMATE_WINDOW 1200
+#define BATTERY_ESTIMATE_MAX_GAP 600
+#define BATTERY_ESTIMATE_MIN_SPAN 180
+#define BATTERY_ESTIMATE_MIN_SAMPLES 3
+#define BATTERY_ESTIMATE_MAX_MIN (24 * 60)
+
+enum battery_charge_state {
+  BATTERY_DISCHARGING,
+  BATTERY_CHARGING,
+  BATTERY_IDLE,
+};
+
+struct battery_sample {
+  int64_t time;
+  float percent;
+  int32_t voltage_mv;
+  int32_t amperage_ma;
+  uint32_t state;
+};
+
+struct battery_log_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t record_size;
+  // Records ever appended, the next slot is head % capacity
+  uint64_t head;
+};
+
+struct battery_log {
+  int fd;
+  size_t size;
+  struct battery_log_header* header;
+  struct battery_sample* samples;
+};
+
+struct battery_estimate {
+  double rate_per_min;
+  int time_to_empty_min;
+  int time_to_full_min;
+};
+
+static inline void battery_log_default_path(char* buffer, size_t size) {
+  const char* home = getenv("HOME");
+  int len = snprintf(buffer, size, "%s/Library/Caches/sketchybar", home ? home : "/tmp");
+  mkdir(buffer, 0755);
+  if (len >= 0 && (size_t)len < size) snprintf(buffer + len, size - len, "/battery.log");
+}
+
+static inline bool battery_log_open(struct battery_log* log, const char* path) {
+  memset(log, 0, sizeof(struct battery_log));
+  log->fd = -1;
+  log->size = sizeof(struct battery_log_header)
+              + BATTERY_LOG_CAPACITY * sizeof(struct battery_sample);
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0
+      || ((size_t)st.st_size != log->size && ftruncate(fd, log->size) != 0)) {
+    close(fd);
+    return false;
+  }
+
+  void* map = mmap(NULL, log->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  log->fd = fd;
+  log->header = map;
+  log->samples = (struct battery_sample*)(log->header + 1);
+
+  // A new file, or one written with a different layout, starts over
+  struct battery_log_header* header = log->header;
+  if (header->magic != BATTERY_LOG_MAGIC
+      || header->version != BATTERY_LOG_VERSION
+      || header->capacity != BATTERY_LOG_CAPACITY
+      || header->record_size != sizeof(struct battery_sample)) {
+    flock(fd, LOCK_EX);
+    header->head = 0;
+    header->capacity = BATTERY_LOG_CAPACITY;
+    header->record_size = sizeof(struct battery_sample);
+    header->version = BATTERY_LOG_VERSION;
+    header->magic = BATTERY_LOG_MAGIC;
+    flock(fd, LOCK_UN);
+  }
+  return true;
+}
+
+static inline void battery_log_close(struct battery_log* log) {
+  if (log->header) munmap(log->header, log->size);
+  if (log->fd >= 0) close(log->fd);
+  log->header = NULL;
+  log->samples = NULL;
+  log->fd = -1;
+}
+
+static inline const struct battery_sample* battery_log_at(struct battery_log* log,
+                                                          uint64_t age) {
+  uint64_t head = log->header->head;
+  if (age >= head || age >= BATTERY_LOG_CAPACITY) return NULL;
+  return &log->samples[(head - 1 - age) % BATTERY_LOG_CAPACITY];
+}
+
+// Appends in O(1) without allocating. Samples arriving faster than
+// BATTERY_LOG_MIN_INTERVAL in the same charge state are dropped.
+static inline bool battery_log_append(struct battery_log* log,
+                                      const struct battery_sample* sample) {
+  if (!log->header) return false;
+
+  flock(log->fd, LOCK_EX);
+  const struct battery_sample* last = battery_log_at(log, 0);
+  bool append = !last
+                || last->state != sample->state
+                || sample->time - last->time >= BATTERY_LOG_MIN_INTERVAL
+                || sample->time < last->time;
+  if (append) {
+    log->samples[log->header->head % BATTERY_LOG_CAPACITY] = *sample;
+    log->header->head++;
+  }
+  flock(log->fd, LOCK_UN);
+  return append;
+}
+
+// Least squares fit of percent over time across the newest run of samples
+// in the current charge state. The run ends at a state change, a gap longer
+// than BATTERY_ESTIMATE_MAX_GAP or the start of the window, so estimates
+// restart cleanly after plugging in, unplugging or waking from sleep.
+static inline bool battery_log_estimate(struct battery_log* log,
+                                        struct battery_estimate* estimate) {
+  estimate->rate_per_min = 0;
+  estimate->time_to_empty_min = -1;
+  estimate->time_to_full_min = -1;
+  if (!log->header) return false;
+
+  const struct battery_sample* newest = battery_log_at(log, 0);
+  if (!newest || newest->state == BATTERY_IDLE) return false;
+
+  double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+  double span = 0;
+  uint32_t n = 0;
+  const struct battery_sample* newer = newest;
+  for (uint64_t age = 0;; age++) {
+    const struct battery_sample* sample = battery_log_at(log, age);
+    if (!sample
+        || sample->state != newest->state
+        || sample->time > newer->time
+        || newer->time - sample->time > BATTERY_ESTIMATE_MAX_GAP
+        || newest->time - sample->time > BATTERY_ESTIMATE_WINDOW) {
+      break;
+    }
+
+    double x = (double)(sample->time - newest->time) / 60.0;
+    double y = sample->percent;
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+    span = (double)(newest->time - sample->time);
+    n++;
+    newer = sample;
+  }
+
+  if (n < BATTERY_ESTIMATE_MIN_SAMPLES || span < BATTERY_ESTIMATE_MIN_SPAN) {
+    return false;
+  }
+
+  double denominator = n * sum_xx - sum_x * sum_x;
+  if (denominator <= 0) return false;
+  double slope = (n * sum_xy - sum_x * sum_y) / denominator;
+  double percent = (sum_y - slope * sum_x) / n;
+  estimate->rate_per_min = slope;
+
+  double minutes = -1;
+  if (newest->state == BATTERY_DISCHARGING && slope < 0) {
+    minutes = percent / -slope;
+    if (minutes >= 0 && minutes <= BATTERY_ESTIMATE_MAX_MIN) {
+      estimate->time_to_empty_min = (int)(minutes + 0.5);
+    }
+  } else if (newest->state == BATTERY_CHARGING && slope > 0) {
+    minutes = (100.0 - percent) / slope;
+    if (minutes >= 0 && minutes <= BATTERY_ESTIMATE_MAX_MIN) {
+      estimate->time_to_full_min = (int)(minutes + 0.5);
+    }
+  }
+  return minutes >= 0;
+}
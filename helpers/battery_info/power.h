@@ -0,0 +1,82 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Watch mode only pushes a trigger when the summary the bar shows changes.
+// The summary comes from a source: IOPS plus the sample log in
+// battery_info.m, a scripted one in the tests.
+
+// Summary of the internal battery. Unknown values are -1.
+struct power_state {
+  int percent;
+  int is_charging;
+  int is_charged;
+  int time_to_empty_min;
+  int time_to_full_min;
+  // Regression over the sample log, smoother than the IOPS estimates
+  int est_time_to_empty_min;
+  int est_time_to_full_min;
+  char power_source[32];
+};
+
+static inline void power_state_init(struct power_state* state) {
+  memset(state, 0, sizeof(struct power_state));
+  state->percent = -1;
+  state->is_charging = -1;
+  state->is_charged = -1;
+  state->time_to_empty_min = -1;
+  state->time_to_full_min = -1;
+  state->est_time_to_empty_min = -1;
+  state->est_time_to_full_min = -1;
+}
+
+// IOPS power source states ("AC Power", "Battery Power") as shown in the bar
+static inline void power_state_set_source(struct power_state* state, const char* source) {
+  if (strcmp(source, "AC Power") == 0) source = "AC";
+  else if (strcmp(source, "Battery Power") == 0) source = "Battery";
+  snprintf(state->power_source, sizeof(state->power_source), "%s", source);
+}
+
+struct power_source {
+  void* context;
+  // Current summary, false if there is no internal battery
+  bool (*read)(void* context, struct power_state* state);
+};
+
+struct power_watch {
+  const char* event;
+  struct power_state last;
+  bool has_last;
+};
+
+// Reads the source and builds the trigger for event into message if the
+// summary differs from the last one pushed. A failed read keeps the last
+// summary, so the next successful one is compared against what the bar
+// shows.
+static inline bool power_watch_poll(struct power_watch* watch,
+                                    const struct power_source* source,
+                                    char* message,
+                                    size_t size                       ) {
+  struct power_state state;
+  power_state_init(&state);
+  if (!source->read(source->context, &state)) return false;
+  if (watch->has_last && memcmp(&state, &watch->last, sizeof(state)) == 0) return false;
+  watch->last = state;
+  watch->has_last = true;
+
+  snprintf(message,
+           size,
+           "--trigger '%s' percent='%d' is_charging='%d' is_charged='%d' "
+           "time_to_empty_min='%d' time_to_full_min='%d' "
+           "est_time_to_empty_min='%d' est_time_to_full_min='%d' power_source='%s'",
+           watch->event,
+           state.percent,
+           state.is_charging,
+           state.is_charged,
+           state.time_to_empty_min,
+           state.time_to_full_min,
+           state.est_time_to_empty_min,
+           state.est_time_to_full_min,
+           state.power_source);
+  return true;
+}
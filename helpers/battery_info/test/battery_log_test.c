@@ -0,0 +1,170 @@
+#include <stdio.h>
+
+#include "../battery_log.h"
+
+// The sample log (battery_log.h) on a scratch file: what gets appended, how
+// runs end for the estimate, and what survives reopening the file. `make
+// test` diffs the output against battery_log.expected.
+
+static char g_path[] = "/tmp/battery_log_test.XXXXXX";
+
+static const char* g_states[] = { "discharging", "charging", "idle" };
+
+static void append(struct battery_log* log, int64_t time, float percent, uint32_t state) {
+  struct battery_sample sample = { .time = time, .percent = percent, .state = state };
+  bool appended = battery_log_append(log, &sample);
+  printf("  t=%lld %.2f%% %s: %s\n",
+         (long long)time,
+         percent,
+         g_states[state],
+         appended ? "appended" : "dropped");
+}
+
+// Samples every interval seconds changing by rate percent per minute
+static void run(struct battery_log* log,
+                int64_t start,
+                int count,
+                int interval,
+                float percent,
+                float rate,
+                uint32_t state) {
+  for (int i = 0; i < count; i++) {
+    append(log, start + (int64_t)i * interval, percent + rate * i * interval / 60.0f, state);
+  }
+}
+
+static void estimate(struct battery_log* log) {
+  struct battery_estimate estimate;
+  if (!battery_log_estimate(log, &estimate)) {
+    printf("  estimate: none\n");
+    return;
+  }
+  printf("  estimate: %+.3f%%/min, empty %d min, full %d min\n",
+         estimate.rate_per_min,
+         estimate.time_to_empty_min,
+         estimate.time_to_full_min);
+}
+
+// Starts every case on an empty file
+static void fresh(struct battery_log* log, const char* what) {
+  battery_log_close(log);
+  if (truncate(g_path, 0) != 0) perror("truncate");
+  printf("%s\n", what);
+  if (!battery_log_open(log, g_path)) printf("  open failed\n");
+}
+
+int main(void) {
+  int fd = mkstemp(g_path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+
+  struct battery_log log = { .fd = -1 };
+  fresh(&log, "empty log");
+  estimate(&log);
+
+  fresh(&log, "steady discharge");
+  run(&log, 1000, 6, 60, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  fresh(&log, "samples closer than the minimum interval");
+  append(&log, 1000, 80.0f, BATTERY_DISCHARGING);
+  append(&log, 1010, 79.9f, BATTERY_DISCHARGING);
+  append(&log, 1030, 79.9f, BATTERY_DISCHARGING);
+  append(&log, 1040, 79.8f, BATTERY_CHARGING);
+
+  fresh(&log, "too few samples");
+  run(&log, 1000, 2, 200, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  fresh(&log, "too short a span");
+  run(&log, 1000, 4, 50, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  estimate(&log);
+  append(&log, 1200, 79.4f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  fresh(&log, "state change ends the run");
+  run(&log, 1000, 6, 60, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  run(&log, 1360, 2, 60, 79.0f, 0.5f, BATTERY_CHARGING);
+  estimate(&log);
+  run(&log, 1480, 3, 60, 80.0f, 0.5f, BATTERY_CHARGING);
+  estimate(&log);
+  append(&log, 1700, 81.8f, BATTERY_IDLE);
+  estimate(&log);
+
+  fresh(&log, "gap longer than BATTERY_ESTIMATE_MAX_GAP");
+  run(&log, 1000, 6, 60, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  run(&log, 1300 + BATTERY_ESTIMATE_MAX_GAP + 1, 3, 60, 70.0f, -0.5f, BATTERY_DISCHARGING);
+  estimate(&log);
+  append(&log, 2081, 68.5f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  fresh(&log, "gap of exactly BATTERY_ESTIMATE_MAX_GAP");
+  run(&log, 1000, 2, 60, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  run(&log, 1060 + BATTERY_ESTIMATE_MAX_GAP, 2, 60, 77.8f, -0.2f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  fresh(&log, "clock moving backwards");
+  run(&log, 5000, 6, 60, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  append(&log, 4000, 78.9f, BATTERY_DISCHARGING);
+  estimate(&log);
+  run(&log, 4060, 3, 60, 78.7f, -0.2f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  fresh(&log, "only the newest BATTERY_ESTIMATE_WINDOW seconds");
+  run(&log, 1000, 10, 60, 90.0f, -1.0f, BATTERY_DISCHARGING);
+  run(&log, 1600, 21, 60, 80.0f, -0.1f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  fresh(&log, "estimate beyond BATTERY_ESTIMATE_MAX_MIN");
+  run(&log, 1000, 6, 60, 50.0f, -0.01f, BATTERY_DISCHARGING);
+  estimate(&log);
+
+  // Quiet: only the state of the ring afterwards is printed
+  printf("wraparound past BATTERY_LOG_CAPACITY\n");
+  battery_log_close(&log);
+  if (truncate(g_path, 0) != 0) perror("truncate");
+  battery_log_open(&log, g_path);
+  int total = BATTERY_LOG_CAPACITY + 100;
+  for (int i = 0; i < total; i++) {
+    struct battery_sample sample = {
+      .time = 1000 + (int64_t)i * 60,
+      .percent = 100.0f - 0.03f * i,
+      .state = BATTERY_DISCHARGING,
+    };
+    battery_log_append(&log, &sample);
+  }
+  const struct battery_sample* oldest = battery_log_at(&log, BATTERY_LOG_CAPACITY - 1);
+  printf("  head %llu, newest t=%lld, oldest kept t=%lld, beyond capacity: %s\n",
+         (unsigned long long)log.header->head,
+         (long long)battery_log_at(&log, 0)->time,
+         oldest ? (long long)oldest->time : -1LL,
+         battery_log_at(&log, BATTERY_LOG_CAPACITY) ? "sample" : "none");
+  estimate(&log);
+
+  printf("reopening keeps the samples\n");
+  battery_log_close(&log);
+  battery_log_open(&log, g_path);
+  printf("  head %llu\n", (unsigned long long)log.header->head);
+  estimate(&log);
+
+  printf("reopening a file with a mismatched header starts over\n");
+  log.header->version = BATTERY_LOG_VERSION + 1;
+  battery_log_close(&log);
+  battery_log_open(&log, g_path);
+  printf("  head %llu, version %u\n", (unsigned long long)log.header->head, log.header->version);
+  estimate(&log);
+  run(&log, 1000, 3, 60, 80.0f, -0.2f, BATTERY_DISCHARGING);
+  log.header->record_size = sizeof(struct battery_sample) + 4;
+  battery_log_close(&log);
+  battery_log_open(&log, g_path);
+  printf("  record size mismatch: head %llu, record size %u\n",
+         (unsigned long long)log.header->head,
+         log.header->record_size);
+
+  battery_log_close(&log);
+  unlink(g_path);
+  return 0;
+}
@@ -0,0 +1,159 @@
+#import <Foundation/Foundation.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../json.h"
+
+// Cost of producing the battery_info document (a full one-shot payload,
+// fields as on an Apple Silicon MacBook):
+//
+//   json.h     the streaming writer into a stack buffer, as battery_info does
+//   NSJSON     an NSDictionary of the same values through
+//              NSJSONSerialization, as before json.h
+//
+// Both produce the bytes in memory; printing is left out.
+//
+//   bench_json [--iterations <n>]
+
+static uint64_t clock_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+struct field {
+  const char* key;
+  char type; // i(nt), d(ouble), b(ool), s(tring)
+  int64_t i;
+  double d;
+  const char* s;
+};
+
+static const struct field g_fields[] = {
+  { "percent", 'i', 80 },
+  { "is_charging", 'b', 0 },
+  { "is_charged", 'b', 0 },
+  { "time_to_empty_min", 'i', 312 },
+  { "est_time_to_empty_min", 'i', 296 },
+  { "power_source", 's', .s = "Battery" },
+  { "device_name", 's', .s = "bq40z651" },
+  { "serial", 's', .s = "F8Y2145017VQ1DLAX" },
+  { "cycle_count", 'i', 187 },
+  { "design_capacity", 'i', 6075 },
+  { "design_cycle_count", 'i', 1000 },
+  { "critical", 'b', 0 },
+  { "battery_installed", 'b', 1 },
+  { "fully_charged", 'b', 0 },
+  { "external_connected", 'b', 0 },
+  { "external_charge_capable", 'b', 0 },
+  { "max_capacity", 'i', 100 },
+  { "current_capacity", 'i', 80 },
+  { "raw_current_capacity", 'i', 4512 },
+  { "raw_max_capacity", 'i', 5640 },
+  { "nominal_capacity", 'i', 5802 },
+  { "voltage_mv", 'i', 12410 },
+  { "amperage_ma", 'i', -1034 },
+  { "instant_amperage_ma", 'i', -1102 },
+  { "cell_voltage_min_mv", 'i', 4133 },
+  { "cell_voltage_max_mv", 'i', 4139 },
+  { "cell_voltage_delta_mv", 'i', 6 },
+  { "soc_percent", 'i', 80 },
+  { "daily_min_soc", 'i', 41 },
+  { "daily_max_soc", 'i', 100 },
+  { "telemetry_system_voltage_in_mv", 'i', 12405 },
+  { "telemetry_system_current_in_ma", 'i', 0 },
+  { "telemetry_system_power_in_w", 'd', .d = 0.0 },
+  { "telemetry_system_load", 'i', 12832 },
+  { "telemetry_battery_power", 'i', 12832 },
+  { "health", 's', .s = "Good" },
+  { "temperature_raw", 'i', 3046 },
+  { "temperature_c", 'd', .d = 31.5 },
+  { "power_w", 'd', .d = -12.8 },
+  { "health_percent", 'd', .d = 92.8 },
+};
+
+static const int64_t g_cells[] = { 4136, 4139, 4133 };
+
+#define FIELD_COUNT (sizeof(g_fields) / sizeof(g_fields[0]))
+#define CELL_COUNT (sizeof(g_cells) / sizeof(g_cells[0]))
+
+static size_t write_json_h(char* buffer, size_t size) {
+  struct json_writer json;
+  json_init(&json, buffer, size, NULL);
+  json_object_begin(&json);
+  for (size_t i = 0; i < FIELD_COUNT; i++) {
+    const struct field* field = &g_fields[i];
+    switch (field->type) {
+      case 'i': json_field_int(&json, field->key, field->i); break;
+      case 'd': json_field_double(&json, field->key, field->d); break;
+      case 'b': json_field_bool(&json, field->key, field->i != 0); break;
+      case 's': json_field_string(&json, field->key, field->s); break;
+    }
+  }
+  json_key(&json, "cell_voltage_mv");
+  json_array_begin(&json);
+  for (size_t i = 0; i < CELL_COUNT; i++) json_int(&json, g_cells[i]);
+  json_array_end(&json);
+  json_object_end(&json);
+  return json_finish(&json, false) ? json.len : 0;
+}
+
+static size_t write_nsjson(void) {
+  NSMutableDictionary* payload = [NSMutableDictionary dictionaryWithCapacity:FIELD_COUNT + 1];
+  for (size_t i = 0; i < FIELD_COUNT; i++) {
+    const struct field* field = &g_fields[i];
+    NSString* key = @(field->key);
+    switch (field->type) {
+      case 'i': payload[key] = @(field->i); break;
+      case 'd': payload[key] = @(field->d); break;
+      case 'b': payload[key] = @(field->i != 0); break;
+      case 's': payload[key] = @(field->s); break;
+    }
+  }
+  NSMutableArray* cells = [NSMutableArray arrayWithCapacity:CELL_COUNT];
+  for (size_t i = 0; i < CELL_COUNT; i++) [cells addObject:@(g_cells[i])];
+  payload[@"cell_voltage_mv"] = cells;
+
+  NSData* data = [NSJSONSerialization dataWithJSONObject:payload options:0 error:nil];
+  return data.length;
+}
+
+int main(int argc, char** argv) {
+  int iterations = 100000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--iterations") == 0) iterations = atoi(argv[i + 1]);
+    else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (iterations <= 0) iterations = 1;
+
+  char buffer[4096];
+  volatile size_t sink = 0;
+  uint64_t start = clock_ns();
+  for (int i = 0; i < iterations; i++) sink += write_json_h(buffer, sizeof(buffer));
+  double json_h_ns = (double)(clock_ns() - start) / iterations;
+  size_t json_h_size = write_json_h(buffer, sizeof(buffer));
+
+  start = clock_ns();
+  for (int i = 0; i < iterations; i++) {
+    @autoreleasepool {
+      sink += write_nsjson();
+    }
+  }
+  double nsjson_ns = (double)(clock_ns() - start) / iterations;
+  size_t nsjson_size;
+  @autoreleasepool {
+    nsjson_size = write_nsjson();
+  }
+  (void)sink;
+
+  printf("battery_info document, %zu fields, %d iterations\n", FIELD_COUNT + 1, iterations);
+  printf("%8s %10s %8s\n", "", "ns/doc", "bytes");
+  printf("%8s %10.0f %8zu\n", "json.h", json_h_ns, json_h_size);
+  printf("%8s %10.0f %8zu\n", "NSJSON", nsjson_ns, nsjson_size);
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "../../json.h"
+
+// The streaming JSON writer on fixed documents: `make test` diffs the output
+// against json.expected. Every document is written twice, through a buffer
+// large enough to hold it and through a 3 byte buffer flushed to stdout,
+// and must come out the same.
+
+static void battery(struct json_writer* json) {
+  static const int64_t cells[] = { 4102, 4099, 4107 };
+  json_object_begin(json);
+  json_field_int(json, "percent", 80);
+  json_field_bool(json, "is_charging", false);
+  json_field_string(json, "power_source", "AC Power");
+  json_key(json, "cell_voltage_mv");
+  json_array_begin(json);
+  for (int i = 0; i < 3; i++) json_int(json, cells[i]);
+  json_array_end(json);
+  json_field_double(json, "temperature_c", 30.5);
+  json_field_double(json, "voltage_v", 12.0);
+  json_object_end(json);
+}
+
+static void nesting(struct json_writer* json) {
+  json_array_begin(json);
+  json_array_begin(json);
+  json_array_end(json);
+  json_object_begin(json);
+  json_object_end(json);
+  json_object_begin(json);
+  json_key(json, "a");
+  json_array_begin(json);
+  json_object_begin(json);
+  json_field_int(json, "b", 1);
+  json_object_end(json);
+  json_null(json);
+  json_array_end(json);
+  json_field_int(json, "c", 2);
+  json_object_end(json);
+  json_string(json, "");
+  json_array_end(json);
+}
+
+static void escapes(struct json_writer* json) {
+  json_object_begin(json);
+  json_field_string(json, "quote", "say \"hi\"");
+  json_field_string(json, "path", "C:\\Users");
+  json_field_string(json, "control", "tab\tline\nbell\a\x1f");
+  json_field_string(json, "utf8", "Bose QC45 — Kopfhörer");
+  json_field_string(json, "key \"quoted\"", "value");
+  json_object_end(json);
+}
+
+static void numbers(struct json_writer* json) {
+  json_array_begin(json);
+  json_int(json, 0);
+  json_int(json, -7);
+  json_int(json, INT64_MAX);
+  json_int(json, INT64_MIN);
+  json_double(json, 0.25);
+  json_double(json, -3.0);
+  json_double(json, 1e15);
+  json_double(json, 1.0 / 3.0);
+  json_double(json, NAN);
+  json_double(json, INFINITY);
+  json_array_end(json);
+}
+
+static void run(const char* name, void (*write)(struct json_writer*)) {
+  char buffer[256];
+  struct json_writer json;
+  json_init(&json, buffer, sizeof(buffer), NULL);
+  write(&json);
+  bool ok = json_finish(&json, false);
+  printf("%s (%zu bytes, ok=%d): %.*s\n", name, json.len, ok, (int)json.len, buffer);
+
+  // Same document through a tiny buffer
+  char tiny[3];
+  printf("%s flushed: ", name);
+  json_init(&json, tiny, sizeof(tiny), stdout);
+  write(&json);
+  ok = json_finish(&json, true);
+  fflush(stdout);
+  if (!ok) printf("(lost output)\n");
+}
+
+int main(void) {
+  run("battery", battery);
+  run("nesting", nesting);
+  run("escapes", escapes);
+  run("numbers", numbers);
+
+  // Without an output stream a full buffer overflows instead of flushing;
+  // what fit is kept
+  char small[16];
+  struct json_writer json;
+  json_init(&json, small, sizeof(small), NULL);
+  battery(&json);
+  bool ok = json_finish(&json, false);
+  printf("overflow (%zu bytes, ok=%d): %.*s\n", json.len, ok, (int)json.len, small);
+
+  // Deeper than JSON_MAX_DEPTH: separators still follow the level
+  char deep[256];
+  json_init(&json, deep, sizeof(deep), NULL);
+  for (int i = 0; i < JSON_MAX_DEPTH + 2; i++) {
+    json_array_begin(&json);
+    json_int(&json, i);
+  }
+  for (int i = 0; i < JSON_MAX_DEPTH + 2; i++) json_array_end(&json);
+  ok = json_finish(&json, false);
+  printf("depth %d (ok=%d): %.*s\n", JSON_MAX_DEPTH + 2, ok, (int)json.len, deep);
+  return 0;
+}
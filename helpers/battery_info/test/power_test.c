@@ -0,0 +1,67 @@
+#include <stdio.h>
+
+#include "../power.h"
+
+// Drives power_watch_poll through a script of readings, printing the
+// triggers watch mode would push: `make test` diffs the output against
+// power.expected.
+
+struct step {
+  const char* what;
+  // false: no internal battery in this reading
+  bool found;
+  int percent;
+  int is_charging;
+  int is_charged;
+  int time_to_empty_min;
+  int time_to_full_min;
+  int est_time_to_empty_min;
+  int est_time_to_full_min;
+  const char* power_source;
+};
+
+static bool script_read(void* context, struct power_state* state) {
+  const struct step* step = *(const struct step**)context;
+  if (!step->found) return false;
+  state->percent = step->percent;
+  state->is_charging = step->is_charging;
+  state->is_charged = step->is_charged;
+  state->time_to_empty_min = step->time_to_empty_min;
+  state->time_to_full_min = step->time_to_full_min;
+  state->est_time_to_empty_min = step->est_time_to_empty_min;
+  state->est_time_to_full_min = step->est_time_to_full_min;
+  if (step->power_source) power_state_set_source(state, step->power_source);
+  return true;
+}
+
+int main(void) {
+  static const struct step steps[] = {
+    { "first reading", true, 80, 0, 0, 240, -1, -1, -1, "Battery Power" },
+    { "same reading", true, 80, 0, 0, 240, -1, -1, -1, "Battery Power" },
+    { "log estimate available", true, 80, 0, 0, 240, -1, 251, -1, "Battery Power" },
+    { "percent step", true, 79, 0, 0, 240, -1, 251, -1, "Battery Power" },
+    { "no battery", false, 0, 0, 0, 0, 0, 0, 0, NULL },
+    { "back, unchanged", true, 79, 0, 0, 240, -1, 251, -1, "Battery Power" },
+    { "plugged in, still calculating", true, 79, 1, 0, -1, -1, -1, -1, "AC Power" },
+    { "time to full", true, 79, 1, 0, -1, 95, -1, 88, "AC Power" },
+    { "charged", true, 100, 0, 1, -1, 0, -1, -1, "AC Power" },
+    { "unknown source state", true, 100, 0, 1, -1, 0, -1, -1, "UPS Power" },
+    { "fields unknown", true, -1, -1, -1, -1, -1, -1, -1, NULL },
+  };
+
+  const struct step* step = NULL;
+  struct power_source source = { .context = &step, .read = script_read };
+  struct power_watch watch = { .event = "battery_update" };
+
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    step = &steps[i];
+    char message[512];
+    printf("%s:\n", step->what);
+    if (power_watch_poll(&watch, &source, message, sizeof(message))) {
+      printf("  %s\n", message);
+    } else {
+      printf("  (no trigger)\n");
+    }
+  }
+  return 0;
+}
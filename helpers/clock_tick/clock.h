@@ -0,0 +1,89 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Wall clock boundaries in local time. A unit is reported whenever the
+// period it falls in differs from the last one reported, so a clock or time
+// zone change shows up as a tick in either direction, not only forwards.
+
+enum clock_unit {
+  CLOCK_SECOND,
+  CLOCK_MINUTE,
+  CLOCK_HOUR,
+  CLOCK_UNITS
+};
+
+struct clock_ticks {
+  // Event triggered at each boundary of the unit, NULL if not wanted
+  const char* events[CLOCK_UNITS];
+  // Start of the period reported last, -1 before the first tick
+  long long last[CLOCK_UNITS];
+};
+
+static const long long clock_unit_seconds[CLOCK_UNITS] = { 1, 60, 3600 };
+
+static inline void clock_init(struct clock_ticks* ticks) {
+  memset(ticks, 0, sizeof(struct clock_ticks));
+  for (int i = 0; i < CLOCK_UNITS; i++) ticks->last[i] = -1;
+}
+
+static inline bool clock_enabled(const struct clock_ticks* ticks) {
+  for (int i = 0; i < CLOCK_UNITS; i++) {
+    if (ticks->events[i]) return true;
+  }
+  return false;
+}
+
+static inline long long clock_period_start(enum clock_unit unit,
+                                           time_t now,
+                                           const struct tm* local) {
+  switch (unit) {
+    case CLOCK_MINUTE: return (long long)now - local->tm_sec;
+    case CLOCK_HOUR: return (long long)now - local->tm_min * 60 - local->tm_sec;
+    default: return (long long)now;
+  }
+}
+
+// Builds one message with a trigger for every unit whose period changed
+// since the last call. A trigger that does not fit is left for the next
+// call. Returns false if there is nothing to send.
+static inline bool clock_update(struct clock_ticks* ticks,
+                                time_t now,
+                                const struct tm* local,
+                                char* buffer,
+                                size_t size           ) {
+  size_t len = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < CLOCK_UNITS; i++) {
+    if (!ticks->events[i]) continue;
+    long long start = clock_period_start(i, now, local);
+    if (start == ticks->last[i]) continue;
+    int written = snprintf(buffer + len,
+                           size - len,
+                           "%s--trigger '%s' EPOCH=%lld",
+                           len > 0 ? " " : "",
+                           ticks->events[i],
+                           start                          );
+    if (written < 0 || (size_t)written >= size - len) {
+      buffer[len] = '\0';
+      continue;
+    }
+    len += written;
+    ticks->last[i] = start;
+  }
+  return len > 0;
+}
+
+// Wall clock time of the next boundary of any wanted unit
+static inline time_t clock_next(const struct clock_ticks* ticks,
+                                time_t now,
+                                const struct tm* local) {
+  long long next = (long long)now + clock_unit_seconds[CLOCK_HOUR];
+  for (int i = 0; i < CLOCK_UNITS; i++) {
+    if (!ticks->events[i]) continue;
+    long long boundary = clock_period_start(i, now, local) + clock_unit_seconds[i];
+    if (boundary < next) next = boundary;
+  }
+  return (time_t)next;
+}
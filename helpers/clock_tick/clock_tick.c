@@ -0,0 +1,146 @@
+#include <arpa/inet.h>
+#include <dispatch/dispatch.h>
+#include <fcntl.h>
+#include <notify.h>
+#include <notify_keys.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "../impact.h"
+#include "../sketchybar.h"
+
+// Wall clock aligned tick source: triggers the given events right after
+// each second, minute or hour boundary in local time, instead of items
+// polling with update_freq. A single one-shot walltime timer is armed for
+// the nearest boundary; ticks that coincide go out in one message.
+//
+// Usage: clock_tick [--second <event>] [--minute <event>] [--hour <event>] [--print]
+//
+// Walltime timers keep counting through sleep and fire on wake if their
+// deadline passed. Clock and time zone changes re-arm the timer through
+// their system notifications, and report a tick if the period changed.
+
+// Fire slightly after the boundary, so the local time has moved on
+#define MARGIN_MSEC 5
+#define LEEWAY_MSEC 10
+
+struct clock {
+  struct clock_ticks ticks;
+  dispatch_source_t timer;
+  bool print;
+  int notify_fd;
+  int timezone_token;
+};
+
+static void tick(void* context) {
+  struct clock* clock = context;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  struct tm local;
+  localtime_r(&now.tv_sec, &local);
+
+  char message[512];
+  if (clock_update(&clock->ticks, now.tv_sec, &local, message, sizeof(message))) {
+    if (clock->print) {
+      printf("%s\n", message);
+      fflush(stdout);
+    } else {
+      sketchybar(message);
+    }
+  }
+
+  struct timespec next = {
+    .tv_sec = clock_next(&clock->ticks, now.tv_sec, &local),
+    .tv_nsec = MARGIN_MSEC * NSEC_PER_MSEC
+  };
+  dispatch_source_set_timer(clock->timer,
+                            dispatch_walltime(&next, 0),
+                            DISPATCH_TIME_FOREVER,
+                            LEEWAY_MSEC * NSEC_PER_MSEC);
+}
+
+// Both notifications are delivered as tokens on one descriptor
+static void system_changed(void* context) {
+  struct clock* clock = context;
+  int token;
+  while (read(clock->notify_fd, &token, sizeof(token)) == sizeof(token)) {
+    if ((int)ntohl(token) == clock->timezone_token) tzset();
+  }
+  tick(clock);
+}
+
+static bool watch_system_changes(struct clock* clock) {
+  int clock_token;
+  if (notify_register_file_descriptor(kNotifyClockSet,
+                                      &clock->notify_fd,
+                                      0,
+                                      &clock_token) != NOTIFY_STATUS_OK
+      || notify_register_file_descriptor(kNotifyTimeZoneChange,
+                                         &clock->notify_fd,
+                                         NOTIFY_REUSE,
+                                         &clock->timezone_token) != NOTIFY_STATUS_OK) {
+    return false;
+  }
+
+  int flags = fcntl(clock->notify_fd, F_GETFL);
+  fcntl(clock->notify_fd, F_SETFL, flags | O_NONBLOCK);
+  dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,
+                                                    clock->notify_fd,
+                                                    0,
+                                                    dispatch_get_main_queue());
+  dispatch_set_context(source, clock);
+  dispatch_source_set_event_handler_f(source, system_changed);
+  dispatch_resume(source);
+  return true;
+}
+
+static void usage(const char* name) {
+  printf("Usage: %s [--second <event>] [--minute <event>] [--hour <event>] [--print]\n", name);
+}
+
+int main(int argc, char** argv) {
+  impact_apply();
+  static struct clock clock;
+  clock_init(&clock.ticks);
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--second") == 0 && i + 1 < argc) {
+      clock.ticks.events[CLOCK_SECOND] = argv[++i];
+    } else if (strcmp(argv[i], "--minute") == 0 && i + 1 < argc) {
+      clock.ticks.events[CLOCK_MINUTE] = argv[++i];
+    } else if (strcmp(argv[i], "--hour") == 0 && i + 1 < argc) {
+      clock.ticks.events[CLOCK_HOUR] = argv[++i];
+    } else if (strcmp(argv[i], "--print") == 0) {
+      clock.print = true;
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (!clock_enabled(&clock.ticks)) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  if (!watch_system_changes(&clock)) {
+    fprintf(stderr, "Could not watch clock changes, ticks may lag after a clock change\n");
+  }
+
+  clock.timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER,
+                                       0,
+                                       0,
+                                       dispatch_get_main_queue());
+  dispatch_set_context(clock.timer, &clock);
+  dispatch_source_set_event_handler_f(clock.timer, tick);
+  dispatch_resume(clock.timer);
+
+  // Nothing was reported yet: the first tick carries every wanted unit
+  tick(&clock);
+  dispatch_main();
+  return 0;
+}
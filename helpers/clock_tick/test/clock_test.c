@@ -0,0 +1,115 @@
+#include <stdio.h>
+
+#include "../clock.h"
+
+// clock_update and clock_next (clock.h) on fixed wall clock readings, the
+// local time given as the offset from UTC: `make test` diffs the output
+// against clock.expected.
+
+// 2026-01-01 00:00:00 UTC
+#define T0 1767225600LL
+
+// Local time offset_min minutes east of UTC at UTC time T0 + utc_sec
+static void reading(long long utc_sec, int offset_min, time_t* now, struct tm* local) {
+  *now = (time_t)(T0 + utc_sec);
+  long long local_sec = utc_sec + offset_min * 60LL;
+  long long of_day = ((local_sec % 86400) + 86400) % 86400;
+  memset(local, 0, sizeof(struct tm));
+  local->tm_hour = (int)(of_day / 3600);
+  local->tm_min = (int)(of_day / 60 % 60);
+  local->tm_sec = (int)(of_day % 60);
+}
+
+static void tick(struct clock_ticks* ticks, long long utc_sec, int offset_min) {
+  time_t now;
+  struct tm local;
+  reading(utc_sec, offset_min, &now, &local);
+
+  char message[256];
+  bool send = clock_update(ticks, now, &local, message, sizeof(message));
+  printf("  %02d:%02d:%02d %c%02d:%02d  next %+lld s  %s\n",
+         local.tm_hour,
+         local.tm_min,
+         local.tm_sec,
+         offset_min < 0 ? '-' : '+',
+         (offset_min < 0 ? -offset_min : offset_min) / 60,
+         (offset_min < 0 ? -offset_min : offset_min) % 60,
+         (long long)clock_next(ticks, now, &local) - (long long)now,
+         send ? message : "(nothing)"                         );
+}
+
+static void setup(struct clock_ticks* ticks,
+                  const char* what,
+                  bool second,
+                  bool minute,
+                  bool hour   ) {
+  clock_init(ticks);
+  ticks->events[CLOCK_SECOND] = second ? "second" : NULL;
+  ticks->events[CLOCK_MINUTE] = minute ? "minute" : NULL;
+  ticks->events[CLOCK_HOUR] = hour ? "hour" : NULL;
+  printf("%s\n", what);
+}
+
+int main(void) {
+  struct clock_ticks ticks;
+
+  setup(&ticks, "second, minute and hour boundaries coinciding", true, true, true);
+  tick(&ticks, 12 * 3600 - 2, 0);
+  tick(&ticks, 12 * 3600 - 1, 0);
+  tick(&ticks, 12 * 3600, 0);
+  tick(&ticks, 12 * 3600, 0);
+  tick(&ticks, 12 * 3600 + 1, 0);
+
+  setup(&ticks, "minute and hour only", false, true, true);
+  tick(&ticks, 12 * 3600 + 58 * 60 + 30, 0);
+  tick(&ticks, 12 * 3600 + 59 * 60 + 59, 0);
+  tick(&ticks, 13 * 3600, 0);
+  tick(&ticks, 13 * 3600 + 1, 0);
+
+  setup(&ticks, "hour only", false, false, true);
+  tick(&ticks, 13 * 3600 + 15 * 60, 0);
+  tick(&ticks, 14 * 3600 - 1, 0);
+  tick(&ticks, 14 * 3600, 0);
+
+  setup(&ticks, "clock set back across a minute and an hour", true, true, true);
+  tick(&ticks, 12 * 3600 + 5, 0);
+  tick(&ticks, 11 * 3600 + 59 * 60 + 30, 0);
+  tick(&ticks, 11 * 3600 + 59 * 60 + 31, 0);
+  tick(&ticks, 12 * 3600, 0);
+
+  setup(&ticks, "clock set back within the minute", false, true, true);
+  tick(&ticks, 12 * 3600 + 40, 0);
+  tick(&ticks, 12 * 3600 + 10, 0);
+
+  setup(&ticks, "half hour offset, UTC+05:30", true, true, true);
+  tick(&ticks, 12 * 3600 - 1, 330);
+  tick(&ticks, 12 * 3600, 330);
+  tick(&ticks, 12 * 3600 + 1800 - 1, 330);
+  tick(&ticks, 12 * 3600 + 1800, 330);
+
+  setup(&ticks, "half hour offset, UTC-09:30", false, false, true);
+  tick(&ticks, 12 * 3600, -570);
+  tick(&ticks, 12 * 3600 + 1800, -570);
+
+  setup(&ticks, "time zone change from UTC+01:00 to UTC+05:30", false, true, true);
+  tick(&ticks, 12 * 3600 + 10 * 60, 60);
+  tick(&ticks, 12 * 3600 + 10 * 60 + 5, 330);
+  tick(&ticks, 12 * 3600 + 10 * 60 + 10, 330);
+
+  setup(&ticks, "nothing wanted", false, false, false);
+  printf("  enabled: %s\n", clock_enabled(&ticks) ? "yes" : "no");
+  tick(&ticks, 12 * 3600, 0);
+
+  printf("message too large for the buffer\n");
+  clock_init(&ticks);
+  ticks.events[CLOCK_SECOND] = "second";
+  ticks.events[CLOCK_MINUTE] = "minute";
+  time_t now;
+  struct tm local;
+  reading(12 * 3600, 0, &now, &local);
+  char message[40];
+  for (int i = 0; i < 3; i++) {
+    printf("  %s\n", clock_update(&ticks, now, &local, message, sizeof(message)) ? message : "(nothing)");
+  }
+  return 0;
+}
@@ -0,0 +1,217 @@
+#include <CoreFoundation/CoreFoundation.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/IOBSD.h>
+#include <IOKit/storage/IOBlockStorageDriver.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../glob.h"
+#include "../rate.h"
+
+#define MAX_DISKS 16
+
+struct disk_device {
+  char name[32];
+  io_registry_entry_t driver;
+  bool present;
+  bool primed;
+
+  uint64_t read_bytes;
+  uint64_t write_bytes;
+  uint64_t reads;
+  uint64_t writes;
+
+  double read_bps;
+  double write_bps;
+  double read_iops;
+  double write_iops;
+};
+
+struct disk {
+  // Comma separated globs over BSD names, e.g. "disk0,disk4" or "disk*"
+  const char* filter;
+  struct timespec ts_prev;
+  struct disk_device devices[MAX_DISKS];
+  uint32_t count;
+
+  double read_bps;
+  double write_bps;
+  double read_iops;
+  double write_iops;
+};
+
+static inline bool disk_driver_name(io_registry_entry_t driver,
+                                    char* buffer,
+                                    size_t buffer_size) {
+  io_registry_entry_t media = 0;
+  if (IORegistryEntryGetChildEntry(driver, kIOServicePlane, &media)
+      != KERN_SUCCESS) {
+    return false;
+  }
+
+  bool ok = false;
+  CFTypeRef name = IORegistryEntryCreateCFProperty(media,
+                                                   CFSTR(kIOBSDNameKey),
+                                                   kCFAllocatorDefault,
+                                                   0                    );
+  if (name) {
+    if (CFGetTypeID(name) == CFStringGetTypeID()) {
+      ok = CFStringGetCString(name, buffer, buffer_size, kCFStringEncodingUTF8);
+    }
+    CFRelease(name);
+  }
+  IOObjectRelease(media);
+  return ok && buffer[0] != '\0';
+}
+
+static inline struct disk_device* disk_find(struct disk* disk, const char* name) {
+  for (uint32_t i = 0; i < disk->count; i++) {
+    if (strcmp(disk->devices[i].name, name) == 0) return &disk->devices[i];
+  }
+  return NULL;
+}
+
+// Re-enumerates the block storage drivers. Counter state of devices that are
+// still attached is kept, so a rescan never produces a spurious spike.
+static inline void disk_scan(struct disk* disk) {
+  for (uint32_t i = 0; i < disk->count; i++) disk->devices[i].present = false;
+
+  io_iterator_t iterator;
+  if (IOServiceGetMatchingServices(kIOMainPortDefault,
+                                   IOServiceMatching(kIOBlockStorageDriverClass),
+                                   &iterator) == KERN_SUCCESS) {
+    io_registry_entry_t driver;
+    while ((driver = IOIteratorNext(iterator))) {
+      char name[32];
+      if (!disk_driver_name(driver, name, sizeof(name))
+          || !glob_list_matches(disk->filter, name)) {
+        IOObjectRelease(driver);
+        continue;
+      }
+
+      struct disk_device* device = disk_find(disk, name);
+      if (!device && disk->count < MAX_DISKS) {
+        device = &disk->devices[disk->count++];
+        memset(device, 0, sizeof(struct disk_device));
+        strlcpy(device->name, name, sizeof(device->name));
+      }
+      if (!device || device->present) {
+        IOObjectRelease(driver);
+        continue;
+      }
+
+      if (device->driver) IOObjectRelease(device->driver);
+      device->driver = driver;
+      device->present = true;
+    }
+    IOObjectRelease(iterator);
+  }
+
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < disk->count; i++) {
+    if (!disk->devices[i].present) {
+      if (disk->devices[i].driver) IOObjectRelease(disk->devices[i].driver);
+      continue;
+    }
+    if (kept != i) disk->devices[kept] = disk->devices[i];
+    kept++;
+  }
+  disk->count = kept;
+}
+
+static inline uint64_t disk_stat(CFDictionaryRef stats, CFStringRef key) {
+  CFNumberRef number = CFDictionaryGetValue(stats, key);
+  uint64_t value = 0;
+  if (number && CFGetTypeID(number) == CFNumberGetTypeID()) {
+    CFNumberGetValue(number, kCFNumberSInt64Type, &value);
+  }
+  return value;
+}
+
+static inline bool disk_read_counters(struct disk_device* device,
+                                      uint64_t* read_bytes,
+                                      uint64_t* write_bytes,
+                                      uint64_t* reads,
+                                      uint64_t* writes               ) {
+  CFDictionaryRef stats = IORegistryEntryCreateCFProperty(
+                             device->driver,
+                             CFSTR(kIOBlockStorageDriverStatisticsKey),
+                             kCFAllocatorDefault,
+                             0                                         );
+  if (!stats) return false;
+  if (CFGetTypeID(stats) != CFDictionaryGetTypeID()) {
+    CFRelease(stats);
+    return false;
+  }
+
+  *read_bytes = disk_stat(stats,
+                          CFSTR(kIOBlockStorageDriverStatisticsBytesReadKey));
+  *write_bytes = disk_stat(stats,
+                           CFSTR(kIOBlockStorageDriverStatisticsBytesWrittenKey));
+  *reads = disk_stat(stats, CFSTR(kIOBlockStorageDriverStatisticsReadsKey));
+  *writes = disk_stat(stats, CFSTR(kIOBlockStorageDriverStatisticsWritesKey));
+  CFRelease(stats);
+  return true;
+}
+
+static inline void disk_init(struct disk* disk, const char* filter) {
+  memset(disk, 0, sizeof(struct disk));
+  disk->filter = filter;
+  disk_scan(disk);
+}
+
+static inline void disk_update(struct disk* disk) {
+  double time_scale = rate_elapsed(&disk->ts_prev);
+
+  disk->read_bps = 0;
+  disk->write_bps = 0;
+  disk->read_iops = 0;
+  disk->write_iops = 0;
+
+  for (uint32_t i = 0; i < disk->count; i++) {
+    struct disk_device* device = &disk->devices[i];
+    uint64_t read_bytes, write_bytes, reads, writes;
+    if (!disk_read_counters(device, &read_bytes, &write_bytes, &reads, &writes)) {
+      device->read_bps = device->write_bps = 0;
+      device->read_iops = device->write_iops = 0;
+      continue;
+    }
+
+    if (device->primed && rate_window_valid(time_scale)) {
+      device->read_bps = rate_per_sec(read_bytes, device->read_bytes, time_scale);
+      device->write_bps = rate_per_sec(write_bytes, device->write_bytes, time_scale);
+      device->read_iops = rate_per_sec(reads, device->reads, time_scale);
+      device->write_iops = rate_per_sec(writes, device->writes, time_scale);
+    }
+
+    device->read_bytes = read_bytes;
+    device->write_bytes = write_bytes;
+    device->reads = reads;
+    device->writes = writes;
+    device->primed = true;
+
+    disk->read_bps += device->read_bps;
+    disk->write_bps += device->write_bps;
+    disk->read_iops += device->read_iops;
+    disk->write_iops += device->write_iops;
+  }
+}
+
+// Formats the per-device rates as "name:read_bps:write_bps:read_iops:write_iops"
+// records separated by ';'.
+static inline void disk_format_devices(struct disk* disk, char* buffer, size_t size) {
+  size_t offset = 0;
+  buffer[0] = '\0';
+  for (uint32_t i = 0; i < disk->count && offset < size; i++) {
+    struct disk_device* device = &disk->devices[i];
+    int written = snprintf(buffer + offset, size - offset, "%s%s:%.0f:%.0f:%.0f:%.0f",
+                           i > 0 ? ";" : "",
+                           device->name,
+                           device->read_bps,
+                           device->write_bps,
+                           device->read_iops,
+                           device->write_iops);
+    if (written > 0) offset += written;
+  }
+}
@@ -0,0 +1,73 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "disk.h"
+#include "../impact.h"
+#include "../sketchybar.h"
+
+int main (int argc, char** argv) {
+  impact_apply();
+  float update_freq;
+  if (argc < 4 || (sscanf(argv[3], "%f", &update_freq) != 1)) {
+    printf("Usage: %s \"<devices|all>\" \"<event-name>\" \"<event_freq>\" [\"<slow_freq>\"]\n", argv[0]);
+    exit(1);
+  }
+
+  float slow_freq = 1.0f;
+  if (argc >= 5) sscanf(argv[4], "%f", &slow_freq);
+  int slow_every = (int)(slow_freq / update_freq);
+  if (slow_every < 1) slow_every = 1;
+
+  alarm(0);
+  // Setup the event in sketchybar
+  char event_message[512];
+  snprintf(event_message, 512, "--add event '%s'", argv[2]);
+  sketchybar(event_message);
+
+  struct disk disk;
+  disk_init(&disk, argv[1]);
+  if (disk.count == 0) {
+    fprintf(stderr, "No block storage devices match: %s\n", argv[1]);
+    return 1;
+  }
+
+  char devices[1024];
+  char trigger_message[1536];
+  int tick = 0;
+  for (;;) {
+    bool is_full = (tick % slow_every == 0);
+    // Pick up attached/detached devices once per slow period
+    if (is_full && tick > 0) disk_scan(&disk);
+
+    // Acquire new info
+    disk_update(&disk);
+    disk_format_devices(&disk, devices, sizeof(devices));
+
+    // Prepare the event message
+    snprintf(trigger_message,
+             sizeof(trigger_message),
+             "--trigger '%s' "
+             "read_bps='%.0f' "
+             "write_bps='%.0f' "
+             "read_iops='%.0f' "
+             "write_iops='%.0f' "
+             "devices='%s' "
+             "full_update='%d'",
+             argv[2],
+             disk.read_bps,
+             disk.write_bps,
+             disk.read_iops,
+             disk.write_iops,
+             devices,
+             is_full ? 1 : 0);
+
+    // Trigger the event
+    sketchybar(trigger_message);
+    tick++;
+
+    // Wait
+    usleep(update_freq * 1000000);
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+
+#include "../../glob.h"
+#include "../../rate.h"
+
+// The counter delta, smoothing and device filter logic shared by disk_load
+// and network_load, on fixed inputs: `make test` diffs the output against
+// rate.expected.
+
+static void elapsed(struct timespec* prev, long sec, long nsec) {
+  struct timespec now = { .tv_sec = sec, .tv_nsec = nsec };
+  double value = rate_elapsed_until(prev, now);
+  printf("elapsed until %ld.%09ld: %.3f valid=%d\n", sec, nsec, value, rate_window_valid(value));
+}
+
+static void per_sec(uint64_t now, uint64_t prev, double window) {
+  printf("rate %llu after %llu over %.2fs: %.1f/s\n",
+         (unsigned long long)now, (unsigned long long)prev, window,
+         rate_per_sec(now, prev, window));
+}
+
+static void matches(const char* list, const char* name) {
+  printf("glob \"%s\" %s: %s\n", list, name, glob_list_matches(list, name) ? "match" : "no match");
+}
+
+int main(void) {
+  struct timespec prev = { 0 };
+  elapsed(&prev, 100, 0);
+  elapsed(&prev, 100, 500000000);
+  elapsed(&prev, 101, 250000000);
+  elapsed(&prev, 101, 250000000);
+  elapsed(&prev, 101, 0);
+  elapsed(&prev, 400, 0);
+
+  per_sec(1500, 500, 0.5);
+  per_sec(1000, 1000, 1.0);
+  per_sec(100, 5000, 1.0);
+  per_sec(UINT64_MAX, UINT64_MAX - 2000, 2.0);
+  per_sec(5000, 1000, 0.0);
+  per_sec(5000, 1000, 150.0);
+
+  struct rate_smoother smoother = { .half_life = 1.0 };
+  double samples[][2] = { { 100, 0.5 }, { 0, 1.0 }, { 0, 0.5 }, { 400, 2.0 }, { 400, 0.25 } };
+  for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+    rate_smoother_add(&smoother, samples[i][0], samples[i][1]);
+    printf("smooth %.0f after %.2fs: %.2f", samples[i][0], samples[i][1], smoother.value);
+    if (i % 2 == 1) printf(" peak %.2f", rate_smoother_take_peak(&smoother));
+    printf("\n");
+  }
+  printf("peak: %.2f\n", rate_smoother_take_peak(&smoother));
+  printf("peak of an empty window: %.2f\n", rate_smoother_take_peak(&smoother));
+
+  struct rate_smoother passthrough = { .half_life = 0 };
+  rate_smoother_add(&passthrough, 10, 1.0);
+  rate_smoother_add(&passthrough, 30, 1.0);
+  printf("half-life 0: %.2f\n", passthrough.value);
+
+  matches("", "disk3");
+  matches("all", "disk3");
+  matches("disk0,disk4", "disk4");
+  matches("disk0,disk4", "disk40");
+  matches("disk*", "disk12");
+  matches("en0,utun*", "utun3");
+  matches("en0,,utun[0-2]", "utun3");
+  printf("pattern \"disk0\": %d, \"disk0,disk1\": %d, \"utun?\": %d\n",
+         glob_list_is_pattern("disk0"),
+         glob_list_is_pattern("disk0,disk1"),
+         glob_list_is_pattern("utun?"));
+  return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Matches a name against a comma separated list of fnmatch globs, e.g.
+// "en0,utun*". An empty list or "all" matches everything.
+static inline bool glob_list_matches(const char* list, const char* name) {
+  if (!list || list[0] == '\0' || strcmp(list, "all") == 0) return true;
+
+  char pattern[64];
+  const char* cursor = list;
+  while (*cursor) {
+    const char* end = strchr(cursor, ',');
+    size_t len = end ? (size_t)(end - cursor) : strlen(cursor);
+    if (len > 0 && len < sizeof(pattern)) {
+      memcpy(pattern, cursor, len);
+      pattern[len] = '\0';
+      if (fnmatch(pattern, name, 0) == 0) return true;
+    }
+    if (!end) break;
+    cursor = end + 1;
+  }
+  return false;
+}
+
+// True if the argument selects a set of names rather than a single one.
+static inline bool glob_list_is_pattern(const char* list) {
+  return strcmp(list, "all") == 0 || strpbrk(list, "*?[,") != NULL;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <libproc.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+#include <pthread/qos.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Low-impact mode of the resident helpers, so a monitor that runs forever
+// never competes with real work. Selected by SKETCHYBAR_LOW_IMPACT, which
+// the supervisor sets for every helper it runs (--low-impact <level>):
+//   1       nice 10, utility QoS and a latency tier that lets the kernel
+//           defer and coalesce timer wakeups (macOS' timer slack)
+//   ecores  additionally the background band: lowest CPU and I/O priority,
+//           and on Apple Silicon only scheduled on the efficiency cores
+// macOS has no hard CPU pinning; the background band is the supported way
+// to keep a process off the performance cores.
+
+static inline const char* impact_level(void) {
+  const char* level = getenv("SKETCHYBAR_LOW_IMPACT");
+  if (!level || level[0] == '\0' || strcmp(level, "0") == 0) return NULL;
+  return level;
+}
+
+// Called first thing in main, before any thread is created, so the threads
+// inherit the QoS of the main thread.
+static inline void impact_apply(void) {
+  const char* level = impact_level();
+  if (!level) return;
+
+  setpriority(PRIO_PROCESS, 0, 10);
+  pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+
+  bool ecores = strcmp(level, "ecores") == 0;
+  struct task_qos_policy qos = {
+    .task_latency_qos_tier = ecores ? LATENCY_QOS_TIER_5 : LATENCY_QOS_TIER_3,
+    .task_throughput_qos_tier = ecores ? THROUGHPUT_QOS_TIER_5 : THROUGHPUT_QOS_TIER_3,
+  };
+  task_policy_set(mach_task_self(),
+                  TASK_BASE_LATENCY_QOS_POLICY,
+                  (task_policy_t)&qos,
+                  TASK_QOS_POLICY_COUNT        );
+  task_policy_set(mach_task_self(),
+                  TASK_BASE_THROUGHPUT_QOS_POLICY,
+                  (task_policy_t)&qos,
+                  TASK_QOS_POLICY_COUNT           );
+
+  if (ecores) setpriority(PRIO_DARWIN_PROCESS, 0, PRIO_DARWIN_BG);
+}
+
+// What a helper costs, to compare the modes: CPU time and the wakeups that
+// took a core out of idle.
+struct impact_usage {
+  double user_sec;
+  double system_sec;
+  uint64_t interrupt_wakeups;
+  uint64_t idle_wakeups;
+};
+
+// Works for the helper itself and for the supervisor's children
+static inline bool impact_usage_read(pid_t pid, struct impact_usage* usage) {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) mach_timebase_info(&timebase);
+
+  struct rusage_info_v3 info;
+  if (proc_pid_rusage(pid, RUSAGE_INFO_V3, (rusage_info_t*)&info) != 0) return false;
+
+  // The times are in mach absolute time units, not nanoseconds
+  double scale = (double)timebase.numer / (double)timebase.denom / 1e9;
+  usage->user_sec = (double)info.ri_user_time * scale;
+  usage->system_sec = (double)info.ri_system_time * scale;
+  usage->interrupt_wakeups = info.ri_interrupt_wkups;
+  usage->idle_wakeups = info.ri_pkg_idle_wkups;
+  return true;
+}
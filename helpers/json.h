@@ -0,0 +1,205 @@
+#pragma once
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Streaming JSON writer over a caller provided buffer. Nothing is allocated:
+// a full buffer is flushed to the output stream, or marks the writer as
+// overflowed when there is none.
+
+#define JSON_MAX_DEPTH 32
+
+struct json_writer {
+  char* buffer;
+  size_t size;
+  size_t len;
+  FILE* out;
+  bool overflow;
+
+  uint32_t depth;
+  // Bit per nesting level: a value was already written at that level
+  uint32_t has_value;
+  bool after_key;
+};
+
+static inline void json_init(struct json_writer* json,
+                             char* buffer,
+                             size_t size,
+                             FILE* out          ) {
+  memset(json, 0, sizeof(struct json_writer));
+  json->buffer = buffer;
+  json->size = size;
+  json->out = out;
+}
+
+static inline bool json_flush(struct json_writer* json) {
+  if (!json->out) return !json->overflow;
+  if (json->len > 0 && fwrite(json->buffer, 1, json->len, json->out) != json->len) {
+    json->overflow = true;
+  }
+  json->len = 0;
+  return !json->overflow;
+}
+
+static inline void json_write(struct json_writer* json, const char* data, size_t len) {
+  while (len > 0) {
+    if (json->len == json->size && (!json->out || !json_flush(json))) {
+      json->overflow = true;
+      return;
+    }
+    size_t chunk = json->size - json->len;
+    if (chunk > len) chunk = len;
+    memcpy(json->buffer + json->len, data, chunk);
+    json->len += chunk;
+    data += chunk;
+    len -= chunk;
+  }
+}
+
+static inline void json_write_char(struct json_writer* json, char c) {
+  if (json->len < json->size) json->buffer[json->len++] = c;
+  else json_write(json, &c, 1);
+}
+
+// Emits the separator owed before a value at the current level
+static inline void json_separate(struct json_writer* json) {
+  if (json->after_key) {
+    json->after_key = false;
+    return;
+  }
+  uint32_t bit = 1u << (json->depth % JSON_MAX_DEPTH);
+  if (json->has_value & bit) json_write_char(json, ',');
+  json->has_value |= bit;
+}
+
+static inline void json_write_escaped(struct json_writer* json, const char* value) {
+  static const char hex[] = "0123456789abcdef";
+  json_write_char(json, '"');
+  const char* run = value;
+  for (const char* c = value; *c; c++) {
+    unsigned char ch = (unsigned char)*c;
+    if (ch >= 0x20 && ch != '"' && ch != '\\') continue;
+
+    json_write(json, run, c - run);
+    run = c + 1;
+    switch (ch) {
+      case '"': json_write(json, "\\\"", 2); break;
+      case '\\': json_write(json, "\\\\", 2); break;
+      case '\b': json_write(json, "\\b", 2); break;
+      case '\f': json_write(json, "\\f", 2); break;
+      case '\n': json_write(json, "\\n", 2); break;
+      case '\r': json_write(json, "\\r", 2); break;
+      case '\t': json_write(json, "\\t", 2); break;
+      default: {
+        char escape[6] = { '\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xf] };
+        json_write(json, escape, sizeof(escape));
+      }
+    }
+  }
+  json_write(json, run, strlen(run));
+  json_write_char(json, '"');
+}
+
+static inline void json_begin(struct json_writer* json, char open) {
+  json_separate(json);
+  json_write_char(json, open);
+  json->depth++;
+  json->has_value &= ~(1u << (json->depth % JSON_MAX_DEPTH));
+}
+
+static inline void json_end(struct json_writer* json, char close) {
+  if (json->depth > 0) json->depth--;
+  json_write_char(json, close);
+}
+
+static inline void json_object_begin(struct json_writer* json) { json_begin(json, '{'); }
+static inline void json_object_end(struct json_writer* json) { json_end(json, '}'); }
+static inline void json_array_begin(struct json_writer* json) { json_begin(json, '['); }
+static inline void json_array_end(struct json_writer* json) { json_end(json, ']'); }
+
+static inline void json_key(struct json_writer* json, const char* key) {
+  json_separate(json);
+  json_write_escaped(json, key);
+  json_write_char(json, ':');
+  json->after_key = true;
+}
+
+static inline void json_string(struct json_writer* json, const char* value) {
+  json_separate(json);
+  json_write_escaped(json, value);
+}
+
+static inline void json_bool(struct json_writer* json, bool value) {
+  json_separate(json);
+  if (value) json_write(json, "true", 4);
+  else json_write(json, "false", 5);
+}
+
+static inline void json_null(struct json_writer* json) {
+  json_separate(json);
+  json_write(json, "null", 4);
+}
+
+static inline void json_int(struct json_writer* json, int64_t value) {
+  json_separate(json);
+  char digits[20];
+  int count = 0;
+  uint64_t magnitude = value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+  do {
+    digits[count++] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+
+  char text[21];
+  int len = 0;
+  if (value < 0) text[len++] = '-';
+  while (count > 0) text[len++] = digits[--count];
+  json_write(json, text, len);
+}
+
+// Integral values are written as integers; non-finite values have no JSON
+// representation and are written as null.
+static inline void json_double(struct json_writer* json, double value) {
+  if (!isfinite(value)) {
+    json_null(json);
+    return;
+  }
+  if (fabs(value) < 1e15 && value == (double)(int64_t)value) {
+    json_int(json, (int64_t)value);
+    return;
+  }
+  json_separate(json);
+  char text[32];
+  int len = snprintf(text, sizeof(text), "%.15g", value);
+  if (len > 0) json_write(json, text, len);
+}
+
+static inline void json_field_string(struct json_writer* json, const char* key, const char* value) {
+  json_key(json, key);
+  json_string(json, value);
+}
+
+static inline void json_field_int(struct json_writer* json, const char* key, int64_t value) {
+  json_key(json, key);
+  json_int(json, value);
+}
+
+static inline void json_field_double(struct json_writer* json, const char* key, double value) {
+  json_key(json, key);
+  json_double(json, value);
+}
+
+static inline void json_field_bool(struct json_writer* json, const char* key, bool value) {
+  json_key(json, key);
+  json_bool(json, value);
+}
+
+// Terminates the document with a newline and flushes it. Returns false if
+// output was lost.
+static inline bool json_finish(struct json_writer* json, bool newline) {
+  if (newline) json_write_char(json, '\n');
+  return json_flush(json) && !json->overflow;
+}
@@ -0,0 +1,227 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include "string_map.h"
+
+// Index of the menu bar extra windows (layer 0x19) by their "owner" and
+// "owner,name" aliases. Window descriptions are only fetched for window ids
+// the index has not seen yet, so refreshing it in the resident server costs
+// a single id listing when nothing changed. Positions are not indexed: they
+// shift whenever another extra appears, and are read fresh for the few
+// windows matching a lookup.
+//
+// The windows are read through a source: the window server in menus.c, an
+// in-memory window list in the tests and the benchmark.
+
+#define EXTRAS_LAYER 0x19
+#define EXTRAS_MAX_MATCHES 32
+
+struct extras_window {
+  uint32_t id;
+  pid_t pid;
+  bool is_extra;
+  char owner[256];
+  char name[256];
+};
+
+struct extras_source {
+  void* context;
+  // Ids of every window, in any order and possibly repeated; NULL on
+  // failure. The caller frees the list.
+  uint32_t* (*copy_ids)(void* context, uint32_t* count);
+  // Describes windows sorted by id with only the id set: the ones on the
+  // extras layer get their owner, name and pid and are marked is_extra
+  void (*describe)(void* context, struct extras_window* windows, uint32_t count);
+  // Current x positions of the windows still present, returns their count
+  int (*positions)(void* context, const uint32_t* ids, uint32_t count, double* xs);
+};
+
+struct extras_alias {
+  pid_t pid;
+  uint32_t count;
+  uint32_t ids[EXTRAS_MAX_MATCHES];
+};
+
+struct extras_index {
+  const struct extras_source* source;
+
+  // Every window seen so far, sorted by id
+  struct extras_window* windows;
+  uint32_t window_count;
+  uint32_t window_capacity;
+
+  struct extras_alias* aliases;
+  uint32_t alias_count;
+  uint32_t alias_capacity;
+  struct string_map alias_map;
+};
+
+static int extras_compare_id(const void* a, const void* b) {
+  uint32_t lhs = *(const uint32_t*)a;
+  uint32_t rhs = *(const uint32_t*)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static int extras_compare_window(const void* a, const void* b) {
+  return extras_compare_id(&((const struct extras_window*)a)->id,
+                           &((const struct extras_window*)b)->id);
+}
+
+static inline void extras_index_free(struct extras_index* index) {
+  const struct extras_source* source = index->source;
+  free(index->windows);
+  free(index->aliases);
+  string_map_free(&index->alias_map);
+  memset(index, 0, sizeof(struct extras_index));
+  index->source = source;
+}
+
+// Forgets every window, so the next refresh describes the full list again
+static inline void extras_index_reset(struct extras_index* index) {
+  index->window_count = 0;
+  index->alias_count = 0;
+  string_map_clear(&index->alias_map);
+}
+
+static inline void extras_index_add_alias(struct extras_index* index,
+                                          const char* alias,
+                                          const struct extras_window* window) {
+  if (index->alias_count == index->alias_capacity) {
+    uint32_t capacity = index->alias_capacity ? index->alias_capacity * 2 : 64;
+    struct extras_alias* aliases = realloc(index->aliases,
+                                           capacity * sizeof(struct extras_alias));
+    if (!aliases) return;
+    index->aliases = aliases;
+    index->alias_capacity = capacity;
+  }
+
+  uint32_t slot = index->alias_count;
+  if (string_map_put(&index->alias_map, alias, &slot)) {
+    index->aliases[slot].pid = window->pid;
+    index->aliases[slot].count = 0;
+    index->alias_count++;
+  } else if (slot >= index->alias_count) {
+    return;
+  }
+
+  struct extras_alias* entry = &index->aliases[slot];
+  if (entry->count < EXTRAS_MAX_MATCHES) entry->ids[entry->count++] = window->id;
+}
+
+static inline void extras_index_rebuild_aliases(struct extras_index* index) {
+  string_map_clear(&index->alias_map);
+  index->alias_count = 0;
+
+  char buffer[512];
+  for (uint32_t i = 0; i < index->window_count; i++) {
+    const struct extras_window* window = &index->windows[i];
+    if (!window->is_extra) continue;
+    extras_index_add_alias(index, window->owner, window);
+    if (window->name[0] != '\0') {
+      snprintf(buffer, sizeof(buffer), "%s,%s", window->owner, window->name);
+      extras_index_add_alias(index, buffer, window);
+    }
+  }
+}
+
+// Brings the index up to date with the current window list: windows that
+// are gone are dropped and only the new ones are described.
+static inline bool extras_index_refresh(struct extras_index* index) {
+  const struct extras_source* source = index->source;
+  uint32_t count = 0;
+  uint32_t* current = source->copy_ids(source->context, &count);
+  if (!current) return false;
+  uint32_t* added = malloc((count ? count : 1) * sizeof(uint32_t));
+  if (!added) {
+    free(current);
+    return false;
+  }
+  qsort(current, count, sizeof(uint32_t), extras_compare_id);
+
+  // Merge the sorted id lists, compacting the windows still present in place
+  bool changed = false;
+  uint32_t kept = 0;
+  uint32_t added_count = 0;
+  uint32_t w = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (i > 0 && current[i] == current[i - 1]) continue;
+    while (w < index->window_count && index->windows[w].id < current[i]) {
+      changed |= index->windows[w].is_extra;
+      w++;
+    }
+    if (w < index->window_count && index->windows[w].id == current[i]) {
+      index->windows[kept++] = index->windows[w++];
+    } else {
+      added[added_count++] = current[i];
+    }
+  }
+  for (; w < index->window_count; w++) changed |= index->windows[w].is_extra;
+  index->window_count = kept;
+  free(current);
+
+  if (added_count > 0) {
+    uint32_t needed = kept + added_count;
+    if (needed > index->window_capacity) {
+      struct extras_window* windows = realloc(index->windows,
+                                              needed * sizeof(struct extras_window));
+      if (!windows) {
+        free(added);
+        extras_index_rebuild_aliases(index);
+        return false;
+      }
+      index->windows = windows;
+      index->window_capacity = needed;
+    }
+
+    // New ids are remembered even when they are not extras (or could not be
+    // described), so they are not described again on the next refresh
+    struct extras_window* fresh = &index->windows[kept];
+    for (uint32_t i = 0; i < added_count; i++) {
+      memset(&fresh[i], 0, sizeof(struct extras_window));
+      fresh[i].id = added[i];
+    }
+    source->describe(source->context, fresh, added_count);
+    for (uint32_t i = 0; i < added_count; i++) changed |= fresh[i].is_extra;
+
+    index->window_count = needed;
+    qsort(index->windows, needed, sizeof(struct extras_window), extras_compare_window);
+  }
+  free(added);
+
+  if (changed || index->alias_map.count == 0) extras_index_rebuild_aliases(index);
+  return true;
+}
+
+// Resolves an alias to the owning pid and the current x positions of its
+// extra windows ("owner,name" aliases only use their first window).
+static inline pid_t extras_index_lookup(struct extras_index* index,
+                                        const char* alias,
+                                        bool owner_only,
+                                        double* xs,
+                                        int* xs_count) {
+  *xs_count = 0;
+  uint32_t slot = 0;
+  if (!string_map_get(&index->alias_map, alias, &slot)) return 0;
+
+  const struct extras_alias* entry = &index->aliases[slot];
+  uint32_t count = owner_only ? entry->count : (entry->count > 0 ? 1 : 0);
+  if (count == 0) return entry->pid;
+
+  const struct extras_source* source = index->source;
+  *xs_count = source->positions(source->context, entry->ids, count, xs);
+  return entry->pid;
+}
+
+// Case-insensitive owner match for aliases typed by hand
+static inline pid_t extras_index_find_owner(struct extras_index* index, const char* owner) {
+  for (uint32_t i = 0; i < index->window_count; i++) {
+    const struct extras_window* window = &index->windows[i];
+    if (window->is_extra && strcasecmp(window->owner, owner) == 0) return window->pid;
+  }
+  return 0;
+}
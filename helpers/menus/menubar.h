@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// The front app's menu bar, read through a provider: the accessibility API
+// in menus.c, an in-memory tree in the tests and the benchmark. Elements are
+// opaque here and released through the provider.
+
+struct menus_provider {
+  void* context;
+  pid_t (*front_pid)(void* context);
+  // The menu bar of the app, NULL if it has none
+  void* (*copy_menubar)(void* context, pid_t pid);
+  // The visible items of a menu bar, NULL if the menu bar is stale
+  void* (*copy_items)(void* context, void* menubar, int* count);
+  // UTF-8 title of an item, false if it has none
+  bool (*item_title)(void* context, void* items, int index, char* buffer, size_t size);
+  void* (*copy_item)(void* context, void* items, int index);
+  void (*release)(void* context, void* element);
+};
+
+// The front app's menu bar element, kept across requests by the resident
+// server. It is dropped as soon as another app is in front, or when the
+// element turns out to be stale.
+struct menubar_cache {
+  const struct menus_provider* provider;
+  pid_t pid;
+  void* menubar;
+};
+
+static inline void menubar_cache_clear(struct menubar_cache* cache) {
+  const struct menus_provider* provider = cache->provider;
+  if (cache->menubar) provider->release(provider->context, cache->menubar);
+  cache->menubar = NULL;
+  cache->pid = 0;
+}
+
+static inline void* menubar_cache_get(struct menubar_cache* cache) {
+  const struct menus_provider* provider = cache->provider;
+  pid_t pid = provider->front_pid(provider->context);
+  if (cache->menubar && cache->pid == pid) return cache->menubar;
+
+  menubar_cache_clear(cache);
+  cache->menubar = provider->copy_menubar(provider->context, pid);
+  if (cache->menubar) cache->pid = pid;
+  return cache->menubar;
+}
+
+static inline void* menubar_copy_items(struct menubar_cache* cache, int* count) {
+  const struct menus_provider* provider = cache->provider;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    void* menubar = menubar_cache_get(cache);
+    if (!menubar) return NULL;
+
+    void* items = provider->copy_items(provider->context, menubar, count);
+    if (items) return items;
+    menubar_cache_clear(cache);
+  }
+  return NULL;
+}
+
+// -l: the titles of the menus, one per line, without the Apple menu
+static inline void menubar_list(struct menubar_cache* cache, FILE* out) {
+  const struct menus_provider* provider = cache->provider;
+  int count = 0;
+  void* items = menubar_copy_items(cache, &count);
+  if (!items) return;
+
+  char title[512];
+  for (int i = 1; i < count; i++) {
+    if (provider->item_title(provider->context, items, i, title, sizeof(title))) {
+      fprintf(out, "%s\n", title);
+    } else {
+      fprintf(out, "•\n");
+    }
+  }
+  provider->release(provider->context, items);
+}
+
+// -s <id>: the menu bar item to press, NULL if there is none
+static inline void* menubar_copy_item(struct menubar_cache* cache, int id) {
+  const struct menus_provider* provider = cache->provider;
+  int count = 0;
+  void* items = menubar_copy_items(cache, &count);
+  if (!items) return NULL;
+
+  void* item = NULL;
+  if (id >= 0 && id < count) item = provider->copy_item(provider->context, items, id);
+  provider->release(provider->context, items);
+  return item;
+}
@@ -1,5 +1,6 @@
 #include <ApplicationServices/ApplicationServices.h>
 #include <Carbon/Carbon.h>
+#include <dispatch/dispatch.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -7,6 +8,12 @@
 #include <string.h>
 #include <strings.h>
 #include <math.h>
+#include <signal.h>
+
+#include "../impact.h"
+#include "../socket.h"
+#include "extras_index.h"
+#include "menubar.h"
 
 void ax_init() {
   const void *keys[] = { kAXTrustedCheckOptionPrompt };
@@ -99,96 +106,8 @@ CFStringRef ax_get_title(AXUIElementRef element) {
   return title;
 }
 
-void ax_select_menu_option(AXUIElementRef app, int id) {
-  AXUIElementRef menubars_ref = NULL;
-  CFArrayRef children_ref = NULL;
-
-  AXError error = AXUIElementCopyAttributeValue(app,
-                                                kAXMenuBarAttribute,
-                                                (CFTypeRef*)&menubars_ref);
-  if (error == kAXErrorSuccess) {
-    error = AXUIElementCopyAttributeValue(menubars_ref,
-                                          kAXVisibleChildrenAttribute,
-                                          (CFTypeRef*)&children_ref   );
-
-    if (error == kAXErrorSuccess) {
-      uint32_t count = CFArrayGetCount(children_ref);
-      if (id < count) {
-        AXUIElementRef item = CFArrayGetValueAtIndex(children_ref, id);
-        ax_perform_click(item);
-      }
-      if (children_ref) CFRelease(children_ref);
-    }
-    if (menubars_ref) CFRelease(menubars_ref);
-  }
-}
-
-void ax_print_menu_options(AXUIElementRef app) {
-  AXUIElementRef menubars_ref = NULL;
-  CFTypeRef menubar = NULL;
-  CFArrayRef children_ref = NULL;
-
-  AXError error = AXUIElementCopyAttributeValue(app,
-                                                kAXMenuBarAttribute,
-                                                (CFTypeRef*)&menubars_ref);
-  if (error == kAXErrorSuccess) {
-    error = AXUIElementCopyAttributeValue(menubars_ref,
-                                          kAXVisibleChildrenAttribute,
-                                          (CFTypeRef*)&children_ref   );
-
-    if (error == kAXErrorSuccess) {
-      uint32_t count = CFArrayGetCount(children_ref);
-
-      for (int i = 1; i < count; i++) {
-        AXUIElementRef item = CFArrayGetValueAtIndex(children_ref, i);
-        CFTypeRef title = ax_get_title(item);
-
-        if (title && CFGetTypeID(title) == CFStringGetTypeID()) {
-          // Ensure sufficient buffer for UTF-8 (up to 4 bytes per code unit + NUL)
-          CFIndex length = CFStringGetLength((CFStringRef)title);
-          CFIndex max_len = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8) + 1;
-          char buffer[max_len];
-          Boolean ok = CFStringGetCString((CFStringRef)title, buffer, max_len, kCFStringEncodingUTF8);
-          if (ok) {
-            printf("%s\n", buffer);
-          } else {
-            // Fallback: use external representation to UTF-8 and write bytes directly
-            CFDataRef data = CFStringCreateExternalRepresentation(kCFAllocatorDefault,
-                                                                  (CFStringRef)title,
-                                                                  kCFStringEncodingUTF8,
-                                                                  0);
-            if (data) {
-              fwrite(CFDataGetBytePtr(data), 1, CFDataGetLength(data), stdout);
-              fputc('\n', stdout);
-              CFRelease(data);
-            }
-          }
-          CFRelease(title);
-        } else {
-          printf("•\n");
-        }
-      }
-    }
-    if (menubars_ref) CFRelease(menubars_ref);
-    if (children_ref) CFRelease(children_ref);
-  }
-}
-
-static bool remember_value(char seen[][512], int *seen_count, const char *value) {
-  if (!value || !*value) return false;
-  for (int i = 0; i < *seen_count; i++) {
-    if (strcmp(seen[i], value) == 0) return false;
-  }
-  if (*seen_count >= 256) return false;
-  strncpy(seen[*seen_count], value, sizeof(seen[*seen_count]) - 1);
-  seen[*seen_count][sizeof(seen[*seen_count]) - 1] = '\0';
-  (*seen_count)++;
-  return true;
-}
-
-void ax_print_menu_extras() {
-  char seen[256][512];
-  int seen_count = 0;
+void ax_print_menu_extras(FILE* out) {
+  struct string_map seen = { 0 };
 
   ProcessSerialNumber psn = {0, kNoProcess};
   while (GetNextProcess(&psn) == noErr) {
@@ -245,8 +164,8 @@ void ax_print_menu_extras() {
       continue;
     }
 
-    if (remember_value(seen, &seen_count, owner_buffer)) {
-      printf("%s\n", owner_buffer);
+    if (string_set_add(&seen, owner_buffer)) {
+      fprintf(out, "%s\n", owner_buffer);
     }
 
     char buffer[512];
@@ -266,8 +185,8 @@ void ax_print_menu_extras() {
                              kCFStringEncodingUTF8)) {
         if (name_buffer[0] != '\0') {
           snprintf(buffer, sizeof(buffer), "%s,%s", owner_buffer, name_buffer);
-          if (remember_value(seen, &seen_count, buffer)) {
-            printf("%s\n", buffer);
+          if (string_set_add(&seen, buffer)) {
+            fprintf(out, "%s\n", buffer);
           }
         }
       }
@@ -278,6 +197,7 @@ void ax_print_menu_extras() {
     CFRelease(extras);
     CFRelease(app);
   }
+  string_map_free(&seen);
 }
 
 static AXUIElementRef ax_get_extra_item_for_pid(pid_t target_pid, const double *xs, int xs_count, bool owner_only) {
@@ -338,77 +258,22 @@ static AXUIElementRef ax_get_extra_item_for_pid(pid_t target_pid, const double *
   return result;
 }
 
-AXUIElementRef ax_get_extra_menu_item(char* alias) {
+AXUIElementRef ax_get_extra_menu_item(struct extras_index* index, char* alias) {
   if (!alias || !*alias) return NULL;
   bool owner_only = strchr(alias, ',') == NULL;
 
-  pid_t pid = 0;
-  double match_x[32];
+  double match_x[EXTRAS_MAX_MATCHES];
   int match_x_count = 0;
-
-  CFArrayRef window_list = CGWindowListCopyWindowInfo(kCGWindowListOptionAll,
-                                                      kCGNullWindowID        );
-  if (!window_list) return NULL;
-  char owner_buffer[256];
-  char name_buffer[256];
-  char buffer[512];
-  int window_count = CFArrayGetCount(window_list);
-  for (int i = 0; i < window_count; ++i) {
-    CFDictionaryRef dictionary = CFArrayGetValueAtIndex(window_list, i);
-    if (!dictionary) continue;
-
-    CFStringRef owner_ref = CFDictionaryGetValue(dictionary,
-                                                 kCGWindowOwnerName);
-
-    CFNumberRef owner_pid_ref = CFDictionaryGetValue(dictionary,
-                                                     kCGWindowOwnerPID);
-
-    CFStringRef name_ref = CFDictionaryGetValue(dictionary, kCGWindowName);
-    CFNumberRef layer_ref = CFDictionaryGetValue(dictionary, kCGWindowLayer);
-    CFDictionaryRef bounds_ref = CFDictionaryGetValue(dictionary,
-                                                      kCGWindowBounds);
-
-    if (!owner_ref || !owner_pid_ref || !layer_ref || !bounds_ref)
-      continue;
-    if (!owner_only && !name_ref)
-      continue;
-
-    long long int layer = 0;
-    CFNumberGetValue(layer_ref, CFNumberGetType(layer_ref), &layer);
-    uint64_t owner_pid = 0;
-    CFNumberGetValue(owner_pid_ref,
-                     CFNumberGetType(owner_pid_ref),
-                     &owner_pid                     );
-
-    if (layer != 0x19) continue;
-    CGRect bounds = CGRectNull;
-    if (!CGRectMakeWithDictionaryRepresentation(bounds_ref, &bounds)) continue;
-    CFStringGetCString(owner_ref,
-                       owner_buffer,
-                       sizeof(owner_buffer),
-                       kCFStringEncodingUTF8);
-
-    bool match = false;
-    if (owner_only) {
-      match = strcmp(owner_buffer, alias) == 0;
-    } else {
-      CFStringGetCString(name_ref,
-                         name_buffer,
-                         sizeof(name_buffer),
-                         kCFStringEncodingUTF8);
-      snprintf(buffer, sizeof(buffer), "%s,%s", owner_buffer, name_buffer);
-      match = strcmp(buffer, alias) == 0;
-    }
-
-    if (match) {
-      pid = owner_pid;
-      if (match_x_count < (int)(sizeof(match_x) / sizeof(match_x[0]))) {
-        match_x[match_x_count++] = bounds.origin.x;
-      }
-      if (!owner_only) break;
-    }
+  bool built = index->window_count == 0;
+  extras_index_refresh(index);
+  pid_t pid = extras_index_lookup(index, alias, owner_only, match_x, &match_x_count);
+
+  // A long lived index may have missed a renamed extra, rebuild it once
+  if (!pid && !built) {
+    extras_index_reset(index);
+    extras_index_refresh(index);
+    pid = extras_index_lookup(index, alias, owner_only, match_x, &match_x_count);
   }
-  CFRelease(window_list);
 
   if (pid) {
     AXUIElementRef item = ax_get_extra_item_for_pid(pid, match_x, match_x_count, owner_only);
@@ -422,6 +287,13 @@ AXUIElementRef ax_get_extra_menu_item(char* alias) {
   if (!owner_only) return NULL;
 
   // Fallback: resolve PID by app name and click its first extra.
+  pid = extras_index_find_owner(index, alias);
+  if (pid) {
+    AXUIElementRef item = ax_get_extra_item_for_pid(pid, NULL, 0, owner_only);
+    if (item) return item;
+  }
+
+  // Apps whose extras have no window of their own are only found by process
   ProcessSerialNumber psn = {0, kNoProcess};
   while (GetNextProcess(&psn) == noErr) {
     CFStringRef proc_name = NULL;
@@ -449,23 +321,48 @@ extern int SLSMainConnectionID();
 extern void SLSSetMenuBarVisibilityOverrideOnDisplay(int cid, int did, bool enabled);
 extern void SLSSetMenuBarVisibilityOverrideOnDisplay(int cid, int did, bool enabled);
 extern void SLSSetMenuBarInsetAndAlpha(int cid, double u1, double u2, float alpha);
-int ax_select_menu_extra(char* alias) {
-  AXUIElementRef item = ax_get_extra_menu_item(alias);
+// A press waiting to run: pressing a menu can block until the menu is
+// closed again, so the resident server answers its client first and runs
+// the press on a queue of its own, while it goes on serving requests.
+struct click {
+  AXUIElementRef item;
+  // Menu bar extras are pressed with the menu bar forced visible
+  bool extra;
+};
+
+static void click_perform(struct click* click) {
+  if (!click->item) return;
+  if (click->extra) {
+    SLSSetMenuBarInsetAndAlpha(SLSMainConnectionID(), 0, 1, 0.0);
+    SLSSetMenuBarVisibilityOverrideOnDisplay(SLSMainConnectionID(), 0, true);
+    SLSSetMenuBarInsetAndAlpha(SLSMainConnectionID(), 0, 1, 0.0);
+  }
+  ax_perform_click(click->item);
+  if (click->extra) {
+    SLSSetMenuBarVisibilityOverrideOnDisplay(SLSMainConnectionID(), 0, false);
+    SLSSetMenuBarInsetAndAlpha(SLSMainConnectionID(), 0, 1, 1.0);
+  }
+  CFRelease(click->item);
+  click->item = NULL;
+}
+
+static void click_run(void* context) {
+  click_perform(context);
+  free(context);
+}
+
+int ax_select_menu_extra(struct extras_index* index, char* alias, struct click* click) {
+  AXUIElementRef item = ax_get_extra_menu_item(index, alias);
   if (!item) return 2;
-  SLSSetMenuBarInsetAndAlpha(SLSMainConnectionID(), 0, 1, 0.0);
-  SLSSetMenuBarVisibilityOverrideOnDisplay(SLSMainConnectionID(), 0, true);
-  SLSSetMenuBarInsetAndAlpha(SLSMainConnectionID(), 0, 1, 0.0);
-  ax_perform_click(item);
-  SLSSetMenuBarVisibilityOverrideOnDisplay(SLSMainConnectionID(), 0, false);
-  SLSSetMenuBarInsetAndAlpha(SLSMainConnectionID(), 0, 1, 1.0);
-  CFRelease(item);
+  click->item = item;
+  click->extra = true;
   return 0;
 }
 
 extern void _SLPSGetFrontProcess(ProcessSerialNumber* psn);
 extern void SLSGetConnectionIDForPSN(int cid, ProcessSerialNumber* psn, int* cid_out);
 extern void SLSConnectionGetPID(int cid, pid_t* pid_out);
-AXUIElementRef ax_get_front_app() {
+pid_t ax_get_front_pid() {
   ProcessSerialNumber psn;
   _SLPSGetFrontProcess(&psn);
   int target_cid;
@@ -473,35 +370,324 @@ AXUIElementRef ax_get_front_app() {
 
   pid_t pid;
   SLSConnectionGetPID(target_cid, &pid);
-  return AXUIElementCreateApplication(pid);
+  return pid;
 }
 
-int main (int argc, char **argv) {
-  if (argc == 1) {
-    printf("Usage: %s [-l | -s id/alias | -x ]\n", argv[0]);
-    exit(0);
+// The menu bar provider of menus.c, on the accessibility API
+static pid_t ax_provider_front_pid(void* context) {
+  (void)context;
+  return ax_get_front_pid();
+}
+
+static void* ax_provider_copy_menubar(void* context, pid_t pid) {
+  (void)context;
+  AXUIElementRef app = AXUIElementCreateApplication(pid);
+  if (!app) return NULL;
+
+  AXUIElementRef menubar = NULL;
+  if (AXUIElementCopyAttributeValue(app,
+                                    kAXMenuBarAttribute,
+                                    (CFTypeRef*)&menubar) != kAXErrorSuccess) {
+    menubar = NULL;
   }
-  ax_init();
-  if (strcmp(argv[1], "-l") == 0) {
-    AXUIElementRef app = ax_get_front_app();
-    if (!app) return 1;
-    ax_print_menu_options(app);
-    CFRelease(app);
+  CFRelease(app);
+  return (void*)menubar;
+}
+
+static void* ax_provider_copy_items(void* context, void* menubar, int* count) {
+  (void)context;
+  CFArrayRef children_ref = NULL;
+  if (AXUIElementCopyAttributeValue(menubar,
+                                    kAXVisibleChildrenAttribute,
+                                    (CFTypeRef*)&children_ref   ) != kAXErrorSuccess
+      || !children_ref) {
+    return NULL;
+  }
+  *count = (int)CFArrayGetCount(children_ref);
+  return (void*)children_ref;
+}
+
+static bool ax_provider_item_title(void* context,
+                                   void* items,
+                                   int index,
+                                   char* buffer,
+                                   size_t size    ) {
+  (void)context;
+  AXUIElementRef item = CFArrayGetValueAtIndex(items, index);
+  CFTypeRef title = ax_get_title(item);
+  if (!title) return false;
+  if (CFGetTypeID(title) != CFStringGetTypeID()) {
+    CFRelease(title);
+    return false;
+  }
+
+  if (!CFStringGetCString((CFStringRef)title, buffer, size, kCFStringEncodingUTF8)) {
+    // Too long for the buffer: as many whole characters as fit
+    CFIndex used = 0;
+    CFStringGetBytes((CFStringRef)title,
+                     CFRangeMake(0, CFStringGetLength((CFStringRef)title)),
+                     kCFStringEncodingUTF8,
+                     0,
+                     false,
+                     (UInt8*)buffer,
+                     size - 1,
+                     &used                                                  );
+    buffer[used] = '\0';
+  }
+  CFRelease(title);
+  return true;
+}
+
+static void* ax_provider_copy_item(void* context, void* items, int index) {
+  (void)context;
+  return (void*)CFRetain(CFArrayGetValueAtIndex(items, index));
+}
+
+static void ax_provider_release(void* context, void* element) {
+  (void)context;
+  CFRelease(element);
+}
+
+static const struct menus_provider g_ax_provider = {
+  .front_pid = ax_provider_front_pid,
+  .copy_menubar = ax_provider_copy_menubar,
+  .copy_items = ax_provider_copy_items,
+  .item_title = ax_provider_item_title,
+  .copy_item = ax_provider_copy_item,
+  .release = ax_provider_release,
+};
+
+static CFArrayRef cg_copy_descriptions(const uint32_t* ids, uint32_t count) {
+  const void** values = malloc(count * sizeof(void*));
+  if (!values) return NULL;
+  for (uint32_t i = 0; i < count; i++) values[i] = (const void*)(uintptr_t)ids[i];
+
+  CFArrayRef id_array = CFArrayCreate(NULL, values, count, NULL);
+  free(values);
+  if (!id_array) return NULL;
+  CFArrayRef descriptions = CGWindowListCreateDescriptionFromArray(id_array);
+  CFRelease(id_array);
+  return descriptions;
+}
+
+static void cg_fill_window(struct extras_window* window, CFDictionaryRef dictionary) {
+  CFStringRef owner_ref = CFDictionaryGetValue(dictionary, kCGWindowOwnerName);
+  CFNumberRef owner_pid_ref = CFDictionaryGetValue(dictionary, kCGWindowOwnerPID);
+  CFStringRef name_ref = CFDictionaryGetValue(dictionary, kCGWindowName);
+  CFNumberRef layer_ref = CFDictionaryGetValue(dictionary, kCGWindowLayer);
+  if (!owner_ref || !owner_pid_ref || !layer_ref) return;
+
+  long long int layer = 0;
+  CFNumberGetValue(layer_ref, CFNumberGetType(layer_ref), &layer);
+  if (layer != EXTRAS_LAYER) return;
+
+  int64_t owner_pid = 0;
+  CFNumberGetValue(owner_pid_ref, kCFNumberSInt64Type, &owner_pid);
+  if (!CFStringGetCString(owner_ref,
+                          window->owner,
+                          sizeof(window->owner),
+                          kCFStringEncodingUTF8) || window->owner[0] == '\0') {
+    return;
+  }
+  if (!name_ref || !CFStringGetCString(name_ref,
+                                       window->name,
+                                       sizeof(window->name),
+                                       kCFStringEncodingUTF8)) {
+    window->name[0] = '\0';
+  }
+  window->pid = (pid_t)owner_pid;
+  window->is_extra = true;
+}
+
+static uint32_t* cg_source_copy_ids(void* context, uint32_t* count) {
+  (void)context;
+  CFArrayRef id_list = CGWindowListCreate(kCGWindowListOptionAll, kCGNullWindowID);
+  if (!id_list) return NULL;
+
+  *count = CFArrayGetCount(id_list);
+  uint32_t* ids = malloc((*count ? *count : 1) * sizeof(uint32_t));
+  if (ids) {
+    for (uint32_t i = 0; i < *count; i++) {
+      ids[i] = (CGWindowID)(uintptr_t)CFArrayGetValueAtIndex(id_list, i);
+    }
+  }
+  CFRelease(id_list);
+  return ids;
+}
+
+static int cg_compare_window(const void* a, const void* b) {
+  uint32_t lhs = ((const struct extras_window*)a)->id;
+  uint32_t rhs = ((const struct extras_window*)b)->id;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+// One description request for all new windows; the descriptions come back
+// in no particular order and without the windows that are already gone
+static void cg_source_describe(void* context, struct extras_window* windows, uint32_t count) {
+  (void)context;
+  uint32_t* ids = malloc(count * sizeof(uint32_t));
+  if (!ids) return;
+  for (uint32_t i = 0; i < count; i++) ids[i] = windows[i].id;
+  CFArrayRef descriptions = cg_copy_descriptions(ids, count);
+  free(ids);
+  if (!descriptions) return;
+
+  CFIndex described = CFArrayGetCount(descriptions);
+  for (CFIndex i = 0; i < described; i++) {
+    CFDictionaryRef dictionary = CFArrayGetValueAtIndex(descriptions, i);
+    CFNumberRef number_ref = dictionary
+                             ? CFDictionaryGetValue(dictionary, kCGWindowNumber)
+                             : NULL;
+    if (!number_ref) continue;
+
+    int64_t number = 0;
+    CFNumberGetValue(number_ref, kCFNumberSInt64Type, &number);
+    struct extras_window key = { .id = (CGWindowID)number };
+    struct extras_window* window = bsearch(&key,
+                                           windows,
+                                           count,
+                                           sizeof(struct extras_window),
+                                           cg_compare_window            );
+    if (window) cg_fill_window(window, dictionary);
+  }
+  CFRelease(descriptions);
+}
+
+static int cg_source_positions(void* context, const uint32_t* ids, uint32_t count, double* xs) {
+  (void)context;
+  CFArrayRef descriptions = cg_copy_descriptions(ids, count);
+  if (!descriptions) return 0;
+
+  int xs_count = 0;
+  CFIndex described = CFArrayGetCount(descriptions);
+  for (CFIndex i = 0; i < described && xs_count < EXTRAS_MAX_MATCHES; i++) {
+    CFDictionaryRef dictionary = CFArrayGetValueAtIndex(descriptions, i);
+    CFDictionaryRef bounds_ref = dictionary
+                                 ? CFDictionaryGetValue(dictionary, kCGWindowBounds)
+                                 : NULL;
+    CGRect bounds = CGRectNull;
+    if (!bounds_ref || !CGRectMakeWithDictionaryRepresentation(bounds_ref, &bounds)) {
+      continue;
+    }
+    xs[xs_count++] = bounds.origin.x;
+  }
+  CFRelease(descriptions);
+  return xs_count;
+}
+
+static const struct extras_source g_cg_extras_source = {
+  .copy_ids = cg_source_copy_ids,
+  .describe = cg_source_describe,
+  .positions = cg_source_positions,
+};
+
+// Lookup state kept across requests by the resident server
+struct menus_state {
+  struct menubar_cache menubar;
+  struct extras_index extras;
+};
+
+// Runs a request; a press it asks for is left in click for the caller
+static int run_command(struct menus_state* state,
+                       int argc,
+                       char** argv,
+                       FILE* out,
+                       struct click* click) {
+  if (argc < 1) return 1;
+
+  if (strcmp(argv[0], "-l") == 0) {
+    menubar_list(&state->menubar, out);
     return 0;
-  } else if (strcmp(argv[1], "-x") == 0) {
-    ax_print_menu_extras();
+  } else if (strcmp(argv[0], "-x") == 0) {
+    ax_print_menu_extras(out);
     return 0;
-  } else if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+  } else if (argc == 2 && strcmp(argv[0], "-s") == 0) {
     int id = 0;
-    if (sscanf(argv[2], "%d", &id) == 1) {
-      AXUIElementRef app = ax_get_front_app();
-      if (!app) return 1;
-      ax_select_menu_option(app, id);
-      CFRelease(app);
+    if (sscanf(argv[1], "%d", &id) == 1) {
+      click->item = menubar_copy_item(&state->menubar, id);
+      click->extra = false;
       return 0;
     } else {
-      return ax_select_menu_extra(argv[2]);
+      return ax_select_menu_extra(&state->extras, argv[1], click);
     }
   }
   return 1;
 }
+
+// Resident mode: one process with accessibility already initialized
+// answers the -l/-s/-x requests of later invocations over a unix socket.
+static int run_server() {
+  char path[128];
+  int listen_fd = socket_path(path, sizeof(path), "menus") ? socket_listen(path, 0600) : -1;
+  if (listen_fd < 0) {
+    fprintf(stderr, "Failed to listen on %s\n", path);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  struct menus_state state = {
+    .menubar.provider = &g_ax_provider,
+    .extras.source = &g_cg_extras_source
+  };
+  dispatch_queue_t clicks = dispatch_queue_create("menus.click", DISPATCH_QUEUE_SERIAL);
+  for (;;) {
+    char request[1024];
+    int client = socket_accept_request(listen_fd, request, sizeof(request));
+    if (client < 0) continue;
+
+    char* args[4];
+    int count = socket_split_args(request, args, 4);
+    char* output = NULL;
+    size_t output_len = 0;
+    FILE* out = open_memstream(&output, &output_len);
+    struct click click = { 0 };
+    int exit_code = out ? run_command(&state, count, args, out, &click) : 1;
+    if (out) fclose(out);
+    socket_reply(client, exit_code, output, output_len);
+    free(output);
+
+    if (click.item) {
+      struct click* pending = malloc(sizeof(struct click));
+      if (pending) {
+        *pending = click;
+        dispatch_async_f(clicks, pending, click_run);
+      } else {
+        CFRelease(click.item);
+      }
+    }
+  }
+  return 0;
+}
+
+int main (int argc, char **argv) {
+  impact_apply();
+  if (argc == 1) {
+    printf("Usage: %s [-l | -s id/alias | -x | -d ]\n", argv[0]);
+    exit(0);
+  }
+
+  if (strcmp(argv[1], "-d") == 0) {
+    ax_init();
+    return run_server();
+  }
+
+  // Prefer the resident server, fall back to doing the work in-process
+  char path[128];
+  char request[1024];
+  socket_join_args(argc - 1, argv + 1, request, sizeof(request));
+  int exit_code = socket_path(path, sizeof(path), "menus")
+                  ? socket_forward(path, request, stdout, stderr)
+                  : -1;
+  if (exit_code >= 0) return exit_code;
+
+  ax_init();
+  struct menus_state state = {
+    .menubar.provider = &g_ax_provider,
+    .extras.source = &g_cg_extras_source
+  };
+  struct click click = { 0 };
+  exit_code = run_command(&state, argc - 1, argv + 1, stdout, &click);
+  fflush(stdout);
+  click_perform(&click);
+  return exit_code;
+}
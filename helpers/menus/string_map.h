@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Open addressing hash map from strings to uint32 values, growing without a
+// fixed cap. Keys are copied. Used as a set by ignoring the values.
+
+struct string_map_slot {
+  char* key;
+  uint64_t hash;
+  uint32_t value;
+};
+
+struct string_map {
+  struct string_map_slot* slots;
+  uint32_t capacity;
+  uint32_t count;
+};
+
+static inline uint64_t string_map_hash(const char* key) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const unsigned char* c = (const unsigned char*)key; *c; c++) {
+    hash ^= *c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static inline struct string_map_slot* string_map_slot_for(struct string_map* map,
+                                                          const char* key,
+                                                          uint64_t hash) {
+  uint32_t mask = map->capacity - 1;
+  for (uint32_t i = (uint32_t)hash & mask;; i = (i + 1) & mask) {
+    struct string_map_slot* slot = &map->slots[i];
+    if (!slot->key) return slot;
+    if (slot->hash == hash && strcmp(slot->key, key) == 0) return slot;
+  }
+}
+
+static inline bool string_map_grow(struct string_map* map) {
+  uint32_t capacity = map->capacity ? map->capacity * 2 : 64;
+  struct string_map_slot* slots = calloc(capacity, sizeof(struct string_map_slot));
+  if (!slots) return false;
+
+  struct string_map old = *map;
+  map->slots = slots;
+  map->capacity = capacity;
+  for (uint32_t i = 0; i < old.capacity; i++) {
+    if (!old.slots[i].key) continue;
+    *string_map_slot_for(map, old.slots[i].key, old.slots[i].hash) = old.slots[i];
+  }
+  free(old.slots);
+  return true;
+}
+
+static inline bool string_map_get(struct string_map* map, const char* key, uint32_t* value) {
+  if (map->count == 0) return false;
+  struct string_map_slot* slot = string_map_slot_for(map, key, string_map_hash(key));
+  if (!slot->key) return false;
+  if (value) *value = slot->value;
+  return true;
+}
+
+// Inserts key with value unless it is already present. Returns true if the
+// key was inserted; *value receives the stored value either way.
+static inline bool string_map_put(struct string_map* map, const char* key, uint32_t* value) {
+  // Keep the load factor below 3/4
+  if ((map->count + 1) * 4 > map->capacity * 3 && !string_map_grow(map)) return false;
+
+  uint64_t hash = string_map_hash(key);
+  struct string_map_slot* slot = string_map_slot_for(map, key, hash);
+  if (slot->key) {
+    *value = slot->value;
+    return false;
+  }
+
+  slot->key = strdup(key);
+  if (!slot->key) return false;
+  slot->hash = hash;
+  slot->value = *value;
+  map->count++;
+  return true;
+}
+
+static inline bool string_set_add(struct string_map* set, const char* key) {
+  uint32_t value = 0;
+  return string_map_put(set, key, &value);
+}
+
+// Drops all keys but keeps the table allocated for reuse
+static inline void string_map_clear(struct string_map* map) {
+  for (uint32_t i = 0; i < map->capacity; i++) {
+    free(map->slots[i].key);
+    map->slots[i].key = NULL;
+  }
+  map->count = 0;
+}
+
+static inline void string_map_free(struct string_map* map) {
+  string_map_clear(map);
+  free(map->slots);
+  memset(map, 0, sizeof(struct string_map));
+}
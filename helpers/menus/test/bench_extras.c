@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_windows.h"
+
+// Cost of resolving a menu bar extra alias against the fake window list:
+//
+//   full         describing every window for each lookup, as before the
+//                index (a fresh index per lookup)
+//   incremental  the server's long lived index: one id listing, and only
+//                new windows are described
+//   alias map    the string map lookup alone, against a linear strcmp scan
+//                over the same aliases
+//
+//   bench_extras [--windows <n>] [--cost-us <µs per described window>]
+
+static uint64_t clock_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static char g_owners[512][32];
+
+static void make_windows(struct fake_window* windows, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    // A third of the windows are extras, the rest app windows
+    bool extra = i % 3 == 0;
+    snprintf(g_owners[i % 512], sizeof(g_owners[0]), "%s %u", extra ? "Extra" : "App", i);
+    windows[i] = (struct fake_window){
+      .id = 1000 + i * 7,
+      .pid = (pid_t)(100 + i),
+      .layer = extra ? EXTRAS_LAYER : 0,
+      .owner = g_owners[i % 512],
+      .name = extra ? "Item" : "Window",
+      .x = 1000.0 + i,
+    };
+  }
+}
+
+static double lookup_ns(struct fake_windows* fake, bool resident, int lookups) {
+  struct extras_source source = fake_windows_source(fake);
+  struct extras_index index = { .source = &source };
+  double xs[EXTRAS_MAX_MATCHES];
+  int xs_count = 0;
+  volatile pid_t sink = 0;
+
+  uint64_t start = clock_ns();
+  for (int i = 0; i < lookups; i++) {
+    if (!resident) extras_index_reset(&index);
+    extras_index_refresh(&index);
+    sink += extras_index_lookup(&index, "Extra 0", true, xs, &xs_count);
+  }
+  uint64_t elapsed = clock_ns() - start;
+  extras_index_free(&index);
+  (void)sink;
+  return (double)elapsed / lookups;
+}
+
+static void bench_alias_map(uint32_t count) {
+  struct string_map map = { 0 };
+  char (*aliases)[32] = malloc(count * sizeof(*aliases));
+  if (!aliases) return;
+  for (uint32_t i = 0; i < count; i++) {
+    snprintf(aliases[i], sizeof(aliases[0]), "Extra %u,Item", i);
+    uint32_t value = i;
+    string_map_put(&map, aliases[i], &value);
+  }
+
+  int rounds = 200000;
+  volatile uint32_t sink = 0;
+  uint64_t start = clock_ns();
+  for (int r = 0; r < rounds; r++) {
+    uint32_t value = 0;
+    if (string_map_get(&map, aliases[(uint32_t)r % count], &value)) sink += value;
+  }
+  double map_ns = (double)(clock_ns() - start) / rounds;
+
+  start = clock_ns();
+  for (int r = 0; r < rounds; r++) {
+    const char* alias = aliases[(uint32_t)r % count];
+    for (uint32_t i = 0; i < count; i++) {
+      if (strcmp(aliases[i], alias) == 0) {
+        sink += i;
+        break;
+      }
+    }
+  }
+  double scan_ns = (double)(clock_ns() - start) / rounds;
+  printf("%8u aliases: map %.0f ns, scan %.0f ns\n", count, map_ns, scan_ns);
+  string_map_free(&map);
+  free(aliases);
+}
+
+int main(int argc, char** argv) {
+  uint32_t only = 0;
+  uint64_t cost_ns = 2000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--windows") == 0) only = (uint32_t)atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--cost-us") == 0) cost_ns = (uint64_t)atoi(argv[i + 1]) * 1000;
+    else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  printf("us per lookup, %.0f us per described window\n", cost_ns / 1000.0);
+  printf("%8s %12s %12s\n", "windows", "full", "incremental");
+  static const uint32_t counts[] = { 16, 64, 256, 512 };
+  for (size_t n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+    uint32_t count = only ? only : counts[n];
+    if (count > 512) count = 512;
+    struct fake_window* windows = malloc(count * sizeof(struct fake_window));
+    if (!windows) return 1;
+    make_windows(windows, count);
+    struct fake_windows fake = { .windows = windows, .count = count, .cost_ns = cost_ns };
+
+    int lookups = 20;
+    double full = lookup_ns(&fake, false, lookups);
+    double incremental = lookup_ns(&fake, true, lookups);
+    printf("%8u %12.1f %12.1f\n", count, full / 1000.0, incremental / 1000.0);
+    free(windows);
+    if (only) break;
+  }
+
+  static const uint32_t alias_counts[] = { 8, 32, 128, 512 };
+  for (size_t n = 0; n < sizeof(alias_counts) / sizeof(alias_counts[0]); n++) {
+    bench_alias_map(alias_counts[n]);
+  }
+  return 0;
+}
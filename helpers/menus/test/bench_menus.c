@@ -0,0 +1,192 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "../../socket.h"
+#include "fake_ax.h"
+
+// Request latency of menus -l / -s against the fake provider:
+//
+//   spawn      a new process per request, as before the resident server
+//   one-shot   a fresh menu bar cache per request, in-process
+//   resident   the server's long lived cache, in-process
+//   socket     a request to a resident server over its unix socket
+//
+//   bench_menus [--requests <n>] [--cost-us <µs per provider call>]
+//
+// The accessibility calls themselves are simulated by --cost-us; the spawn
+// row still misses ax_init and the framework loading of the real binary.
+
+extern char** environ;
+
+static const char* g_titles[] = {
+  "Apple", "Safari", "File", "Edit", "View", "History", "Bookmarks", "Develop", "Window", "Help"
+};
+
+struct bench {
+  struct fake_app app;
+  struct fake_ax fake;
+  struct menus_provider provider;
+  struct menubar_cache cache;
+};
+
+static void bench_init(struct bench* bench, uint64_t cost_ns) {
+  memset(bench, 0, sizeof(struct bench));
+  bench->app.pid = 100;
+  bench->app.titles = g_titles;
+  bench->app.count = sizeof(g_titles) / sizeof(g_titles[0]);
+  bench->fake.apps = &bench->app;
+  bench->fake.app_count = 1;
+  bench->fake.front = 100;
+  bench->fake.cost_ns = cost_ns;
+  bench->provider = fake_provider(&bench->fake);
+  bench->cache.provider = &bench->provider;
+}
+
+static int run_request(struct menubar_cache* cache, const char* request, FILE* out) {
+  if (strcmp(request, "-l") == 0) {
+    menubar_list(cache, out);
+    return 0;
+  }
+  if (strncmp(request, "-s\t", 3) == 0) {
+    void* item = menubar_copy_item(cache, atoi(request + 3));
+    if (item) cache->provider->release(cache->provider->context, item);
+    return 0;
+  }
+  return 1;
+}
+
+static uint64_t clock_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t lhs = *(const uint64_t*)a;
+  uint64_t rhs = *(const uint64_t*)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static void report(const char* mode, const char* request, uint64_t* samples, int count) {
+  qsort(samples, count, sizeof(uint64_t), compare_u64);
+  printf("%-9s %-5s p50 %9.1fus  p99 %9.1fus\n",
+         mode,
+         request[1] == 'l' ? "-l" : "-s",
+         samples[count / 2] / 1e3,
+         samples[count * 99 / 100] / 1e3);
+}
+
+static void serve(const char* path, uint64_t cost_ns) {
+  int listen_fd = socket_listen(path, 0600);
+  if (listen_fd < 0) exit(1);
+  signal(SIGPIPE, SIG_IGN);
+
+  struct bench bench;
+  bench_init(&bench, cost_ns);
+  for (;;) {
+    char request[256];
+    int client = socket_accept_request(listen_fd, request, sizeof(request));
+    if (client < 0) continue;
+    char* output = NULL;
+    size_t output_len = 0;
+    FILE* out = open_memstream(&output, &output_len);
+    int exit_code = out ? run_request(&bench.cache, request, out) : 1;
+    if (out) fclose(out);
+    socket_reply(client, exit_code, output, output_len);
+    free(output);
+  }
+}
+
+int main(int argc, char** argv) {
+  int requests = 2000;
+  uint64_t cost_ns = 0;
+  const char* once = NULL;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--requests") == 0) requests = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--cost-us") == 0) cost_ns = (uint64_t)atoi(argv[i + 1]) * 1000;
+    else if (strcmp(argv[i], "--once") == 0) once = argv[i + 1];
+  }
+  if (requests < 1) requests = 1;
+
+  // A request as a process of its own, for the spawn row
+  if (once) {
+    struct bench bench;
+    bench_init(&bench, cost_ns);
+    return run_request(&bench.cache, once, stdout);
+  }
+
+  FILE* null = fopen("/dev/null", "w");
+  uint64_t* samples = malloc(sizeof(uint64_t) * requests);
+  if (!null || !samples) return 1;
+
+  char path[128];
+  snprintf(path, sizeof(path), "/tmp/menus_bench_%d.socket", (int)getpid());
+  pid_t server = fork();
+  if (server == 0) serve(path, cost_ns);
+
+  posix_spawn_file_actions_t quiet;
+  posix_spawn_file_actions_init(&quiet);
+  posix_spawn_file_actions_addopen(&quiet, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  const char* request_lines[] = { "-l", "-s\t3" };
+  char cost[24];
+  snprintf(cost, sizeof(cost), "%llu", (unsigned long long)(cost_ns / 1000));
+  printf("%d requests, %s us per provider call\n", requests, cost);
+
+  for (int r = 0; r < 2; r++) {
+    const char* request = request_lines[r];
+
+    int spawns = requests < 200 ? requests : 200;
+    for (int i = 0; i < spawns; i++) {
+      char* args[] = { argv[0], "--cost-us", cost, "--once", (char*)request, NULL };
+      uint64_t start = clock_ns();
+      pid_t pid;
+      if (posix_spawn(&pid, argv[0], &quiet, NULL, args, environ) != 0) return 1;
+      waitpid(pid, NULL, 0);
+      samples[i] = clock_ns() - start;
+    }
+    report("spawn", request, samples, spawns);
+
+    for (int i = 0; i < requests; i++) {
+      struct bench bench;
+      uint64_t start = clock_ns();
+      bench_init(&bench, cost_ns);
+      run_request(&bench.cache, request, null);
+      menubar_cache_clear(&bench.cache);
+      samples[i] = clock_ns() - start;
+    }
+    report("one-shot", request, samples, requests);
+
+    struct bench resident;
+    bench_init(&resident, cost_ns);
+    for (int i = 0; i < requests; i++) {
+      uint64_t start = clock_ns();
+      run_request(&resident.cache, request, null);
+      samples[i] = clock_ns() - start;
+    }
+    menubar_cache_clear(&resident.cache);
+    report("resident", request, samples, requests);
+
+    for (int i = 0; i < requests; i++) {
+      uint64_t start = clock_ns();
+      int exit_code = socket_forward(path, request, null, null);
+      samples[i] = clock_ns() - start;
+      // The server may not be listening yet on the first requests
+      if (exit_code < 0) i--;
+    }
+    report("socket", request, samples, requests);
+  }
+
+  posix_spawn_file_actions_destroy(&quiet);
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+  unlink(path);
+  free(samples);
+  fclose(null);
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+
+#include "fake_windows.h"
+
+// The extras index and the string map under it against a scripted window
+// list: `make test` diffs the output against extras.expected.
+
+static void lookup(struct extras_index* index, const char* alias) {
+  bool owner_only = strchr(alias, ',') == NULL;
+  double xs[EXTRAS_MAX_MATCHES];
+  int xs_count = 0;
+  pid_t pid = extras_index_lookup(index, alias, owner_only, xs, &xs_count);
+  printf("  lookup \"%s\": pid %d, x", alias, (int)pid);
+  for (int i = 0; i < xs_count; i++) printf(" %.0f", xs[i]);
+  printf("\n");
+}
+
+static void refresh(const char* what, struct extras_index* index, struct fake_windows* fake) {
+  memset(&fake->calls, 0, sizeof(fake->calls));
+  bool ok = extras_index_refresh(index);
+  printf("%s: ok=%d windows=%u aliases=%u (listed %u, described %u in %u calls)\n",
+         what, ok, index->window_count, index->alias_count,
+         fake->calls.copy_ids, fake->calls.described, fake->calls.describe);
+}
+
+static void string_maps(void) {
+  struct string_map map = { 0 };
+  uint32_t value = 0;
+  printf("string map: get on empty %d\n", string_map_get(&map, "a", &value));
+
+  char key[32];
+  for (uint32_t i = 0; i < 200; i++) {
+    snprintf(key, sizeof(key), "key%u", i);
+    value = i * 3;
+    if (!string_map_put(&map, key, &value)) printf("  put %s failed\n", key);
+  }
+  printf("  200 keys: count=%u capacity=%u\n", map.count, map.capacity);
+
+  value = 999;
+  bool inserted = string_map_put(&map, "key17", &value);
+  printf("  put existing key17: inserted=%d value=%u\n", inserted, value);
+
+  uint32_t found = 0;
+  for (uint32_t i = 0; i < 200; i++) {
+    snprintf(key, sizeof(key), "key%u", i);
+    if (string_map_get(&map, key, &value) && value == i * 3) found++;
+  }
+  printf("  found %u of 200, key200 %d, empty key %d\n",
+         found, string_map_get(&map, "key200", NULL), string_map_get(&map, "", NULL));
+
+  uint32_t capacity = map.capacity;
+  string_map_clear(&map);
+  printf("  cleared: count=%u same table=%d key5 %d\n",
+         map.count, map.capacity == capacity, string_map_get(&map, "key5", NULL));
+  bool first = string_set_add(&map, "Wi-Fi");
+  bool again = string_set_add(&map, "Wi-Fi");
+  bool empty = string_set_add(&map, "");
+  printf("  set add: %d, again %d, empty key %d\n", first, again, empty);
+  string_map_free(&map);
+  printf("  freed: capacity=%u\n", map.capacity);
+}
+
+int main(void) {
+  struct fake_window windows[] = {
+    { 40, 200, 0, "Safari", "Start Page", 0 },
+    { 12, 300, EXTRAS_LAYER, "Control Center", "WiFi", 1410 },
+    { 13, 300, EXTRAS_LAYER, "Control Center", "Battery", 1440 },
+    { 14, 300, EXTRAS_LAYER, "Control Center", "Clock", 1470 },
+    { 20, 400, EXTRAS_LAYER, "Dropbox", "", 1300 },
+    { 21, 500, EXTRAS_LAYER, "", "Nameless", 1280 },
+    { 30, 600, 20, "Dock", "Dock", 0 },
+    // Listed twice, as the window server sometimes does
+    { 20, 400, EXTRAS_LAYER, "Dropbox", "", 1300 },
+  };
+  struct fake_windows fake = { .windows = windows, .count = 8 };
+  struct extras_source source = fake_windows_source(&fake);
+  struct extras_index index = { .source = &source };
+
+  refresh("first refresh", &index, &fake);
+  lookup(&index, "Control Center");
+  lookup(&index, "Control Center,Battery");
+  lookup(&index, "Dropbox");
+  lookup(&index, "Dropbox,");
+  lookup(&index, "Safari");
+  lookup(&index, "Nameless");
+  printf("  owner \"dropbox\": pid %d, \"dock\": pid %d\n",
+         (int)extras_index_find_owner(&index, "dropbox"),
+         (int)extras_index_find_owner(&index, "dock"));
+
+  refresh("nothing changed", &index, &fake);
+
+  // Safari opens a window, Dropbox quits
+  windows[0].id = 41;
+  windows[4].id = 22;
+  windows[4].owner = "Bartender 5";
+  windows[4].pid = 700;
+  fake.count = 7;
+  refresh("window and extra replaced", &index, &fake);
+  lookup(&index, "Dropbox");
+  lookup(&index, "Bartender 5");
+
+  // A renamed extra keeps its id: only a reset picks up the new name
+  windows[1].name = "Wi-Fi";
+  refresh("extra renamed", &index, &fake);
+  lookup(&index, "Control Center,Wi-Fi");
+  extras_index_reset(&index);
+  refresh("after reset", &index, &fake);
+  lookup(&index, "Control Center,Wi-Fi");
+
+  // Positions are read fresh on every lookup
+  windows[3].x = 1500;
+  lookup(&index, "Control Center");
+
+  fake.count = 0;
+  refresh("no windows", &index, &fake);
+  lookup(&index, "Control Center");
+
+  extras_index_free(&index);
+  printf("freed: windows=%u source kept=%d\n", index.window_count, index.source == &source);
+
+  string_maps();
+  return 0;
+}
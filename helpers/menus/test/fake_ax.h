@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../menubar.h"
+
+// In-memory menu bar provider for the tests and the benchmark. Every call
+// is counted and can be made to take cost_ns, standing in for the round
+// trip to the app an accessibility call is.
+
+struct fake_app {
+  pid_t pid;
+  const char** titles;
+  int count;
+  // Bumped when the app relaunches: its old elements turn stale
+  uint32_t generation;
+};
+
+struct fake_calls {
+  uint32_t front_pid;
+  uint32_t copy_menubar;
+  uint32_t copy_items;
+  uint32_t item_title;
+  uint32_t copy_item;
+  uint32_t release;
+};
+
+struct fake_ax {
+  struct fake_app* apps;
+  int app_count;
+  pid_t front;
+  uint64_t cost_ns;
+  struct fake_calls calls;
+  // Elements handed out and not released yet
+  int live;
+};
+
+struct fake_element {
+  struct fake_app* app;
+  uint32_t generation;
+  int index;
+};
+
+static inline void fake_cost(struct fake_ax* fake) {
+  if (fake->cost_ns == 0) return;
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ull
+           + (uint64_t)now.tv_nsec - (uint64_t)start.tv_nsec < fake->cost_ns);
+}
+
+static inline struct fake_element* fake_element(struct fake_ax* fake,
+                                                struct fake_app* app,
+                                                int index            ) {
+  struct fake_element* element = malloc(sizeof(struct fake_element));
+  if (!element) return NULL;
+  element->app = app;
+  element->generation = app->generation;
+  element->index = index;
+  fake->live++;
+  return element;
+}
+
+static pid_t fake_front_pid(void* context) {
+  struct fake_ax* fake = context;
+  fake->calls.front_pid++;
+  fake_cost(fake);
+  return fake->front;
+}
+
+static void* fake_copy_menubar(void* context, pid_t pid) {
+  struct fake_ax* fake = context;
+  fake->calls.copy_menubar++;
+  fake_cost(fake);
+  for (int i = 0; i < fake->app_count; i++) {
+    if (fake->apps[i].pid == pid) return fake_element(fake, &fake->apps[i], -1);
+  }
+  return NULL;
+}
+
+static void* fake_copy_items(void* context, void* menubar, int* count) {
+  struct fake_ax* fake = context;
+  struct fake_element* element = menubar;
+  fake->calls.copy_items++;
+  fake_cost(fake);
+  if (element->generation != element->app->generation) return NULL;
+  *count = element->app->count;
+  return fake_element(fake, element->app, -1);
+}
+
+static bool fake_item_title(void* context, void* items, int index, char* buffer, size_t size) {
+  struct fake_ax* fake = context;
+  struct fake_element* element = items;
+  fake->calls.item_title++;
+  fake_cost(fake);
+  const char* title = element->app->titles[index];
+  if (!title) return false;
+  snprintf(buffer, size, "%s", title);
+  return true;
+}
+
+static void* fake_copy_item(void* context, void* items, int index) {
+  struct fake_ax* fake = context;
+  fake->calls.copy_item++;
+  return fake_element(fake, ((struct fake_element*)items)->app, index);
+}
+
+static void fake_release(void* context, void* element) {
+  struct fake_ax* fake = context;
+  fake->calls.release++;
+  fake->live--;
+  free(element);
+}
+
+static inline struct menus_provider fake_provider(struct fake_ax* fake) {
+  struct menus_provider provider = {
+    .context = fake,
+    .front_pid = fake_front_pid,
+    .copy_menubar = fake_copy_menubar,
+    .copy_items = fake_copy_items,
+    .item_title = fake_item_title,
+    .copy_item = fake_copy_item,
+    .release = fake_release,
+  };
+  return provider;
+}
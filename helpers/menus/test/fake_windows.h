@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../extras_index.h"
+
+// In-memory window list for the tests and the benchmark, standing in for
+// the window server. Calls and described windows are counted, and every
+// window described or positioned can be made to take cost_ns.
+
+struct fake_window {
+  uint32_t id;
+  pid_t pid;
+  int layer;
+  const char* owner;
+  const char* name;
+  double x;
+};
+
+struct fake_window_calls {
+  uint32_t copy_ids;
+  uint32_t describe;
+  uint32_t described;
+  uint32_t positions;
+};
+
+struct fake_windows {
+  struct fake_window* windows;
+  uint32_t count;
+  uint64_t cost_ns;
+  struct fake_window_calls calls;
+};
+
+static inline void fake_windows_cost(struct fake_windows* fake, uint32_t windows) {
+  if (fake->cost_ns == 0 || windows == 0) return;
+  uint64_t cost_ns = fake->cost_ns * windows;
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ull
+           + (uint64_t)now.tv_nsec - (uint64_t)start.tv_nsec < cost_ns);
+}
+
+static inline struct fake_window* fake_windows_find(struct fake_windows* fake, uint32_t id) {
+  for (uint32_t i = 0; i < fake->count; i++) {
+    if (fake->windows[i].id == id) return &fake->windows[i];
+  }
+  return NULL;
+}
+
+// Listed back to front, like the window server
+static uint32_t* fake_copy_ids(void* context, uint32_t* count) {
+  struct fake_windows* fake = context;
+  fake->calls.copy_ids++;
+  uint32_t* ids = malloc((fake->count ? fake->count : 1) * sizeof(uint32_t));
+  if (!ids) return NULL;
+  for (uint32_t i = 0; i < fake->count; i++) ids[i] = fake->windows[fake->count - 1 - i].id;
+  *count = fake->count;
+  return ids;
+}
+
+static void fake_describe(void* context, struct extras_window* windows, uint32_t count) {
+  struct fake_windows* fake = context;
+  fake->calls.describe++;
+  fake->calls.described += count;
+  fake_windows_cost(fake, count);
+  for (uint32_t i = 0; i < count; i++) {
+    const struct fake_window* window = fake_windows_find(fake, windows[i].id);
+    if (!window || window->layer != EXTRAS_LAYER || !window->owner[0]) continue;
+    snprintf(windows[i].owner, sizeof(windows[i].owner), "%s", window->owner);
+    snprintf(windows[i].name, sizeof(windows[i].name), "%s", window->name ? window->name : "");
+    windows[i].pid = window->pid;
+    windows[i].is_extra = true;
+  }
+}
+
+static int fake_positions(void* context, const uint32_t* ids, uint32_t count, double* xs) {
+  struct fake_windows* fake = context;
+  fake->calls.positions++;
+  fake_windows_cost(fake, count);
+  int xs_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const struct fake_window* window = fake_windows_find(fake, ids[i]);
+    if (window) xs[xs_count++] = window->x;
+  }
+  return xs_count;
+}
+
+static inline struct extras_source fake_windows_source(struct fake_windows* fake) {
+  struct extras_source source = {
+    .context = fake,
+    .copy_ids = fake_copy_ids,
+    .describe = fake_describe,
+    .positions = fake_positions,
+  };
+  return source;
+}
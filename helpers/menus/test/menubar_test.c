@@ -0,0 +1,73 @@
+#include <stdio.h>
+
+#include "fake_ax.h"
+
+// Runs -l and -s requests against the fake provider the way the resident
+// server does, printing the answers and the provider calls each one took:
+// `make test` diffs them against menubar.expected.
+
+static const char* finder_titles[] = { "Apple", "Finder", "File", "Edit", "View", NULL, "Help" };
+static const char* terminal_titles[] = { "Apple", "Terminal", "Shell", "Window" };
+
+static void print_calls(struct fake_ax* fake) {
+  struct fake_calls* calls = &fake->calls;
+  printf("  calls: front_pid=%u copy_menubar=%u copy_items=%u item_title=%u "
+         "copy_item=%u release=%u\n",
+         calls->front_pid, calls->copy_menubar, calls->copy_items, calls->item_title,
+         calls->copy_item, calls->release);
+  memset(calls, 0, sizeof(struct fake_calls));
+}
+
+static void list(struct menubar_cache* cache, struct fake_ax* fake, const char* label) {
+  printf("-l (%s)\n", label);
+  char* output = NULL;
+  size_t output_len = 0;
+  FILE* out = open_memstream(&output, &output_len);
+  menubar_list(cache, out);
+  fclose(out);
+  for (char* line = strtok(output, "\n"); line; line = strtok(NULL, "\n")) {
+    printf("  %s\n", line);
+  }
+  free(output);
+  print_calls(fake);
+}
+
+static void select_item(struct menubar_cache* cache, struct fake_ax* fake, int id) {
+  struct fake_element* item = menubar_copy_item(cache, id);
+  if (item) {
+    printf("-s %d: %s\n", id, item->app->titles[item->index]);
+    cache->provider->release(cache->provider->context, item);
+  } else {
+    printf("-s %d: no item\n", id);
+  }
+  print_calls(fake);
+}
+
+int main(void) {
+  struct fake_app apps[] = {
+    { .pid = 100, .titles = finder_titles, .count = 7 },
+    { .pid = 200, .titles = terminal_titles, .count = 4 },
+  };
+  struct fake_ax fake = { .apps = apps, .app_count = 2, .front = 100 };
+  struct menus_provider provider = fake_provider(&fake);
+  struct menubar_cache cache = { .provider = &provider };
+
+  list(&cache, &fake, "first request");
+  list(&cache, &fake, "cached menu bar");
+  select_item(&cache, &fake, 2);
+  select_item(&cache, &fake, 7);
+
+  fake.front = 200;
+  list(&cache, &fake, "app switch");
+
+  apps[1].generation++;
+  list(&cache, &fake, "app relaunched, stale menu bar");
+
+  fake.front = 300;
+  list(&cache, &fake, "front app without a menu bar");
+  select_item(&cache, &fake, 1);
+
+  menubar_cache_clear(&cache);
+  printf("live elements: %d\n", fake.live);
+  return fake.live == 0 ? 0 : 1;
+}
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "socket.h"
+#include "state.h"
+
+// Optional scrape endpoint serving the latest sampled values in the
+// OpenMetrics text format, over HTTP on a localhost TCP port or on a unix
+// socket (e.g. curl --unix-socket <path> http://localhost/metrics).
+//
+// The sampling loop only ever touches its own copy of the metrics and hands
+// it over once per tick with metrics_publish(). The handover never waits: if
+// a scrape is copying the shared snapshot at that moment, the publish is
+// skipped and the next tick carries the values. Scrapes are served by a
+// separate thread and render from the snapshot, so they sample nothing.
+
+#define METRICS_MAX 128
+#define METRICS_MAX_BUCKETS 12
+#define METRICS_NAME_SIZE 64
+#define METRICS_LABELS_SIZE 48
+#define METRICS_RESPONSE_SIZE (128 * 1024)
+
+enum metric_type {
+  METRIC_GAUGE,
+  METRIC_COUNTER,
+  METRIC_HISTOGRAM,
+};
+
+struct metric {
+  char name[METRICS_NAME_SIZE];
+  // Label pairs without braces, e.g. core="3"; empty for none
+  char labels[METRICS_LABELS_SIZE];
+  const char* help;
+  enum metric_type type;
+  // Not sampled yet or currently unavailable: left out of the scrape
+  bool valid;
+  double value;
+
+  // Histograms: upper bounds in ascending order, per bucket counts (not
+  // cumulative) with the +Inf bucket last
+  const double* bounds;
+  uint32_t bucket_count;
+  uint64_t buckets[METRICS_MAX_BUCKETS + 1];
+  uint64_t count;
+  double sum;
+};
+
+struct metric_set {
+  uint32_t count;
+  struct metric entries[METRICS_MAX];
+};
+
+struct metrics {
+  bool enabled;
+  int listen_fd;
+  pthread_mutex_t lock;
+  struct metric_set local;
+  struct metric_set shared;
+};
+
+static inline void metrics_init(struct metrics* metrics) {
+  memset(metrics, 0, sizeof(struct metrics));
+  metrics->listen_fd = -1;
+  pthread_mutex_init(&metrics->lock, NULL);
+}
+
+// Registers a metric and returns its index for the update functions below,
+// or -1 if the endpoint is disabled (updates of -1 are no-ops). Metrics of
+// one family share the name and help and differ in their labels.
+static inline int metrics_add(struct metrics* metrics,
+                              enum metric_type type,
+                              const char* name,
+                              const char* labels,
+                              const char* help    ) {
+  if (!metrics->enabled || metrics->local.count >= METRICS_MAX) return -1;
+  int index = metrics->local.count++;
+  struct metric* metric = &metrics->local.entries[index];
+  memset(metric, 0, sizeof(struct metric));
+  metric->type = type;
+  metric->help = help;
+  snprintf(metric->name, sizeof(metric->name), "%s", name);
+  snprintf(metric->labels, sizeof(metric->labels), "%s", labels ? labels : "");
+  return index;
+}
+
+static inline int metrics_add_histogram(struct metrics* metrics,
+                                        const char* name,
+                                        const char* labels,
+                                        const char* help,
+                                        const double* bounds,
+                                        uint32_t bucket_count) {
+  int index = metrics_add(metrics, METRIC_HISTOGRAM, name, labels, help);
+  if (index < 0) return -1;
+  struct metric* metric = &metrics->local.entries[index];
+  metric->bounds = bounds;
+  metric->bucket_count = bucket_count < METRICS_MAX_BUCKETS
+                         ? bucket_count
+                         : METRICS_MAX_BUCKETS;
+  metric->valid = true;
+  return index;
+}
+
+// Moves a gauge to other labels, e.g. once the slot it reports on is reused
+static inline void metrics_relabel(struct metrics* metrics, int index, const char* labels) {
+  if (index < 0) return;
+  snprintf(metrics->local.entries[index].labels, METRICS_LABELS_SIZE, "%s", labels);
+}
+
+static inline void metrics_set(struct metrics* metrics, int index, double value) {
+  if (index < 0) return;
+  metrics->local.entries[index].value = value;
+  metrics->local.entries[index].valid = true;
+}
+
+static inline void metrics_invalidate(struct metrics* metrics, int index) {
+  if (index < 0) return;
+  metrics->local.entries[index].valid = false;
+}
+
+static inline void metrics_inc(struct metrics* metrics, int index, double amount) {
+  if (index < 0) return;
+  metrics->local.entries[index].value += amount;
+  metrics->local.entries[index].valid = true;
+}
+
+static inline void metrics_observe(struct metrics* metrics, int index, double value) {
+  if (index < 0) return;
+  struct metric* metric = &metrics->local.entries[index];
+  uint32_t bucket = 0;
+  while (bucket < metric->bucket_count && value > metric->bounds[bucket]) bucket++;
+  metric->buckets[bucket]++;
+  metric->count++;
+  metric->sum += value;
+}
+
+static inline void metrics_publish(struct metrics* metrics) {
+  if (!metrics->enabled) return;
+  if (pthread_mutex_trylock(&metrics->lock) != 0) return;
+  size_t used = metrics->local.count * sizeof(struct metric);
+  metrics->shared.count = metrics->local.count;
+  memcpy(metrics->shared.entries, metrics->local.entries, used);
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+// How long the helper took from its start to repaint the last-known state
+// and to send its first valid values (state.h)
+struct metrics_startup {
+  int replayed;
+  int first_valid;
+};
+
+static inline void metrics_add_startup(struct metrics* metrics, struct metrics_startup* startup) {
+  startup->replayed = metrics_add(metrics, METRIC_GAUGE, "sketchybar_helper_startup_seconds",
+                                  "stage=\"state_replay\"", "Time from the start of the helper");
+  startup->first_valid = metrics_add(metrics, METRIC_GAUGE, "sketchybar_helper_startup_seconds",
+                                     "stage=\"first_valid\"", NULL);
+}
+
+static inline void metrics_update_startup(struct metrics* metrics,
+                                          const struct metrics_startup* startup,
+                                          const struct state* state            ) {
+  if (!metrics->enabled) return;
+  if (state->replayed_ns) {
+    metrics_set(metrics, startup->replayed, (double)(state->replayed_ns - state->started_ns) / 1e9);
+  }
+  if (state->first_valid_ns) {
+    metrics_set(metrics, startup->first_valid,
+                (double)(state->first_valid_ns - state->started_ns) / 1e9);
+  }
+}
+
+static inline size_t metrics_append(char* buffer, size_t size, size_t len, const char* format, ...)
+  __attribute__((format(printf, 4, 5)));
+
+static inline size_t metrics_append(char* buffer, size_t size, size_t len, const char* format, ...) {
+  if (len >= size) return len;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(buffer + len, size - len, format, args);
+  va_end(args);
+  return written > 0 ? len + written : len;
+}
+
+static inline size_t metrics_append_sample(char* buffer,
+                                           size_t size,
+                                           size_t len,
+                                           const struct metric* metric,
+                                           const char* suffix,
+                                           const char* le,
+                                           double value        ) {
+  len = metrics_append(buffer, size, len, "%s%s", metric->name, suffix);
+  if (metric->labels[0] || le) {
+    len = metrics_append(buffer, size, len, "{%s%s%s%s%s}",
+                         metric->labels,
+                         metric->labels[0] && le ? "," : "",
+                         le ? "le=\"" : "",
+                         le ? le : "",
+                         le ? "\"" : ""                    );
+  }
+  return metrics_append(buffer, size, len, " %.15g\n", value);
+}
+
+static inline size_t metrics_render_metric(char* buffer,
+                                           size_t size,
+                                           size_t len,
+                                           const struct metric* metric) {
+  if (!metric->valid) return len;
+  if (metric->type == METRIC_GAUGE) {
+    return metrics_append_sample(buffer, size, len, metric, "", NULL, metric->value);
+  }
+  if (metric->type == METRIC_COUNTER) {
+    return metrics_append_sample(buffer, size, len, metric, "_total", NULL, metric->value);
+  }
+
+  uint64_t cumulative = 0;
+  char le[32];
+  for (uint32_t i = 0; i < metric->bucket_count; i++) {
+    cumulative += metric->buckets[i];
+    snprintf(le, sizeof(le), "%.15g", metric->bounds[i]);
+    len = metrics_append_sample(buffer, size, len, metric, "_bucket", le, cumulative);
+  }
+  len = metrics_append_sample(buffer, size, len, metric, "_bucket", "+Inf", metric->count);
+  len = metrics_append_sample(buffer, size, len, metric, "_count", NULL, metric->count);
+  return metrics_append_sample(buffer, size, len, metric, "_sum", NULL, metric->sum);
+}
+
+#define METRICS_EOF "# EOF\n"
+
+// Families are rendered together, with their TYPE and HELP lines once. A
+// family that does not fit in size is left out whole, as is every one after
+// it, so the scrape still ends with "# EOF" and holds complete families
+// only; *dropped counts the families left out.
+static inline size_t metrics_render(const struct metric_set* set,
+                                    char* buffer,
+                                    size_t size,
+                                    uint32_t* dropped          ) {
+  static const char* types[] = { "gauge", "counter", "histogram" };
+  size_t limit = size - (sizeof(METRICS_EOF) - 1);
+  size_t len = 0;
+  buffer[0] = '\0';
+  *dropped = 0;
+  for (uint32_t i = 0; i < set->count; i++) {
+    const struct metric* family = &set->entries[i];
+    bool rendered = false;
+    for (uint32_t j = 0; j < i && !rendered; j++) {
+      rendered = strcmp(set->entries[j].name, family->name) == 0;
+    }
+    if (rendered) continue;
+    if (*dropped > 0) {
+      (*dropped)++;
+      continue;
+    }
+
+    size_t start = len;
+    len = metrics_append(buffer, limit, len, "# TYPE %s %s\n", family->name, types[family->type]);
+    if (family->help) {
+      len = metrics_append(buffer, limit, len, "# HELP %s %s\n", family->name, family->help);
+    }
+    for (uint32_t j = i; j < set->count; j++) {
+      if (strcmp(set->entries[j].name, family->name) != 0) continue;
+      len = metrics_render_metric(buffer, limit, len, &set->entries[j]);
+    }
+    if (len >= limit) {
+      len = start;
+      buffer[len] = '\0';
+      (*dropped)++;
+    }
+  }
+  return metrics_append(buffer, size, len, METRICS_EOF);
+}
+
+// Reads the request head; its path is not looked at, every request is
+// answered with the metrics.
+static inline bool metrics_read_request(int fd) {
+  char request[2048];
+  size_t len = 0;
+  while (len + 1 < sizeof(request)) {
+    ssize_t n = read(fd, request + len, sizeof(request) - len - 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    len += n;
+    request[len] = '\0';
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) return true;
+  }
+  return true;
+}
+
+static void* metrics_serve(void* context) {
+  struct metrics* metrics = context;
+  static struct metric_set snapshot;
+  static char body[METRICS_RESPONSE_SIZE];
+
+  for (;;) {
+    int fd = accept(metrics->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;
+    }
+    socket_set_timeout(fd, SOCKET_TIMEOUT_SEC);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    if (metrics_read_request(fd)) {
+      pthread_mutex_lock(&metrics->lock);
+      snapshot.count = metrics->shared.count;
+      memcpy(snapshot.entries,
+             metrics->shared.entries,
+             snapshot.count * sizeof(struct metric));
+      pthread_mutex_unlock(&metrics->lock);
+
+      // A truncated scrape says so, rather than passing for a complete one
+      uint32_t dropped;
+      size_t len = metrics_render(&snapshot, body, sizeof(body), &dropped);
+      char truncated[64] = "";
+      if (dropped > 0) {
+        snprintf(truncated, sizeof(truncated), "X-Metrics-Dropped-Families: %u\r\n", dropped);
+      }
+      char header[320];
+      int header_len = snprintf(header,
+                                sizeof(header),
+                                "HTTP/1.1 200 OK\r\n"
+                                "Content-Type: application/openmetrics-text; "
+                                "version=1.0.0; charset=utf-8\r\n"
+                                "Content-Length: %zu\r\n"
+                                "%s"
+                                "Connection: close\r\n\r\n",
+                                len,
+                                truncated                                   );
+      if (socket_write_all(fd, header, header_len)) socket_write_all(fd, body, len);
+    }
+    close(fd);
+  }
+  return NULL;
+}
+
+static inline int metrics_listen_tcp(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  // Loopback only: the endpoint is meant for a local scraper
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 8) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Starts serving on 127.0.0.1:<port>, or on a unix socket if the address
+// contains a '/'. Until then (and if never started) every metrics_* call
+// is a no-op, so the sampler only pays for the endpoint when it is enabled.
+static inline bool metrics_start(struct metrics* metrics, const char* address) {
+  if (strchr(address, '/')) {
+    metrics->listen_fd = socket_listen(address, 0600);
+  } else {
+    char* end = NULL;
+    long port = strtol(address, &end, 10);
+    if (!end || *end != '\0' || port <= 0 || port > 65535) return false;
+    metrics->listen_fd = metrics_listen_tcp((int)port);
+  }
+  if (metrics->listen_fd < 0) return false;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, metrics_serve, metrics) != 0) {
+    close(metrics->listen_fd);
+    metrics->listen_fd = -1;
+    return false;
+  }
+  pthread_detach(thread);
+  metrics->enabled = true;
+  return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <unistd.h>
+
+#include "impact.h"
+#include "metrics.h"
+
+// The helper's own CPU time and wakeups, e.g. to compare the low-impact
+// modes (impact.h)
+struct metrics_process {
+  int cpu[2];
+  int wakeups[2];
+};
+
+static inline void metrics_add_process(struct metrics* metrics, struct metrics_process* process) {
+  process->cpu[0] = metrics_add(metrics, METRIC_COUNTER, "sketchybar_helper_cpu_seconds",
+                                "mode=\"user\"", "CPU time of the helper");
+  process->cpu[1] = metrics_add(metrics, METRIC_COUNTER, "sketchybar_helper_cpu_seconds",
+                                "mode=\"system\"", NULL);
+  process->wakeups[0] = metrics_add(metrics, METRIC_COUNTER, "sketchybar_helper_wakeups",
+                                    "kind=\"interrupt\"", "Wakeups of the helper");
+  process->wakeups[1] = metrics_add(metrics, METRIC_COUNTER, "sketchybar_helper_wakeups",
+                                    "kind=\"idle\"", NULL);
+}
+
+static inline void metrics_update_process(struct metrics* metrics,
+                                          const struct metrics_process* process) {
+  struct impact_usage usage;
+  if (!metrics->enabled || !impact_usage_read(getpid(), &usage)) return;
+  metrics_set(metrics, process->cpu[0], usage.user_sec);
+  metrics_set(metrics, process->cpu[1], usage.system_sec);
+  metrics_set(metrics, process->wakeups[0], (double)usage.interrupt_wakeups);
+  metrics_set(metrics, process->wakeups[1], (double)usage.idle_wakeups);
+}
@@ -0,0 +1,88 @@
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Watch mode pushes a trigger only when the connection state visible in the
+// bar changes. Store notifications arrive in bursts while an interface comes
+// up, so the state is read through a source (the dynamic store in
+// network_info.m, a fixture in the tests) once the burst has settled.
+
+#define LINK_SETTLE_SEC 0.25
+
+struct link_state {
+  char interface[IF_NAMESIZE];
+  char ssid[128];
+  char ip[INET_ADDRSTRLEN];
+  char subnet_mask[INET_ADDRSTRLEN];
+  char router[64];
+  bool active;
+};
+
+// Copies a value for use inside a quoted trigger argument.
+static inline void link_copy_field(char* dst, size_t size, const char* src) {
+  size_t out = 0;
+  for (; src && *src && out + 1 < size; src++) {
+    if (*src == '\'' || *src == '"') continue;
+    dst[out++] = *src;
+  }
+  dst[out] = '\0';
+}
+
+struct link_source {
+  void* context;
+  // Fills the zeroed state; an empty interface means no connection
+  void (*read)(void* context, struct link_state* state);
+};
+
+struct link_watch {
+  const char* event;
+  // When the pending burst settles, 0 if none is pending
+  double deadline;
+  struct link_state last;
+  bool has_last;
+};
+
+// A store notification: every one pushes the read back. Returns the time to
+// wake up at.
+static inline double link_watch_notify(struct link_watch* watch, double now) {
+  watch->deadline = now + LINK_SETTLE_SEC;
+  return watch->deadline;
+}
+
+// A wakeup: true once no notification arrived for LINK_SETTLE_SEC. An early
+// wakeup leaves the burst pending, to be waited for until deadline.
+static inline bool link_watch_settled(struct link_watch* watch, double now) {
+  if (watch->deadline == 0 || now < watch->deadline) return false;
+  watch->deadline = 0;
+  return true;
+}
+
+// Reads the source and builds the trigger into message if the state differs
+// from the last one pushed.
+static inline bool link_watch_poll(struct link_watch* watch,
+                                   const struct link_source* source,
+                                   char* message,
+                                   size_t size                      ) {
+  struct link_state state;
+  memset(&state, 0, sizeof(state));
+  source->read(source->context, &state);
+  if (watch->has_last && memcmp(&state, &watch->last, sizeof(state)) == 0) return false;
+  watch->last = state;
+  watch->has_last = true;
+
+  snprintf(message,
+           size,
+           "--trigger '%s' interface='%s' ssid='%s' ip='%s' subnet_mask='%s' router='%s' "
+           "link='%s' connected='%d'",
+           watch->event,
+           state.interface,
+           state.ssid,
+           state.ip,
+           state.subnet_mask,
+           state.router,
+           state.active ? "up" : "down",
+           state.ip[0] != '\0' ? 1 : 0);
+  return true;
+}
@@ -4,18 +4,17 @@
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <net/if.h>
+#include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
 
-static void set_string(NSMutableDictionary *dict, NSString *key, NSString *value) {
-  if (value && value.length > 0) {
-    dict[key] = value;
-  }
-}
+#include "../impact.h"
+#include "../json.h"
+#include "../sketchybar.h"
+#include "link.h"
 
-static void set_number(NSMutableDictionary *dict, NSString *key, NSNumber *value) {
-  if (value) {
-    dict[key] = value;
-  }
+static void write_string(struct json_writer *json, const char *key, NSString *value) {
+  if (value.length > 0) json_field_string(json, key, value.UTF8String);
 }
 
 static NSString *string_from_phy_mode(CWPHYMode mode) {
@@ -192,40 +191,179 @@ static void copy_ipconfig_ssid_bssid(NSString *interface_name, NSString **ssid_o
   if (bssid_out && bssid.length > 0) *bssid_out = bssid;
 }
 
-static void add_ipv4_info(NSMutableDictionary *dict, const char *ifname) {
-  if (!ifname || ifname[0] == '\0') return;
+static BOOL copy_ipv4_info(const char *ifname,
+                           char *ip, size_t ip_size,
+                           char *mask, size_t mask_size) {
+  if (ip_size > 0) ip[0] = '\0';
+  if (mask_size > 0) mask[0] = '\0';
+  if (!ifname || ifname[0] == '\0') return NO;
   struct ifaddrs *ifaddr = NULL;
-  if (getifaddrs(&ifaddr) != 0 || !ifaddr) return;
+  if (getifaddrs(&ifaddr) != 0 || !ifaddr) return NO;
+  BOOL found = NO;
   for (struct ifaddrs *ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
     if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET) continue;
     if (strcmp(ifa->ifa_name, ifname) != 0) continue;
-    char addr_buf[INET_ADDRSTRLEN] = { 0 };
     struct sockaddr_in *addr = (struct sockaddr_in *)ifa->ifa_addr;
-    if (inet_ntop(AF_INET, &addr->sin_addr, addr_buf, sizeof(addr_buf))) {
-      set_string(dict, @"ip", [NSString stringWithUTF8String:addr_buf]);
-    }
+    found = inet_ntop(AF_INET, &addr->sin_addr, ip, (socklen_t)ip_size) != NULL;
     if (ifa->ifa_netmask) {
-      char mask_buf[INET_ADDRSTRLEN] = { 0 };
-      struct sockaddr_in *mask = (struct sockaddr_in *)ifa->ifa_netmask;
-      if (inet_ntop(AF_INET, &mask->sin_addr, mask_buf, sizeof(mask_buf))) {
-        set_string(dict, @"subnet_mask", [NSString stringWithUTF8String:mask_buf]);
+      struct sockaddr_in *netmask = (struct sockaddr_in *)ifa->ifa_netmask;
+      if (!inet_ntop(AF_INET, &netmask->sin_addr, mask, (socklen_t)mask_size)) {
+        mask[0] = '\0';
       }
     }
     break;
   }
   freeifaddrs(ifaddr);
+  return found;
+}
+
+static void write_ipv4_info(struct json_writer *json, const char *ifname) {
+  char addr_buf[INET_ADDRSTRLEN] = { 0 };
+  char mask_buf[INET_ADDRSTRLEN] = { 0 };
+  copy_ipv4_info(ifname, addr_buf, sizeof(addr_buf), mask_buf, sizeof(mask_buf));
+  if (addr_buf[0]) json_field_string(json, "ip", addr_buf);
+  if (mask_buf[0]) json_field_string(json, "subnet_mask", mask_buf);
+}
+
+// Watch mode: stay resident with one dynamic store session and push a trigger
+// only when the connection state visible in the bar actually changes (link.h).
+struct watch_context {
+  __unsafe_unretained NSString *interface_arg;
+  SCDynamicStoreRef store;
+  CFRunLoopTimerRef timer;
+  struct link_watch watch;
+  struct link_source source;
+};
+
+static void copy_field(char *dst, size_t size, NSString *value) {
+  link_copy_field(dst, size, value.UTF8String);
+}
+
+static BOOL copy_link_active(SCDynamicStoreRef store, NSString *interface_name) {
+  if (!store || interface_name.length == 0) return NO;
+  NSString *key = [NSString stringWithFormat:@"State:/Network/Interface/%@/Link", interface_name];
+  CFDictionaryRef dict = SCDynamicStoreCopyValue(store, (__bridge CFStringRef)key);
+  if (!dict) return NO;
+  CFBooleanRef active = CFDictionaryGetValue(dict, CFSTR("Active"));
+  BOOL value = active && CFGetTypeID(active) == CFBooleanGetTypeID() && CFBooleanGetValue(active);
+  CFRelease(dict);
+  return value;
+}
+
+// Source of the watch
+static void read_link_state(void *context, struct link_state *state) {
+  struct watch_context *ctx = (struct watch_context *)context;
+  NSString *interface_name = ctx->interface_arg;
+  if (!interface_name) interface_name = copy_primary_interface(ctx->store);
+  CWInterface *iface = nil;
+  if (interface_name.length == 0) {
+    iface = [[CWWiFiClient sharedWiFiClient] interface];
+    interface_name = iface.interfaceName;
+  }
+  if (interface_name.length == 0) return;
+
+  copy_field(state->interface, sizeof(state->interface), interface_name);
+  copy_ipv4_info(state->interface,
+                 state->ip, sizeof(state->ip),
+                 state->subnet_mask, sizeof(state->subnet_mask));
+  copy_field(state->router, sizeof(state->router), copy_router(ctx->store, interface_name));
+  state->active = copy_link_active(ctx->store, interface_name);
+
+  NSString *ssid = copy_airport_ssid(ctx->store, interface_name);
+  if (ssid.length == 0) {
+    if (!iface) iface = [[CWWiFiClient sharedWiFiClient] interfaceWithName:interface_name];
+    ssid = iface.ssid;
+  }
+  copy_field(state->ssid, sizeof(state->ssid), ssid);
+}
+
+static void emit_if_changed(struct watch_context *ctx) {
+  @autoreleasepool {
+    char message[768];
+    if (link_watch_poll(&ctx->watch, &ctx->source, message, sizeof(message))) sketchybar(message);
+  }
+}
+
+static void coalesce_timer_fired(CFRunLoopTimerRef timer, void *info) {
+  struct watch_context *ctx = (struct watch_context *)info;
+  if (link_watch_settled(&ctx->watch, CFAbsoluteTimeGetCurrent())) {
+    emit_if_changed(ctx);
+  } else if (ctx->watch.deadline > 0) {
+    CFRunLoopTimerSetNextFireDate(timer, ctx->watch.deadline);
+  }
+}
+
+// Store notifications arrive in bursts while an interface comes up; the
+// state is re-read once the burst has settled.
+static void store_changed(SCDynamicStoreRef store, CFArrayRef changed_keys, void *info) {
+  (void)store;
+  (void)changed_keys;
+  struct watch_context *ctx = (struct watch_context *)info;
+  CFRunLoopTimerSetNextFireDate(ctx->timer, link_watch_notify(&ctx->watch, CFAbsoluteTimeGetCurrent()));
+}
+
+static int run_watch(NSString *interface_arg, const char *event) {
+  static struct watch_context ctx;
+  ctx.watch.event = event;
+  ctx.interface_arg = interface_arg;
+  ctx.source = (struct link_source){ .context = &ctx, .read = read_link_state };
+
+  SCDynamicStoreContext store_context = { 0, &ctx, NULL, NULL, NULL };
+  ctx.store = SCDynamicStoreCreate(NULL, CFSTR("network_info"), store_changed, &store_context);
+  if (!ctx.store) {
+    fprintf(stderr, "Failed to open dynamic store\n");
+    return 1;
+  }
+
+  NSArray *keys = @[ @"State:/Network/Global/IPv4", @"State:/Network/Global/IPv6" ];
+  NSArray *patterns = @[
+    @"State:/Network/Interface/[^/]+/IPv4",
+    @"State:/Network/Interface/[^/]+/Link",
+    @"State:/Network/Interface/[^/]+/AirPort",
+  ];
+  if (!SCDynamicStoreSetNotificationKeys(ctx.store,
+                                         (__bridge CFArrayRef)keys,
+                                         (__bridge CFArrayRef)patterns)) {
+    fprintf(stderr, "Failed to register for network changes\n");
+    CFRelease(ctx.store);
+    return 1;
+  }
+
+  CFRunLoopTimerContext timer_context = { 0, &ctx, NULL, NULL, NULL };
+  ctx.timer = CFRunLoopTimerCreate(NULL, 1e12, 1e12, 0, 0, coalesce_timer_fired, &timer_context);
+  CFRunLoopAddTimer(CFRunLoopGetCurrent(), ctx.timer, kCFRunLoopDefaultMode);
+
+  CFRunLoopSourceRef source = SCDynamicStoreCreateRunLoopSource(NULL, ctx.store, 0);
+  CFRunLoopAddSource(CFRunLoopGetCurrent(), source, kCFRunLoopDefaultMode);
+  CFRelease(source);
+
+  alarm(0);
+  char event_message[256];
+  snprintf(event_message, sizeof(event_message), "--add event '%s'", event);
+  sketchybar(event_message);
+
+  emit_if_changed(&ctx);
+  CFRunLoopRun();
+  return 0;
 }
 
 int main(int argc, char **argv) {
   @autoreleasepool {
+    impact_apply();
     NSString *interface_arg = nil;
+    const char *watch_event = NULL;
     for (int i = 1; i < argc; i++) {
-      if (!interface_arg) {
+      if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+        watch_event = argv[++i];
+      } else if (!interface_arg) {
         interface_arg = [NSString stringWithUTF8String:argv[i]];
       }
     }
 
     BOOL auto_mode = (interface_arg.length == 0) || [interface_arg isEqualToString:@"auto"] || [interface_arg isEqualToString:@"default"];
+    if (watch_event) {
+      return run_watch(auto_mode ? nil : interface_arg, watch_event);
+    }
     SCDynamicStoreRef store = SCDynamicStoreCreate(NULL, CFSTR("network_info"), NULL, NULL);
     NSString *interface_name = nil;
     if (auto_mode) {
@@ -245,15 +383,18 @@ int main(int argc, char **argv) {
       }
     }
 
-    NSMutableDictionary *info = [NSMutableDictionary dictionary];
+    char buffer[4096];
+    struct json_writer json;
+    json_init(&json, buffer, sizeof(buffer), stdout);
+    json_object_begin(&json);
     if (interface_name.length > 0) {
-      set_string(info, @"interface", interface_name);
-      add_ipv4_info(info, [interface_name UTF8String]);
+      write_string(&json, "interface", interface_name);
+      write_ipv4_info(&json, [interface_name UTF8String]);
     }
 
     CFStringRef computer_name = SCDynamicStoreCopyComputerName(NULL, NULL);
     if (computer_name) {
-      set_string(info, @"hostname", (__bridge_transfer NSString *)computer_name);
+      write_string(&json, "hostname", (__bridge_transfer NSString *)computer_name);
     }
 
     if (iface) {
@@ -278,61 +419,62 @@ int main(int argc, char **argv) {
         if (ssid.length == 0 && ipconfig_ssid.length > 0) ssid = ipconfig_ssid;
         if (bssid.length == 0 && ipconfig_bssid.length > 0) bssid = ipconfig_bssid;
       }
-      set_string(info, @"ssid", ssid);
-      set_string(info, @"bssid", bssid);
-      set_string(info, @"country_code", iface.countryCode);
-      set_string(info, @"adapter_mac", iface.hardwareAddress);
+      write_string(&json, "ssid", ssid);
+      write_string(&json, "bssid", bssid);
+      write_string(&json, "country_code", iface.countryCode);
+      write_string(&json, "adapter_mac", iface.hardwareAddress);
 
       NSString *phy = string_from_phy_mode(iface.activePHYMode);
-      set_string(info, @"phy_mode", phy);
+      write_string(&json, "phy_mode", phy);
 
       NSString *channel = string_from_channel(iface.wlanChannel);
-      set_string(info, @"channel", channel);
+      write_string(&json, "channel", channel);
 
       NSString *security = string_from_security(iface.security);
-      set_string(info, @"security", security);
+      write_string(&json, "security", security);
 
       NSString *mode = string_from_interface_mode(iface.interfaceMode);
-      set_string(info, @"interface_mode", mode);
+      write_string(&json, "interface_mode", mode);
 
+      char text[64];
       NSInteger rssi = iface.rssiValue;
       NSInteger noise = iface.noiseMeasurement;
       if (rssi != 0) {
-        set_number(info, @"rssi", @(rssi));
+        json_field_int(&json, "rssi", rssi);
       }
       if (noise != 0) {
-        set_number(info, @"noise", @(noise));
+        json_field_int(&json, "noise", noise);
       }
       if (rssi != 0 && noise != 0) {
-        NSInteger snr = rssi - noise;
-        set_number(info, @"snr", @(snr));
-        set_string(info, @"signal_noise", [NSString stringWithFormat:@"%ld dBm / %ld dBm", (long)rssi, (long)noise]);
+        json_field_int(&json, "snr", rssi - noise);
+        snprintf(text, sizeof(text), "%ld dBm / %ld dBm", (long)rssi, (long)noise);
+        json_field_string(&json, "signal_noise", text);
       }
 
       double tx_rate = iface.transmitRate;
       if (tx_rate > 0) {
-        set_string(info, @"transmit_rate", [NSString stringWithFormat:@"%.0f Mbps", tx_rate]);
-        set_number(info, @"transmit_rate_mbps", @(tx_rate));
+        snprintf(text, sizeof(text), "%.0f Mbps", tx_rate);
+        json_field_string(&json, "transmit_rate", text);
+        json_field_double(&json, "transmit_rate_mbps", tx_rate);
       }
 
       NSInteger tx_power = iface.transmitPower;
       if (tx_power > 0) {
-        set_string(info, @"transmit_power", [NSString stringWithFormat:@"%ld mW", (long)tx_power]);
-        set_number(info, @"transmit_power_mw", @(tx_power));
+        snprintf(text, sizeof(text), "%ld mW", (long)tx_power);
+        json_field_string(&json, "transmit_power", text);
+        json_field_int(&json, "transmit_power_mw", tx_power);
       }
     }
 
     NSString *router = copy_router(store, interface_name);
-    set_string(info, @"router", router);
+    write_string(&json, "router", router);
     if (store) CFRelease(store);
 
-    NSError *error = nil;
-    NSData *json = [NSJSONSerialization dataWithJSONObject:info options:0 error:&error];
-    if (!json) {
-      fprintf(stderr, "Failed to encode JSON: %s\n", error.localizedDescription.UTF8String);
+    json_object_end(&json);
+    if (!json_finish(&json, false)) {
+      fprintf(stderr, "Failed to write JSON\n");
       return 1;
     }
-    fwrite(json.bytes, 1, json.length, stdout);
   }
   return 0;
 }
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../link.h"
+
+// Replays a fixture of dynamic store activity through the coalescing and the
+// diff of watch mode. Each line is "<seconds> <action>":
+//   state <interface> <ssid> <ip> <mask> <router> <up|down>
+//                    what the store reports from now on, "-" for empty
+//   notify           a store notification
+//   wake             the coalescing timer fires
+// Prints what every wakeup pushes: `make test` diffs the output against
+// link.expected.
+
+static void set_field(char* dst, size_t size, const char* value) {
+  link_copy_field(dst, size, strcmp(value, "-") == 0 ? "" : value);
+}
+
+static void fixture_read(void* context, struct link_state* state) {
+  *state = *(const struct link_state*)context;
+}
+
+int main(void) {
+  struct link_state store;
+  memset(&store, 0, sizeof(store));
+  struct link_source source = { .context = &store, .read = fixture_read };
+  struct link_watch watch = { .event = "network_info_change" };
+
+  char line[512];
+  while (fgets(line, sizeof(line), stdin)) {
+    line[strcspn(line, "\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0') continue;
+
+    double now = strtod(line, NULL);
+    char action[16] = "";
+    char fields[6][128];
+    int count = sscanf(line, "%*f %15s %127s %127s %127s %127s %127s %127s",
+                       action, fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+    if (strcmp(action, "state") == 0 && count == 7) {
+      memset(&store, 0, sizeof(store));
+      set_field(store.interface, sizeof(store.interface), fields[0]);
+      set_field(store.ssid, sizeof(store.ssid), fields[1]);
+      set_field(store.ip, sizeof(store.ip), fields[2]);
+      set_field(store.subnet_mask, sizeof(store.subnet_mask), fields[3]);
+      set_field(store.router, sizeof(store.router), fields[4]);
+      store.active = strcmp(fields[5], "up") == 0;
+    } else if (strcmp(action, "notify") == 0) {
+      double deadline = link_watch_notify(&watch, now);
+      printf("%.2f notify, wake at %.2f\n", now, deadline);
+    } else if (strcmp(action, "wake") == 0) {
+      char message[768];
+      if (watch.deadline == 0) {
+        printf("%.2f wake, nothing pending\n", now);
+      } else if (!link_watch_settled(&watch, now)) {
+        printf("%.2f wake, not settled\n", now);
+      } else if (link_watch_poll(&watch, &source, message, sizeof(message))) {
+        printf("%.2f wake: %s\n", now, message);
+      } else {
+        printf("%.2f wake, unchanged\n", now);
+      }
+    } else {
+      printf("bad line: %s\n", line);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Slots of the interfaces a network_set tracks, looked up by interface index
+// on every dump. Interfaces come and go (VPN tunnels get a new utunN each
+// time), so a slot whose interface was missing from the last dump is handed
+// to the next new interface once all MAX_INTERFACES are taken.
+
+#define MAX_INTERFACES 32
+#define MAX_IFINDEX 1024
+#define IFSLOT_UNSEEN 0xff
+#define IFSLOT_IGNORED 0xfe
+// Every slot is held by an interface of the last dump: not cached, the
+// interface is retried on the next dump
+#define IFSLOT_FULL 0xfd
+
+struct network_iface {
+  char name[IF_NAMESIZE];
+  uint16_t index;
+  bool seen;
+  // Missing from the last dump, the slot can be recycled
+  bool stale;
+  bool primed;
+  uint64_t ibytes;
+  uint64_t obytes;
+
+  double up_mbps;
+  double down_mbps;
+};
+
+struct network_ifaces {
+  // Slot of each interface index, valid while the index still carries the
+  // interface name it was assigned under (hash in slot_names): an index can
+  // be reused by another interface between two dumps
+  uint8_t slots[MAX_IFINDEX];
+  uint32_t slot_names[MAX_IFINDEX];
+
+  struct network_iface entries[MAX_INTERFACES];
+  uint32_t count;
+};
+
+static inline void network_ifaces_init(struct network_ifaces* ifaces) {
+  memset(ifaces, 0, sizeof(struct network_ifaces));
+  memset(ifaces->slots, IFSLOT_UNSEEN, sizeof(ifaces->slots));
+}
+
+// FNV-1a, to tell a reused interface index from the one that was cached
+static inline uint32_t network_name_hash(const char* name) {
+  uint32_t hash = 2166136261u;
+  for (; *name; name++) hash = (hash ^ (uint8_t)*name) * 16777619u;
+  return hash;
+}
+
+// Cached slot of the interface at index, IFSLOT_UNSEEN if it has to be
+// assigned
+static inline uint8_t network_ifaces_lookup(const struct network_ifaces* ifaces,
+                                            uint16_t index,
+                                            uint32_t name_hash           ) {
+  if (ifaces->slot_names[index] != name_hash) return IFSLOT_UNSEEN;
+  return ifaces->slots[index];
+}
+
+// Drops the cached index of slot, before it moves to another index
+static inline void network_ifaces_unmap(struct network_ifaces* ifaces, uint8_t slot) {
+  uint16_t index = ifaces->entries[slot].index;
+  if (ifaces->slots[index] == slot) ifaces->slots[index] = IFSLOT_UNSEEN;
+}
+
+static inline uint8_t network_ifaces_claim(struct network_ifaces* ifaces,
+                                           uint16_t index,
+                                           const char* name            ) {
+  // Reuse the slot of an interface that came back under a new index
+  for (uint32_t i = 0; i < ifaces->count; i++) {
+    struct network_iface* iface = &ifaces->entries[i];
+    if (strcmp(iface->name, name) != 0) continue;
+    if (iface->index != index) {
+      network_ifaces_unmap(ifaces, (uint8_t)i);
+      iface->index = index;
+      iface->primed = false;
+    }
+    return (uint8_t)i;
+  }
+
+  uint32_t slot = ifaces->count;
+  if (slot < MAX_INTERFACES) {
+    ifaces->count++;
+  } else {
+    for (slot = 0; slot < ifaces->count && !ifaces->entries[slot].stale; slot++);
+    if (slot == ifaces->count) return IFSLOT_FULL;
+    network_ifaces_unmap(ifaces, (uint8_t)slot);
+  }
+
+  struct network_iface* iface = &ifaces->entries[slot];
+  memset(iface, 0, sizeof(struct network_iface));
+  snprintf(iface->name, sizeof(iface->name), "%s", name);
+  iface->index = index;
+  return (uint8_t)slot;
+}
+
+// Assigns and caches the slot of the interface at index; untracked ones
+// (filtered out, nameless) are cached as IFSLOT_IGNORED.
+static inline uint8_t network_ifaces_assign(struct network_ifaces* ifaces,
+                                            uint16_t index,
+                                            const char* name,
+                                            uint32_t name_hash,
+                                            bool tracked                 ) {
+  uint8_t slot = tracked ? network_ifaces_claim(ifaces, index, name) : IFSLOT_IGNORED;
+  if (slot == IFSLOT_FULL) return slot;
+  ifaces->slots[index] = slot;
+  ifaces->slot_names[index] = name_hash;
+  return slot;
+}
+
+static inline void network_ifaces_begin_dump(struct network_ifaces* ifaces) {
+  for (uint32_t i = 0; i < ifaces->count; i++) ifaces->entries[i].seen = false;
+}
+
+// Interfaces missing from the dump have no rate and give up their counters
+static inline void network_ifaces_end_dump(struct network_ifaces* ifaces) {
+  for (uint32_t i = 0; i < ifaces->count; i++) {
+    struct network_iface* iface = &ifaces->entries[i];
+    iface->stale = !iface->seen;
+    if (iface->seen) continue;
+    iface->up_mbps = 0;
+    iface->down_mbps = 0;
+    iface->primed = false;
+  }
+}
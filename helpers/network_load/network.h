@@ -1,13 +1,25 @@
+#include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <net/if.h>
+#include <net/if_dl.h>
 #include <net/if_mib.h>
+#include <net/route.h>
+#include <sys/socket.h>
 #include <sys/sysctl.h>
 #include <time.h>
+#include "../glob.h"
+#include "../rate.h"
+#include "../trace.h"
+#include "ifaces.h"
+
 struct network {
   uint32_t row;
   struct ifmibdata data;
   struct timespec ts_prev;
+  double elapsed;
 
   double up_mbps;
   double down_mbps;
@@ -16,8 +28,20 @@ struct network {
 static inline void ifdata(uint32_t net_row, struct ifmibdata* data) {
 	static size_t size = sizeof(struct ifmibdata);
   static int32_t data_option[] = { CTL_NET, PF_LINK, NETLINK_GENERIC, IFMIB_IFDATA, 0, IFDATA_GENERAL };
+  if (trace_replaying()) {
+    trace_read(TRACE_INTERFACE, data, sizeof(struct ifmibdata));
+    return;
+  }
   data_option[4] = net_row;
   sysctl(data_option, 6, data, &size, NULL, 0);
+  trace_record(TRACE_INTERFACE, data, sizeof(struct ifmibdata));
+}
+
+// Monotonic time of a counter sample, recorded with the trace inputs
+static inline double network_elapsed(struct timespec* prev) {
+  struct timespec now;
+  trace_now(&now);
+  return rate_elapsed_until(prev, now);
 }
 
 static inline int network_init(struct network* net, const char* ifname) {
@@ -30,30 +54,193 @@ static inline int network_init(struct network* net, const char* ifname) {
   return 1;
 }
 
-static inline void network_update(struct network* net) {
-  struct timespec ts_now;
-  clock_gettime(CLOCK_MONOTONIC, &ts_now);
-  if (net->ts_prev.tv_sec == 0 && net->ts_prev.tv_nsec == 0) {
-    net->ts_prev = ts_now;
-    return;
-  }
-  double time_scale = (double)(ts_now.tv_sec - net->ts_prev.tv_sec)
-                      + (double)(ts_now.tv_nsec - net->ts_prev.tv_nsec) / 1e9;
-  net->ts_prev = ts_now;
+// Returns true if a new rate sample was produced. The first call and a
+// counter reset (interface went down and came back) only re-prime the
+// counters and keep the previous rates.
+static inline bool network_update(struct network* net) {
+  double time_scale = network_elapsed(&net->ts_prev);
+  if (time_scale == 0.0) return false;
 
   uint64_t ibytes_nm1 = net->data.ifmd_data.ifi_ibytes;
   uint64_t obytes_nm1 = net->data.ifmd_data.ifi_obytes;
   ifdata(net->row, &net->data);
 
-  if (time_scale <= 0.0 || time_scale > 1e2) return;
-  double delta_ibytes = (double)(net->data.ifmd_data.ifi_ibytes - ibytes_nm1)
-                        / time_scale;
-  double delta_obytes = (double)(net->data.ifmd_data.ifi_obytes - obytes_nm1)
-                        / time_scale;
-
-  if (delta_ibytes < 0) delta_ibytes = 0;
-  if (delta_obytes < 0) delta_obytes = 0;
+  if (!rate_window_valid(time_scale)) return false;
+  if (net->data.ifmd_data.ifi_ibytes < ibytes_nm1
+      || net->data.ifmd_data.ifi_obytes < obytes_nm1) {
+    return false;
+  }
+  double delta_ibytes = rate_per_sec(net->data.ifmd_data.ifi_ibytes,
+                                     ibytes_nm1,
+                                     time_scale                     );
+  double delta_obytes = rate_per_sec(net->data.ifmd_data.ifi_obytes,
+                                     obytes_nm1,
+                                     time_scale                     );
 
   net->down_mbps = (delta_ibytes * 8.0) / 1000000.0;
   net->up_mbps = (delta_obytes * 8.0) / 1000000.0;
+  net->elapsed = time_scale;
+  return true;
+}
+
+// Tracks every interface matching a glob list with a single NET_RT_IFLIST2
+// dump per tick, independent of how many interfaces there are.
+struct network_set {
+  const char* filter;
+  bool skip_loopback;
+  struct timespec ts_prev;
+  double elapsed;
+
+  char* buffer;
+  size_t buffer_size;
+  struct network_ifaces ifaces;
+
+  double up_mbps;
+  double down_mbps;
+};
+
+static inline bool iflist2_replay(struct network_set* set, size_t* length) {
+  const void* recorded = trace_next(TRACE_INTERFACE_LIST, length);
+  if (!recorded) return false;
+  if (*length > set->buffer_size) {
+    char* buffer = realloc(set->buffer, *length);
+    if (!buffer) return false;
+    set->buffer = buffer;
+    set->buffer_size = *length;
+  }
+  memcpy(set->buffer, recorded, *length);
+  return true;
+}
+
+static inline bool iflist2(struct network_set* set, size_t* length) {
+  if (trace_replaying()) return iflist2_replay(set, length);
+
+  static int32_t mib[] = { CTL_NET, PF_ROUTE, 0, 0, NET_RT_IFLIST2, 0 };
+  for (int attempt = 0; attempt < 4; attempt++) {
+    *length = set->buffer_size;
+    if (set->buffer && sysctl(mib, 6, set->buffer, length, NULL, 0) == 0) {
+      trace_record(TRACE_INTERFACE_LIST, set->buffer, *length);
+      return true;
+    }
+    if (set->buffer && errno != ENOMEM) return false;
+
+    // Size query, with headroom for interfaces appearing in between
+    size_t needed = 0;
+    if (sysctl(mib, 6, NULL, &needed, NULL, 0) != 0) return false;
+    needed += needed / 2;
+    char* buffer = realloc(set->buffer, needed);
+    if (!buffer) return false;
+    set->buffer = buffer;
+    set->buffer_size = needed;
+  }
+  return false;
+}
+
+static inline void network_set_init(struct network_set* set, const char* filter) {
+  memset(set, 0, sizeof(struct network_set));
+  set->filter = filter;
+  set->skip_loopback = strcmp(filter, "all") == 0;
+  network_ifaces_init(&set->ifaces);
+}
+
+// The name from the link address following the message; false if it has none
+static inline bool network_iface_name(struct if_msghdr2* ifm, char name[IF_NAMESIZE]) {
+  struct sockaddr_dl* sdl = (struct sockaddr_dl*)(ifm + 1);
+  if (sdl->sdl_family != AF_LINK || sdl->sdl_nlen == 0
+      || sdl->sdl_nlen >= IF_NAMESIZE) {
+    return false;
+  }
+  memcpy(name, sdl->sdl_data, sdl->sdl_nlen);
+  name[sdl->sdl_nlen] = '\0';
+  return true;
+}
+
+static inline bool network_set_tracks(struct network_set* set,
+                                      struct if_msghdr2* ifm,
+                                      const char* name       ) {
+  if (set->skip_loopback && (ifm->ifm_flags & IFF_LOOPBACK)) return false;
+  return name[0] && glob_list_matches(set->filter, name);
+}
+
+// Returns true if a new aggregate sample was produced.
+static inline bool network_set_update(struct network_set* set) {
+  double time_scale = network_elapsed(&set->ts_prev);
+  size_t length = 0;
+  if (!iflist2(set, &length)) return false;
+
+  network_ifaces_begin_dump(&set->ifaces);
+
+  char* end = set->buffer + length;
+  for (char* next = set->buffer; next < end;) {
+    struct if_msghdr* msg = (struct if_msghdr*)next;
+    if (msg->ifm_msglen == 0) break;
+    next += msg->ifm_msglen;
+    if (msg->ifm_type != RTM_IFINFO2) continue;
+
+    struct if_msghdr2* ifm = (struct if_msghdr2*)msg;
+    if (ifm->ifm_index >= MAX_IFINDEX) continue;
+
+    char name[IF_NAMESIZE];
+    if (!network_iface_name(ifm, name)) name[0] = '\0';
+    uint32_t name_hash = network_name_hash(name);
+    uint8_t slot = network_ifaces_lookup(&set->ifaces, ifm->ifm_index, name_hash);
+    if (slot == IFSLOT_UNSEEN) {
+      slot = network_ifaces_assign(&set->ifaces, ifm->ifm_index, name, name_hash,
+                                   network_set_tracks(set, ifm, name)            );
+    }
+    if (slot >= MAX_INTERFACES) continue;
+
+    struct network_iface* iface = &set->ifaces.entries[slot];
+    uint64_t ibytes = ifm->ifm_data.ifi_ibytes;
+    uint64_t obytes = ifm->ifm_data.ifi_obytes;
+    bool reset = ibytes < iface->ibytes || obytes < iface->obytes;
+    if (iface->primed && !reset && rate_window_valid(time_scale)) {
+      iface->down_mbps = rate_per_sec(ibytes, iface->ibytes, time_scale)
+                         * 8.0 / 1000000.0;
+      iface->up_mbps = rate_per_sec(obytes, iface->obytes, time_scale)
+                       * 8.0 / 1000000.0;
+    } else {
+      // Reset counters (interface bounced, re-attached) only give a new
+      // baseline: the interface is left out of the total until its next
+      // sample instead of repeating its rate from before the reset
+      iface->down_mbps = 0;
+      iface->up_mbps = 0;
+    }
+    iface->ibytes = ibytes;
+    iface->obytes = obytes;
+    iface->primed = true;
+    iface->seen = true;
+  }
+
+  network_ifaces_end_dump(&set->ifaces);
+  set->up_mbps = 0;
+  set->down_mbps = 0;
+  for (uint32_t i = 0; i < set->ifaces.count; i++) {
+    struct network_iface* iface = &set->ifaces.entries[i];
+    if (!iface->seen) continue;
+    set->up_mbps += iface->up_mbps;
+    set->down_mbps += iface->down_mbps;
+  }
+  set->elapsed = time_scale;
+  return rate_window_valid(time_scale);
+}
+
+// Formats the per-interface rates as "name:up:down" records separated by ';'.
+static inline void network_set_format(struct network_set* set,
+                                      char* buffer,
+                                      size_t size         ) {
+  size_t offset = 0;
+  buffer[0] = '\0';
+  bool first = true;
+  for (uint32_t i = 0; i < set->ifaces.count && offset < size; i++) {
+    struct network_iface* iface = &set->ifaces.entries[i];
+    if (!iface->seen) continue;
+    int written = snprintf(buffer + offset, size - offset, "%s%s:%.2f:%.2f",
+                           first ? "" : ";",
+                           iface->name,
+                           iface->up_mbps,
+                           iface->down_mbps);
+    if (written > 0) offset += written;
+    first = false;
+  }
 }
@@ -5,7 +5,14 @@
 #include <CoreFoundation/CoreFoundation.h>
 #include <SystemConfiguration/SystemConfiguration.h>
 #include "network.h"
+#include "primary.h"
+#include "../heartbeat.h"
+#include "../impact.h"
+#include "../metrics.h"
+#include "../metrics_process.h"
 #include "../sketchybar.h"
+#include "../state.h"
+#include "../trace.h"
 
 static bool resolve_primary_interface(SCDynamicStoreRef store,
                                       char* buffer,
@@ -29,25 +36,380 @@ static bool resolve_primary_interface(SCDynamicStoreRef store,
   return false;
 }
 
+static void primary_interface_changed(SCDynamicStoreRef store,
+                                      CFArrayRef changed_keys,
+                                      void* info                ) {
+  (void)store;
+  (void)changed_keys;
+  ((struct primary_watch*)info)->changed = true;
+}
+
+static bool watch_primary_interface(SCDynamicStoreRef store) {
+  CFStringRef keys[] = {
+    CFSTR("State:/Network/Global/IPv4"),
+    CFSTR("State:/Network/Global/IPv6"),
+  };
+  CFArrayRef key_array = CFArrayCreate(NULL,
+                                       (const void**)keys,
+                                       sizeof(keys) / sizeof(keys[0]),
+                                       &kCFTypeArrayCallBacks         );
+  if (!key_array) return false;
+  bool ok = SCDynamicStoreSetNotificationKeys(store, key_array, NULL);
+  CFRelease(key_array);
+  if (!ok) return false;
+
+  CFRunLoopSourceRef source = SCDynamicStoreCreateRunLoopSource(NULL, store, 0);
+  if (!source) return false;
+  CFRunLoopAddSource(CFRunLoopGetCurrent(), source, kCFRunLoopDefaultMode);
+  CFRelease(source);
+  return true;
+}
+
+// The primary_source of the sampling loop
+struct primary_context {
+  SCDynamicStoreRef store;
+  struct network* network;
+};
+
+static bool primary_resolve(void* context, char* ifname, size_t size) {
+  return resolve_primary_interface(((struct primary_context*)context)->store, ifname, size);
+}
+
+static bool primary_open(void* context, const char* ifname) {
+  if (network_init(((struct primary_context*)context)->network, ifname)) return true;
+  fprintf(stderr, "Interface not found: %s\n", ifname);
+  return false;
+}
+
+// Sleeps for one tick while servicing dynamic store notifications, so an
+// interface switch takes effect as soon as it is announced.
+static void wait_tick(float seconds,
+                      SCDynamicStoreRef store,
+                      struct primary_watch* watch,
+                      char* ifname,
+                      struct network* network     ) {
+  if (!store || trace_replaying()) {
+    trace_sleep(seconds);
+    return;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  double target = (double)deadline.tv_sec + (double)deadline.tv_nsec / 1e9
+                  + seconds;
+  struct primary_context context = { .store = store, .network = network };
+  struct primary_source source = {
+    .context = &context,
+    .resolve = primary_resolve,
+    .open = primary_open
+  };
+  for (;;) {
+    primary_follow(watch, &source, ifname);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double remaining = target - ((double)now.tv_sec + (double)now.tv_nsec / 1e9);
+    if (remaining <= 0.0) return;
+    CFRunLoopRunInMode(kCFRunLoopDefaultMode, remaining, true);
+  }
+}
+
+// Counters can be sampled several times per emitted tick. The emitted rate is
+// then an EWMA over all samples together with the peak sample of the window.
+struct sampling {
+  int samples_per_tick;
+  float period;
+  struct rate_smoother up;
+  struct rate_smoother down;
+};
+
+static void sampling_init(struct sampling* sampling,
+                          float update_freq,
+                          float sample_freq,
+                          float half_life         ) {
+  memset(sampling, 0, sizeof(struct sampling));
+  sampling->samples_per_tick = 1;
+  if (sample_freq > 0.0f && sample_freq < update_freq) {
+    sampling->samples_per_tick = (int)(update_freq / sample_freq + 0.5f);
+  }
+  sampling->period = update_freq / (float)sampling->samples_per_tick;
+  sampling->up.half_life = half_life;
+  sampling->down.half_life = half_life;
+}
+
+// Scrape endpoint (--metrics): the emitted rates of every tick, plus
+// histograms of the rates since the helper started
+static const double rate_buckets[] = { 0.1, 1, 10, 50, 100, 500, 1000 };
+
+struct net_metrics {
+  int up;
+  int down;
+  int up_peak;
+  int down_peak;
+  int up_hist;
+  int down_hist;
+  int ticks;
+  int iface_rates[MAX_INTERFACES][2];
+  // Interface each slot's rates are labelled with
+  char iface_names[MAX_INTERFACES][IF_NAMESIZE];
+  struct metrics_process process;
+  struct metrics_startup startup;
+};
+
+static void net_metrics_init(struct net_metrics* m, struct metrics* metrics) {
+  m->up = metrics_add(metrics, METRIC_GAUGE, "sketchybar_network_rate_mbps",
+                      "direction=\"up\"", "Smoothed rate of the last tick");
+  m->down = metrics_add(metrics, METRIC_GAUGE, "sketchybar_network_rate_mbps",
+                        "direction=\"down\"", NULL);
+  m->up_peak = metrics_add(metrics, METRIC_GAUGE, "sketchybar_network_peak_mbps",
+                           "direction=\"up\"", "Peak sample of the last tick");
+  m->down_peak = metrics_add(metrics, METRIC_GAUGE, "sketchybar_network_peak_mbps",
+                             "direction=\"down\"", NULL);
+  m->up_hist = metrics_add_histogram(metrics, "sketchybar_network_tick_mbps",
+                                     "direction=\"up\"", "Smoothed rate per tick",
+                                     rate_buckets, sizeof(rate_buckets) / sizeof(double));
+  m->down_hist = metrics_add_histogram(metrics, "sketchybar_network_tick_mbps",
+                                       "direction=\"down\"", NULL,
+                                       rate_buckets, sizeof(rate_buckets) / sizeof(double));
+  m->ticks = metrics_add(metrics, METRIC_COUNTER, "sketchybar_network_load_ticks",
+                         NULL, "Sampling ticks");
+  memset(m->iface_rates, 0xff, sizeof(m->iface_rates));
+  metrics_add_process(metrics, &m->process);
+  metrics_add_startup(metrics, &m->startup);
+}
+
+static void net_metrics_update(struct net_metrics* m,
+                               struct metrics* metrics,
+                               double up,
+                               double down,
+                               double up_peak,
+                               double down_peak,
+                               const struct state* state) {
+  if (!metrics->enabled) return;
+  metrics_set(metrics, m->up, up);
+  metrics_set(metrics, m->down, down);
+  metrics_set(metrics, m->up_peak, up_peak);
+  metrics_set(metrics, m->down_peak, down_peak);
+  metrics_observe(metrics, m->up_hist, up);
+  metrics_observe(metrics, m->down_hist, down);
+  metrics_inc(metrics, m->ticks, 1);
+  metrics_update_process(metrics, &m->process);
+  metrics_update_startup(metrics, &m->startup, state);
+}
+
+// The metrics of an interface slot are registered the first time the slot
+// is used and relabelled when the slot is recycled for another interface.
+// Interfaces that are gone are left out.
+static void net_metrics_update_set(struct net_metrics* m,
+                                   struct metrics* metrics,
+                                   const struct network_set* set) {
+  if (!metrics->enabled) return;
+  for (uint32_t i = 0; i < set->ifaces.count; i++) {
+    const struct network_iface* iface = &set->ifaces.entries[i];
+    int* rates = m->iface_rates[i];
+    char labels[METRICS_LABELS_SIZE];
+    if (rates[0] < 0) {
+      snprintf(labels, sizeof(labels), "interface=\"%s\",direction=\"up\"", iface->name);
+      rates[0] = metrics_add(metrics, METRIC_GAUGE, "sketchybar_network_interface_mbps",
+                             labels, "Unsmoothed rate of the last sample");
+      snprintf(labels, sizeof(labels), "interface=\"%s\",direction=\"down\"", iface->name);
+      rates[1] = metrics_add(metrics, METRIC_GAUGE, "sketchybar_network_interface_mbps",
+                             labels, NULL);
+    } else if (strcmp(m->iface_names[i], iface->name) != 0) {
+      snprintf(labels, sizeof(labels), "interface=\"%s\",direction=\"up\"", iface->name);
+      metrics_relabel(metrics, rates[0], labels);
+      snprintf(labels, sizeof(labels), "interface=\"%s\",direction=\"down\"", iface->name);
+      metrics_relabel(metrics, rates[1], labels);
+    }
+    snprintf(m->iface_names[i], sizeof(m->iface_names[i]), "%s", iface->name);
+    if (iface->seen) {
+      metrics_set(metrics, rates[0], iface->up_mbps);
+      metrics_set(metrics, rates[1], iface->down_mbps);
+    } else {
+      metrics_invalidate(metrics, rates[0]);
+      metrics_invalidate(metrics, rates[1]);
+    }
+  }
+}
+
+// Last-known state (state.h): the triggers of the last ticks, replayed in
+// order so the graph is refilled and the label shows the last rates
+#define NET_STATE_TRIGGER 1
+#define NET_HISTORY 16
+#define NET_TRIGGER_SIZE 1600
+
+struct net_history {
+  char triggers[NET_HISTORY][NET_TRIGGER_SIZE];
+  uint32_t count;
+  uint32_t next;
+};
+
+static void net_history_add(struct net_history* history, const char* trigger) {
+  strlcpy(history->triggers[history->next], trigger, NET_TRIGGER_SIZE);
+  history->next = (history->next + 1) % NET_HISTORY;
+  if (history->count < NET_HISTORY) history->count++;
+}
+
+static void save_state(struct state* state, const struct net_history* history) {
+  if (!state->enabled) return;
+  state_begin(state);
+  uint32_t start = (history->next + NET_HISTORY - history->count) % NET_HISTORY;
+  for (uint32_t i = 0; i < history->count; i++) {
+    const char* trigger = history->triggers[(start + i) % NET_HISTORY];
+    state_add(state, NET_STATE_TRIGGER, trigger, strlen(trigger));
+  }
+  state_commit(state);
+}
+
+// The replayed triggers are kept as the start of the new history
+static void replay_state(struct state* state, struct net_history* history) {
+  if (!state_load(state)) return;
+  char trigger[NET_TRIGGER_SIZE];
+  size_t cursor = 0;
+  size_t size = 0;
+  for (const char* saved; (saved = state_next(state, NET_STATE_TRIGGER, &cursor, &size));) {
+    if (size >= sizeof(trigger)) continue;
+    memcpy(trigger, saved, size);
+    trigger[size] = '\0';
+    sketchybar(trigger);
+    net_history_add(history, trigger);
+  }
+  state_replayed(state);
+}
+
+// Emits aggregate upload/download plus per-interface "name:up:down" records
+// for every interface matching the glob list.
+static int run_interface_set(const char* filter,
+                             const char* event,
+                             struct sampling* sampling,
+                             int slow_every,
+                             struct metrics* metrics,
+                             struct state* state      ) {
+  alarm(0);
+  char event_message[512];
+  snprintf(event_message, 512, "--add event '%s'", event);
+  sketchybar(event_message);
+  static struct net_history history;
+  replay_state(state, &history);
+
+  struct network_set set;
+  network_set_init(&set, filter);
+  struct net_metrics net_metrics;
+  net_metrics_init(&net_metrics, metrics);
+
+  char interfaces[1024];
+  char trigger_message[NET_TRIGGER_SIZE];
+  int tick = 0;
+  while (trace_tick()) {
+    // The first tick only primes the counters with its first sample and
+    // takes the second one right away
+    int samples = tick == 0 ? 2 : sampling->samples_per_tick;
+    float period = tick == 0 ? STATE_PRIME_SEC : sampling->period;
+    bool sampled = false;
+    for (int i = 0; i < samples; i++) {
+      if (i > 0) trace_sleep(period);
+      if (network_set_update(&set)) {
+        rate_smoother_add(&sampling->up, set.up_mbps, set.elapsed);
+        rate_smoother_add(&sampling->down, set.down_mbps, set.elapsed);
+        sampled = true;
+      }
+    }
+    network_set_format(&set, interfaces, sizeof(interfaces));
+
+    bool is_full = (tick % slow_every == 0);
+    double up_peak = rate_smoother_take_peak(&sampling->up);
+    double down_peak = rate_smoother_take_peak(&sampling->down);
+    snprintf(trigger_message,
+             sizeof(trigger_message),
+             "--trigger '%s' upload='%.2f' download='%.2f' "
+             "upload_peak='%.2f' download_peak='%.2f' "
+             "interfaces='%s' full_update='%d'",
+             event,
+             sampling->up.value,
+             sampling->down.value,
+             up_peak,
+             down_peak,
+             interfaces,
+             is_full ? 1 : 0);
+
+    sketchybar(trigger_message);
+    if (sampled) state_valid(state);
+    net_history_add(&history, trigger_message);
+    if (is_full) save_state(state, &history);
+    net_metrics_update(&net_metrics,
+                       metrics,
+                       sampling->up.value,
+                       sampling->down.value,
+                       up_peak,
+                       down_peak,
+                       state               );
+    net_metrics_update_set(&net_metrics, metrics, &set);
+    metrics_publish(metrics);
+    heartbeat();
+    tick++;
+    trace_sleep(sampling->period);
+  }
+  return 0;
+}
+
 int main (int argc, char** argv) {
+  impact_apply();
+  static struct state state;
   float update_freq;
   if (argc < 4 || (sscanf(argv[3], "%f", &update_freq) != 1)) {
-    printf("Usage: %s \"<interface|auto>\" \"<event-name>\" \"<event_freq>\" [\"<slow_freq>\"]\n", argv[0]);
+    printf("Usage: %s \"<interface|auto|all|glob,...>\" \"<event-name>\" \"<event_freq>\" [\"<slow_freq>\"] "
+           "[--sample \"<sample_freq>\"] [--half-life \"<seconds>\"] "
+           "[--metrics <port|socket-path>]\n", argv[0]);
     exit(1);
   }
 
   float slow_freq = 1.0f;
-  if (argc >= 5) sscanf(argv[4], "%f", &slow_freq);
+  float sample_freq = 0.0f;
+  float half_life = 0.0f;
+  const char* metrics_address = NULL;
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%f", &sample_freq);
+    } else if (strcmp(argv[i], "--half-life") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%f", &half_life);
+    } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+      metrics_address = argv[++i];
+    } else if (i == 4) {
+      sscanf(argv[4], "%f", &slow_freq);
+    }
+  }
   int slow_every = (int)(slow_freq / update_freq);
   if (slow_every < 1) slow_every = 1;
+  if (!trace_init()) return 1;
+  state_init(&state, "network_load", argv[2], !trace_replaying());
+
+  static struct metrics metrics;
+  metrics_init(&metrics);
+  if (metrics_address && !metrics_start(&metrics, metrics_address)) {
+    fprintf(stderr, "Failed to serve metrics on %s\n", metrics_address);
+    return 1;
+  }
+
+  struct sampling sampling;
+  sampling_init(&sampling, update_freq, sample_freq, half_life);
 
   bool auto_mode = (strcmp(argv[1], "auto") == 0) || (strcmp(argv[1], "default") == 0);
+  if (!auto_mode && glob_list_is_pattern(argv[1])) {
+    return run_interface_set(argv[1], argv[2], &sampling, slow_every, &metrics, &state);
+  }
+
   SCDynamicStoreRef store = NULL;
+  struct primary_watch watch = { 0 };
   char ifname[IF_NAMESIZE] = { 0 };
   const char* interface_name = argv[1];
   if (auto_mode) {
-    store = SCDynamicStoreCreate(NULL, CFSTR("network_load"), NULL, NULL);
-    if (!store || !resolve_primary_interface(store, ifname, sizeof(ifname))) {
+    SCDynamicStoreContext context = { 0, &watch, NULL, NULL, NULL };
+    store = SCDynamicStoreCreate(NULL,
+                                 CFSTR("network_load"),
+                                 primary_interface_changed,
+                                 &context                  );
+    if (!store || !watch_primary_interface(store)
+        || !resolve_primary_interface(store, ifname, sizeof(ifname))) {
       fprintf(stderr, "Failed to resolve primary interface\n");
       if (store) CFRelease(store);
       return 1;
@@ -60,6 +422,8 @@ int main (int argc, char** argv) {
   char event_message[512];
   snprintf(event_message, 512, "--add event '%s'", argv[2]);
   sketchybar(event_message);
+  static struct net_history history;
+  replay_state(&state, &history);
 
   struct network network;
   if (!network_init(&network, interface_name)) {
@@ -67,40 +431,60 @@ int main (int argc, char** argv) {
     if (store) CFRelease(store);
     return 1;
   }
+  watch.open = true;
+  struct net_metrics net_metrics;
+  net_metrics_init(&net_metrics, &metrics);
   char trigger_message[512];
   int tick = 0;
-  for (;;) {
-    if (auto_mode) {
-      char current[IF_NAMESIZE] = { 0 };
-      if (resolve_primary_interface(store, current, sizeof(current))
-          && strcmp(current, ifname) != 0) {
-        strlcpy(ifname, current, sizeof(ifname));
-        if (!network_init(&network, ifname)) {
-          fprintf(stderr, "Interface not found: %s\n", ifname);
-          usleep(update_freq * 1000000);
-          continue;
-        }
+  while (trace_tick()) {
+    // Acquire new info, possibly several samples per emitted tick. The
+    // first tick only primes the counters with its first sample and takes
+    // the second one right away.
+    int samples = tick == 0 ? 2 : sampling.samples_per_tick;
+    float period = tick == 0 ? STATE_PRIME_SEC : sampling.period;
+    bool sampled = false;
+    for (int i = 0; i < samples; i++) {
+      if (i > 0) wait_tick(period, store, &watch, ifname, &network);
+      if (network_update(&network)) {
+        rate_smoother_add(&sampling.up, network.up_mbps, network.elapsed);
+        rate_smoother_add(&sampling.down, network.down_mbps, network.elapsed);
+        sampled = true;
       }
     }
-    // Acquire new info
-    network_update(&network);
 
     // Prepare the event message
     bool is_full = (tick % slow_every == 0);
+    double up_peak = rate_smoother_take_peak(&sampling.up);
+    double down_peak = rate_smoother_take_peak(&sampling.down);
     snprintf(trigger_message,
              512,
-             "--trigger '%s' upload='%.2f' download='%.2f' full_update='%d'",
+             "--trigger '%s' upload='%.2f' download='%.2f' "
+             "upload_peak='%.2f' download_peak='%.2f' full_update='%d'",
              argv[2],
-             network.up_mbps,
-             network.down_mbps,
+             sampling.up.value,
+             sampling.down.value,
+             up_peak,
+             down_peak,
              is_full ? 1 : 0);
 
     // Trigger the event
     sketchybar(trigger_message);
+    if (sampled) state_valid(&state);
+    net_history_add(&history, trigger_message);
+    if (is_full) save_state(&state, &history);
+    net_metrics_update(&net_metrics,
+                       &metrics,
+                       sampling.up.value,
+                       sampling.down.value,
+                       up_peak,
+                       down_peak,
+                       &state             );
+    metrics_publish(&metrics);
+    heartbeat();
     tick++;
 
     // Wait
-    usleep(update_freq * 1000000);
+    wait_tick(sampling.period, store, &watch, ifname, &network);
   }
   return 0;
 }
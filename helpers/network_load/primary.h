@@ -0,0 +1,42 @@
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Primary interface changes are pushed by the dynamic store instead of being
+// polled, so the hot tick only reads the interface counters. The store
+// callback only marks the watch as changed; the sampling loop applies the
+// change on its next wakeup through a source: the dynamic store and
+// network_init in network_load.c, a scripted one in the tests.
+
+struct primary_source {
+  void* context;
+  // Name of the primary interface, false if there is none right now
+  bool (*resolve)(void* context, char* ifname, size_t size);
+  // Starts sampling ifname, false if it cannot be opened (yet)
+  bool (*open)(void* context, const char* ifname);
+};
+
+struct primary_watch {
+  bool changed;
+  // Whether ifname is being sampled
+  bool open;
+};
+
+// Applies a pending change; returns true if the sampled interface changed.
+// An interface that cannot be opened yet is retried on the next wakeup.
+static inline bool primary_follow(struct primary_watch* watch,
+                                  const struct primary_source* source,
+                                  char* ifname                        ) {
+  if (!watch->changed) return false;
+  watch->changed = false;
+
+  char current[IF_NAMESIZE] = { 0 };
+  if (!source->resolve(source->context, current, sizeof(current))) return false;
+  if (strcmp(current, ifname) == 0 && watch->open) return false;
+
+  snprintf(ifname, IF_NAMESIZE, "%s", current);
+  watch->open = source->open(source->context, ifname);
+  if (!watch->open) watch->changed = true;
+  return watch->open;
+}
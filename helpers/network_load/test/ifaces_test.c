@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../ifaces.h"
+
+// Drives the interface slots through scripted NET_RT_IFLIST2 dumps the way
+// network_set_update does, including interface churn past MAX_INTERFACES,
+// and prints the slot each interface lands in: `make test` diffs the output
+// against ifaces.expected.
+
+// One dump: "<index>:<name>" entries separated by spaces; lo0 is filtered
+// out. Prints the slot of every entry if verbose.
+static void dump(struct network_ifaces* ifaces, const char* what, const char* entries, bool verbose) {
+  network_ifaces_begin_dump(ifaces);
+  if (verbose) printf("%s:", what);
+
+  char copy[512];
+  snprintf(copy, sizeof(copy), "%s", entries);
+  for (char* entry = strtok(copy, " "); entry; entry = strtok(NULL, " ")) {
+    uint16_t index = (uint16_t)atoi(entry);
+    const char* name = strchr(entry, ':') + 1;
+    uint32_t name_hash = network_name_hash(name);
+    uint8_t slot = network_ifaces_lookup(ifaces, index, name_hash);
+    if (slot == IFSLOT_UNSEEN) {
+      slot = network_ifaces_assign(ifaces, index, name, name_hash, strcmp(name, "lo0") != 0);
+    }
+    if (slot < MAX_INTERFACES) ifaces->entries[slot].seen = true;
+
+    if (!verbose) continue;
+    if (slot == IFSLOT_IGNORED) printf(" %s=ignored", name);
+    else if (slot == IFSLOT_FULL) printf(" %s=full", name);
+    else printf(" %s=%u", name, slot);
+  }
+  network_ifaces_end_dump(ifaces);
+  if (verbose) printf("\n");
+}
+
+static void print_slots(const struct network_ifaces* ifaces) {
+  printf("  %u slots:", ifaces->count);
+  for (uint32_t i = 0; i < ifaces->count; i++) {
+    const struct network_iface* iface = &ifaces->entries[i];
+    printf(" %s%s", iface->name, iface->stale ? "(stale)" : "");
+  }
+  printf("\n");
+}
+
+static void print_slot(const struct network_ifaces* ifaces, uint16_t index, const char* name) {
+  uint8_t slot = network_ifaces_lookup(ifaces, index, network_name_hash(name));
+  if (slot < MAX_INTERFACES) printf("  %s: slot %u (%s)\n", name, slot, ifaces->entries[slot].name);
+  else printf("  %s: no slot\n", name);
+}
+
+int main(void) {
+  static struct network_ifaces ifaces;
+  network_ifaces_init(&ifaces);
+
+  dump(&ifaces, "boot", "1:lo0 4:en0 5:en1", true);
+  dump(&ifaces, "same dump", "1:lo0 4:en0 5:en1", true);
+  dump(&ifaces, "en1 re-attached under a new index", "1:lo0 4:en0 9:en1", true);
+  dump(&ifaces, "index 5 reused by another interface", "1:lo0 4:en0 9:en1 5:bridge0", true);
+
+  // A VPN reconnecting every few minutes gets a new tunnel each time
+  char entries[1024];
+  for (int n = 0; n < 40; n++) {
+    snprintf(entries, sizeof(entries), "1:lo0 4:en0 9:en1 5:bridge0 %d:utun%d", 20 + n, n);
+    dump(&ifaces, NULL, entries, false);
+  }
+  printf("after 40 tunnels:\n");
+  print_slots(&ifaces);
+  dump(&ifaces, "the next tunnel", "1:lo0 4:en0 9:en1 5:bridge0 60:utun40", true);
+
+  // Every slot held by an interface that is still there
+  char all[512] = "";
+  size_t len = 0;
+  for (int n = 0; n < MAX_INTERFACES; n++) {
+    len += snprintf(all + len, sizeof(all) - len, "%d:vnic%d ", 100 + n, n);
+  }
+  // The first dump finds only the slots that were stale before it
+  dump(&ifaces, NULL, all, false);
+  dump(&ifaces, NULL, all, false);
+  printf("%d interfaces present at once:\n", MAX_INTERFACES);
+  print_slots(&ifaces);
+  snprintf(entries, sizeof(entries), "%s200:extra0", all);
+  dump(&ifaces, NULL, entries, false);
+  printf("one more:\n");
+  print_slot(&ifaces, 200, "extra0");
+
+  // vnic0 goes away: its slot is free once a dump has missed it
+  const char* without_vnic0 = entries + strlen("100:vnic0 ");
+  dump(&ifaces, NULL, without_vnic0, false);
+  printf("first dump without vnic0:\n");
+  print_slot(&ifaces, 200, "extra0");
+  dump(&ifaces, NULL, without_vnic0, false);
+  printf("second dump without vnic0:\n");
+  print_slot(&ifaces, 200, "extra0");
+  print_slot(&ifaces, 100, "vnic0");
+
+  // Back under its old index, vnic0 must not land in the slot extra0 took
+  char returned[1024];
+  snprintf(returned, sizeof(returned), "%s 100:vnic0", without_vnic0);
+  dump(&ifaces, NULL, returned, false);
+  printf("vnic0 back:\n");
+  print_slot(&ifaces, 100, "vnic0");
+  print_slot(&ifaces, 200, "extra0");
+  return 0;
+}
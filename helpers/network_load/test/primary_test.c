@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+#include "../primary.h"
+
+// Drives primary_follow through a script of store notifications and
+// interfaces coming and going, printing what the sampling loop does on each
+// wakeup: `make test` diffs it against primary.expected.
+
+struct step {
+  const char* what;
+  bool notify;
+  // Primary interface the store reports, NULL for none
+  const char* primary;
+  // Interfaces that can be opened, comma separated
+  const char* present;
+};
+
+struct script {
+  const struct step* step;
+  int resolves;
+  int opens;
+};
+
+static bool script_resolve(void* context, char* ifname, size_t size) {
+  struct script* script = context;
+  script->resolves++;
+  if (!script->step->primary) return false;
+  snprintf(ifname, size, "%s", script->step->primary);
+  return true;
+}
+
+static bool script_open(void* context, const char* ifname) {
+  struct script* script = context;
+  script->opens++;
+  const char* present = script->step->present;
+  size_t len = strlen(ifname);
+  for (const char* name = present; name; name = strchr(name, ',')) {
+    if (*name == ',') name++;
+    if (strncmp(name, ifname, len) == 0 && (name[len] == ',' || name[len] == '\0')) return true;
+  }
+  return false;
+}
+
+int main(void) {
+  static const struct step steps[] = {
+    { "tick without a notification", false, "en0", "en0,en1" },
+    { "notification, primary unchanged", true, "en0", "en0,en1" },
+    { "switch to wifi", true, "en1", "en0,en1" },
+    { "notification, no primary during the switch", true, NULL, "en0,en1" },
+    { "switch to a tunnel that is not up yet", true, "utun4", "en0,en1" },
+    { "wakeup, tunnel still missing", false, "utun4", "en0,en1" },
+    { "wakeup, tunnel up", false, "utun4", "en0,en1,utun4" },
+    { "tick after the switch", false, "utun4", "en0,en1,utun4" },
+    { "back to ethernet", true, "en0", "en0,en1,utun4" },
+  };
+
+  struct script script = { 0 };
+  struct primary_source source = {
+    .context = &script,
+    .resolve = script_resolve,
+    .open = script_open
+  };
+  struct primary_watch watch = { .open = true };
+  char ifname[IF_NAMESIZE] = "en0";
+
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    script.step = &steps[i];
+    script.resolves = 0;
+    script.opens = 0;
+    if (steps[i].notify) watch.changed = true;
+    bool switched = primary_follow(&watch, &source, ifname);
+    printf("%s: sampling %s%s%s (resolves=%d opens=%d)%s\n",
+           steps[i].what,
+           ifname,
+           watch.open ? "" : " (not open)",
+           switched ? ", switched" : "",
+           script.resolves,
+           script.opens,
+           watch.changed ? ", retry pending" : "");
+  }
+  return 0;
+}
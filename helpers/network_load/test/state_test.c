@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "../../state.h"
+
+// Saving and loading the last-known state (state.h), including symlinks
+// planted at the state file names: `make test` diffs the output against
+// state.expected. TMPDIR points to a scratch dir, which is where the state
+// goes off macOS; macOS uses its per-user temp dir either way.
+
+static char g_dir[] = "/tmp/state_test.XXXXXX";
+
+static void victim_check(const char* victim) {
+  char buffer[64] = { 0 };
+  FILE* file = fopen(victim, "r");
+  if (file) {
+    if (!fgets(buffer, sizeof(buffer), file)) buffer[0] = '\0';
+    fclose(file);
+  }
+  printf("  victim file: %s\n", buffer);
+}
+
+static void save(struct state* state, const char* text) {
+  state_begin(state);
+  state_add(state, 1, text, strlen(text) + 1);
+  state->committed = state->building;
+  printf("  write: %d\n", state_write(state, &state->snapshots[state->committed]));
+}
+
+static void load(struct state* state) {
+  if (!state_load(state)) {
+    printf("  load: none\n");
+    return;
+  }
+  size_t cursor = 0, size = 0;
+  const char* text = state_next(state, 1, &cursor, &size);
+  printf("  load: %s\n", text ? text : "(no record)");
+}
+
+static bool is_symlink(const char* path) {
+  struct stat info;
+  return lstat(path, &info) == 0 && S_ISLNK(info.st_mode);
+}
+
+int main(void) {
+  if (!mkdtemp(g_dir)) return 1;
+  setenv("TMPDIR", g_dir, 1);
+  char victim[512];
+  snprintf(victim, sizeof(victim), "%s/victim", g_dir);
+  FILE* file = fopen(victim, "w");
+  if (!file) return 1;
+  fputs("untouched", file);
+  fclose(file);
+
+  struct state state;
+  state_init(&state, "network_load", "network_update en0/utun 4", true);
+  const char* base = strrchr(state.path, '/');
+  printf("file: %s\n", base ? base + 1 : state.path);
+  printf("fresh\n");
+  load(&state);
+  save(&state, "first");
+  load(&state);
+
+  printf("stale tmp file left behind\n");
+  file = fopen(state.tmp_path, "w");
+  if (file) fclose(file);
+  save(&state, "second");
+  load(&state);
+
+  printf("symlink planted at the tmp file\n");
+  unlink(state.tmp_path);
+  if (symlink(victim, state.tmp_path) != 0) return 1;
+  save(&state, "third");
+  load(&state);
+  victim_check(victim);
+
+  printf("symlink planted at the state file\n");
+  unlink(state.path);
+  if (symlink(victim, state.path) != 0) return 1;
+  load(&state);
+  save(&state, "fourth");
+  printf("  state file is a symlink: %d\n", is_symlink(state.path));
+  load(&state);
+  victim_check(victim);
+
+  unlink(state.path);
+  unlink(state.tmp_path);
+  unlink(victim);
+  rmdir(g_dir);
+  return 0;
+}
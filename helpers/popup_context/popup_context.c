@@ -6,19 +6,35 @@
 // - Display index is the index in SkyLight's display list (0 = main display).
 // - Intended to pin SketchyBar popups to the space/display where they were opened.
 //
+// Usage: popup_context [-d | --invalidate]
+//
+// - -d stays resident and answers later invocations over a unix socket from
+//   a cached display/space layout, so a query only reads the cursor and the
+//   display's current space.
+// - --invalidate drops the resident process' cached layout before the query,
+//   which reads it again (passed by the first query after a
+//   space_change/display_change).
+// - Without a resident process every invocation reads the layout itself.
+//
 // NOTE: Uses private SkyLight APIs (like other helpers in this repo).
 
 #include <ApplicationServices/ApplicationServices.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <stdbool.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "../sketchybar.h"
+#include "../impact.h"
+#include "../json.h"
+#include "../socket.h"
+#include "topology.h"
 
 // SkyLight (private)
 extern int SLSMainConnectionID(void);
 extern CFArrayRef SLSCopyManagedDisplaySpaces(int cid);
+extern uint64_t SLSManagedDisplayGetCurrentSpace(int cid, CFStringRef uuid);
 
 static CGPoint mouse_location_global(void) {
   CGPoint p = CGPointMake(0, 0);
@@ -30,33 +46,6 @@ static CGPoint mouse_location_global(void) {
   return p;
 }
 
-static CGDirectDisplayID display_under_point(CGPoint p) {
-  uint32_t count = 0;
-  if (CGGetActiveDisplayList(0, NULL, &count) != kCGErrorSuccess || count == 0) {
-    return CGMainDisplayID();
-  }
-
-  CGDirectDisplayID* displays = (CGDirectDisplayID*)calloc(count, sizeof(CGDirectDisplayID));
-  if (!displays) return CGMainDisplayID();
-
-  if (CGGetActiveDisplayList(count, displays, &count) != kCGErrorSuccess || count == 0) {
-    free(displays);
-    return CGMainDisplayID();
-  }
-
-  CGDirectDisplayID chosen = CGMainDisplayID();
-  for (uint32_t i = 0; i < count; i++) {
-    CGRect bounds = CGDisplayBounds(displays[i]);
-    if (CGRectContainsPoint(bounds, p)) {
-      chosen = displays[i];
-      break;
-    }
-  }
-
-  free(displays);
-  return chosen;
-}
-
 static bool cfstring_matches_display(CFStringRef s, CGDirectDisplayID did, CFStringRef did_uuid_str) {
   if (!s) return false;
   if (did_uuid_str && CFStringCompare(s, did_uuid_str, 0) == kCFCompareEqualTo) {
@@ -131,98 +120,205 @@ static bool display_dict_matches(CFDictionaryRef display_dict,
   return false;
 }
 
-static int current_space_index_for_display(CFDictionaryRef display_dict) {
-  int index = 1; // fallback (1-based)
-  if (!display_dict) return index;
-
-  CFDictionaryRef current_space = NULL;
-  CFArrayRef spaces = NULL;
-
-  CFTypeRef tmp = CFDictionaryGetValue(display_dict, CFSTR("Current Space"));
-  if (tmp && CFGetTypeID(tmp) == CFDictionaryGetTypeID()) {
-    current_space = (CFDictionaryRef)tmp;
-  }
-
-  tmp = CFDictionaryGetValue(display_dict, CFSTR("Spaces"));
-  if (tmp && CFGetTypeID(tmp) == CFArrayGetTypeID()) {
-    spaces = (CFArrayRef)tmp;
-  }
+static uint64_t space_id(CFDictionaryRef space_dict) {
+  if (!space_dict || CFGetTypeID(space_dict) != CFDictionaryGetTypeID()) return 0;
+  CFTypeRef id = CFDictionaryGetValue(space_dict, CFSTR("id64"));
+  if (!id) id = CFDictionaryGetValue(space_dict, CFSTR("ManagedSpaceID"));
+  if (!id || CFGetTypeID(id) != CFNumberGetTypeID()) return 0;
 
-  if (!current_space || !spaces) return index;
+  int64_t value = 0;
+  CFNumberGetValue((CFNumberRef)id, kCFNumberSInt64Type, &value);
+  return (uint64_t)value;
+}
 
-  CFTypeRef cu = CFDictionaryGetValue(current_space, CFSTR("uuid"));
-  if (!cu || CFGetTypeID(cu) != CFStringGetTypeID()) return index;
-  CFStringRef current_uuid = (CFStringRef)cu;
+static void read_space_ids(CFDictionaryRef display_dict, struct topology_display* display) {
+  CFTypeRef tmp = CFDictionaryGetValue(display_dict, CFSTR("Spaces"));
+  if (!tmp || CFGetTypeID(tmp) != CFArrayGetTypeID()) return;
 
+  CFArrayRef spaces = (CFArrayRef)tmp;
   CFIndex count = CFArrayGetCount(spaces);
-  for (CFIndex i = 0; i < count; i++) {
-    CFDictionaryRef space_dict = (CFDictionaryRef)CFArrayGetValueAtIndex(spaces, i);
-    if (!space_dict) continue;
-    CFTypeRef su = CFDictionaryGetValue(space_dict, CFSTR("uuid"));
-    if (!su || CFGetTypeID(su) != CFStringGetTypeID()) continue;
-    CFStringRef uuid = (CFStringRef)su;
-    if (CFStringCompare(uuid, current_uuid, 0) == kCFCompareEqualTo) {
-      index = (int)(i + 1);
-      break;
-    }
+  for (CFIndex i = 0; i < count && display->space_count < TOPOLOGY_MAX_SPACES; i++) {
+    display->space_ids[display->space_count++] = space_id(CFArrayGetValueAtIndex(spaces, i));
   }
 
-  return index;
+  tmp = CFDictionaryGetValue(display_dict, CFSTR("Current Space"));
+  if (tmp && CFGetTypeID(tmp) == CFDictionaryGetTypeID()) {
+    uint64_t current = space_id((CFDictionaryRef)tmp);
+    if (current) display->current_index = topology_space_index(display, current);
+  }
 }
 
-int main(int argc, char** argv) {
-  (void)argc;
-  (void)argv;
+// Reads the active displays and the spaces SkyLight manages on each of them
+static void skylight_build(void* context, struct topology* topology) {
+  int cid = *(int*)context;
 
-  // Determine display under mouse cursor (CG).
-  CGPoint mouse = mouse_location_global();
-  CGDirectDisplayID did = display_under_point(mouse);
-  CFUUIDRef did_uuid = CGDisplayCreateUUIDFromDisplayID(did);
-  CFStringRef did_uuid_str = NULL;
-  if (did_uuid) {
-    did_uuid_str = CFUUIDCreateString(kCFAllocatorDefault, did_uuid);
+  CGDirectDisplayID ids[TOPOLOGY_MAX_DISPLAYS];
+  uint32_t count = 0;
+  if (CGGetActiveDisplayList(TOPOLOGY_MAX_DISPLAYS, ids, &count) != kCGErrorSuccess
+      || count == 0) {
+    ids[0] = CGMainDisplayID();
+    count = 1;
   }
 
-  // Query SkyLight managed display spaces.
-  int cid = SLSMainConnectionID();
   CFArrayRef displays = SLSCopyManagedDisplaySpaces(cid);
+  CFIndex n = 0;
+  if (displays && CFGetTypeID(displays) == CFArrayGetTypeID()) {
+    n = CFArrayGetCount(displays);
+  }
 
-  int display_index = 0; // 0-based
-  int space_index = 1;   // 1-based
+  CGDirectDisplayID main_display = CGMainDisplayID();
+  for (uint32_t i = 0; i < count; i++) {
+    struct topology_display* display = &topology->displays[topology->count++];
+    CGRect bounds = CGDisplayBounds(ids[i]);
+    display->display_id = ids[i];
+    display->x = bounds.origin.x;
+    display->y = bounds.origin.y;
+    display->width = bounds.size.width;
+    display->height = bounds.size.height;
+    if (ids[i] == main_display) topology->fallback = i;
+
+    CFUUIDRef did_uuid = CGDisplayCreateUUIDFromDisplayID(ids[i]);
+    CFStringRef did_uuid_str = NULL;
+    if (did_uuid) {
+      did_uuid_str = CFUUIDCreateString(kCFAllocatorDefault, did_uuid);
+    }
+    if (did_uuid_str) {
+      CFStringGetCString(did_uuid_str,
+                         display->uuid,
+                         sizeof(display->uuid),
+                         kCFStringEncodingUTF8);
+    }
 
-  if (displays && CFGetTypeID(displays) == CFArrayGetTypeID()) {
-    CFIndex n = CFArrayGetCount(displays);
     CFDictionaryRef match_dict = NULL;
-
-    if (n > 0) {
-      for (CFIndex i = 0; i < n; i++) {
-        CFDictionaryRef display_dict = (CFDictionaryRef)CFArrayGetValueAtIndex(displays, i);
-        if (!display_dict) continue;
-        if (display_dict_matches(display_dict, did, did_uuid, did_uuid_str)) {
-          match_dict = display_dict;
-          display_index = (int)i;
-          break;
-        }
+    for (CFIndex j = 0; j < n; j++) {
+      CFDictionaryRef display_dict = (CFDictionaryRef)CFArrayGetValueAtIndex(displays, j);
+      if (!display_dict) continue;
+      if (display_dict_matches(display_dict, ids[i], did_uuid, did_uuid_str)) {
+        match_dict = display_dict;
+        display->index = (int)j;
+        break;
       }
     }
 
     if (!match_dict && n > 0) {
       match_dict = (CFDictionaryRef)CFArrayGetValueAtIndex(displays, 0);
-      display_index = 0;
+      display->index = 0;
     }
+    if (match_dict) read_space_ids(match_dict, display);
 
-    if (match_dict) {
-      space_index = current_space_index_for_display(match_dict);
-    }
+    if (did_uuid_str) CFRelease(did_uuid_str);
+    if (did_uuid) CFRelease(did_uuid);
   }
 
   if (displays) CFRelease(displays);
-  if (did_uuid_str) CFRelease(did_uuid_str);
-  if (did_uuid) CFRelease(did_uuid);
+}
 
-  // JSON output for sbar.exec() (Lua) to parse.
-  printf("{\"space\":%d,\"display\":%d}\n", space_index, display_index);
+static void skylight_cursor(void* context, double* x, double* y) {
+  (void)context;
+  CGPoint mouse = mouse_location_global();
+  *x = mouse.x;
+  *y = mouse.y;
+}
+
+static uint64_t skylight_current_space(void* context, const struct topology_display* display) {
+  int cid = *(int*)context;
+  CFStringRef uuid = CFStringCreateWithCString(kCFAllocatorDefault,
+                                               display->uuid,
+                                               kCFStringEncodingUTF8);
+  if (!uuid) return 0;
+
+  uint64_t current = SLSManagedDisplayGetCurrentSpace(cid, uuid);
+  CFRelease(uuid);
+  return current;
+}
+
+static struct topology_source skylight_source(int* cid) {
+  struct topology_source source = {
+    .context = cid,
+    .build = skylight_build,
+    .cursor = skylight_cursor,
+    .current_space = skylight_current_space
+  };
+  return source;
+}
+
+static void write_context(struct json_writer* json, int space_index, int display_index) {
+  json_object_begin(json);
+  json_field_int(json, "space", space_index);
+  json_field_int(json, "display", display_index);
+  json_object_end(json);
+}
+
+static int run_server(void) {
+  char path[128];
+  int listen_fd = socket_path(path, sizeof(path), "popup_context") ? socket_listen(path, 0600) : -1;
+  if (listen_fd < 0) {
+    fprintf(stderr, "Failed to listen on %s\n", path);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  int cid = SLSMainConnectionID();
+  struct topology_source source = skylight_source(&cid);
+  struct topology topology;
+  topology_build(&topology, &source);
+
+  for (;;) {
+    char request[128];
+    int client = socket_accept_request(listen_fd, request, sizeof(request));
+    if (client < 0) continue;
+
+    if (strcmp(request, "query") == 0) {
+      int space_index, display_index;
+      topology_resolve(&topology, &source, &space_index, &display_index);
+
+      char buffer[64];
+      struct json_writer json;
+      json_init(&json, buffer, sizeof(buffer), NULL);
+      write_context(&json, space_index, display_index);
+      bool ok = json_finish(&json, true);
+      socket_reply(client, ok ? 0 : 1, buffer, ok ? json.len : 0);
+    } else if (strcmp(request, "invalidate") == 0) {
+      // Read again by the next query, not by every change
+      topology.valid = false;
+      socket_reply(client, 0, NULL, 0);
+    } else {
+      socket_reply(client, 1, NULL, 0);
+    }
+  }
   return 0;
 }
 
+int main(int argc, char** argv) {
+  impact_apply();
+  if (argc > 1 && strcmp(argv[1], "-d") == 0) return run_server();
 
+  bool invalidate = argc > 1 && strcmp(argv[1], "--invalidate") == 0;
+  if (argc > 1 && !invalidate) {
+    fprintf(stderr, "Usage: %s [-d | --invalidate]\n", argv[0]);
+    return 1;
+  }
+
+  // Prefer the resident process and its cached layout
+  char path[128];
+  int exit_code = socket_path(path, sizeof(path), "popup_context") ? 0 : -1;
+  if (exit_code == 0 && invalidate) {
+    exit_code = socket_forward(path, "invalidate", stdout, stderr);
+  }
+  if (exit_code == 0) exit_code = socket_forward(path, "query", stdout, stderr);
+  if (exit_code >= 0) return exit_code;
+
+  int cid = SLSMainConnectionID();
+  struct topology_source source = skylight_source(&cid);
+  int space_index, display_index;
+  struct topology topology;
+  topology_clear(&topology);
+  topology_resolve(&topology, &source, &space_index, &display_index);
+
+  // JSON output for sbar.exec() (Lua) to parse.
+  char buffer[64];
+  struct json_writer json;
+  json_init(&json, buffer, sizeof(buffer), stdout);
+  write_context(&json, space_index, display_index);
+  return json_finish(&json, true) ? 0 : 1;
+}
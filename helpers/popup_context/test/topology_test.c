@@ -0,0 +1,140 @@
+#include <stdio.h>
+
+#include "../topology.h"
+
+// Display lookup and space resolution of topology.h against a scripted
+// layout: a laptop display and an external one to its right, spaces being
+// switched, created and removed. `make test` diffs the output against
+// topology.expected.
+
+struct layout {
+  // Spaces per display, 0 terminated
+  uint64_t spaces[2][8];
+  // Current space per display as SkyLight answers it, 0 for no answer
+  uint64_t current[2];
+  // Current space in the layout SkyLight lists, if it differs
+  uint64_t recorded[2];
+  double x, y;
+  int builds;
+  int current_calls;
+};
+
+static void layout_build(void* context, struct topology* topology) {
+  struct layout* layout = context;
+  layout->builds++;
+  static const double bounds[2][4] = { { 0, 0, 1512, 982 }, { 1512, -200, 2560, 1440 } };
+  for (int i = 0; i < 2; i++) {
+    struct topology_display* display = &topology->displays[topology->count++];
+    display->display_id = 1 + i;
+    display->x = bounds[i][0];
+    display->y = bounds[i][1];
+    display->width = bounds[i][2];
+    display->height = bounds[i][3];
+    display->index = i;
+    snprintf(display->uuid, sizeof(display->uuid), "display-%d", i);
+    for (int s = 0; layout->spaces[i][s]; s++) {
+      display->space_ids[display->space_count++] = layout->spaces[i][s];
+    }
+    uint64_t recorded = layout->recorded[i] ? layout->recorded[i] : layout->current[i];
+    display->current_index = topology_space_index(display, recorded);
+  }
+  // Main display: the laptop
+  topology->fallback = 0;
+}
+
+static void layout_cursor(void* context, double* x, double* y) {
+  struct layout* layout = context;
+  *x = layout->x;
+  *y = layout->y;
+}
+
+static uint64_t layout_current_space(void* context, const struct topology_display* display) {
+  struct layout* layout = context;
+  layout->current_calls++;
+  return layout->current[display->display_id - 1];
+}
+
+static void resolve(const char* what, struct topology* topology,
+                    const struct topology_source* source, struct layout* layout) {
+  layout->builds = 0;
+  layout->current_calls = 0;
+  int space_index, display_index;
+  topology_resolve(topology, source, &space_index, &display_index);
+  printf("%s: space %d display %d (builds=%d current=%d)\n",
+         what, space_index, display_index, layout->builds, layout->current_calls);
+}
+
+int main(void) {
+  struct layout layout = {
+    .spaces = { { 11, 12, 13 }, { 21, 22 } },
+    .current = { 12, 21 },
+    .x = 700, .y = 500,
+  };
+  struct topology_source source = {
+    .context = &layout,
+    .build = layout_build,
+    .cursor = layout_cursor,
+    .current_space = layout_current_space
+  };
+  struct topology topology;
+  topology_clear(&topology);
+
+  resolve("first query, laptop", &topology, &source, &layout);
+  resolve("cached", &topology, &source, &layout);
+
+  layout.x = 2000;
+  layout.y = -100;
+  resolve("external display", &topology, &source, &layout);
+  layout.current[1] = 22;
+  resolve("space switched", &topology, &source, &layout);
+
+  // Display edges: right and bottom edges belong to the next display
+  layout.current[0] = 13;
+  layout.x = 1511.5;
+  layout.y = 0;
+  resolve("last laptop column", &topology, &source, &layout);
+  layout.x = 1512;
+  resolve("first external column", &topology, &source, &layout);
+  layout.x = 700;
+  layout.y = 982;
+  resolve("below the laptop, fallback display", &topology, &source, &layout);
+
+  // A space created since the layout was read: one rebuild
+  layout.spaces[0][3] = 14;
+  layout.current[0] = 14;
+  layout.y = 500;
+  resolve("new space", &topology, &source, &layout);
+  resolve("new space, cached", &topology, &source, &layout);
+
+  // A space removed: the cached layout answers with the old index until
+  // invalidated, and the next query reads it again (popup_context's
+  // "invalidate" request)
+  layout.spaces[0][1] = 13;
+  layout.spaces[0][2] = 14;
+  layout.spaces[0][3] = 0;
+  resolve("space removed, cached", &topology, &source, &layout);
+  topology.valid = false;
+  resolve("space removed, invalidated", &topology, &source, &layout);
+  resolve("space removed, cached again", &topology, &source, &layout);
+  layout.spaces[0][1] = 12;
+  layout.spaces[0][2] = 13;
+  layout.spaces[0][3] = 14;
+
+  // Current space unknown even after the rebuild: fallback space 1
+  layout.current[0] = 99;
+  resolve("unknown space", &topology, &source, &layout);
+
+  // SkyLight not answering on a fresh layout: the recorded current space
+  layout.current[0] = 0;
+  layout.recorded[0] = 13;
+  topology_clear(&topology);
+  resolve("no answer, fresh layout", &topology, &source, &layout);
+  resolve("no answer, cached layout", &topology, &source, &layout);
+
+  struct topology empty;
+  topology_clear(&empty);
+  printf("empty layout: display %s, space of 12 in display 0: %d\n",
+         topology_display_at(&empty, 0, 0) ? "found" : "none",
+         topology_space_index(&topology.displays[0], 12));
+  return 0;
+}
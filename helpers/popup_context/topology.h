@@ -0,0 +1,120 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Display and space layout cached by the resident popup_context. It holds
+// plain values only: looking up the display under a point and the index of
+// a space is pure arithmetic over the cached data. The layout, the cursor
+// and the current space are read through a source: CoreGraphics/SkyLight in
+// popup_context.c, a scripted layout in the tests.
+
+#define TOPOLOGY_MAX_DISPLAYS 16
+#define TOPOLOGY_MAX_SPACES 64
+
+struct topology_display {
+  uint32_t display_id;
+  double x, y, width, height;
+  // Index in SkyLight's managed display list (0 = main display)
+  int index;
+  // Display UUID as given to SLSManagedDisplayGetCurrentSpace
+  char uuid[64];
+  uint32_t space_count;
+  uint64_t space_ids[TOPOLOGY_MAX_SPACES];
+  // Current space when the layout was read, used if SkyLight does not
+  // answer for this display's UUID
+  int current_index;
+};
+
+struct topology {
+  bool valid;
+  uint32_t count;
+  // Display used when the point is outside of every display
+  uint32_t fallback;
+  struct topology_display displays[TOPOLOGY_MAX_DISPLAYS];
+};
+
+static inline void topology_clear(struct topology* topology) {
+  memset(topology, 0, sizeof(struct topology));
+}
+
+static inline const struct topology_display* topology_display_at(const struct topology* topology,
+                                                                 double x,
+                                                                 double y) {
+  if (topology->count == 0) return NULL;
+  for (uint32_t i = 0; i < topology->count; i++) {
+    const struct topology_display* display = &topology->displays[i];
+    if (x >= display->x && x < display->x + display->width
+        && y >= display->y && y < display->y + display->height) {
+      return display;
+    }
+  }
+  return &topology->displays[topology->fallback < topology->count ? topology->fallback : 0];
+}
+
+// 1-based position of space_id on the display, or 0 if the cached layout
+// does not know the space (created since the layout was read).
+static inline int topology_space_index(const struct topology_display* display,
+                                       uint64_t space_id) {
+  for (uint32_t i = 0; i < display->space_count; i++) {
+    if (display->space_ids[i] == space_id) return (int)i + 1;
+  }
+  return 0;
+}
+
+struct topology_source {
+  void* context;
+  // Reads the displays and their spaces into a cleared topology
+  void (*build)(void* context, struct topology* topology);
+  void (*cursor)(void* context, double* x, double* y);
+  // Current space of the display, 0 if it does not answer
+  uint64_t (*current_space)(void* context, const struct topology_display* display);
+};
+
+static inline void topology_build(struct topology* topology,
+                                  const struct topology_source* source) {
+  topology_clear(topology);
+  source->build(source->context, topology);
+  topology->valid = true;
+}
+
+// Resolves the cursor against the cached layout. Only the cursor position
+// and the display's current space are read; returns false if the current
+// space is not part of the cached layout. A layout that was just read may
+// fall back to the current space it recorded.
+static inline bool topology_query(const struct topology* topology,
+                                  const struct topology_source* source,
+                                  bool fresh,
+                                  int* space_index,
+                                  int* display_index) {
+  double x = 0, y = 0;
+  source->cursor(source->context, &x, &y);
+  const struct topology_display* display = topology_display_at(topology, x, y);
+  if (!display) return false;
+  *display_index = display->index;
+
+  uint64_t current = source->current_space(source->context, display);
+  int index = current ? topology_space_index(display, current) : 0;
+  if (index == 0 && fresh) index = display->current_index;
+  if (index == 0) return false;
+  *space_index = index;
+  return true;
+}
+
+// 1-based space and 0-based display index under the cursor. The layout is
+// read on first use, and again once if the current space is not part of it.
+static inline void topology_resolve(struct topology* topology,
+                                    const struct topology_source* source,
+                                    int* space_index,
+                                    int* display_index) {
+  *space_index = 1;   // fallback (1-based)
+  *display_index = 0; // fallback (0-based)
+
+  bool fresh = !topology->valid;
+  if (fresh) topology_build(topology, source);
+  if (topology_query(topology, source, fresh, space_index, display_index)) return;
+  if (fresh) return;
+
+  // A space created since the layout was cached
+  topology_build(topology, source);
+  topology_query(topology, source, true, space_index, display_index);
+}
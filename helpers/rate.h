@@ -0,0 +1,77 @@
+#pragma once
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Shared delta/rate logic for the counter based collectors (network, disk).
+
+// Seconds elapsed from *prev to now, advancing *prev to now. Returns 0 on the
+// first call so the caller can prime its counters and skip emitting a rate.
+static inline double rate_elapsed_until(struct timespec* prev, struct timespec now) {
+  if (prev->tv_sec == 0 && prev->tv_nsec == 0) {
+    *prev = now;
+    return 0.0;
+  }
+  double elapsed = (double)(now.tv_sec - prev->tv_sec)
+                   + (double)(now.tv_nsec - prev->tv_nsec) / 1e9;
+  *prev = now;
+  return elapsed;
+}
+
+static inline double rate_elapsed(struct timespec* prev) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return rate_elapsed_until(prev, now);
+}
+
+// Elapsed windows outside of this range are discarded (clock hiccup, sleep).
+static inline bool rate_window_valid(double elapsed) {
+  return elapsed > 0.0 && elapsed <= 1e2;
+}
+
+// Per-second rate of a monotonically increasing 64-bit counter. Returns 0 on
+// a counter that went backwards instead of a bogus spike: it was reset
+// (device re-attached, interface bounced), or it wrapped, which a 64-bit
+// byte counter does not do in practice.
+static inline double rate_per_sec(uint64_t now, uint64_t prev, double elapsed) {
+  if (!rate_window_valid(elapsed) || now < prev) return 0.0;
+  return (double)(now - prev) / elapsed;
+}
+
+// Exponentially weighted moving average over irregularly spaced samples, with
+// the half-life given in seconds, plus the peak sample since the last read.
+// A half-life of 0 passes samples through unchanged.
+struct rate_smoother {
+  double half_life;
+  double value;
+  double peak;
+  bool primed;
+  bool has_peak;
+};
+
+static inline void rate_smoother_add(struct rate_smoother* smoother,
+                                     double sample,
+                                     double elapsed                 ) {
+  if (!smoother->primed || smoother->half_life <= 0.0) {
+    smoother->value = sample;
+    smoother->primed = true;
+  } else {
+    double alpha = 1.0 - exp2(-elapsed / smoother->half_life);
+    smoother->value += alpha * (sample - smoother->value);
+  }
+
+  if (!smoother->has_peak || sample > smoother->peak) {
+    smoother->peak = sample;
+    smoother->has_peak = true;
+  }
+}
+
+// Returns the peak of the current window and starts a new one. A window
+// without samples reports the smoothed value.
+static inline double rate_smoother_take_peak(struct rate_smoother* smoother) {
+  double peak = smoother->has_peak ? smoother->peak : smoother->value;
+  smoother->has_peak = false;
+  return peak;
+}
@@ -1,16 +1,28 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Off macOS there is no bar to send to: messages are printed to stdout,
+// which is what the tests of the portable parts of the helpers diff.
+#if defined(__APPLE__)
 #include <mach/arm/kern_return.h>
 #include <mach/mach.h>
 #include <mach/mach_port.h>
 #include <mach/message.h>
 #include <bootstrap.h>
-#include <stdlib.h>
 #include <pthread.h>
-#include <stdio.h>
+#endif
 
 typedef char* env;
 
+// Messages are written here instead of being sent, if set (trace replay)
+static FILE* g_sketchybar_capture = NULL;
+
+#if defined(__APPLE__)
 #define MACH_HANDLER(name) void name(env env)
 typedef MACH_HANDLER(mach_handler);
 
@@ -81,6 +93,7 @@ static inline bool mach_send_message(mach_port_t port, char* message, uint32_t l
 
   return err == KERN_SUCCESS;
 }
+#endif
 
 static inline uint32_t format_message(char* message, char* formatted_message) {
   // This is not actually robust, switch to stack based messaging.
@@ -106,17 +119,35 @@ static inline uint32_t format_message(char* message, char* formatted_message) {
   return caret + 1;
 }
 
-static inline void sketchybar(char* message) {
+// Returns false if no sketchybar instance is running
+static inline bool sketchybar_send(char* message) {
+  if (g_sketchybar_capture) {
+    fprintf(g_sketchybar_capture, "%s\n", message);
+    fflush(g_sketchybar_capture);
+    return true;
+  }
+
+#if !defined(__APPLE__)
+  printf("%s\n", message);
+  fflush(stdout);
+  return true;
+#else
   char formatted_message[strlen(message) + 2];
   uint32_t length = format_message(message, formatted_message);
-  if (!length) return;
+  if (!length) return true;
 
   if (!g_mach_port) g_mach_port = mach_get_bs_port();
   if (!mach_send_message(g_mach_port, formatted_message, length)) {
     g_mach_port = mach_get_bs_port();
-    if (!mach_send_message(g_mach_port, formatted_message, length)) {
-      // No sketchybar instance running, exit.
-      exit(0);
-    }
+    return mach_send_message(g_mach_port, formatted_message, length);
+  }
+  return true;
+#endif
+}
+
+static inline void sketchybar(char* message) {
+  if (!sketchybar_send(message)) {
+    // No sketchybar instance running, exit.
+    exit(0);
   }
 }
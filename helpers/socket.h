@@ -0,0 +1,218 @@
+#pragma once
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tmpdir.h"
+
+// Line oriented request/response over a unix domain socket, used by the
+// resident helpers to serve one-shot invocations of the same binary.
+// A request is a single line; the response is everything written until the
+// server closes the connection.
+
+#define SOCKET_TIMEOUT_SEC 2
+
+// "<temp dir>/sketchybar_<name>.socket", see tmpdir.h; false if it does not
+// fit. A root daemon picks its own path, root's temp dir being unreachable
+// for the user's clients.
+static inline bool socket_path(char* buffer, size_t size, const char* name) {
+  char file[64];
+  snprintf(file, sizeof(file), "%s.socket", name);
+  return tmpdir_path(buffer, size, file);
+}
+
+static inline bool socket_address(struct sockaddr_un* address, const char* path) {
+  memset(address, 0, sizeof(struct sockaddr_un));
+  address->sun_family = AF_UNIX;
+  size_t len = strlen(path);
+  if (len >= sizeof(address->sun_path)) return false;
+  memcpy(address->sun_path, path, len + 1);
+  return true;
+}
+
+static inline void socket_set_timeout(int fd, int seconds) {
+  struct timeval timeout = { .tv_sec = seconds, .tv_usec = 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static inline bool socket_write_all(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, data, len);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+// Binds a listening socket at path, replacing a stale socket file. The file
+// is restricted to mode, so callers can decide who may connect.
+static inline int socket_listen(const char* path, mode_t mode) {
+  struct sockaddr_un address;
+  if (!socket_address(&address, path)) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0
+      || chmod(path, mode) != 0
+      || listen(fd, 8) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Accepts one client and reads its request line into buffer. Returns the
+// client fd (to be answered and closed by the caller) or -1.
+static inline int socket_accept_request(int listen_fd, char* buffer, size_t size) {
+  int fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0) return -1;
+  socket_set_timeout(fd, SOCKET_TIMEOUT_SEC);
+
+  size_t len = 0;
+  while (len + 1 < size) {
+    ssize_t n = read(fd, buffer + len, size - len - 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    len += n;
+    if (memchr(buffer + len - n, '\n', n)) break;
+  }
+  buffer[len] = '\0';
+
+  char* newline = strchr(buffer, '\n');
+  if (newline) *newline = '\0';
+  if (len == 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Connects to the server at path and sends one request line. Returns the
+// connected fd to read the response from, or -1 if no server is listening.
+static inline int socket_connect(const char* path, const char* request) {
+  struct sockaddr_un address;
+  if (!socket_address(&address, path)) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  socket_set_timeout(fd, SOCKET_TIMEOUT_SEC);
+
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0
+      || !socket_write_all(fd, request, strlen(request))
+      || !socket_write_all(fd, "\n", 1)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Sends one request line and reads the full response. Returns false if no
+// server is listening at path, so the caller can fall back to doing the
+// work itself.
+static inline bool socket_request(const char* path,
+                                  const char* request,
+                                  char* response,
+                                  size_t size          ) {
+  int fd = socket_connect(path, request);
+  if (fd < 0) return false;
+
+  size_t len = 0;
+  while (len + 1 < size) {
+    ssize_t n = read(fd, response + len, size - len - 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    len += n;
+  }
+  response[len] = '\0';
+  close(fd);
+  return true;
+}
+
+// Command requests carry the client's arguments separated by tabs, so a
+// single argument may contain spaces.
+static inline void socket_join_args(int argc, char** argv, char* buffer, size_t size) {
+  size_t len = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < argc && len + 1 < size; i++) {
+    int written = snprintf(buffer + len, size - len, i > 0 ? "\t%s" : "%s", argv[i]);
+    if (written < 0) break;
+    len += (size_t)written < size - len ? (size_t)written : size - len - 1;
+  }
+}
+
+static inline int socket_split_args(char* request, char** args, int max) {
+  int count = 0;
+  char* cursor = request;
+  while (cursor && count < max) {
+    args[count++] = cursor;
+    cursor = strchr(cursor, '\t');
+    if (cursor) *cursor++ = '\0';
+  }
+  return count;
+}
+
+// Command responses are "<exit code>\n" followed by the command output.
+// Closes the client connection.
+static inline void socket_reply(int fd, int exit_code, const char* output, size_t len) {
+  char header[16];
+  int header_len = snprintf(header, sizeof(header), "%d\n", exit_code);
+  socket_write_all(fd, header, header_len);
+  if (output && len > 0) socket_write_all(fd, output, len);
+  close(fd);
+}
+
+// Runs a command on the server: the output is streamed to out, or to err if
+// the command failed. Returns the command's exit code, or -1 if no server
+// is listening, so the caller can fall back to doing the work itself. Once
+// the request is sent the server may already be running it, so a missing
+// answer (busy, hung or gone) is reported as a failure instead: running the
+// command again in-process could apply it twice.
+static inline int socket_forward(const char* path,
+                                 const char* request,
+                                 FILE* out,
+                                 FILE* err           ) {
+  int fd = socket_connect(path, request);
+  if (fd < 0) return -1;
+
+  char buffer[4096];
+  int exit_code = -1;
+  FILE* target = out;
+  for (;;) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+
+    char* data = buffer;
+    if (exit_code < 0) {
+      char* newline = memchr(buffer, '\n', n);
+      if (!newline) break;
+      *newline = '\0';
+      exit_code = atoi(buffer);
+      target = exit_code == 0 ? out : err;
+      n -= newline + 1 - buffer;
+      data = newline + 1;
+    }
+    fwrite(data, 1, n, target);
+  }
+  close(fd);
+  if (exit_code < 0) {
+    fprintf(err, "No answer from %s\n", path);
+    return 1;
+  }
+  return exit_code;
+}
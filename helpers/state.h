@@ -0,0 +1,240 @@
+#pragma once
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tmpdir.h"
+
+// Last-known state of a sampling helper, so that a restarted helper (bar
+// reload, supervisor restart, login) repaints its items with the values it
+// had before at once, instead of "--" and empty graphs until its first ticks.
+//
+// A state file is STATE_MAGIC, the wall clock time of the snapshot and
+// records of a helper defined kind; a kind may repeat, e.g. one record per
+// history entry. The helper rebuilds the snapshot on full ticks with
+// state_begin/state_add and commits it with state_commit, which writes it
+// to sketchybar_<name>_<event>.state in the per-user temp dir (tmpdir.h)
+// every STATE_SAVE_SEC. SIGTERM, SIGINT and SIGHUP write the last committed
+// snapshot before the helper exits: it is double buffered, so the handler
+// never sees a half built one.
+//
+// Each startup is also measured from the start of the process: when the
+// state was replayed and when the first valid live values went out.
+
+#define STATE_MAGIC "SBSTATE1"
+#define STATE_MAGIC_SIZE 8
+#define STATE_SIZE (32 * 1024)
+#define STATE_SAVE_SEC 10
+// Older values would be misleading rather than helpful
+#define STATE_MAX_AGE_SEC 600
+// Delta based values need two samples; the first tick takes the second
+// one this much after the first instead of a whole tick later
+#define STATE_PRIME_SEC 0.1
+
+struct state_record {
+  uint16_t kind;
+  uint16_t reserved;
+  uint32_t size;
+};
+
+struct state_snapshot {
+  size_t len;
+  char data[STATE_SIZE];
+};
+
+struct state {
+  bool enabled;
+  char name[64];
+  char path[256];
+  char tmp_path[264];
+
+  // Built into the slot that is not committed
+  struct state_snapshot snapshots[2];
+  int building;
+  volatile sig_atomic_t committed;
+  uint64_t saved_ns;
+
+  struct state_snapshot loaded;
+
+  uint64_t started_ns;
+  uint64_t replayed_ns;
+  uint64_t first_valid_ns;
+};
+
+static struct state* g_state;
+
+static inline uint64_t state_clock_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static inline size_t state_padded(size_t size) {
+  return (size + 7) & ~(size_t)7;
+}
+
+// Only async-signal-safe calls: also used by the signal handler. The tmp
+// file is always created anew, so neither a leftover file nor a symlink
+// planted at its name is written through.
+static inline bool state_write(const struct state* state,
+                               const struct state_snapshot* snapshot) {
+  unlink(state->tmp_path);
+  int fd = open(state->tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+  if (fd < 0) return false;
+  bool ok = write(fd, snapshot->data, snapshot->len) == (ssize_t)snapshot->len;
+  close(fd);
+  if (!ok || rename(state->tmp_path, state->path) != 0) {
+    unlink(state->tmp_path);
+    return false;
+  }
+  return true;
+}
+
+static void state_exit_handler(int signal_number) {
+  struct state* state = g_state;
+  if (state && state->committed >= 0) {
+    state_write(state, &state->snapshots[state->committed]);
+  }
+  signal(signal_number, SIG_DFL);
+  raise(signal_number);
+}
+
+// The event keeps apart several instances of a helper, e.g. one
+// network_load per interface. A disabled state (e.g. while replaying a
+// trace) neither loads nor saves, but still measures the startup.
+static inline void state_init(struct state* state,
+                              const char* name,
+                              const char* event,
+                              bool enabled      ) {
+  memset(state, 0, sizeof(struct state));
+  state->started_ns = state_clock_ns();
+  state->committed = -1;
+  state->enabled = enabled;
+  snprintf(state->name, sizeof(state->name), "%s", name);
+  if (!enabled) return;
+
+  char file[128];
+  int len = snprintf(file, sizeof(file), "%s_", name);
+  if (len < 0 || len >= (int)sizeof(file) - 7) {
+    state->enabled = false;
+    return;
+  }
+  for (const char* c = event; *c && len < (int)sizeof(file) - 7; c++) {
+    bool plain = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z')
+                 || (*c >= '0' && *c <= '9') || *c == '-' || *c == '_';
+    file[len++] = plain ? *c : '_';
+  }
+  snprintf(file + len, sizeof(file) - len, ".state");
+  if (!tmpdir_path(state->path, sizeof(state->path), file)) {
+    state->enabled = false;
+    return;
+  }
+  snprintf(state->tmp_path, sizeof(state->tmp_path), "%s.tmp", state->path);
+  g_state = state;
+  signal(SIGTERM, state_exit_handler);
+  signal(SIGINT, state_exit_handler);
+  signal(SIGHUP, state_exit_handler);
+}
+
+// Reads the state file; false if there is none, or it is invalid or stale.
+static inline bool state_load(struct state* state) {
+  if (!state->enabled) return false;
+  int fd = open(state->path, O_RDONLY | O_NOFOLLOW);
+  if (fd < 0) return false;
+  ssize_t len = read(fd, state->loaded.data, STATE_SIZE);
+  close(fd);
+
+  int64_t saved_at = 0;
+  size_t header = STATE_MAGIC_SIZE + sizeof(saved_at);
+  if (len < (ssize_t)header || memcmp(state->loaded.data, STATE_MAGIC, STATE_MAGIC_SIZE) != 0) {
+    return false;
+  }
+  memcpy(&saved_at, state->loaded.data + STATE_MAGIC_SIZE, sizeof(saved_at));
+  int64_t age = (int64_t)time(NULL) - saved_at;
+  if (age < 0 || age > STATE_MAX_AGE_SEC) return false;
+
+  state->loaded.len = (size_t)len;
+  return true;
+}
+
+// The next loaded record of kind after *cursor (0 to start), NULL at the end
+static inline const void* state_next(const struct state* state,
+                                     uint16_t kind,
+                                     size_t* cursor,
+                                     size_t* size       ) {
+  size_t offset = *cursor;
+  if (offset == 0) offset = STATE_MAGIC_SIZE + sizeof(int64_t);
+  while (offset + sizeof(struct state_record) <= state->loaded.len) {
+    const struct state_record* record =
+      (const struct state_record*)(state->loaded.data + offset);
+    size_t payload = offset + sizeof(struct state_record);
+    if (record->size > state->loaded.len - payload) break;
+    offset = payload + state_padded(record->size);
+    if (record->kind != kind) continue;
+    *cursor = offset;
+    *size = record->size;
+    return record + 1;
+  }
+  *cursor = state->loaded.len;
+  return NULL;
+}
+
+// Marks the loaded state as sent to the bar
+static inline void state_replayed(struct state* state) {
+  if (!state->replayed_ns) state->replayed_ns = state_clock_ns();
+}
+
+static inline void state_begin(struct state* state) {
+  if (!state->enabled) return;
+  state->building = state->committed == 0 ? 1 : 0;
+  struct state_snapshot* snapshot = &state->snapshots[state->building];
+  int64_t saved_at = (int64_t)time(NULL);
+  memcpy(snapshot->data, STATE_MAGIC, STATE_MAGIC_SIZE);
+  memcpy(snapshot->data + STATE_MAGIC_SIZE, &saved_at, sizeof(saved_at));
+  snapshot->len = STATE_MAGIC_SIZE + sizeof(saved_at);
+}
+
+// Records that do not fit any more are left out
+static inline bool state_add(struct state* state, uint16_t kind, const void* data, size_t size) {
+  if (!state->enabled) return false;
+  struct state_snapshot* snapshot = &state->snapshots[state->building];
+  size_t padded = state_padded(size);
+  if (sizeof(struct state_record) + padded > STATE_SIZE - snapshot->len) return false;
+
+  struct state_record record = { .kind = kind, .size = (uint32_t)size };
+  char* out = snapshot->data + snapshot->len;
+  memcpy(out, &record, sizeof(record));
+  memcpy(out + sizeof(record), data, size);
+  memset(out + sizeof(record) + size, 0, padded - size);
+  snapshot->len += sizeof(record) + padded;
+  return true;
+}
+
+static inline void state_commit(struct state* state) {
+  if (!state->enabled) return;
+  state->committed = state->building;
+  uint64_t now = state_clock_ns();
+  if (now - state->saved_ns < (uint64_t)STATE_SAVE_SEC * 1000000000ull) return;
+  state->saved_ns = now;
+  state_write(state, &state->snapshots[state->committed]);
+}
+
+// Called after every emit; reports the first one with valid live values
+static inline void state_valid(struct state* state) {
+  if (state->first_valid_ns) return;
+  state->first_valid_ns = state_clock_ns();
+  double valid_ms = (double)(state->first_valid_ns - state->started_ns) / 1e6;
+  if (state->replayed_ns) {
+    double replayed_ms = (double)(state->replayed_ns - state->started_ns) / 1e6;
+    fprintf(stderr, "%s: last-known state after %.1fms, first valid values after %.1fms\n",
+            state->name, replayed_ms, valid_ms);
+  } else {
+    fprintf(stderr, "%s: first valid values after %.1fms\n", state->name, valid_ms);
+  }
+}
@@ -0,0 +1,479 @@
+#include <dispatch/dispatch.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libproc.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../impact.h"
+#include "../sketchybar.h"
+#include "../tmpdir.h"
+
+// Runs the resident helpers, one instance each, and restarts them when they
+// exit or stop sending heartbeats.
+//
+// Usage: supervisor [--event <event>] [--low-impact <level>]
+//                   --helper <name> <heartbeat-sec> <command> ...
+//
+// <name> is the process name of the helper, <command> a shell command that
+// starts it. With a heartbeat, the helper is restarted once it has not beat
+// (see heartbeat.h) for that many seconds of awake time; 0 only restarts it
+// when it exits. Restarts back off exponentially while a helper keeps
+// failing. Once a restarted helper is up again (its first beat, or its start
+// without a heartbeat), <event> is triggered with HELPER, REASON, RESTARTS
+// and RECOVER_MS. SIGUSR1 logs the restart counts, CPU times and wakeups to
+// stderr. --low-impact runs the supervisor and every helper in the given
+// low-impact mode (see impact.h).
+//
+// Single instances: the supervisor holds a lock on its pid file, and a new
+// supervisor stops the running one before it takes over. Every helper
+// inherits the lock on its own pid file, so the lock is held exactly as long
+// as the helper runs, also if the supervisor dies first.
+
+#define MAX_HELPERS 16
+#define COMMAND_SIZE 1024
+
+#define BACKOFF_MIN_MSEC 500
+#define BACKOFF_MAX_MSEC 30000
+// A helper that ran this long before failing starts over with the minimum delay
+#define STABLE_SEC 60
+#define LOCK_RETRY_MSEC 200
+#define STOP_TIMEOUT_MSEC 1000
+
+// Where the inherited descriptors end up in the helper
+#define CHILD_LOCK_FD 3
+#define CHILD_HEARTBEAT_FD 4
+
+enum failure {
+  FAILURE_EXIT,
+  FAILURE_SIGNAL,
+  FAILURE_HANG
+};
+
+static const char* failure_names[] = { "exit", "signal", "hang" };
+
+struct helper {
+  const char* name;
+  char command[COMMAND_SIZE];
+  uint64_t heartbeat_ns;
+
+  // Both ends live as long as the supervisor; the helper gets a copy of
+  // heartbeat_fds[1] as CHILD_HEARTBEAT_FD
+  int heartbeat_fds[2];
+
+  pid_t pid;
+  bool hung;
+  uint64_t started;
+  uint64_t last_beat;
+
+  enum failure failure;
+  // When the running instance was lost, 0 while up
+  uint64_t failed_at;
+  uint32_t failures;
+  uint32_t restarts;
+  uint64_t recover_ns;
+};
+
+struct supervisor {
+  const char* event;
+  bool stopping;
+  uint32_t count;
+  struct helper helpers[MAX_HELPERS];
+};
+
+static struct supervisor g_supervisor;
+
+extern char** environ;
+
+static uint64_t now_ns(void) {
+  // Does not advance while asleep, so sleep is never mistaken for a hang
+  return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+static bool pid_file_path(char* buffer, size_t size, const char* name) {
+  char file[64];
+  snprintf(file, sizeof(file), "%s.pid", name);
+  return tmpdir_path(buffer, size, file);
+}
+
+static int open_pid_file(const char* name) {
+  char path[1024];
+  if (!pid_file_path(path, sizeof(path), name)) return -1;
+  return open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+}
+
+static pid_t read_pid(int fd) {
+  char buffer[16] = { 0 };
+  if (pread(fd, buffer, sizeof(buffer) - 1, 0) <= 0) return 0;
+  return (pid_t)atoi(buffer);
+}
+
+static void write_pid(int fd, pid_t pid) {
+  char buffer[16];
+  int len = snprintf(buffer, sizeof(buffer), "%d\n", pid);
+  if (ftruncate(fd, 0) == 0) pwrite(fd, buffer, len, 0);
+}
+
+// Moves fd out of the range the helpers' descriptors are placed in
+static int move_high(int fd) {
+  int moved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+  close(fd);
+  return moved;
+}
+
+// Only the pid recorded in the pid file is stopped, and only while it still
+// runs the helper: the Lua code starts one-shot clients of the same binaries
+// (menus -s, audio_info --toggle-mute, ...), which must not be hit.
+static void stop_recorded(int fd, const char* name) {
+  pid_t pid = read_pid(fd);
+  if (pid <= 0 || pid == getpid()) return;
+  char process[2 * MAXCOMLEN + 1];
+  if (proc_name(pid, process, sizeof(process)) <= 0) return;
+  if (strcmp(process, name) == 0) kill(pid, SIGTERM);
+}
+
+static void spawn(void* context);
+
+static uint64_t backoff_msec(uint32_t failures) {
+  uint64_t delay = BACKOFF_MIN_MSEC;
+  for (uint32_t i = 1; i < failures && delay < BACKOFF_MAX_MSEC; i++) delay *= 2;
+  return delay < BACKOFF_MAX_MSEC ? delay : BACKOFF_MAX_MSEC;
+}
+
+static void schedule_spawn(struct helper* helper, uint64_t msec) {
+  dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, msec * NSEC_PER_MSEC),
+                   dispatch_get_main_queue(),
+                   helper,
+                   spawn                                                  );
+}
+
+static void recovered(struct helper* helper) {
+  if (!helper->failed_at) return;
+  helper->recover_ns = now_ns() - helper->failed_at;
+  helper->failed_at = 0;
+  fprintf(stderr,
+          "supervisor: %s recovered after %llums (%u restarts)\n",
+          helper->name,
+          helper->recover_ns / NSEC_PER_MSEC,
+          helper->restarts                    );
+  if (!g_supervisor.event) return;
+
+  char message[256];
+  snprintf(message,
+           sizeof(message),
+           "--trigger '%s' HELPER='%s' REASON=%s RESTARTS=%u RECOVER_MS=%llu",
+           g_supervisor.event,
+           helper->name,
+           failure_names[helper->failure],
+           helper->restarts,
+           helper->recover_ns / NSEC_PER_MSEC                                );
+  // A bar that is restarting is not reachable for a moment; the supervisor
+  // has to stay up for its helpers, unlike a helper that exits with the bar
+  sketchybar_send(message);
+}
+
+static bool start_process(struct helper* helper, int lock_fd) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, lock_fd, CHILD_LOCK_FD);
+  posix_spawn_file_actions_adddup2(&actions, helper->heartbeat_fds[1], CHILD_HEARTBEAT_FD);
+
+  // Own process group, so a hung helper is killed with its children; the
+  // signals the supervisor ignores are restored for the helper
+  posix_spawnattr_t attributes;
+  posix_spawnattr_init(&attributes);
+  sigset_t signals;
+  sigfillset(&signals);
+  posix_spawnattr_setsigdefault(&attributes, &signals);
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attributes, &signals);
+  posix_spawnattr_setpgroup(&attributes, 0);
+  posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP
+                                        | POSIX_SPAWN_SETSIGDEF
+                                        | POSIX_SPAWN_SETSIGMASK);
+
+  char* argv[] = { "/bin/sh", "-c", helper->command, NULL };
+  pid_t pid;
+  int error = posix_spawn(&pid, "/bin/sh", &actions, &attributes, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attributes);
+  if (error != 0) return false;
+
+  helper->pid = pid;
+  helper->hung = false;
+  helper->started = now_ns();
+  helper->last_beat = helper->started;
+  write_pid(lock_fd, pid);
+  return true;
+}
+
+static void spawn(void* context) {
+  struct helper* helper = context;
+  if (g_supervisor.stopping || helper->pid) return;
+
+  int lock_fd = open_pid_file(helper->name);
+  if (lock_fd < 0) {
+    schedule_spawn(helper, LOCK_RETRY_MSEC);
+    return;
+  }
+  lock_fd = move_high(lock_fd);
+
+  if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    // An instance that outlived its supervisor still holds the lock
+    stop_recorded(lock_fd, helper->name);
+    close(lock_fd);
+    schedule_spawn(helper, LOCK_RETRY_MSEC);
+    return;
+  }
+
+  bool started = start_process(helper, lock_fd);
+  close(lock_fd);
+  if (!started) {
+    fprintf(stderr, "supervisor: could not start %s\n", helper->name);
+    helper->failure = FAILURE_EXIT;
+    if (!helper->failed_at) helper->failed_at = now_ns();
+    schedule_spawn(helper, backoff_msec(++helper->failures));
+    return;
+  }
+  if (!helper->heartbeat_ns) recovered(helper);
+}
+
+static void drain_heartbeats(struct helper* helper) {
+  char beats[64];
+  while (recv(helper->heartbeat_fds[0], beats, sizeof(beats), MSG_DONTWAIT) > 0) {}
+}
+
+static void heartbeat_received(void* context) {
+  struct helper* helper = context;
+  drain_heartbeats(helper);
+  if (!helper->pid) return;
+  helper->last_beat = now_ns();
+  recovered(helper);
+}
+
+static bool any_running(void) {
+  for (uint32_t i = 0; i < g_supervisor.count; i++) {
+    if (g_supervisor.helpers[i].pid) return true;
+  }
+  return false;
+}
+
+static void exited(struct helper* helper, int status) {
+  helper->pid = 0;
+  drain_heartbeats(helper);
+  if (g_supervisor.stopping) {
+    if (!any_running()) exit(0);
+    return;
+  }
+
+  uint64_t now = now_ns();
+  if (helper->hung) helper->failure = FAILURE_HANG;
+  else if (WIFSIGNALED(status)) helper->failure = FAILURE_SIGNAL;
+  else helper->failure = FAILURE_EXIT;
+  // Recovery is measured from the first failure of a series
+  if (!helper->failed_at) helper->failed_at = now;
+  if (now - helper->started >= STABLE_SEC * NSEC_PER_SEC) helper->failures = 0;
+  helper->failures++;
+  helper->restarts++;
+
+  uint64_t delay = backoff_msec(helper->failures);
+  fprintf(stderr,
+          "supervisor: %s stopped (%s), restarting in %llums\n",
+          helper->name,
+          failure_names[helper->failure],
+          delay                                                );
+  schedule_spawn(helper, delay);
+}
+
+static void reap(void* context) {
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (uint32_t i = 0; i < g_supervisor.count; i++) {
+      if (g_supervisor.helpers[i].pid == pid) exited(&g_supervisor.helpers[i], status);
+    }
+  }
+}
+
+static void watchdog(void* context) {
+  uint64_t now = now_ns();
+  for (uint32_t i = 0; i < g_supervisor.count; i++) {
+    struct helper* helper = &g_supervisor.helpers[i];
+    if (!helper->pid || !helper->heartbeat_ns || helper->hung) continue;
+    if (now - helper->last_beat < helper->heartbeat_ns) continue;
+    helper->hung = true;
+    kill(-helper->pid, SIGKILL);
+  }
+}
+
+static void print_stats(void* context) {
+  for (uint32_t i = 0; i < g_supervisor.count; i++) {
+    struct helper* helper = &g_supervisor.helpers[i];
+    struct impact_usage usage = { 0 };
+    if (helper->pid) impact_usage_read(helper->pid, &usage);
+    fprintf(stderr,
+            "supervisor: %s pid %d, %u restarts, last recovery %llums, "
+            "cpu %.2fs user %.2fs sys, %llu interrupt / %llu idle wakeups\n",
+            helper->name,
+            helper->pid,
+            helper->restarts,
+            helper->recover_ns / NSEC_PER_MSEC,
+            usage.user_sec,
+            usage.system_sec,
+            usage.interrupt_wakeups,
+            usage.idle_wakeups                                              );
+  }
+}
+
+static void force_exit(void* context) {
+  for (uint32_t i = 0; i < g_supervisor.count; i++) {
+    if (g_supervisor.helpers[i].pid) kill(-g_supervisor.helpers[i].pid, SIGKILL);
+  }
+  exit(0);
+}
+
+static void stop(void* context) {
+  g_supervisor.stopping = true;
+  if (!any_running()) exit(0);
+  for (uint32_t i = 0; i < g_supervisor.count; i++) {
+    if (g_supervisor.helpers[i].pid) kill(-g_supervisor.helpers[i].pid, SIGTERM);
+  }
+  dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, STOP_TIMEOUT_MSEC * NSEC_PER_MSEC),
+                   dispatch_get_main_queue(),
+                   NULL,
+                   force_exit                                                        );
+}
+
+// Takes over from a running supervisor: it stops its helpers and exits
+// on SIGTERM, which releases the lock
+static bool acquire_instance(void) {
+  int fd = open_pid_file("supervisor");
+  if (fd < 0) return false;
+
+  for (int attempt = 0; flock(fd, LOCK_EX | LOCK_NB) != 0; attempt++) {
+    if (errno != EWOULDBLOCK) return false;
+    pid_t holder = read_pid(fd);
+    if (holder > 0 && attempt == 0) kill(holder, SIGTERM);
+    if (holder > 0 && attempt == 40) kill(holder, SIGKILL);
+    if (attempt == 60) return false;
+    usleep(50000);
+  }
+  write_pid(fd, getpid());
+  // Kept open (and locked) until the supervisor exits
+  return true;
+}
+
+static bool setup_helper(struct helper* helper) {
+  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, helper->heartbeat_fds) != 0) return false;
+  helper->heartbeat_fds[0] = move_high(helper->heartbeat_fds[0]);
+  helper->heartbeat_fds[1] = move_high(helper->heartbeat_fds[1]);
+  int enable = 1;
+  setsockopt(helper->heartbeat_fds[1], SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+  fcntl(helper->heartbeat_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(helper->heartbeat_fds[1], F_SETFL, O_NONBLOCK);
+
+  dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,
+                                                    helper->heartbeat_fds[0],
+                                                    0,
+                                                    dispatch_get_main_queue() );
+  dispatch_set_context(source, helper);
+  dispatch_source_set_event_handler_f(source, heartbeat_received);
+  dispatch_resume(source);
+  return true;
+}
+
+static void watch_signal(int signal_number, dispatch_function_t handler) {
+  if (signal_number != SIGCHLD) signal(signal_number, SIG_IGN);
+  dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL,
+                                                    signal_number,
+                                                    0,
+                                                    dispatch_get_main_queue()  );
+  dispatch_source_set_event_handler_f(source, handler);
+  dispatch_resume(source);
+}
+
+static void usage(const char* name) {
+  printf("Usage: %s [--event <event>] [--low-impact <1|ecores>] "
+         "--helper <name> <heartbeat-sec> <command> ...\n", name);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--event") == 0 && i + 1 < argc) {
+      g_supervisor.event = argv[++i];
+    } else if (strcmp(argv[i], "--low-impact") == 0 && i + 1 < argc) {
+      // Inherited by the helpers, which apply it themselves
+      setenv("SKETCHYBAR_LOW_IMPACT", argv[++i], 1);
+    } else if (strcmp(argv[i], "--helper") == 0
+               && i + 3 < argc
+               && g_supervisor.count < MAX_HELPERS) {
+      struct helper* helper = &g_supervisor.helpers[g_supervisor.count++];
+      helper->name = argv[i + 1];
+      helper->heartbeat_ns = (uint64_t)(atof(argv[i + 2]) * NSEC_PER_SEC);
+      // exec, so the helper replaces the shell and keeps its process name
+      snprintf(helper->command, sizeof(helper->command), "exec %s", argv[i + 3]);
+      i += 3;
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (g_supervisor.count == 0) {
+    usage(argv[0]);
+    exit(1);
+  }
+  impact_apply();
+
+  if (!acquire_instance()) {
+    fprintf(stderr, "supervisor: could not take over from the running instance\n");
+    exit(1);
+  }
+
+  char heartbeat_fd[8];
+  snprintf(heartbeat_fd, sizeof(heartbeat_fd), "%d", CHILD_HEARTBEAT_FD);
+  setenv("HEARTBEAT_FD", heartbeat_fd, 1);
+
+  // SIGCHLD keeps its default action, so exited helpers are not reaped
+  // behind waitpid's back
+  watch_signal(SIGCHLD, reap);
+  watch_signal(SIGTERM, stop);
+  watch_signal(SIGINT, stop);
+  watch_signal(SIGHUP, stop);
+  watch_signal(SIGUSR1, print_stats);
+
+  dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER,
+                                                   0,
+                                                   0,
+                                                   dispatch_get_main_queue());
+  dispatch_source_set_timer(timer,
+                            dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC),
+                            NSEC_PER_SEC,
+                            100 * NSEC_PER_MSEC                           );
+  dispatch_source_set_event_handler_f(timer, watchdog);
+  dispatch_resume(timer);
+
+  for (uint32_t i = 0; i < g_supervisor.count; i++) {
+    struct helper* helper = &g_supervisor.helpers[i];
+    if (!setup_helper(helper)) {
+      fprintf(stderr, "supervisor: no heartbeat socket for %s\n", helper->name);
+      continue;
+    }
+    spawn(helper);
+  }
+
+  dispatch_main();
+  return 0;
+}
+
@@ -0,0 +1,172 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Declarative threshold rules evaluated natively on every sample, e.g.
+//   cpu_hot:cpu_temp_avg > 90 for 3s clear 85
+// A rule turns on once its condition has held for the hold time and turns off
+// once the value has been back past the clear threshold (defaults to the
+// trip threshold) for the same time. Only transitions are reported, plus the
+// initial state of every rule: a restarted helper starts with all rules off,
+// and the bar has to drop an "on" left over from the previous instance.
+
+#define MAX_ALERTS 16
+
+enum alert_metric {
+  ALERT_CPU_USER,
+  ALERT_CPU_SYS,
+  ALERT_CPU_TOTAL,
+  ALERT_CPU_AVG,
+  ALERT_MEM_USED_PERCENT,
+  ALERT_GPU_UTIL,
+  ALERT_GPU_AVG,
+  ALERT_CPU_TEMP,
+  ALERT_GPU_TEMP,
+  ALERT_CPU_TEMP_AVG,
+  ALERT_GPU_TEMP_AVG,
+  ALERT_METRIC_COUNT
+};
+
+static const char* alert_metric_names[ALERT_METRIC_COUNT] = {
+  [ALERT_CPU_USER] = "cpu_user",
+  [ALERT_CPU_SYS] = "cpu_sys",
+  [ALERT_CPU_TOTAL] = "cpu_total",
+  [ALERT_CPU_AVG] = "cpu_avg",
+  [ALERT_MEM_USED_PERCENT] = "mem_used_percent",
+  [ALERT_GPU_UTIL] = "gpu_util",
+  [ALERT_GPU_AVG] = "gpu_avg",
+  [ALERT_CPU_TEMP] = "cpu_temp",
+  [ALERT_GPU_TEMP] = "gpu_temp",
+  [ALERT_CPU_TEMP_AVG] = "cpu_temp_avg",
+  [ALERT_GPU_TEMP_AVG] = "gpu_temp_avg",
+};
+
+struct alert_rule {
+  char id[32];
+  enum alert_metric metric;
+  bool above;
+  bool inclusive;
+  double threshold;
+  double clear;
+  double hold;
+
+  bool active;
+  bool pending;
+  struct timespec pending_since;
+};
+
+struct alerts {
+  struct alert_rule rules[MAX_ALERTS];
+  uint32_t count;
+  bool started;
+};
+
+static inline bool alert_parse(struct alerts* alerts, const char* spec) {
+  if (alerts->count >= MAX_ALERTS) return false;
+
+  struct alert_rule rule = { 0 };
+  char metric[32];
+  char op[3];
+  int consumed = 0;
+  if (sscanf(spec, " %31[^:]:%31s %2s %lf%n",
+                   rule.id,
+                   metric,
+                   op,
+                   &rule.threshold,
+                   &consumed                 ) != 4) {
+    return false;
+  }
+
+  bool found = false;
+  for (int i = 0; i < ALERT_METRIC_COUNT; i++) {
+    if (strcmp(metric, alert_metric_names[i]) == 0) {
+      rule.metric = (enum alert_metric)i;
+      found = true;
+      break;
+    }
+  }
+  if (!found) return false;
+
+  if (strcmp(op, ">") == 0) rule.above = true;
+  else if (strcmp(op, ">=") == 0) rule.above = rule.inclusive = true;
+  else if (strcmp(op, "<") == 0) rule.above = false;
+  else if (strcmp(op, "<=") == 0) rule.inclusive = true;
+  else return false;
+
+  rule.clear = rule.threshold;
+  const char* cursor = spec + consumed;
+  char keyword[8];
+  double value;
+  int n = 0;
+  while (sscanf(cursor, " %7s %lf%n", keyword, &value, &n) == 2) {
+    if (strcmp(keyword, "for") == 0) rule.hold = value;
+    else if (strcmp(keyword, "clear") == 0) rule.clear = value;
+    else return false;
+    cursor += n;
+    // Accept an optional unit suffix on the hold time ("3s")
+    if (*cursor == 's') cursor++;
+  }
+  while (*cursor == ' ') cursor++;
+  if (*cursor != '\0' || rule.hold < 0) return false;
+
+  alerts->rules[alerts->count++] = rule;
+  return true;
+}
+
+static inline bool alert_condition(struct alert_rule* rule, double value) {
+  double limit = rule->active ? rule->clear : rule->threshold;
+  if (rule->above) return rule->inclusive ? value >= limit : value > limit;
+  return rule->inclusive ? value <= limit : value < limit;
+}
+
+static inline void alert_send(const char* event, const struct alert_rule* rule, int value) {
+  char message[256];
+  snprintf(message,
+           sizeof(message),
+           "--trigger '%s' rule='%s' metric='%s' state='%s' value='%d'",
+           event,
+           rule->id,
+           alert_metric_names[rule->metric],
+           rule->active ? "on" : "off",
+           value);
+  sketchybar(message);
+}
+
+// Evaluates every rule against the current sample, taken at now (from
+// trace_now, so hold times follow the recorded clock on replay). Unavailable
+// metrics are passed as negative values and leave the rule untouched.
+// Transitions are sent as one '<event>' trigger each.
+static inline void alerts_update(struct alerts* alerts,
+                                 const char* event,
+                                 const int values[ALERT_METRIC_COUNT],
+                                 struct timespec now                 ) {
+  if (alerts->count == 0) return;
+
+  for (uint32_t i = 0; i < alerts->count; i++) {
+    struct alert_rule* rule = &alerts->rules[i];
+    int value = values[rule->metric];
+    if (!alerts->started) alert_send(event, rule, value);
+    if (value < 0) continue;
+
+    bool tripped = alert_condition(rule, value);
+    if (tripped == rule->active) {
+      rule->pending = false;
+      continue;
+    }
+
+    if (!rule->pending) {
+      rule->pending = true;
+      rule->pending_since = now;
+    }
+    double held = (double)(now.tv_sec - rule->pending_since.tv_sec)
+                  + (double)(now.tv_nsec - rule->pending_since.tv_nsec) / 1e9;
+    if (held < rule->hold) continue;
+
+    rule->active = tripped;
+    rule->pending = false;
+    alert_send(event, rule, value);
+  }
+  alerts->started = true;
+}
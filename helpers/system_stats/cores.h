@@ -0,0 +1,212 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CORES_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CORES_SSE2 1
+#endif
+
+// Per-core loads from the kernel's processor tick counters. The kernel
+// reports an array of structs (user, system, idle, nice ticks per core);
+// the previous busy and total ticks are kept as separate arrays, so four
+// cores are handled per vector step: the ticks are deinterleaved on load,
+// and delta, percentage and the idle-core check run on all four at once.
+//
+// load = (user + system) * 100 / (user + system + idle + nice), truncated,
+// in single precision by every variant so they agree on the result. The
+// product is exact for the deltas of a tick, so unlike dividing first
+// (29 / 50 * 100 = 57.999...) it never lands just below the integer.
+
+// Upper bound for the per-core output (trigger, metrics, rendered bars);
+// the tracking itself grows with the reported core count
+#define MAX_CORES 1024
+
+// Index of the counters in one core's ticks, as in <mach/machine.h>
+#define CORES_TICK_USER 0
+#define CORES_TICK_SYSTEM 1
+#define CORES_TICK_IDLE 2
+#define CORES_TICK_NICE 3
+#define CORES_TICKS_PER_CORE 4
+
+struct cores {
+  uint32_t count;
+  uint32_t capacity;
+  bool primed;
+  uint32_t* prev_busy;
+  uint32_t* prev_total;
+  int* loads;
+};
+
+// Grows the arrays to count cores; new cores start unprimed (load 0).
+static inline bool cores_reserve(struct cores* cores, uint32_t count) {
+  if (count <= cores->capacity) return true;
+  uint32_t capacity = count;
+  uint32_t* busy = realloc(cores->prev_busy, capacity * sizeof(uint32_t));
+  if (busy) cores->prev_busy = busy;
+  uint32_t* total = realloc(cores->prev_total, capacity * sizeof(uint32_t));
+  if (total) cores->prev_total = total;
+  int* loads = realloc(cores->loads, capacity * sizeof(int));
+  if (loads) cores->loads = loads;
+  if (!busy || !total || !loads) return false;
+
+  uint32_t added = capacity - cores->capacity;
+  memset(cores->prev_busy + cores->capacity, 0, added * sizeof(uint32_t));
+  memset(cores->prev_total + cores->capacity, 0, added * sizeof(uint32_t));
+  memset(cores->loads + cores->capacity, 0, added * sizeof(int));
+  cores->capacity = capacity;
+  return true;
+}
+
+static inline int cores_load(uint32_t busy, uint32_t total) {
+  if (total == 0) return 0;
+  int load = (int)((float)busy * 100.0f / (float)total);
+  return load < 0 ? 0 : (load > 100 ? 100 : load);
+}
+
+static inline void cores_update_scalar(struct cores* cores,
+                                       const int32_t* ticks,
+                                       uint32_t from,
+                                       uint32_t to         ) {
+  for (uint32_t i = from; i < to; i++) {
+    const uint32_t* core = (const uint32_t*)ticks + i * CORES_TICKS_PER_CORE;
+    uint32_t busy = core[CORES_TICK_USER] + core[CORES_TICK_SYSTEM];
+    uint32_t total = busy + core[CORES_TICK_IDLE] + core[CORES_TICK_NICE];
+    cores->loads[i] = cores_load(busy - cores->prev_busy[i], total - cores->prev_total[i]);
+    cores->prev_busy[i] = busy;
+    cores->prev_total[i] = total;
+  }
+}
+
+#if defined(CORES_NEON)
+static inline uint32_t cores_update_vector(struct cores* cores,
+                                           const int32_t* ticks,
+                                           uint32_t count      ) {
+  const uint32x4_t zero = vdupq_n_u32(0);
+  const uint32x4_t hundred = vdupq_n_u32(100);
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32x4x4_t core = vld4q_u32((const uint32_t*)ticks + i * CORES_TICKS_PER_CORE);
+    uint32x4_t busy = vaddq_u32(core.val[CORES_TICK_USER], core.val[CORES_TICK_SYSTEM]);
+    uint32x4_t total = vaddq_u32(vaddq_u32(busy, core.val[CORES_TICK_IDLE]),
+                                 core.val[CORES_TICK_NICE]                  );
+    uint32x4_t delta_busy = vsubq_u32(busy, vld1q_u32(cores->prev_busy + i));
+    uint32x4_t delta_total = vsubq_u32(total, vld1q_u32(cores->prev_total + i));
+    vst1q_u32(cores->prev_busy + i, busy);
+    vst1q_u32(cores->prev_total + i, total);
+
+    float32x4_t percent = vdivq_f32(vmulq_n_f32(vcvtq_f32_u32(delta_busy), 100.0f),
+                                    vcvtq_f32_u32(delta_total)                     );
+    uint32x4_t load = vminq_u32(vcvtq_u32_f32(percent), hundred);
+    load = vbslq_u32(vceqq_u32(delta_total, zero), zero, load);
+    vst1q_s32(cores->loads + i, vreinterpretq_s32_u32(load));
+  }
+  return i;
+}
+#elif defined(CORES_SSE2)
+static inline uint32_t cores_update_vector(struct cores* cores,
+                                           const int32_t* ticks,
+                                           uint32_t count      ) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i hundred = _mm_set1_epi32(100);
+  const __m128 scale = _mm_set1_ps(100.0f);
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i* core = (const __m128i*)(ticks + i * CORES_TICKS_PER_CORE);
+    __m128i a = _mm_loadu_si128(core);
+    __m128i b = _mm_loadu_si128(core + 1);
+    __m128i c = _mm_loadu_si128(core + 2);
+    __m128i d = _mm_loadu_si128(core + 3);
+    // Transpose: one register per counter, one lane per core
+    __m128i ab_low = _mm_unpacklo_epi32(a, b);
+    __m128i cd_low = _mm_unpacklo_epi32(c, d);
+    __m128i ab_high = _mm_unpackhi_epi32(a, b);
+    __m128i cd_high = _mm_unpackhi_epi32(c, d);
+    __m128i user = _mm_unpacklo_epi64(ab_low, cd_low);
+    __m128i system = _mm_unpackhi_epi64(ab_low, cd_low);
+    __m128i idle = _mm_unpacklo_epi64(ab_high, cd_high);
+    __m128i nice = _mm_unpackhi_epi64(ab_high, cd_high);
+
+    __m128i busy = _mm_add_epi32(user, system);
+    __m128i total = _mm_add_epi32(_mm_add_epi32(busy, idle), nice);
+    __m128i* prev_busy = (__m128i*)(cores->prev_busy + i);
+    __m128i* prev_total = (__m128i*)(cores->prev_total + i);
+    __m128i delta_busy = _mm_sub_epi32(busy, _mm_loadu_si128(prev_busy));
+    __m128i delta_total = _mm_sub_epi32(total, _mm_loadu_si128(prev_total));
+    _mm_storeu_si128(prev_busy, busy);
+    _mm_storeu_si128(prev_total, total);
+
+    // Deltas of one tick interval are far below 2^31, so the signed
+    // conversion is exact enough
+    __m128 percent = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(delta_busy), scale),
+                                _mm_cvtepi32_ps(delta_total)                  );
+    __m128i load = _mm_cvttps_epi32(percent);
+    __m128i over = _mm_cmpgt_epi32(load, hundred);
+    load = _mm_or_si128(_mm_andnot_si128(over, load), _mm_and_si128(over, hundred));
+    __m128i invalid = _mm_or_si128(_mm_cmpeq_epi32(delta_total, zero),
+                                   _mm_cmplt_epi32(load, zero)         );
+    load = _mm_andnot_si128(invalid, load);
+    _mm_storeu_si128((__m128i*)(cores->loads + i), load);
+  }
+  return i;
+}
+#else
+static inline uint32_t cores_update_vector(struct cores* cores,
+                                           const int32_t* ticks,
+                                           uint32_t count      ) {
+  return 0;
+}
+#endif
+
+// ticks holds CORES_TICKS_PER_CORE counters per core. The first update
+// after a change of the core count only primes the new counters.
+static inline bool cores_update(struct cores* cores, const int32_t* ticks, uint32_t count) {
+  if (!cores_reserve(cores, count)) return false;
+  if (count != cores->count) {
+    cores->count = count;
+    cores->primed = false;
+  }
+  uint32_t done = cores_update_vector(cores, ticks, count);
+  cores_update_scalar(cores, ticks, done, count);
+  if (!cores->primed) memset(cores->loads, 0, count * sizeof(int));
+  cores->primed = true;
+  return true;
+}
+
+// Writes the loads as "12,0,100,..." without going through printf: every
+// load is 0-100, so its digits come from a two digit table.
+static inline size_t cores_format(const int* loads, uint32_t count, char* buffer, size_t size) {
+  static const char digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+  if (size < 5) {
+    if (size > 0) buffer[0] = '\0';
+    return 0;
+  }
+  char* out = buffer;
+  // Room for the longest load, its separator and the terminator
+  char* end = buffer + size - 5;
+  for (uint32_t i = 0; i < count && out <= end; i++) {
+    unsigned int load = (unsigned int)loads[i];
+    *out = ',';
+    out += i > 0;
+    if (load >= 100) {
+      memcpy(out, "100", 3);
+      out += 3;
+      continue;
+    }
+    // One digit below 10: write both, keep the second
+    const char* pair = digits + load * 2;
+    out[0] = pair[load < 10];
+    out[1] = pair[1];
+    out += 1 + (load >= 10);
+  }
+  *out = '\0';
+  return out - buffer;
+}
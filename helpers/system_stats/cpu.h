@@ -4,7 +4,8 @@
 #include <unistd.h>
 #include <stdio.h>
 
-#define MAX_CORES 32
+#include "../trace.h"
+#include "cores.h"
 
 struct cpu {
   host_t host;
@@ -17,12 +18,10 @@ struct cpu {
   int sys_load;
   int total_load;
 
-  // Per-core tracking
+  // Per-core tracking; core_loads points into cores
   natural_t ncores;
-  int core_loads[MAX_CORES];
-  processor_cpu_load_info_t prev_core_info;
-  mach_msg_type_number_t prev_core_count;
-  bool has_prev_core_info;
+  int* core_loads;
+  struct cores cores;
 };
 
 static inline void cpu_init(struct cpu* cpu) {
@@ -34,10 +33,8 @@ static inline void cpu_init(struct cpu* cpu) {
   cpu->total_load = 0;
 
   cpu->ncores = 0;
-  memset(cpu->core_loads, 0, sizeof(cpu->core_loads));
-  cpu->prev_core_info = NULL;
-  cpu->prev_core_count = 0;
-  cpu->has_prev_core_info = false;
+  cpu->core_loads = NULL;
+  memset(&cpu->cores, 0, sizeof(struct cores));
 }
 
 static inline void cpu_update_cores(struct cpu* cpu) {
@@ -45,6 +42,19 @@ static inline void cpu_update_cores(struct cpu* cpu) {
   processor_cpu_load_info_t info = NULL;
   mach_msg_type_number_t info_count = 0;
 
+  if (trace_replaying()) {
+    size_t size = 0;
+    const void* recorded = trace_next(TRACE_CPU_CORES, &size);
+    if (!recorded || size == 0) return;
+    ncores = (natural_t)(size / sizeof(integer_t) / PROCESSOR_CPU_LOAD_INFO_COUNT);
+    if (ncores > MAX_CORES) ncores = MAX_CORES;
+    if (cores_update(&cpu->cores, recorded, ncores)) {
+      cpu->ncores = ncores;
+      cpu->core_loads = cpu->cores.loads;
+    }
+    return;
+  }
+
   kern_return_t kr = host_processor_info(cpu->host,
                                           PROCESSOR_CPU_LOAD_INFO,
                                           &ncores,
@@ -53,55 +63,32 @@ static inline void cpu_update_cores(struct cpu* cpu) {
   if (kr != KERN_SUCCESS) {
     return;
   }
+  trace_record(TRACE_CPU_CORES, info, info_count * sizeof(integer_t));
 
+  // The counters are folded into the busy/total arrays right away, so the
+  // kernel's array is not kept until the next tick
   if (ncores > MAX_CORES) ncores = MAX_CORES;
-  cpu->ncores = ncores;
-
-  if (cpu->has_prev_core_info && cpu->prev_core_info) {
-    natural_t prev_n = cpu->prev_core_count / PROCESSOR_CPU_LOAD_INFO_COUNT;
-    if (prev_n > ncores) prev_n = ncores;
-
-    for (natural_t i = 0; i < prev_n; i++) {
-      unsigned int delta_user = info[i].cpu_ticks[CPU_STATE_USER]
-                                - cpu->prev_core_info[i].cpu_ticks[CPU_STATE_USER];
-      unsigned int delta_sys  = info[i].cpu_ticks[CPU_STATE_SYSTEM]
-                                - cpu->prev_core_info[i].cpu_ticks[CPU_STATE_SYSTEM];
-      unsigned int delta_idle = info[i].cpu_ticks[CPU_STATE_IDLE]
-                                - cpu->prev_core_info[i].cpu_ticks[CPU_STATE_IDLE];
-      unsigned int delta_nice = info[i].cpu_ticks[CPU_STATE_NICE]
-                                - cpu->prev_core_info[i].cpu_ticks[CPU_STATE_NICE];
-
-      unsigned int total = delta_user + delta_sys + delta_idle + delta_nice;
-      if (total > 0) {
-        cpu->core_loads[i] = (int)((double)(delta_user + delta_sys) / (double)total * 100.0);
-      } else {
-        cpu->core_loads[i] = 0;
-      }
-    }
+  if (cores_update(&cpu->cores, (const int32_t*)info, ncores)) {
+    cpu->ncores = ncores;
+    cpu->core_loads = cpu->cores.loads;
   }
-
-  // Deallocate previous snapshot
-  if (cpu->prev_core_info) {
-    vm_deallocate(mach_task_self(),
-                  (vm_address_t)cpu->prev_core_info,
-                  cpu->prev_core_count * sizeof(integer_t));
-  }
-
-  // Store current as previous for next iteration
-  cpu->prev_core_info = info;
-  cpu->prev_core_count = info_count;
-  cpu->has_prev_core_info = true;
+  vm_deallocate(mach_task_self(), (vm_address_t)info, info_count * sizeof(integer_t));
 }
 
 static inline void cpu_update(struct cpu* cpu) {
-  kern_return_t error = host_statistics(cpu->host,
-                                        HOST_CPU_LOAD_INFO,
-                                        (host_info_t)&cpu->load,
-                                        &cpu->count                );
-
-  if (error != KERN_SUCCESS) {
-    printf("Error: Could not read cpu host statistics.\n");
-    return;
+  if (trace_replaying()) {
+    if (!trace_read(TRACE_CPU_LOAD, &cpu->load, sizeof(cpu->load))) return;
+  } else {
+    kern_return_t error = host_statistics(cpu->host,
+                                          HOST_CPU_LOAD_INFO,
+                                          (host_info_t)&cpu->load,
+                                          &cpu->count                );
+
+    if (error != KERN_SUCCESS) {
+      printf("Error: Could not read cpu host statistics.\n");
+      return;
+    }
+    trace_record(TRACE_CPU_LOAD, &cpu->load, sizeof(cpu->load));
   }
 
   if (cpu->has_prev_load) {
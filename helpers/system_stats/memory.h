@@ -0,0 +1,40 @@
+#include <stdint.h>
+
+// Memory breakdown from the VM page counts. Only the counts the breakdown
+// needs are taken from vm_statistics64, so the arithmetic is checked on
+// other platforms too.
+
+struct memory_pages {
+  uint64_t active;
+  uint64_t wired;
+  uint64_t compressor;
+  // File-backed pages
+  uint64_t external;
+  uint64_t purgeable;
+};
+
+struct memory_stats {
+  uint64_t total;
+  // Active, wired and compressed, as shown by the bar
+  uint64_t used;
+  uint64_t wired;
+  // File-backed and purgeable pages the system can drop at any time
+  uint64_t cached;
+  // Memory occupied by the compressor
+  uint64_t compressed;
+  int percent;
+};
+
+static inline void memory_stats_compute(struct memory_stats* stats,
+                                        uint64_t total,
+                                        uint64_t page_size,
+                                        const struct memory_pages* pages) {
+  stats->total = total;
+  stats->wired = pages->wired * page_size;
+  stats->compressed = pages->compressor * page_size;
+  stats->cached = (pages->external + pages->purgeable) * page_size;
+  stats->used = pages->active * page_size + stats->wired + stats->compressed;
+
+  int percent = total > 0 ? (int)((double)stats->used / (double)total * 100.0) : 0;
+  stats->percent = percent < 0 ? 0 : (percent > 100 ? 100 : percent);
+}
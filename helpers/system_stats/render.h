@@ -0,0 +1,224 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "cores.h"
+
+// Direct-render mode: the per-core bars and the GPU/MEM graphs are drawn by
+// the helper itself, as one batched --set/--push message per tick, instead
+// of going through the trigger and the Lua handler. Configured with
+//   --render-cores <item prefix>   core i is the item "<prefix><i>"
+//   --bar-height <px>              height of a fully loaded core bar
+//   --pcores <n>                   cores from n on are efficiency cores
+//   --ecore-color <color>          fixed color of the efficiency cores
+//   --core-color <load>:<color>    color from this load on (repeatable)
+//   --gpu-graph <item>, --mem-graph <item>
+//   --suspend-file <path>          nothing is drawn while this file exists
+//
+// The suspend file is the helper's side of _G.SKETCHYBAR_SUSPENDED: the bar
+// writes it while Mission Control, a space change or a wake suspends the
+// Lua handlers (mission_control.lua), which these messages bypass. A file
+// older than RENDER_SUSPEND_MAX_SEC is left over from a crashed bar and
+// ignored.
+
+#define RENDER_SUSPEND_MAX_SEC 10
+#define RENDER_MAX_LEVELS 8
+#define RENDER_NAME_SIZE 64
+
+struct render_level {
+  int min_load;
+  uint32_t color;
+};
+
+struct render {
+  bool cores;
+  char core_prefix[RENDER_NAME_SIZE];
+  int bar_height;
+  int pcores;
+  uint32_t ecore_color;
+  struct render_level levels[RENDER_MAX_LEVELS];
+  uint32_t level_count;
+
+  char gpu_graph[RENDER_NAME_SIZE];
+  char mem_graph[RENDER_NAME_SIZE];
+  char suspend_file[256];
+
+  // Last values sent, so unchanged bars are left out of the message
+  int heights[MAX_CORES];
+  uint32_t colors[MAX_CORES];
+};
+
+static inline void render_init(struct render* render) {
+  memset(render, 0, sizeof(struct render));
+  render->bar_height = 28;
+  render->pcores = MAX_CORES;
+  for (int i = 0; i < MAX_CORES; i++) render->heights[i] = -1;
+}
+
+static inline bool render_enabled(const struct render* render) {
+  return render->cores || render->gpu_graph[0] || render->mem_graph[0];
+}
+
+// One stat per tick; the bars keep their last sent state, so the first
+// tick after the suspension only sends what changed in the meantime
+static inline bool render_suspended(const struct render* render) {
+  if (!render->suspend_file[0]) return false;
+  struct stat info;
+  if (stat(render->suspend_file, &info) != 0) return false;
+  return time(NULL) - info.st_mtime <= RENDER_SUSPEND_MAX_SEC;
+}
+
+static inline bool render_parse_level(struct render* render, const char* spec) {
+  if (render->level_count >= RENDER_MAX_LEVELS) return false;
+  int min_load = 0;
+  unsigned int color = 0;
+  if (sscanf(spec, "%d:%x", &min_load, &color) != 2) return false;
+
+  // Kept sorted by load, so the last matching level wins
+  uint32_t i = render->level_count++;
+  while (i > 0 && render->levels[i - 1].min_load > min_load) {
+    render->levels[i] = render->levels[i - 1];
+    i--;
+  }
+  render->levels[i] = (struct render_level){ min_load, color };
+  return true;
+}
+
+// Consumes the render option at argv[*i] (and its value). Returns false if
+// argv[*i] is not a render option; sets *error if its value is invalid.
+static inline bool render_parse_option(struct render* render,
+                                       int argc,
+                                       char** argv,
+                                       int* i,
+                                       bool* error         ) {
+  const char* option = argv[*i];
+  if (strncmp(option, "--", 2) != 0 || *i + 1 >= argc) return false;
+  const char* value = argv[*i + 1];
+
+  if (strcmp(option, "--render-cores") == 0) {
+    strlcpy(render->core_prefix, value, sizeof(render->core_prefix));
+    render->cores = true;
+  } else if (strcmp(option, "--bar-height") == 0) {
+    render->bar_height = atoi(value);
+    if (render->bar_height < 3) *error = true;
+  } else if (strcmp(option, "--pcores") == 0) {
+    render->pcores = atoi(value);
+  } else if (strcmp(option, "--ecore-color") == 0) {
+    render->ecore_color = (uint32_t)strtoul(value, NULL, 16);
+  } else if (strcmp(option, "--core-color") == 0) {
+    if (!render_parse_level(render, value)) *error = true;
+  } else if (strcmp(option, "--gpu-graph") == 0) {
+    strlcpy(render->gpu_graph, value, sizeof(render->gpu_graph));
+  } else if (strcmp(option, "--mem-graph") == 0) {
+    strlcpy(render->mem_graph, value, sizeof(render->mem_graph));
+  } else if (strcmp(option, "--suspend-file") == 0) {
+    strlcpy(render->suspend_file, value, sizeof(render->suspend_file));
+  } else {
+    return false;
+  }
+  (*i)++;
+  return true;
+}
+
+static inline uint32_t render_core_color(const struct render* render, int core, int load) {
+  if (core >= render->pcores) return render->ecore_color;
+  uint32_t color = render->level_count > 0 ? render->levels[0].color : 0;
+  for (uint32_t i = 0; i < render->level_count; i++) {
+    if (load >= render->levels[i].min_load) color = render->levels[i].color;
+  }
+  return color;
+}
+
+static inline size_t render_append(char* buffer, size_t size, size_t len, const char* format, ...)
+  __attribute__((format(printf, 4, 5)));
+
+static inline size_t render_append(char* buffer, size_t size, size_t len, const char* format, ...) {
+  if (len >= size) return len;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(buffer + len, size - len, format, args);
+  va_end(args);
+  return written > 0 ? len + written : len;
+}
+
+// Builds the batched message for one tick. Graph values below zero are
+// unavailable and not pushed. Returns false if there is nothing to send.
+static inline bool render_tick(struct render* render,
+                               const int* core_loads,
+                               int ncores,
+                               int gpu_util,
+                               int mem_percent,
+                               char* buffer,
+                               size_t size     ) {
+  size_t len = 0;
+  buffer[0] = '\0';
+
+  if (render->cores) {
+    for (int i = 0; i < ncores && i < MAX_CORES; i++) {
+      int load = core_loads[i];
+      int height = (int)((double)load / 100.0 * render->bar_height + 0.5);
+      if (height < 3) height = 3;
+      uint32_t color = render_core_color(render, i, load);
+      if (height == render->heights[i] && color == render->colors[i]) continue;
+
+      render->heights[i] = height;
+      render->colors[i] = color;
+      len = render_append(buffer,
+                          size,
+                          len,
+                          "%s--set %s%d background.height=%d "
+                          "background.y_offset=%d background.color=0x%08x",
+                          len > 0 ? " " : "",
+                          render->core_prefix,
+                          i,
+                          height,
+                          -(render->bar_height - height) / 2,
+                          color                                       );
+    }
+  }
+
+  if (render->gpu_graph[0] && gpu_util >= 0) {
+    len = render_append(buffer, size, len, "%s--push %s %.2f",
+                        len > 0 ? " " : "",
+                        render->gpu_graph,
+                        gpu_util / 100.0                     );
+  }
+  if (render->mem_graph[0] && mem_percent >= 0) {
+    len = render_append(buffer, size, len, "%s--push %s %.2f",
+                        len > 0 ? " " : "",
+                        render->mem_graph,
+                        mem_percent / 100.0                  );
+  }
+  return len > 0 && len < size;
+}
+
+// Fills the graphs with a history of values (0-1, oldest first) in one
+// message, to repaint the last-known state at startup.
+static inline bool render_history(const struct render* render,
+                                  const float* gpu,
+                                  uint32_t gpu_count,
+                                  const float* mem,
+                                  uint32_t mem_count,
+                                  char* buffer,
+                                  size_t size        ) {
+  size_t len = 0;
+  buffer[0] = '\0';
+  if (render->gpu_graph[0] && gpu_count > 0) {
+    len = render_append(buffer, size, len, "--push %s", render->gpu_graph);
+    for (uint32_t i = 0; i < gpu_count; i++) {
+      len = render_append(buffer, size, len, " %.2f", gpu[i]);
+    }
+  }
+  if (render->mem_graph[0] && mem_count > 0) {
+    len = render_append(buffer, size, len, "%s--push %s", len > 0 ? " " : "", render->mem_graph);
+    for (uint32_t i = 0; i < mem_count; i++) {
+      len = render_append(buffer, size, len, " %.2f", mem[i]);
+    }
+  }
+  return len > 0 && len < size;
+}
@@ -16,7 +16,16 @@
 #include <libproc.h>
 
 #include "cpu.h"
+#include "../heartbeat.h"
+#include "../impact.h"
+#include "../metrics.h"
+#include "../metrics_process.h"
 #include "../sketchybar.h"
+#include "../state.h"
+#include "../trace.h"
+#include "alert.h"
+#include "memory.h"
+#include "render.h"
 
 #define MAX_TOP_PROCS 10
 
@@ -51,7 +60,7 @@ static uint64_t get_process_gpu_time(pid_t pid) {
 }
 
 // Get top GPU-using processes and format as string for sketchybar
-static void get_top_gpu_processes(char *buffer, size_t bufsize) {
+static void get_live_top_gpu_processes(char *buffer, size_t bufsize) {
   // Get list of all PIDs
   int num_pids = proc_listallpids(NULL, 0);
   if (num_pids <= 0) {
@@ -177,7 +186,7 @@ static double read_hid_service_temperature(IOHIDServiceClientRef service) {
   return temp;
 }
 
-static void read_temperatures(int *cpu_temp, int *gpu_temp) {
+static void read_live_temperatures(int *cpu_temp, int *gpu_temp) {
   if (cpu_temp) *cpu_temp = -1;
   if (gpu_temp) *gpu_temp = -1;
   if (!ensure_hid_services()) return;
@@ -219,37 +228,96 @@ static void read_temperatures(int *cpu_temp, int *gpu_temp) {
   }
 }
 
-static bool read_memory_stats(uint64_t *used_bytes, uint64_t *total_bytes, int *percent) {
-  if (!used_bytes || !total_bytes || !percent) return false;
-
-  uint64_t total = 0;
-  size_t total_len = sizeof(total);
-  if (sysctlbyname("hw.memsize", &total, &total_len, NULL, 0) != 0) return false;
-
-  mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+// Raw memory inputs, as recorded in traces
+struct memory_input {
+  uint64_t total;
+  uint64_t page_size;
   vm_statistics64_data_t vmstat;
-  if (host_statistics64(mach_host_self(),
-                        HOST_VM_INFO64,
-                        (host_info64_t)&vmstat,
-                        &count) != KERN_SUCCESS) {
-    return false;
+};
+
+// Swap use and the pressure level change slowly and are read on full ticks
+struct memory_pressure {
+  // -1 if unavailable
+  int64_t swap_used;
+  // 1 normal, 2 warning, 4 critical, as kern.memorystatus_vm_pressure_level
+  int level;
+};
+
+static bool read_live_memory_input(struct memory_input *input) {
+  // Constant for the lifetime of the helper, so only the page counts are
+  // read per tick
+  static mach_port_t host = MACH_PORT_NULL;
+  static uint64_t total = 0;
+  static uint64_t page_size = 0;
+  if (host == MACH_PORT_NULL) {
+    size_t total_len = sizeof(total);
+    vm_size_t host_page = 0;
+    mach_port_t self = mach_host_self();
+    if (sysctlbyname("hw.memsize", &total, &total_len, NULL, 0) != 0
+        || host_page_size(self, &host_page) != KERN_SUCCESS) {
+      mach_port_deallocate(mach_task_self(), self);
+      return false;
+    }
+    page_size = host_page;
+    host = self;
   }
 
-  mach_port_t host = mach_host_self();
-  vm_size_t page_size = 0;
-  if (host_page_size(host, &page_size) != KERN_SUCCESS) return false;
+  input->total = total;
+  input->page_size = page_size;
+  mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+  return host_statistics64(host,
+                           HOST_VM_INFO64,
+                           (host_info64_t)&input->vmstat,
+                           &count                        ) == KERN_SUCCESS;
+}
 
-  uint64_t used_pages = (uint64_t)vmstat.active_count + (uint64_t)vmstat.wire_count + (uint64_t)vmstat.compressor_page_count;
-  uint64_t used = used_pages * (uint64_t)page_size;
-  int pct = total > 0 ? (int)((double)used / (double)total * 100.0) : 0;
+static bool read_memory_stats(struct memory_stats *stats) {
+  struct memory_input input;
+  if (trace_replaying()) {
+    if (!trace_read(TRACE_MEMORY, &input, sizeof(input))) return false;
+  } else {
+    if (!read_live_memory_input(&input)) return false;
+    trace_record(TRACE_MEMORY, &input, sizeof(input));
+  }
 
-  *used_bytes = used;
-  *total_bytes = total;
-  *percent = clamp_int(pct, 0, 100);
+  const vm_statistics64_data_t *vmstat = &input.vmstat;
+  struct memory_pages pages = {
+    .active = vmstat->active_count,
+    .wired = vmstat->wire_count,
+    .compressor = vmstat->compressor_page_count,
+    .external = vmstat->external_page_count,
+    .purgeable = vmstat->purgeable_count
+  };
+  memory_stats_compute(stats, input.total, input.page_size, &pages);
   return true;
 }
 
-static int read_gpu_utilization(void) {
+static void read_live_memory_pressure(struct memory_pressure *pressure) {
+  struct xsw_usage swap;
+  size_t swap_len = sizeof(swap);
+  pressure->swap_used = sysctlbyname("vm.swapusage", &swap, &swap_len, NULL, 0) == 0
+                        ? (int64_t)swap.xsu_used
+                        : -1;
+  int level = 0;
+  size_t level_len = sizeof(level);
+  if (sysctlbyname("kern.memorystatus_vm_pressure_level", &level, &level_len, NULL, 0) != 0) {
+    level = -1;
+  }
+  pressure->level = level;
+}
+
+static void read_memory_pressure(struct memory_pressure *pressure) {
+  if (trace_replaying()) {
+    if (!trace_read(TRACE_MEMORY_PRESSURE, pressure, sizeof(struct memory_pressure))) {
+      *pressure = (struct memory_pressure){ -1, -1 };
+    }
+    return;
+  }
+  read_live_memory_pressure(pressure);
+  trace_record(TRACE_MEMORY_PRESSURE, pressure, sizeof(struct memory_pressure));
+}
+
+static int read_live_gpu_utilization(void) {
   io_iterator_t iterator;
   if (IOServiceGetMatchingServices(kIOMainPortDefault,
                                    IOServiceMatching("IOAccelerator"),
@@ -282,18 +350,328 @@ static int read_gpu_utilization(void) {
   return (best >= 0) ? clamp_int(best, 0, 100) : -1;
 }
 
+// The inputs below are recorded to and replayed from traces (trace.h)
+static int read_gpu_utilization(void) {
+  int utilization = -1;
+  if (trace_replaying()) {
+    trace_read(TRACE_GPU_UTIL, &utilization, sizeof(utilization));
+  } else {
+    utilization = read_live_gpu_utilization();
+    trace_record(TRACE_GPU_UTIL, &utilization, sizeof(utilization));
+  }
+  return utilization;
+}
+
+static void read_temperatures(int *cpu_temp, int *gpu_temp) {
+  int temperatures[2] = { -1, -1 };
+  if (trace_replaying()) {
+    trace_read(TRACE_TEMPERATURES, temperatures, sizeof(temperatures));
+  } else {
+    read_live_temperatures(&temperatures[0], &temperatures[1]);
+    trace_record(TRACE_TEMPERATURES, temperatures, sizeof(temperatures));
+  }
+  *cpu_temp = temperatures[0];
+  *gpu_temp = temperatures[1];
+}
+
+static void get_top_gpu_processes(char *buffer, size_t bufsize) {
+  if (trace_replaying()) {
+    size_t size = 0;
+    const char *recorded = trace_next(TRACE_GPU_PROCS, &size);
+    snprintf(buffer, bufsize, "%.*s", recorded ? (int)size : 0, recorded ? recorded : "");
+    return;
+  }
+  get_live_top_gpu_processes(buffer, bufsize);
+  trace_record(TRACE_GPU_PROCS, buffer, strlen(buffer));
+}
+
+// Scrape endpoint (--metrics): the values of every tick, plus histograms of
+// the loads and temperatures since the helper started
+static const double load_buckets[] = { 10, 25, 50, 75, 90, 100 };
+static const double temp_buckets[] = { 40, 50, 60, 70, 80, 90, 100 };
+
+struct stats_metrics {
+  int cpu_user;
+  int cpu_sys;
+  int cpu_total;
+  int cpu_total_hist;
+  int cpu_cores[MAX_CORES];
+  int mem_used;
+  int mem_total;
+  int mem_percent;
+  int mem_wired;
+  int mem_cached;
+  int mem_compressed;
+  int swap_used;
+  int mem_pressure;
+  int gpu_util;
+  int gpu_util_hist;
+  int cpu_temp;
+  int gpu_temp;
+  int cpu_temp_hist;
+  int ticks;
+  struct metrics_process process;
+  struct metrics_startup startup;
+};
+
+static void stats_metrics_init(struct stats_metrics *m, struct metrics *metrics) {
+  m->cpu_user = metrics_add(metrics, METRIC_GAUGE, "sketchybar_cpu_load_percent",
+                            "mode=\"user\"", "CPU load of the last tick");
+  m->cpu_sys = metrics_add(metrics, METRIC_GAUGE, "sketchybar_cpu_load_percent",
+                           "mode=\"system\"", NULL);
+  m->cpu_total = metrics_add(metrics, METRIC_GAUGE, "sketchybar_cpu_load_percent",
+                             "mode=\"total\"", NULL);
+  m->cpu_total_hist = metrics_add_histogram(metrics, "sketchybar_cpu_total_load_percent",
+                                            NULL, "Total CPU load per tick",
+                                            load_buckets, sizeof(load_buckets) / sizeof(double));
+  for (int i = 0; i < MAX_CORES; i++) m->cpu_cores[i] = -1;
+  m->mem_used = metrics_add(metrics, METRIC_GAUGE, "sketchybar_memory_used_bytes",
+                            NULL, "Active, wired and compressed memory");
+  m->mem_total = metrics_add(metrics, METRIC_GAUGE, "sketchybar_memory_total_bytes",
+                             NULL, "Physical memory");
+  m->mem_percent = metrics_add(metrics, METRIC_GAUGE, "sketchybar_memory_used_percent",
+                               NULL, "Used share of the physical memory");
+  m->mem_wired = metrics_add(metrics, METRIC_GAUGE, "sketchybar_memory_breakdown_bytes",
+                             "kind=\"wired\"", "Memory by kind");
+  m->mem_cached = metrics_add(metrics, METRIC_GAUGE, "sketchybar_memory_breakdown_bytes",
+                              "kind=\"cached\"", NULL);
+  m->mem_compressed = metrics_add(metrics, METRIC_GAUGE, "sketchybar_memory_breakdown_bytes",
+                                  "kind=\"compressed\"", NULL);
+  m->swap_used = metrics_add(metrics, METRIC_GAUGE, "sketchybar_swap_used_bytes",
+                             NULL, "Swap in use, as of the last full tick");
+  m->mem_pressure = metrics_add(metrics, METRIC_GAUGE, "sketchybar_memory_pressure_level",
+                                NULL, "1 normal, 2 warning, 4 critical");
+  m->gpu_util = metrics_add(metrics, METRIC_GAUGE, "sketchybar_gpu_utilization_percent",
+                            NULL, "GPU device utilization of the last tick");
+  m->gpu_util_hist = metrics_add_histogram(metrics, "sketchybar_gpu_utilization_hist_percent",
+                                           NULL, "GPU device utilization per tick",
+                                           load_buckets, sizeof(load_buckets) / sizeof(double));
+  m->cpu_temp = metrics_add(metrics, METRIC_GAUGE, "sketchybar_temperature_celsius",
+                            "sensor=\"cpu\"", "Die temperature of the last full tick");
+  m->gpu_temp = metrics_add(metrics, METRIC_GAUGE, "sketchybar_temperature_celsius",
+                            "sensor=\"gpu\"", NULL);
+  m->cpu_temp_hist = metrics_add_histogram(metrics, "sketchybar_cpu_temperature_hist_celsius",
+                                           NULL, "CPU die temperature per full tick",
+                                           temp_buckets, sizeof(temp_buckets) / sizeof(double));
+  m->ticks = metrics_add(metrics, METRIC_COUNTER, "sketchybar_system_stats_ticks",
+                         NULL, "Sampling ticks");
+  metrics_add_process(metrics, &m->process);
+  metrics_add_startup(metrics, &m->startup);
+}
+
+static void stats_metrics_update(struct stats_metrics *m,
+                                 struct metrics *metrics,
+                                 const struct cpu *cpu,
+                                 const struct memory_stats *mem,
+                                 const struct memory_pressure *pressure,
+                                 int gpu_util,
+                                 int cpu_temp,
+                                 int gpu_temp,
+                                 const struct state *state) {
+  if (!metrics->enabled) return;
+
+  if (cpu->has_prev_load) {
+    metrics_set(metrics, m->cpu_user, cpu->user_load);
+    metrics_set(metrics, m->cpu_sys, cpu->sys_load);
+    metrics_set(metrics, m->cpu_total, cpu->total_load);
+    metrics_observe(metrics, m->cpu_total_hist, cpu->total_load);
+  }
+  for (int i = 0; i < (int)cpu->ncores && i < MAX_CORES; i++) {
+    if (m->cpu_cores[i] < 0) {
+      char labels[16];
+      snprintf(labels, sizeof(labels), "core=\"%d\"", i);
+      m->cpu_cores[i] = metrics_add(metrics, METRIC_GAUGE, "sketchybar_cpu_core_load_percent",
+                                    labels, "Per-core CPU load of the last tick");
+    }
+    metrics_set(metrics, m->cpu_cores[i], cpu->core_loads[i]);
+  }
+
+  if (mem) {
+    metrics_set(metrics, m->mem_used, (double)mem->used);
+    metrics_set(metrics, m->mem_total, (double)mem->total);
+    metrics_set(metrics, m->mem_percent, mem->percent);
+    metrics_set(metrics, m->mem_wired, (double)mem->wired);
+    metrics_set(metrics, m->mem_cached, (double)mem->cached);
+    metrics_set(metrics, m->mem_compressed, (double)mem->compressed);
+  }
+  if (pressure->swap_used >= 0) metrics_set(metrics, m->swap_used, (double)pressure->swap_used);
+  if (pressure->level >= 0) metrics_set(metrics, m->mem_pressure, pressure->level);
+
+  if (gpu_util >= 0) {
+    metrics_set(metrics, m->gpu_util, gpu_util);
+    metrics_observe(metrics, m->gpu_util_hist, gpu_util);
+  } else {
+    metrics_invalidate(metrics, m->gpu_util);
+  }
+
+  // Temperatures are only read on full ticks and kept in between
+  if (cpu_temp >= 0) {
+    metrics_set(metrics, m->cpu_temp, cpu_temp);
+    metrics_observe(metrics, m->cpu_temp_hist, cpu_temp);
+  }
+  if (gpu_temp >= 0) metrics_set(metrics, m->gpu_temp, gpu_temp);
+
+  metrics_inc(metrics, m->ticks, 1);
+  metrics_update_process(metrics, &m->process);
+  metrics_update_startup(metrics, &m->startup, state);
+  metrics_publish(metrics);
+}
+
+// Last-known state (state.h): the labels of the last full tick, the core
+// bars and the graph histories, so a restart repaints all of them at once
+enum stats_state {
+  STATS_STATE_TRIGGER = 1,
+  STATS_STATE_CORES,
+  STATS_STATE_GPU,
+  STATS_STATE_MEM
+};
+
+// One value per pixel of the graphs
+#define GRAPH_HISTORY 80
+
+struct graph_history {
+  float values[GRAPH_HISTORY];
+  uint32_t count;
+  uint32_t next;
+};
+
+static void graph_history_add(struct graph_history *history, float value) {
+  history->values[history->next] = value;
+  history->next = (history->next + 1) % GRAPH_HISTORY;
+  if (history->count < GRAPH_HISTORY) history->count++;
+}
+
+// Oldest first
+static uint32_t graph_history_get(const struct graph_history *history, float *values) {
+  uint32_t start = (history->next + GRAPH_HISTORY - history->count) % GRAPH_HISTORY;
+  for (uint32_t i = 0; i < history->count; i++) {
+    values[i] = history->values[(start + i) % GRAPH_HISTORY];
+  }
+  return history->count;
+}
+
+static void graph_history_load(struct graph_history *history,
+                               const struct state *state,
+                               uint16_t kind,
+                               float *values) {
+  memset(history, 0, sizeof(struct graph_history));
+  size_t cursor = 0;
+  size_t size = 0;
+  const float *saved = state_next(state, kind, &cursor, &size);
+  uint32_t count = saved ? (uint32_t)(size / sizeof(float)) : 0;
+  if (count > GRAPH_HISTORY) count = GRAPH_HISTORY;
+  for (uint32_t i = 0; i < count; i++) graph_history_add(history, saved[i]);
+  graph_history_get(history, values);
+}
+
+static void save_state(struct state *state,
+                       const char *trigger_message,
+                       const struct cpu *cpu,
+                       const struct graph_history *gpu_history,
+                       const struct graph_history *mem_history) {
+  if (!state->enabled) return;
+  float values[GRAPH_HISTORY];
+  state_begin(state);
+  state_add(state, STATS_STATE_TRIGGER, trigger_message, strlen(trigger_message));
+  state_add(state, STATS_STATE_CORES, cpu->core_loads, cpu->ncores * sizeof(int));
+  uint32_t count = graph_history_get(gpu_history, values);
+  state_add(state, STATS_STATE_GPU, values, count * sizeof(float));
+  count = graph_history_get(mem_history, values);
+  state_add(state, STATS_STATE_MEM, values, count * sizeof(float));
+  state_commit(state);
+}
+
+// Sends the saved state to the bar and continues the graph histories from
+// it; buffer is a scratch message buffer.
+static void replay_state(struct state *state,
+                         struct render *render,
+                         struct graph_history *gpu_history,
+                         struct graph_history *mem_history,
+                         char *buffer,
+                         size_t size) {
+  if (!state_load(state)) return;
+
+  size_t cursor = 0;
+  size_t length = 0;
+  const int *loads = state_next(state, STATS_STATE_CORES, &cursor, &length);
+  if (loads && render_tick(render, loads, (int)(length / sizeof(int)), -1, -1, buffer, size)) {
+    sketchybar(buffer);
+  }
+
+  float gpu[GRAPH_HISTORY];
+  float mem[GRAPH_HISTORY];
+  graph_history_load(gpu_history, state, STATS_STATE_GPU, gpu);
+  graph_history_load(mem_history, state, STATS_STATE_MEM, mem);
+  if (render_history(render, gpu, gpu_history->count, mem, mem_history->count, buffer, size)) {
+    sketchybar(buffer);
+  }
+
+  cursor = 0;
+  const char *trigger = state_next(state, STATS_STATE_TRIGGER, &cursor, &length);
+  if (trigger && length < size) {
+    memcpy(buffer, trigger, length);
+    buffer[length] = '\0';
+    sketchybar(buffer);
+  }
+  state_replayed(state);
+}
+
 int main(int argc, char **argv) {
+  impact_apply();
+  static struct state state;
   float update_freq;
   if (argc < 3 || (sscanf(argv[2], "%f", &update_freq) != 1)) {
-    printf("Usage: %s \"<event-name>\" \"<event_freq>\" [\"<slow_freq>\"]\n", argv[0]);
+    printf("Usage: %s \"<event-name>\" \"<event_freq>\" [\"<slow_freq>\"] "
+           "[--alert \"<id>:<metric> <op> <value> [for <secs>s] [clear <value>]\"]... "
+           "[--alert-event \"<event-name>\"] "
+           "[--render-cores \"<item-prefix>\" [--bar-height <px>] [--pcores <n>] "
+           "[--ecore-color <color>] [--core-color <load>:<color>]...] "
+           "[--gpu-graph \"<item>\"] [--mem-graph \"<item>\"] [--suspend-file \"<path>\"] "
+           "[--metrics <port|socket-path>]\n", argv[0]);
     return 1;
   }
 
   float slow_freq = 1.0f;
-  if (argc >= 4) sscanf(argv[3], "%f", &slow_freq);
+  struct alerts alerts = { 0 };
+  const char* alert_event = "system_alert";
+  struct render render;
+  render_init(&render);
+  const char* metrics_address = NULL;
+  for (int i = 3; i < argc; i++) {
+    bool render_error = false;
+    if (render_parse_option(&render, argc, argv, &i, &render_error)) {
+      if (render_error) {
+        fprintf(stderr, "Invalid value for %s: %s\n", argv[i - 1], argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--alert") == 0 && i + 1 < argc) {
+      if (!alert_parse(&alerts, argv[++i])) {
+        fprintf(stderr, "Invalid alert rule: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--alert-event") == 0 && i + 1 < argc) {
+      alert_event = argv[++i];
+    } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+      metrics_address = argv[++i];
+    } else if (i == 3) {
+      sscanf(argv[3], "%f", &slow_freq);
+    }
+  }
   int slow_every = (int)(slow_freq / update_freq);
   if (slow_every < 1) slow_every = 1;
 
+  if (!trace_init()) return 1;
+  state_init(&state, "system_stats", argv[1], !trace_replaying());
+
+  static struct metrics metrics;
+  metrics_init(&metrics);
+  if (metrics_address && !metrics_start(&metrics, metrics_address)) {
+    fprintf(stderr, "Failed to serve metrics on %s\n", metrics_address);
+    return 1;
+  }
+  struct stats_metrics stats_metrics;
+  stats_metrics_init(&stats_metrics, &metrics);
+
   alarm(0);
   struct cpu cpu;
   cpu_init(&cpu);
@@ -301,11 +679,21 @@ int main(int argc, char **argv) {
   char event_message[256];
   snprintf(event_message, sizeof(event_message), "--add event '%s'", argv[1]);
   sketchybar(event_message);
+  if (alerts.count > 0) {
+    snprintf(event_message, sizeof(event_message), "--add event '%s'", alert_event);
+    sketchybar(event_message);
+  }
 
-  char trigger_message[8192];
+  char trigger_message[16384];
+  char render_message[16384];
   char gpu_procs_buffer[2048];
   gpu_procs_buffer[0] = '\0';
 
+  struct graph_history gpu_history = { 0 };
+  struct graph_history mem_history = { 0 };
+  replay_state(&state, &render, &gpu_history, &mem_history,
+               render_message, sizeof(render_message));
+
   // 1-second averaging state
   host_cpu_load_info_data_t slow_cpu_prev;
   bool has_slow_cpu_prev = false;
@@ -316,20 +704,32 @@ int main(int argc, char **argv) {
   int gpu_temp_sum = 0;
   int gpu_temp_count = 0;
 
+  // Read on full ticks, reported unchanged in between
+  struct memory_pressure mem_pressure = { -1, -1 };
+
   int tick = 0;
-  for (;;) {
+  while (trace_tick()) {
     cpu_update(&cpu);
+    if (tick == 0) {
+      // Loads are deltas: take the second sample right away instead of a
+      // tick later, and use the first one for the full tick average
+      slow_cpu_prev = cpu.load;
+      has_slow_cpu_prev = true;
+      trace_sleep(STATE_PRIME_SEC);
+      cpu_update(&cpu);
+    }
 
-    uint64_t mem_used = 0;
-    uint64_t mem_total = 0;
-    int mem_percent = -1;
-    bool mem_ok = read_memory_stats(&mem_used, &mem_total, &mem_percent);
+    struct memory_stats mem = { 0 };
+    bool mem_ok = read_memory_stats(&mem);
+    int mem_percent = mem_ok ? mem.percent : -1;
 
     int gpu_util = read_gpu_utilization();
     if (gpu_util >= 0) {
       gpu_util_sum += gpu_util;
       gpu_util_count++;
+      graph_history_add(&gpu_history, gpu_util / 100.0f);
     }
+    if (mem_percent >= 0) graph_history_add(&mem_history, mem_percent / 100.0f);
 
     int cpu_temp = -1;
     int gpu_temp = -1;
@@ -370,66 +770,123 @@ int main(int argc, char **argv) {
       gpu_temp_sum = 0; gpu_temp_count = 0;
 
       get_top_gpu_processes(gpu_procs_buffer, sizeof(gpu_procs_buffer));
+      read_memory_pressure(&mem_pressure);
     }
 
-    // Format per-core loads as comma-separated string
-    char core_loads_str[512] = "";
-    size_t off = 0;
-    for (int i = 0; i < (int)cpu.ncores && i < MAX_CORES; i++) {
-      off += snprintf(core_loads_str + off, sizeof(core_loads_str) - off,
-                      "%s%d", i > 0 ? "," : "", cpu.core_loads[i]);
+    // Threshold rules see every sample, not just the emitted averages
+    int alert_values[ALERT_METRIC_COUNT] = {
+      [ALERT_CPU_USER] = cpu.has_prev_load ? cpu.user_load : -1,
+      [ALERT_CPU_SYS] = cpu.has_prev_load ? cpu.sys_load : -1,
+      [ALERT_CPU_TOTAL] = cpu.has_prev_load ? cpu.total_load : -1,
+      [ALERT_CPU_AVG] = cpu_avg,
+      [ALERT_MEM_USED_PERCENT] = mem_percent,
+      [ALERT_GPU_UTIL] = gpu_util,
+      [ALERT_GPU_AVG] = gpu_avg,
+      [ALERT_CPU_TEMP] = cpu_temp,
+      [ALERT_GPU_TEMP] = gpu_temp,
+      [ALERT_CPU_TEMP_AVG] = cpu_temp_avg,
+      [ALERT_GPU_TEMP_AVG] = gpu_temp_avg,
+    };
+    if (alerts.count > 0) {
+      struct timespec now;
+      trace_now(&now);
+      alerts_update(&alerts, alert_event, alert_values, now);
+    }
+    stats_metrics_update(&stats_metrics,
+                         &metrics,
+                         &cpu,
+                         mem_ok ? &mem : NULL,
+                         &mem_pressure,
+                         gpu_util,
+                         cpu_temp,
+                         gpu_temp,
+                         &state       );
+
+    // While the bar is suspended the Lua handlers drop the trigger, and the
+    // direct messages are held back the same way
+    bool rendering = render_enabled(&render);
+    if (rendering && !render_suspended(&render)
+        && render_tick(&render,
+                       cpu.core_loads,
+                       (int)cpu.ncores,
+                       gpu_util,
+                       mem_percent,
+                       render_message,
+                       sizeof(render_message))) {
+      sketchybar(render_message);
     }
 
-    // Compute memory in GB
-    double mem_used_gb = mem_ok ? (double)mem_used / (1024.0 * 1024.0 * 1024.0) : 0.0;
-    double mem_total_gb = mem_ok ? (double)mem_total / (1024.0 * 1024.0 * 1024.0) : 0.0;
-
-    snprintf(trigger_message,
-             sizeof(trigger_message),
-             "--trigger '%s' "
-             "cpu_user='%d' "
-             "cpu_sys='%d' "
-             "cpu_total='%d' "
-             "cpu_ncores='%d' "
-             "cpu_core_loads='%s' "
-             "mem_used_percent='%d' "
-             "mem_used_bytes='%llu' "
-             "mem_total_bytes='%llu' "
-             "mem_used_gb='%.1f' "
-             "mem_total_gb='%.0f' "
-             "gpu_util='%d' "
-             "cpu_temp='%d' "
-             "gpu_temp='%d' "
-             "gpu_procs='%s' "
-             "full_update='%d' "
-             "cpu_avg='%d' "
-             "gpu_avg='%d' "
-             "cpu_temp_avg='%d' "
-             "gpu_temp_avg='%d'",
-             argv[1],
-             cpu.user_load,
-             cpu.sys_load,
-             cpu.total_load,
-             (int)cpu.ncores,
-             core_loads_str,
-             mem_ok ? mem_percent : -1,
-             (unsigned long long)(mem_ok ? mem_used : 0ULL),
-             (unsigned long long)(mem_ok ? mem_total : 0ULL),
-             mem_used_gb,
-             mem_total_gb,
-             gpu_util,
-             cpu_temp,
-             gpu_temp,
-             gpu_procs_buffer,
-             is_full ? 1 : 0,
-             cpu_avg,
-             gpu_avg,
-             cpu_temp_avg,
-             gpu_temp_avg);
-
-    sketchybar(trigger_message);
+    // Bars and graphs are drawn directly: the trigger is then only needed
+    // for the text labels of full ticks
+    if (!rendering || is_full) {
+      // Format per-core loads as comma-separated string
+      char core_loads_str[MAX_CORES * 4];
+      cores_format(cpu.core_loads, cpu.ncores, core_loads_str, sizeof(core_loads_str));
+
+      // Compute memory in GB
+      double mem_used_gb = (double)mem.used / (1024.0 * 1024.0 * 1024.0);
+      double mem_total_gb = (double)mem.total / (1024.0 * 1024.0 * 1024.0);
+
+      snprintf(trigger_message,
+               sizeof(trigger_message),
+               "--trigger '%s' "
+               "cpu_user='%d' "
+               "cpu_sys='%d' "
+               "cpu_total='%d' "
+               "cpu_ncores='%d' "
+               "cpu_core_loads='%s' "
+               "mem_used_percent='%d' "
+               "mem_used_bytes='%llu' "
+               "mem_total_bytes='%llu' "
+               "mem_used_gb='%.1f' "
+               "mem_total_gb='%.0f' "
+               "mem_wired_bytes='%llu' "
+               "mem_cached_bytes='%llu' "
+               "mem_compressed_bytes='%llu' "
+               "mem_swap_used_bytes='%lld' "
+               "mem_pressure='%d' "
+               "gpu_util='%d' "
+               "cpu_temp='%d' "
+               "gpu_temp='%d' "
+               "gpu_procs='%s' "
+               "full_update='%d' "
+               "cpu_avg='%d' "
+               "gpu_avg='%d' "
+               "cpu_temp_avg='%d' "
+               "gpu_temp_avg='%d'",
+               argv[1],
+               cpu.user_load,
+               cpu.sys_load,
+               cpu.total_load,
+               (int)cpu.ncores,
+               core_loads_str,
+               mem_percent,
+               (unsigned long long)mem.used,
+               (unsigned long long)mem.total,
+               mem_used_gb,
+               mem_total_gb,
+               (unsigned long long)mem.wired,
+               (unsigned long long)mem.cached,
+               (unsigned long long)mem.compressed,
+               (long long)mem_pressure.swap_used,
+               mem_pressure.level,
+               gpu_util,
+               cpu_temp,
+               gpu_temp,
+               gpu_procs_buffer,
+               is_full ? 1 : 0,
+               cpu_avg,
+               gpu_avg,
+               cpu_temp_avg,
+               gpu_temp_avg);
+
+      sketchybar(trigger_message);
+      if (is_full) save_state(&state, trigger_message, &cpu, &gpu_history, &mem_history);
+    }
+    if (cpu.has_prev_load) state_valid(&state);
+    heartbeat();
     tick++;
-    usleep((useconds_t)(update_freq * 1000000.0f));
+    trace_sleep(update_freq);
   }
   return 0;
 }
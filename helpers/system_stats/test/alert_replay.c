@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../trace.h"
+#include "../alert.h"
+
+// Replays a trace through the alert rules the way system_stats feeds them,
+// printing the triggers: `make test` diffs them against alerts.expected, at
+// the recorded pace and at SKETCHYBAR_TRACE_SPEED=max.
+//
+//   alert_replay --write <trace> < alerts.input   builds the trace
+//   alert_replay                                  replays SKETCHYBAR_TRACE_REPLAY
+//
+// An input line is "<ms> <user> <system> <idle> <nice>": the time of a tick
+// and the cumulative CPU ticks read in it, as host_cpu_load_info has them.
+
+struct cpu_load {
+  uint32_t cpu_ticks[4];
+};
+
+static void write_record(FILE* file, uint16_t channel, uint64_t time_ns,
+                         const void* data, size_t size) {
+  static const char padding[8] = { 0 };
+  struct trace_record record = {
+    .channel = channel,
+    .size = (uint32_t)size,
+    .time_ns = time_ns
+  };
+  fwrite(&record, sizeof(record), 1, file);
+  if (size > 0) fwrite(data, 1, size, file);
+  fwrite(padding, 1, trace_padded(size) - size, file);
+}
+
+static int write_trace(const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (!file) return 1;
+  fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, file);
+
+  unsigned long long ms;
+  struct cpu_load load;
+  while (scanf("%llu %u %u %u %u", &ms, &load.cpu_ticks[0], &load.cpu_ticks[1],
+               &load.cpu_ticks[2], &load.cpu_ticks[3]) == 5) {
+    uint64_t time_ns = ms * 1000000ull;
+    struct timespec clock = { .tv_sec = 1000 + ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+    write_record(file, TRACE_TICK, time_ns, NULL, 0);
+    write_record(file, TRACE_CPU_LOAD, time_ns, &load, sizeof(load));
+    write_record(file, TRACE_CLOCK, time_ns, &clock, sizeof(clock));
+  }
+  fclose(file);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 3 && strcmp(argv[1], "--write") == 0) return write_trace(argv[2]);
+  if (!trace_init() || !trace_replaying()) return 1;
+
+  struct alerts alerts = { 0 };
+  if (!alert_parse(&alerts, "busy:cpu_total > 80 for 1s clear 50")
+      || !alert_parse(&alerts, "idle:cpu_total <= 5 for 0.5s")) {
+    return 1;
+  }
+
+  struct cpu_load prev = { 0 };
+  bool has_prev = false;
+  while (trace_tick()) {
+    struct cpu_load load;
+    if (!trace_read(TRACE_CPU_LOAD, &load, sizeof(load))) continue;
+
+    int values[ALERT_METRIC_COUNT];
+    for (int i = 0; i < ALERT_METRIC_COUNT; i++) values[i] = -1;
+    if (has_prev) {
+      uint32_t busy = load.cpu_ticks[0] - prev.cpu_ticks[0]
+                      + load.cpu_ticks[1] - prev.cpu_ticks[1];
+      uint32_t total = busy + load.cpu_ticks[2] - prev.cpu_ticks[2];
+      if (total > 0) values[ALERT_CPU_TOTAL] = (int)((double)busy / (double)total * 100.0);
+    }
+    prev = load;
+    has_prev = true;
+
+    struct timespec now;
+    trace_now(&now);
+    alerts_update(&alerts, "system_alert", values, now);
+  }
+  return 0;
+}
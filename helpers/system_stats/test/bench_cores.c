@@ -0,0 +1,198 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cores.h"
+
+// Per-core load kernel and core list of cores.h against the loop they
+// replaced (array of structs, a double divide and one snprintf per core),
+// over synthetic ticks from 8 to 1024 cores.
+//
+//   bench_cores           ns per tick, old and new
+//   bench_cores --check   the vector kernel against the scalar one and the
+//                         core list against snprintf; run by make test
+
+#define TICKS 64
+
+struct reference {
+  uint32_t* prev;
+  int* loads;
+};
+
+static void reference_update(struct reference* reference, const uint32_t* ticks, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    const uint32_t* core = ticks + i * CORES_TICKS_PER_CORE;
+    uint32_t* prev = reference->prev + i * CORES_TICKS_PER_CORE;
+    unsigned int delta_user = core[CORES_TICK_USER] - prev[CORES_TICK_USER];
+    unsigned int delta_sys = core[CORES_TICK_SYSTEM] - prev[CORES_TICK_SYSTEM];
+    unsigned int delta_idle = core[CORES_TICK_IDLE] - prev[CORES_TICK_IDLE];
+    unsigned int delta_nice = core[CORES_TICK_NICE] - prev[CORES_TICK_NICE];
+    unsigned int total = delta_user + delta_sys + delta_idle + delta_nice;
+    if (total > 0) {
+      reference->loads[i] = (int)((double)(delta_user + delta_sys) / (double)total * 100.0);
+    } else {
+      reference->loads[i] = 0;
+    }
+  }
+  memcpy(reference->prev, ticks, count * CORES_TICKS_PER_CORE * sizeof(uint32_t));
+}
+
+static size_t reference_format(const int* loads, uint32_t count, char* buffer, size_t size) {
+  size_t len = 0;
+  buffer[0] = '\0';
+  for (uint32_t i = 0; i < count && len < size; i++) {
+    len += snprintf(buffer + len, size - len, "%s%d", i > 0 ? "," : "", loads[i]);
+  }
+  return len;
+}
+
+// TICKS snapshots of cumulative counters, each a tick after the previous:
+// busy, idle and fully idle cores, and some that wrap around 2^32
+static uint32_t* make_ticks(uint32_t count) {
+  uint32_t* ticks = malloc((size_t)TICKS * count * CORES_TICKS_PER_CORE * sizeof(uint32_t));
+  if (!ticks) return NULL;
+  uint32_t state = 0x12345678u ^ count;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t counters[CORES_TICKS_PER_CORE] = { 0 };
+    if (i % 7 == 3) counters[CORES_TICK_USER] = 0xffffff00u;
+    for (int t = 0; t < TICKS; t++) {
+      for (int c = 0; c < CORES_TICKS_PER_CORE; c++) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t step = (state >> 8) % (c == CORES_TICK_IDLE ? 200 : 60);
+        if (c == CORES_TICK_NICE) step %= 4;
+        if (i % 11 == 5) step = 0;
+        counters[c] += step;
+        ticks[((size_t)t * count + i) * CORES_TICKS_PER_CORE + c] = counters[c];
+      }
+    }
+  }
+  return ticks;
+}
+
+static uint64_t clock_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int check(void) {
+  static const uint32_t counts[] = { 1, 3, 4, 5, 8, 13, 64, 191, 1024 };
+  int failures = 0;
+  for (size_t n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+    uint32_t count = counts[n];
+    uint32_t* ticks = make_ticks(count);
+    struct cores vector = { 0 };
+    struct cores scalar = { 0 };
+    char* list = malloc(count * 4 + 1);
+    char* expected = malloc(count * 4 + 1);
+    if (!ticks || !list || !expected) return 1;
+
+    for (int t = 0; t < TICKS; t++) {
+      const uint32_t* tick = ticks + (size_t)t * count * CORES_TICKS_PER_CORE;
+      cores_update(&vector, (const int32_t*)tick, count);
+      cores_reserve(&scalar, count);
+      cores_update_scalar(&scalar, (const int32_t*)tick, 0, count);
+      if (t == 0) continue;
+
+      for (uint32_t i = 0; i < count; i++) {
+        if (vector.loads[i] != scalar.loads[i]) {
+          printf("%u cores, tick %d, core %u: vector %d, scalar %d\n",
+                 count, t, i, vector.loads[i], scalar.loads[i]);
+          failures++;
+        }
+      }
+      cores_format(vector.loads, count, list, count * 4 + 1);
+      reference_format(vector.loads, count, expected, count * 4 + 1);
+      if (strcmp(list, expected) != 0) {
+        printf("%u cores, tick %d: core list \"%s\", snprintf \"%s\"\n",
+               count, t, list, expected);
+        failures++;
+      }
+    }
+    free(ticks);
+    free(list);
+    free(expected);
+    free(vector.prev_busy);
+    free(vector.prev_total);
+    free(vector.loads);
+    free(scalar.prev_busy);
+    free(scalar.prev_total);
+    free(scalar.loads);
+  }
+  printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 2 && strcmp(argv[1], "--check") == 0) return check();
+
+#if defined(CORES_NEON)
+  const char* kernel = "NEON";
+#elif defined(CORES_SSE2)
+  const char* kernel = "SSE2";
+#else
+  const char* kernel = "scalar";
+#endif
+  printf("ns per tick, %s kernel\n", kernel);
+  printf("%6s %12s %12s %14s %14s\n", "cores", "delta old", "delta new", "list old", "list new");
+
+  static const uint32_t counts[] = { 8, 16, 64, 192, 256, 1024 };
+  volatile size_t sink = 0;
+  for (size_t n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+    uint32_t count = counts[n];
+    uint32_t* ticks = make_ticks(count);
+    struct reference reference = {
+      .prev = calloc((size_t)count * CORES_TICKS_PER_CORE, sizeof(uint32_t)),
+      .loads = calloc(count, sizeof(int))
+    };
+    struct cores cores = { 0 };
+    char* list = malloc(count * 4 + 1);
+    if (!ticks || !reference.prev || !reference.loads || !list) return 1;
+
+    // Enough rounds for about 100ms at the largest count
+    int rounds = (int)(2000000 / count) + 1;
+    uint64_t start = clock_ns();
+    for (int round = 0; round < rounds; round++) {
+      const uint32_t* tick = ticks + (size_t)(round % TICKS) * count * CORES_TICKS_PER_CORE;
+      reference_update(&reference, tick, count);
+    }
+    uint64_t delta_old = clock_ns() - start;
+
+    start = clock_ns();
+    for (int round = 0; round < rounds; round++) {
+      const uint32_t* tick = ticks + (size_t)(round % TICKS) * count * CORES_TICKS_PER_CORE;
+      cores_update(&cores, (const int32_t*)tick, count);
+    }
+    uint64_t delta_new = clock_ns() - start;
+
+    start = clock_ns();
+    for (int round = 0; round < rounds; round++) {
+      sink += reference_format(reference.loads, count, list, count * 4 + 1);
+    }
+    uint64_t list_old = clock_ns() - start;
+
+    start = clock_ns();
+    for (int round = 0; round < rounds; round++) {
+      sink += cores_format(cores.loads, count, list, count * 4 + 1);
+    }
+    uint64_t list_new = clock_ns() - start;
+
+    printf("%6u %12.0f %12.0f %14.0f %14.0f\n",
+           count,
+           (double)delta_old / rounds,
+           (double)delta_new / rounds,
+           (double)list_old / rounds,
+           (double)list_new / rounds);
+
+    free(ticks);
+    free(reference.prev);
+    free(reference.loads);
+    free(list);
+    free(cores.prev_busy);
+    free(cores.prev_total);
+    free(cores.loads);
+  }
+  return 0;
+}
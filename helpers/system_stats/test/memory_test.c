@@ -0,0 +1,45 @@
+#include <stdio.h>
+
+#include "../memory.h"
+
+// The memory breakdown on page counts like vm_stat reports them and on
+// edge cases: `make test` diffs the output against memory.expected.
+
+static void breakdown(const char* what, uint64_t total, uint64_t page_size,
+                      struct memory_pages pages) {
+  struct memory_stats stats;
+  memory_stats_compute(&stats, total, page_size, &pages);
+  printf("%s: used %llu wired %llu compressed %llu cached %llu of %llu = %d%%\n",
+         what,
+         (unsigned long long)stats.used,
+         (unsigned long long)stats.wired,
+         (unsigned long long)stats.compressed,
+         (unsigned long long)stats.cached,
+         (unsigned long long)stats.total,
+         stats.percent);
+}
+
+int main(void) {
+  // 16 GiB Apple Silicon, 16 KiB pages
+  breakdown("16G arm64", 17179869184ull, 16384,
+            (struct memory_pages){ .active = 301245, .wired = 170112, .compressor = 98234,
+                                   .external = 260031, .purgeable = 4410 });
+  // 8 GiB Intel, 4 KiB pages
+  breakdown("8G x86_64", 8589934592ull, 4096,
+            (struct memory_pages){ .active = 702113, .wired = 512004, .compressor = 301877,
+                                   .external = 401220, .purgeable = 12001 });
+  // 96 GiB: byte counts past 32 bits
+  breakdown("96G arm64", 103079215104ull, 16384,
+            (struct memory_pages){ .active = 2900000, .wired = 900000, .compressor = 10,
+                                   .external = 1500000, .purgeable = 0 });
+  // Just under a full percent step: truncated, not rounded
+  breakdown("99.99%", 1000000ull * 4096, 4096,
+            (struct memory_pages){ .active = 999900 });
+  // Counts that momentarily add up to more than the total are clamped
+  breakdown("over total", 1024ull * 4096, 4096,
+            (struct memory_pages){ .active = 900, .wired = 200, .compressor = 100 });
+  breakdown("no total", 0, 16384,
+            (struct memory_pages){ .active = 10, .wired = 10 });
+  breakdown("idle", 17179869184ull, 16384, (struct memory_pages){ 0 });
+  return 0;
+}
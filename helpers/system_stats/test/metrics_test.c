@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../metrics.h"
+
+// Scrapes the metrics endpoint (metrics.h) over a unix socket like a local
+// scraper would, then renders a set too large for the response: `make test`
+// diffs the output against metrics.expected.
+
+static const double g_bounds[] = { 0.001, 0.01, 0.1 };
+
+// One request; prints the response whole, or for a large one the head, the
+// last line and whether Content-Length matches the body received
+static void scrape(const char* path, bool whole) {
+  struct sockaddr_un address;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || !socket_address(&address, path)
+      || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    printf("connect failed\n");
+    return;
+  }
+  socket_set_timeout(fd, SOCKET_TIMEOUT_SEC);
+  const char* request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  socket_write_all(fd, request, strlen(request));
+
+  static char response[METRICS_RESPONSE_SIZE + 1024];
+  size_t len = 0;
+  while (len + 1 < sizeof(response)) {
+    ssize_t n = read(fd, response + len, sizeof(response) - len - 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    len += n;
+  }
+  response[len] = '\0';
+  close(fd);
+  if (whole) {
+    fputs(response, stdout);
+    return;
+  }
+
+  char* body = strstr(response, "\r\n\r\n");
+  if (!body) {
+    printf("no header\n");
+    return;
+  }
+  body += 4;
+  fwrite(response, 1, body - response, stdout);
+  char* length = strstr(response, "Content-Length: ");
+  size_t expected = length ? strtoul(length + 16, NULL, 10) : 0;
+  char* last = body + strlen(body) - 1;
+  while (last > body && last[-1] != '\n') last--;
+  printf("%zu bytes of body, Content-Length %s, last line: %s",
+         strlen(body), expected == strlen(body) ? "matches" : "differs", last);
+}
+
+int main(void) {
+  char dir[] = "/tmp/metrics_test.XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  char path[64];
+  snprintf(path, sizeof(path), "%s/metrics.socket", dir);
+
+  static struct metrics metrics;
+  metrics_init(&metrics);
+  printf("before metrics_start: index %d\n",
+         metrics_add(&metrics, METRIC_GAUGE, "sketchybar_unused", NULL, NULL));
+  if (!metrics_start(&metrics, path)) {
+    printf("metrics_start failed\n");
+    return 1;
+  }
+
+  int user = metrics_add(&metrics, METRIC_GAUGE, "sketchybar_cpu_percent",
+                         "mode=\"user\"", "CPU load");
+  int system = metrics_add(&metrics, METRIC_GAUGE, "sketchybar_cpu_percent",
+                           "mode=\"system\"", NULL);
+  int ticks = metrics_add(&metrics, METRIC_COUNTER, "sketchybar_helper_ticks",
+                          NULL, "Sampling ticks");
+  int missing = metrics_add(&metrics, METRIC_GAUGE, "sketchybar_gpu_percent",
+                            NULL, "Not sampled");
+  int latency = metrics_add_histogram(&metrics, "sketchybar_tick_seconds", NULL,
+                                      "Duration of a tick", g_bounds, 3);
+  (void)missing;
+
+  printf("scrape before the first publish\n");
+  scrape(path, true);
+
+  metrics_set(&metrics, user, 12.5);
+  metrics_set(&metrics, system, 3.25);
+  metrics_inc(&metrics, ticks, 1);
+  metrics_inc(&metrics, ticks, 1);
+  metrics_observe(&metrics, latency, 0.0004);
+  metrics_observe(&metrics, latency, 0.004);
+  metrics_observe(&metrics, latency, 0.02);
+  metrics_observe(&metrics, latency, 0.5);
+  metrics_publish(&metrics);
+  printf("\nscrape after a publish\n");
+  scrape(path, true);
+
+  // Not published: the scrape keeps the last published values
+  metrics_set(&metrics, user, 99);
+  printf("\nscrape with unpublished changes\n");
+  scrape(path, true);
+
+  // Families that do not fit are left out whole, "# EOF" always ends it
+  static const size_t sizes[] = { 32, 180, 300, 500 };
+  char body[500];
+  uint32_t dropped;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t len = metrics_render(&metrics.shared, body, sizes[i], &dropped);
+    printf("\nrender into %zu bytes: %zu bytes, %u families dropped\n%s",
+           sizes[i], len, dropped, body);
+  }
+
+  // Every other slot a histogram with all buckets: past METRICS_RESPONSE_SIZE
+  static double bounds[METRICS_MAX_BUCKETS];
+  for (int i = 0; i < METRICS_MAX_BUCKETS; i++) bounds[i] = 0.000123456789 * (1 << i);
+  for (int i = 0; metrics.local.count < METRICS_MAX; i++) {
+    char name[METRICS_NAME_SIZE];
+    snprintf(name, sizeof(name), "sketchybar_large_histogram_family_%03d_seconds", i);
+    int index = metrics_add_histogram(&metrics, name,
+                                      "interface=\"bridge100\",direction=\"down\"", NULL,
+                                      bounds, METRICS_MAX_BUCKETS);
+    for (int j = 0; j < 1000; j++) metrics_observe(&metrics, index, 0.0001 * j);
+  }
+  metrics_publish(&metrics);
+  printf("\nscrape larger than METRICS_RESPONSE_SIZE\n");
+  scrape(path, false);
+
+  unlink(path);
+  rmdir(dir);
+  return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Runtime files of the helpers (pid files, saved state) live in the per-user
+// temp dir (/var/folders/.../T/), not in /tmp: /tmp is shared and world
+// writable, so anyone could plant a symlink at a predictable name there and
+// have the helper overwrite a file of the user. The files are still opened
+// with O_NOFOLLOW.
+
+// "<temp dir>/sketchybar_<name>"; false if it does not fit
+static inline bool tmpdir_path(char* buffer, size_t size, const char* name) {
+  char dir[1024];
+  size_t len = 0;
+#if defined(_CS_DARWIN_USER_TEMP_DIR)
+  len = confstr(_CS_DARWIN_USER_TEMP_DIR, dir, sizeof(dir));
+#endif
+  if (len == 0 || len > sizeof(dir)) {
+    const char* env = getenv("TMPDIR");
+    if (!env || !env[0] || strlen(env) >= sizeof(dir)) return false;
+    snprintf(dir, sizeof(dir), "%s", env);
+  }
+  len = strlen(dir);
+  while (len > 1 && dir[len - 1] == '/') dir[--len] = '\0';
+
+  int written = snprintf(buffer, size, "%s/sketchybar_%s", dir, name);
+  return written > 0 && (size_t)written < size;
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sketchybar.h"
+
+// Record and replay of the raw inputs of the collectors, so that a run can
+// be reproduced exactly and its trigger output diffed against a golden file.
+//
+//   SKETCHYBAR_TRACE_RECORD=<file>  records every input the helper reads
+//   SKETCHYBAR_TRACE_REPLAY=<file>  feeds the recorded inputs back instead of
+//                                   reading live state and prints the bar
+//                                   messages to stdout; the helper exits at
+//                                   the end of the trace
+//   SKETCHYBAR_TRACE_SPEED=max      replays without the recorded pauses
+//
+// A trace is TRACE_MAGIC followed by records: a struct trace_record header
+// and size bytes of payload (padded to 8), the input as read from the kernel. Payloads
+// are native structs, so a trace replays on the architecture it was
+// recorded on. Each helper iteration starts with a TRACE_TICK record; on
+// replay an input is only looked up among the records of the current tick,
+// so code that reads an input more or less often stays in step.
+
+#define TRACE_MAGIC "SBTRACE1"
+#define TRACE_MAGIC_SIZE 8
+
+enum trace_channel {
+  TRACE_TICK = 1,
+  TRACE_CLOCK,
+  TRACE_CPU_LOAD,
+  TRACE_CPU_CORES,
+  TRACE_MEMORY,
+  TRACE_GPU_UTIL,
+  TRACE_TEMPERATURES,
+  TRACE_GPU_PROCS,
+  TRACE_INTERFACE,
+  TRACE_INTERFACE_LIST,
+  TRACE_BATTERY,
+  TRACE_BATTERY_SAMPLE,
+  TRACE_MEMORY_PRESSURE,
+  TRACE_CHANNELS
+};
+
+struct trace_record {
+  uint16_t channel;
+  uint16_t reserved;
+  uint32_t size;
+  // Since the start of the recording
+  uint64_t time_ns;
+};
+
+struct trace {
+  FILE* record;
+  uint64_t start_ns;
+
+  bool replay;
+  bool max_speed;
+  char* data;
+  size_t size;
+  // Records of the current tick: [tick_start, tick_end)
+  size_t tick_start;
+  size_t tick_end;
+  size_t cursors[TRACE_CHANNELS];
+};
+
+static struct trace g_trace;
+
+static inline uint64_t trace_clock_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Payloads are padded to 8 bytes, so every header and payload is aligned
+static inline size_t trace_padded(size_t size) {
+  return (size + 7) & ~(size_t)7;
+}
+
+static inline size_t trace_record_size(const struct trace_record* record) {
+  return sizeof(struct trace_record) + trace_padded(record->size);
+}
+
+// Header of the record at offset, NULL past the end or on a truncated record
+static inline const struct trace_record* trace_at(size_t offset) {
+  if (offset + sizeof(struct trace_record) > g_trace.size) return NULL;
+  const struct trace_record* record = (const struct trace_record*)(g_trace.data + offset);
+  if (offset + trace_record_size(record) > g_trace.size) return NULL;
+  return record;
+}
+
+// Makes the records from start up to the next tick the current window
+static inline void trace_window(size_t start) {
+  g_trace.tick_start = start;
+  g_trace.tick_end = start;
+  for (const struct trace_record* record; (record = trace_at(g_trace.tick_end));) {
+    if (record->channel == TRACE_TICK) break;
+    g_trace.tick_end += trace_record_size(record);
+  }
+  for (int i = 0; i < TRACE_CHANNELS; i++) g_trace.cursors[i] = start;
+}
+
+static inline bool trace_load(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  g_trace.data = size > 0 ? malloc(size) : NULL;
+  bool ok = g_trace.data
+            && fread(g_trace.data, 1, size, file) == (size_t)size
+            && size >= TRACE_MAGIC_SIZE
+            && memcmp(g_trace.data, TRACE_MAGIC, TRACE_MAGIC_SIZE) == 0;
+  fclose(file);
+  if (!ok) return false;
+
+  g_trace.size = size;
+  // Inputs read before the first tick (initialization) form a window too
+  trace_window(TRACE_MAGIC_SIZE);
+  return true;
+}
+
+// Reads the environment; returns false if a trace could not be opened.
+static inline bool trace_init(void) {
+  const char* record = getenv("SKETCHYBAR_TRACE_RECORD");
+  const char* replay = getenv("SKETCHYBAR_TRACE_REPLAY");
+  if (replay) {
+    if (!trace_load(replay)) {
+      fprintf(stderr, "Invalid trace: %s\n", replay);
+      return false;
+    }
+    const char* speed = getenv("SKETCHYBAR_TRACE_SPEED");
+    g_trace.max_speed = speed && strcmp(speed, "max") == 0;
+    g_trace.replay = true;
+    g_sketchybar_capture = stdout;
+  } else if (record) {
+    g_trace.record = fopen(record, "wb");
+    if (!g_trace.record) {
+      fprintf(stderr, "Could not create trace: %s\n", record);
+      return false;
+    }
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, g_trace.record);
+  }
+  g_trace.start_ns = trace_clock_ns();
+  return true;
+}
+
+static inline bool trace_replaying(void) {
+  return g_trace.replay;
+}
+
+static inline void trace_record(uint16_t channel, const void* data, size_t size) {
+  if (!g_trace.record) return;
+  struct trace_record record = {
+    .channel = channel,
+    .size = (uint32_t)size,
+    .time_ns = trace_clock_ns() - g_trace.start_ns
+  };
+  static const char padding[8] = { 0 };
+  fwrite(&record, sizeof(record), 1, g_trace.record);
+  if (size > 0) fwrite(data, 1, size, g_trace.record);
+  fwrite(padding, 1, trace_padded(size) - size, g_trace.record);
+}
+
+// Starts the next iteration of the helper. Recording marks it in the
+// trace; replaying moves on to the next recorded iteration, waiting for its
+// original time unless at max speed. Returns false at the end of the trace.
+static inline bool trace_tick(void) {
+  if (g_trace.record) {
+    trace_record(TRACE_TICK, NULL, 0);
+    fflush(g_trace.record);
+    return true;
+  }
+  if (!g_trace.replay) return true;
+
+  size_t offset = g_trace.tick_end;
+  const struct trace_record* tick = NULL;
+  for (const struct trace_record* record; (record = trace_at(offset));) {
+    offset += trace_record_size(record);
+    if (record->channel == TRACE_TICK) {
+      tick = record;
+      break;
+    }
+  }
+  if (!tick) return false;
+
+  trace_window(offset);
+
+  if (!g_trace.max_speed) {
+    uint64_t elapsed = trace_clock_ns() - g_trace.start_ns;
+    if (tick->time_ns > elapsed) usleep((useconds_t)((tick->time_ns - elapsed) / 1000));
+  }
+  return true;
+}
+
+// The next recorded input of channel in the current tick, NULL if there is
+// none left (replayed as a failed read)
+static inline const void* trace_next(uint16_t channel, size_t* size) {
+  if (channel >= TRACE_CHANNELS) return NULL;
+  size_t offset = g_trace.cursors[channel];
+  while (offset < g_trace.tick_end) {
+    const struct trace_record* record = trace_at(offset);
+    if (!record) break;
+    offset += trace_record_size(record);
+    if (record->channel != channel) continue;
+    g_trace.cursors[channel] = offset;
+    *size = record->size;
+    return record + 1;
+  }
+  g_trace.cursors[channel] = g_trace.tick_end;
+  return NULL;
+}
+
+// Copies the next recorded input of a fixed size into data
+static inline bool trace_read(uint16_t channel, void* data, size_t size) {
+  size_t recorded = 0;
+  const void* payload = trace_next(channel, &recorded);
+  if (!payload || recorded != size) return false;
+  memcpy(data, payload, size);
+  return true;
+}
+
+// Monotonic time for rate computations, recorded like any other input
+static inline void trace_now(struct timespec* now) {
+  if (g_trace.replay && trace_read(TRACE_CLOCK, now, sizeof(struct timespec))) return;
+  clock_gettime(CLOCK_MONOTONIC, now);
+  trace_record(TRACE_CLOCK, now, sizeof(struct timespec));
+}
+
+// Pauses between iterations are taken from the trace while replaying
+static inline void trace_sleep(double seconds) {
+  if (g_trace.replay) return;
+  usleep((useconds_t)(seconds * 1000000.0));
+}
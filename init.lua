@@ -17,6 +17,10 @@ local function helpers_ready()
     root .. "/popup_context/bin/popup_context",
     root .. "/system_stats/bin/system_stats",
     root .. "/menus/bin/menus",
+    root .. "/aerospace_state/bin/aerospace_state",
+    root .. "/audio_info/bin/audio_info",
+    root .. "/clock_tick/bin/clock_tick",
+    root .. "/supervisor/bin/supervisor",
   }
 
   for _, path in ipairs(required) do
@@ -25,12 +29,6 @@ local function helpers_ready()
   return true
 end
 
-if not helpers_ready() then
-  -- Run make asynchronously to avoid blocking the event loop if compilation hangs
-  local helpers_dir = os.getenv("HOME") .. "/.config/sketchybar/helpers"
-  os.execute("(cd '" .. helpers_dir .. "' && make) >/dev/null 2>&1 &")
-end
-
 -- Require the sketchybar module
 sbar = require("sketchybar")
 
@@ -56,6 +54,10 @@ require("mission_control")
 require("items")
 sbar.end_config()
 
+-- Start the resident helpers the items registered; missing binaries are
+-- built first, in the supervisor's shell so the event loop is not blocked
+require("supervisor").start(not helpers_ready())
+
 -- Run the event loop of the sketchybar module (without this there will be no
 -- callback functions executed in the lua module)
 sbar.event_loop()
@@ -1,11 +1,12 @@
 local colors = require("colors")
 local settings = require("settings")
 local app_icons = require("app_icons")
+local supervisor = require("supervisor")
 
 -- Aerospace workspaces: show all workspaces that contain windows,
 -- each with a workspace-ID pill and app icons for its windows.
 -- Focused workspace is highlighted in lavender; others in surface0.
--- All sbar.exec() calls use hardcoded strings with no user input.
+-- Workspace names are single-quoted before they reach sbar.exec().
 
 sbar.add("event", "aerospace_workspace_change")
 sbar.add("event", "aerospace_focus_change")
@@ -16,6 +17,18 @@ local MAX_WINDOWS_PER_WS = 5
 -- Track which workspace name is assigned to each slot (for click handling)
 local slot_ws_name = {}
 
+local function shell_quote(text)
+	return "'" .. text:gsub("'", "'\\''") .. "'"
+end
+
+-- aerospace_state percent-encodes the characters the trigger payload cannot
+-- carry (quotes, "|" and "%") in names
+local function unescape(field)
+	return (field:gsub("%%(%x%x)", function(hex)
+		return string.char(tonumber(hex, 16))
+	end))
+end
+
 -- Pre-create workspace groups (pill + window icon slots)
 local ws_groups = {}
 for w = 1, MAX_WORKSPACES do
@@ -69,191 +82,96 @@ for w = 1, MAX_WORKSPACES do
 	pill:subscribe("mouse.clicked", function(_)
 		local name = slot_ws_name[slot]
 		if name then
-			sbar.exec("aerospace workspace " .. name)
+			sbar.exec("aerospace workspace " .. shell_quote(name))
 		end
 	end)
 
 	ws_groups[w] = { pill = pill, icons = icons }
 end
 
--- Parse `aerospace list-windows --all` output into workspace -> window list map
-local function parse_all_windows(output)
-	local workspaces = {} -- ws_name -> { {app, win_id}, ... }
-	local ws_seen = {}
-	local ws_order = {}
-
-	for line in output:gmatch("[^\r\n]+") do
-		local ws, app, win_id = line:match("^(.-)|||(.-)|||(.-)$")
-		if ws and app then
-			ws = ws:match("^%s*(.-)%s*$")
-			app = app:match("^%s*(.-)%s*$")
-			win_id = win_id and win_id:match("^%s*(.-)%s*$") or ""
-			if ws ~= "" and app ~= "" then
-				if not ws_seen[ws] then
-					ws_seen[ws] = true
-					ws_order[#ws_order + 1] = ws
-					workspaces[ws] = {}
-				end
-				workspaces[ws][#workspaces[ws] + 1] = { app = app, win_id = win_id }
-			end
-		end
+-- Render one slot from the helper's "<ws>|<focused>|<window flags>|<app>|..." payload
+-- (empty when the slot is unused)
+local function render_slot(w, payload)
+	local fields = {}
+	for field in (payload .. "|"):gmatch("(.-)|") do
+		fields[#fields + 1] = unescape(field)
 	end
 
-	table.sort(ws_order)
-	return workspaces, ws_order
-end
-
--- Ensure the focused workspace appears in the list (even if empty)
-local function ensure_focused(workspaces, ws_order, focused_ws)
-	if focused_ws == "" or workspaces[focused_ws] then
-		return
-	end
-	workspaces[focused_ws] = {}
-	local inserted = false
-	for idx, name in ipairs(ws_order) do
-		if focused_ws < name then
-			table.insert(ws_order, idx, focused_ws)
-			inserted = true
-			break
+	local ws_name = fields[1]
+	if not ws_name or ws_name == "" then
+		slot_ws_name[w] = nil
+		ws_groups[w].pill:set({ drawing = false })
+		for i = 1, MAX_WINDOWS_PER_WS do
+			ws_groups[w].icons[i]:set({ drawing = false })
 		end
+		return
 	end
-	if not inserted then
-		ws_order[#ws_order + 1] = focused_ws
-	end
-end
 
--- Apply workspace data to pre-created sketchybar items
-local function render(workspaces, ws_order, focused_ws, focused_win_id)
-	for w = 1, MAX_WORKSPACES do
-		local ws_name = ws_order[w]
-		slot_ws_name[w] = ws_name
+	slot_ws_name[w] = ws_name
+	local is_focused_ws = (fields[2] == "1")
+	local flags = fields[3] or ""
+	ws_groups[w].pill:set({
+		drawing = true,
+		icon = {
+			string = ws_name,
+			color = is_focused_ws and colors.base or colors.text,
+		},
+		background = {
+			color = is_focused_ws and colors.lavender or colors.surface0,
+		},
+	})
 
-		if ws_name then
-			local is_focused_ws = (ws_name == focused_ws)
-			ws_groups[w].pill:set({
+	for i = 1, MAX_WINDOWS_PER_WS do
+		local app = fields[3 + i]
+		if app and app ~= "" then
+			local icon_str = app_icons[app] or app_icons["Default"] or ":default:"
+			local is_app_font = icon_str:match("^:.*:$")
+			local is_focused = (flags:sub(i, i) == "1")
+			ws_groups[w].icons[i]:set({
 				drawing = true,
 				icon = {
-					string = ws_name,
-					color = is_focused_ws and colors.base or colors.text,
-				},
-				background = {
-					color = is_focused_ws and colors.lavender or colors.surface0,
+					string = icon_str,
+					font = {
+						family = is_app_font and "sketchybar-app-font" or settings.font.icons,
+						style = "Regular",
+						size = 16.0,
+					},
+					color = is_focused and colors.text or colors.overlay0,
 				},
 			})
-
-			local wins = workspaces[ws_name] or {}
-			for i = 1, MAX_WINDOWS_PER_WS do
-				local win = wins[i]
-				if win then
-					local icon_str = app_icons[win.app] or app_icons["Default"] or ":default:"
-					local is_app_font = icon_str:match("^:.*:$")
-					local is_focused = (win.win_id ~= "" and win.win_id == focused_win_id)
-					ws_groups[w].icons[i]:set({
-						drawing = true,
-						icon = {
-							string = icon_str,
-							font = {
-								family = is_app_font and "sketchybar-app-font" or settings.font.icons,
-								style = "Regular",
-								size = 16.0,
-							},
-							color = is_focused and colors.text or colors.overlay0,
-						},
-					})
-				else
-					ws_groups[w].icons[i]:set({ drawing = false })
-				end
-			end
 		else
-			ws_groups[w].pill:set({ drawing = false })
-			for i = 1, MAX_WINDOWS_PER_WS do
-				ws_groups[w].icons[i]:set({ drawing = false })
-			end
+			ws_groups[w].icons[i]:set({ drawing = false })
 		end
 	end
 end
 
--- Single combined shell command (1 process instead of 3 sequential ones)
-local QUERY_CMD = "echo '---WINDOWS---'; "
-	.. "aerospace list-windows --all --format '%{workspace}|||%{app-name}|||%{window-id}' 2>/dev/null; "
-	.. "echo '---FOCUSED_WS---'; "
-	.. "aerospace list-workspaces --focused 2>/dev/null; "
-	.. "echo '---FOCUSED_WIN---'; "
-	.. "aerospace list-windows --focused --format '%{window-id}' 2>/dev/null"
-
--- Parse the combined output into its 3 sections
-local function parse_combined(raw)
-	local windows_block = ""
-	local focused_ws = ""
-	local focused_win_id = ""
-
-	local section = nil
-	for line in raw:gmatch("[^\r\n]+") do
-		if line == "---WINDOWS---" then
-			section = "w"
-		elseif line == "---FOCUSED_WS---" then
-			section = "fw"
-		elseif line == "---FOCUSED_WIN---" then
-			section = "fwin"
-		elseif section == "w" then
-			windows_block = windows_block .. line .. "\n"
-		elseif section == "fw" then
-			focused_ws = line:match("^%s*(.-)%s*$") or ""
-		elseif section == "fwin" then
-			focused_win_id = line:match("^%s*(.-)%s*$") or ""
+-- The aerospace_state helper runs the aerospace query natively and triggers
+-- aerospace_state_change with only the slots that changed since its last
+-- trigger. Change events just poke it; bursts are coalesced by the helper.
+local aerospace_state_path = "$CONFIG_DIR/helpers/aerospace_state/bin/aerospace_state"
+sbar.add("event", "aerospace_state_change")
+
+ws_groups[1].pill:subscribe("aerospace_state_change", function(env)
+	for slot in tostring(env.CHANGED or ""):gmatch("%d+") do
+		local w = tonumber(slot)
+		if w and ws_groups[w] then
+			render_slot(w, tostring(env["SLOT_" .. slot] or ""))
 		end
 	end
+end)
 
-	return windows_block, focused_ws, focused_win_id
-end
-
--- Synchronous update (used at startup)
-local function update_display_sync()
-	local p = io.popen(QUERY_CMD)
-	local raw = p and p:read("*a") or ""
-	if p then
-		p:close()
-	end
-
-	local windows_block, focused_ws, focused_win_id = parse_combined(raw)
-	local workspaces, ws_order = parse_all_windows(windows_block)
-	ensure_focused(workspaces, ws_order, focused_ws)
-	render(workspaces, ws_order, focused_ws, focused_win_id)
-end
-
--- Async update (used in event callbacks — single exec, no nesting)
-local function update_display_async()
+local function poke_state()
 	if _G.SKETCHYBAR_SUSPENDED then
 		return
 	end
-
-	sbar.exec(QUERY_CMD, function(raw)
-		local output = tostring(raw or "")
-		local windows_block, focused_ws, focused_win_id = parse_combined(output)
-		local workspaces, ws_order = parse_all_windows(windows_block)
-		ensure_focused(workspaces, ws_order, focused_ws)
-		render(workspaces, ws_order, focused_ws, focused_win_id)
-	end)
+	sbar.exec("killall -USR1 aerospace_state >/dev/null 2>&1")
 end
 
-update_display_sync()
-
-ws_groups[1].pill:subscribe("aerospace_workspace_change", function(_)
-	update_display_async()
-end)
-
-ws_groups[1].pill:subscribe("front_app_switched", function(_)
-	update_display_async()
-end)
-
-ws_groups[1].pill:subscribe("aerospace_focus_change", function(_)
-	update_display_async()
-end)
+ws_groups[1].pill:subscribe(
+	{ "aerospace_workspace_change", "aerospace_focus_change", "front_app_switched" },
+	function(_)
+		poke_state()
+	end
+)
 
-local poller = sbar.add("item", "aerospace.poller", {
-	drawing = false,
-	update_freq = 0,
-})
-poller:subscribe("routine", function(_)
-	update_display_async()
-end)
+supervisor.add("aerospace_state", aerospace_state_path .. " aerospace_state_change")
@@ -1,6 +1,7 @@
 local icons = require("icons")
 local colors = require("colors")
 local settings = require("settings")
+local supervisor = require("supervisor")
 
 -- Battery widget (no popup). Click opens System Preferences.
 -- Background maintain-charge logic is preserved.
@@ -91,37 +92,7 @@ local function file_exists(path)
   return true
 end
 
-local function fetch_battery_info(callback)
-  if not file_exists(battery_helper_path) then
-    if callback then callback(nil, 1) end
-    return
-  end
-  -- Hardcoded path to local helper binary
-  sbar.exec(battery_helper_path, function(info, exit_code)
-    if callback then callback(info, exit_code) end
-  end)
-end
-
-local function enable_charging(callback)
-  -- Hardcoded path to local helper binary
-  sbar.exec("sudo " .. battery_control_path .. " enable", function(_, exit_code)
-    if callback then callback(exit_code == 0) end
-  end)
-end
-
-local function disable_charging(callback)
-  -- Hardcoded path to local helper binary
-  sbar.exec("sudo " .. battery_control_path .. " disable", function(_, exit_code)
-    if callback then callback(exit_code == 0) end
-  end)
-end
-
-local function enable_adapter(callback)
-  -- Hardcoded path to local helper binary
-  sbar.exec("sudo " .. battery_control_path .. " adapter off", function(_, exit_code)
-    if callback then callback(exit_code == 0) end
-  end)
-end
+sbar.add("event", "battery_update")
 
 local battery = sbar.add("item", "widgets.battery", {
   position = "right",
@@ -142,82 +113,77 @@ local battery = sbar.add("item", "widgets.battery", {
   update_freq = 600,
 })
 
-local function update_battery()
-  if _G.SKETCHYBAR_SUSPENDED then return end
-  fetch_battery_info(function(info, exit_code)
-    if exit_code ~= 0 or type(info) ~= "table" then return end
-    local charge = tonumber(info.percent)
-    if not charge then return end
-    local charge_i = math.floor(charge + 0.5)
-    local charging = info.is_charging == true
-    local charged = info.is_charged == true
-
-    local color = colors.green
-    local icon = icons.battery._0
-    if charging then
-      icon = icons.battery.charging
-    elseif charged then
-      icon = icons.battery._100
-    else
-      if charge > 80 then icon = icons.battery._100
-      elseif charge > 60 then icon = icons.battery._75
-      elseif charge > 40 then icon = icons.battery._50
-      elseif charge > 20 then icon = icons.battery._25; color = colors.peach
-      else icon = icons.battery._0; color = colors.red end
-    end
+-- Latest summary pushed by the resident battery_info helper
+local last_percent = nil
+
+local function update_battery(env)
+  -- The helper only triggers on changes, so a dropped event would leave the
+  -- widget stale until the next one
+  if _G.SKETCHYBAR_SUSPENDED then
+    _G.SKETCHYBAR_DEFER("battery", function() update_battery(env) end)
+    return
+  end
+  local charge = tonumber(env.percent)
+  if not charge or charge < 0 then return end
+  last_percent = charge
+  local charge_i = math.floor(charge + 0.5)
+  local charging = env.is_charging == "1"
+  local charged = env.is_charged == "1"
+
+  local color = colors.green
+  local icon = icons.battery._0
+  if charging then
+    icon = icons.battery.charging
+  elseif charged then
+    icon = icons.battery._100
+  else
+    if charge > 80 then icon = icons.battery._100
+    elseif charge > 60 then icon = icons.battery._75
+    elseif charge > 40 then icon = icons.battery._50
+    elseif charge > 20 then icon = icons.battery._25; color = colors.peach
+    else icon = icons.battery._0; color = colors.red end
+  end
 
-    if last_charge == charge_i and last_charging == charging and last_icon == icon and last_color == color then return end
-    last_charge = charge_i
-    last_charging = charging
-    last_icon = icon
-    last_color = color
-    battery:set({ icon = { string = icon, color = color }, label = { string = tostring(charge_i) .. "%" } })
-  end)
+  if last_charge == charge_i and last_charging == charging and last_icon == icon and last_color == color then return end
+  last_charge = charge_i
+  last_charging = charging
+  last_icon = icon
+  last_color = color
+  battery:set({ icon = { string = icon, color = color }, label = { string = tostring(charge_i) .. "%" } })
 end
 
 local MAINTAIN_HYSTERESIS = 2
 
-local function check_and_maintain()
-  if not maintain_state.enabled then return end
+-- The privileged daemon holds the SMC session and enforces the charge limit
+-- itself on power source events, so nothing here polls the SMC.
+local function start_battery_control()
   if not file_exists(battery_control_path) then return end
-  fetch_battery_info(function(info, exit_code)
-    if exit_code ~= 0 or type(info) ~= "table" then return end
-    local percent = tonumber(info.percent)
-    if not percent then return end
-    -- Hardcoded path to local helper binary
-    sbar.exec("sudo " .. battery_control_path .. " status", function(ctrl_info, ctrl_exit)
-      if ctrl_exit ~= 0 or type(ctrl_info) ~= "table" then return end
-      local charging_enabled = ctrl_info.charging_enabled
-      if percent >= maintain_state.target then
-        if charging_enabled then disable_charging(function() end) end
-      elseif percent < maintain_state.target - MAINTAIN_HYSTERESIS then
-        if not charging_enabled then
-          enable_adapter(function() enable_charging(function() end) end)
-        end
-      end
-    end)
-  end)
+  local args = " daemon"
+  if maintain_state.enabled then
+    args = args .. string.format(" --limit %d --hysteresis %d", maintain_state.target, MAINTAIN_HYSTERESIS)
+  end
+  -- Hardcoded path to local helper binary
+  sbar.exec("sudo " .. battery_control_path .. args)
 end
 
 local history_counter = 0
 local function routine_update()
-  check_and_maintain()
   history_counter = history_counter + 1
   if history_counter >= 10 then
     history_counter = 0
-    fetch_battery_info(function(info, exit_code)
-      if exit_code ~= 0 or type(info) ~= "table" then return end
-      local percent = tonumber(info.percent)
-      if percent then record_history(percent) end
-    end)
+    if last_percent then record_history(last_percent) end
   end
 end
 
-battery:subscribe({ "forced", "routine", "power_source_change", "system_woke" }, function()
-  update_battery()
-  routine_update()
-end)
-update_battery()
+-- The helper only triggers when percent, charging state or time estimates
+-- change, so this runs on power source events instead of polling.
+battery:subscribe("battery_update", update_battery)
+
+battery:subscribe("routine", routine_update)
+
+-- Hardcoded path to local helper binary
+supervisor.add("battery_info", battery_helper_path .. " --watch battery_update")
+start_battery_control()
 
 -- Click opens Battery preferences (hardcoded system URL)
 battery:subscribe("mouse.clicked", function(env)
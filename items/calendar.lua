@@ -1,5 +1,6 @@
 local settings = require("settings")
 local colors = require("colors")
+local supervisor = require("supervisor")
 
 -- Date/time widget (no icon, clean text only)
 
@@ -21,7 +22,6 @@ local cal = sbar.add("item", "widgets.calendar", {
   },
   padding_left = 0,
   padding_right = 0,
-  update_freq = 1,
 })
 
 local function update_calendar()
@@ -31,9 +31,15 @@ local function update_calendar()
   cal:set({ label = { string = label } })
 end
 
-cal:subscribe({ "forced", "routine", "system_woke" }, update_calendar)
+-- The label only changes once a minute: clock_tick triggers minute_tick
+-- right after each minute boundary, also after clock and time zone changes.
+sbar.add("event", "minute_tick")
+
+cal:subscribe({ "forced", "minute_tick", "system_woke" }, update_calendar)
 update_calendar()
 
+supervisor.add("clock_tick", "$CONFIG_DIR/helpers/clock_tick/bin/clock_tick --minute minute_tick")
+
 -- Click opens notification center (hardcoded osascript, no user input)
 cal:subscribe("mouse.clicked", function(env)
   if env.BUTTON ~= "left" then return end
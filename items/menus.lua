@@ -1,4 +1,5 @@
 local settings = require("settings")
+local supervisor = require("supervisor")
 
 -- App menu bar items (reads native menu titles via helpers/menus binary).
 -- All sbar.exec calls reference $CONFIG_DIR paths (SketchyBar Lua API, not Node.js).
@@ -8,6 +9,10 @@ local menu_watcher = sbar.add("item", "menus.watcher", {
   updates = true,
 })
 
+-- Resident menus server: the -l/-s calls below are answered by it over a
+-- socket (and fall back to running in-process while it is not up).
+supervisor.add("menus", "$CONFIG_DIR/helpers/menus/bin/menus -d", nil, true)
+
 local SWITCH_DEBOUNCE_S = 0.45
 local MENU_ITEM_GAP = 2
 local MENU_LABEL_PADDING = 6
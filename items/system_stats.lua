@@ -1,15 +1,10 @@
 local colors = require("colors")
 local settings = require("settings")
+local supervisor = require("supervisor")
 
 -- CPU per-core bars + GPU/MEM graphs. No popups.
 -- NOTE: sbar.exec is the SketchyBar Lua API, NOT Node.js child_process.
 -- All commands below are hardcoded strings with no user input.
-local system_stats_cmd = "killall system_stats >/dev/null 2>&1; "
-	.. os.getenv("CONFIG_DIR")
-	.. "/helpers/system_stats/bin/system_stats system_stats_update 0.5"
-
-sbar.exec(system_stats_cmd)
-
 local graph_width = 80
 
 local function make_graph(name, icon_text, graph_color, padding_right)
@@ -66,37 +61,31 @@ end)
 --------------------------------------------------------------------------------
 -- CPU PER-CORE VERTICAL BARS
 --------------------------------------------------------------------------------
-local ncores
+-- Core count and P/E core split (Apple Silicon; falls back to all-P on Intel,
+-- which has no perflevels) from a single sysctl: this runs before the bar
+-- draws, so it is one process spawn instead of one per value
+local ncores = 10
+local pcores
 do
-	local p = io.popen("sysctl -n hw.ncpu")
-	ncores = p and tonumber(p:read("*a"):match("(%d+)")) or 10
+	local p = io.popen("sysctl -n hw.ncpu hw.perflevel0.logicalcpu 2>/dev/null")
 	if p then
+		local values = {}
+		for n in p:read("*a"):gmatch("(%d+)") do
+			values[#values + 1] = tonumber(n)
+		end
 		p:close()
+		ncores = values[1] or ncores
+		local n = values[2]
+		if n and n > 0 and n < ncores then pcores = n end
 	end
+	pcores = pcores or ncores
 end
 
 local max_bar_height = 28
 
--- Detect P/E core split (Apple Silicon; falls back to all-P on Intel)
-local pcores = ncores
-do
-	local p = io.popen("sysctl -n hw.perflevel0.logicalcpu 2>/dev/null")
-	if p then
-		local n = tonumber(p:read("*a"):match("(%d+)"))
-		p:close()
-		if n and n > 0 and n < ncores then pcores = n end
-	end
-end
 local bar_width = 6
 local bar_gap = 2
 
-local function color_for_load(load)
-	if load >= 75 then return colors.red end
-	if load >= 50 then return colors.peach end
-	if load >= 25 then return colors.yellow end
-	return colors.green
-end
-
 -- Spacer between GPU graph and core bars (keeps trailing_gap off the bars)
 sbar.add("item", "widgets.sys.cpu.spacer", {
 	position = "right",
@@ -106,9 +95,8 @@ sbar.add("item", "widgets.sys.cpu.spacer", {
 })
 
 -- Single loop, right-to-left. Kernel order: P(0..pcores-1), E(pcores..ncores-1)
-local core_items = {}
 for i = ncores - 1, 0, -1 do
-	core_items[i] = sbar.add("item", "widgets.sys.cpu.core_" .. i, {
+	sbar.add("item", "widgets.sys.cpu.core_" .. i, {
 		position = "right",
 		width = bar_width,
 		icon = { drawing = false },
@@ -178,18 +166,30 @@ cpu_label:subscribe("mouse.clicked", function(env)
 	end
 end)
 
-local function update_core(idx, load)
-	if not core_items[idx] then return end
-	local h = math.max(3, math.floor(load / 100 * max_bar_height + 0.5))
-	core_items[idx]:set({
-		background = {
-			color = (idx >= pcores) and colors.blue or color_for_load(load),
-			height = h,
-			y_offset = -(max_bar_height - h) / 2,
-		},
-	})
+-- The helper draws the core bars and pushes the graphs itself (one batched
+-- message per tick), holding them back while the bar is suspended; the event
+-- handler below only updates the text labels.
+local function hex(color)
+	return string.format("%08x", color)
 end
 
+local system_stats_cmd = "$CONFIG_DIR/helpers/system_stats/bin/system_stats system_stats_update 0.5"
+	.. " --alert 'cpu_hot:cpu_temp_avg > 90 for 3s clear 85'"
+	.. " --render-cores widgets.sys.cpu.core_"
+	.. " --bar-height " .. max_bar_height
+	.. " --pcores " .. pcores
+	.. " --ecore-color " .. hex(colors.blue)
+	.. " --core-color 0:" .. hex(colors.green)
+	.. " --core-color 25:" .. hex(colors.yellow)
+	.. " --core-color 50:" .. hex(colors.peach)
+	.. " --core-color 75:" .. hex(colors.red)
+	.. " --gpu-graph widgets.sys.gpu"
+	.. " --mem-graph widgets.sys.mem"
+	.. " --suspend-file '" .. _G.SKETCHYBAR_SUSPEND_FILE .. "'"
+
+-- Beats every tick; restarted by the supervisor if it stalls (e.g. on wake)
+supervisor.add("system_stats", system_stats_cmd, 10)
+
 --------------------------------------------------------------------------------
 -- EVENT: system_stats_update
 --------------------------------------------------------------------------------
@@ -198,31 +198,8 @@ cpu_info:subscribe("system_stats_update", function(env)
 		return
 	end
 
-	local is_full = env.full_update == "1"
-
-	-- Graphics: always update (unlimited refresh)
-	-- Per-core bars
-	local core_loads_str = env.cpu_core_loads or ""
-	local core_idx = 0
-	for load_str in core_loads_str:gmatch("([^,]+)") do
-		update_core(core_idx, tonumber(load_str) or 0)
-		core_idx = core_idx + 1
-	end
-
-	-- GPU graph push
-	local gpu_util = tonumber(env.gpu_util)
-	if gpu_util and gpu_util >= 0 then
-		gpu:push({ gpu_util / 100.0 })
-	end
-
-	-- MEM graph push
-	local mem_percent = tonumber(env.mem_used_percent)
-	if mem_percent and mem_percent >= 0 then
-		mem:push({ mem_percent / 100.0 })
-	end
-
-	-- Text labels: only on full update (~1s)
-	if not is_full then
+	-- Only full updates (~1s) reach Lua; bars and graphs are drawn by the helper
+	if env.full_update ~= "1" then
 		return
 	end
 
@@ -247,27 +224,35 @@ cpu_info:subscribe("system_stats_update", function(env)
 		gpu:set({ label = "--" })
 	end
 
-	-- MEM label
+	-- MEM label, tinted by the memory pressure level (2 warning, 4 critical)
+	local mem_percent = tonumber(env.mem_used_percent)
 	local mem_used_gb = tonumber(env.mem_used_gb)
 	local mem_total_gb = tonumber(env.mem_total_gb)
+	local mem_pressure = tonumber(env.mem_pressure)
+	local mem_color = colors.text
+	if mem_pressure == 4 then
+		mem_color = colors.red
+	elseif mem_pressure == 2 then
+		mem_color = colors.orange
+	end
 	if mem_percent and mem_percent >= 0 then
 		local lbl = string.format("%d%%", mem_percent)
 		if mem_used_gb and mem_total_gb then
 			lbl = lbl .. string.format(" %.0f/%.0fG", mem_used_gb, mem_total_gb)
 		end
-		mem:set({ label = lbl })
+		mem:set({ label = { string = lbl, color = mem_color } })
 	else
-		mem:set({ label = "--" })
+		mem:set({ label = { string = "--", color = colors.text } })
 	end
 end)
 
 --------------------------------------------------------------------------------
--- Restart helper after sleep to avoid stale/zombie process
+-- EVENT: system_alert (sent by the helper only when a rule changes state)
 --------------------------------------------------------------------------------
-cpu_info:subscribe("system_woke", function(_)
-	sbar.delay(1.5, function()
-		sbar.exec(system_stats_cmd)
-	end)
+cpu_info:subscribe("system_alert", function(env)
+	if env.rule == "cpu_hot" then
+		cpu_info:set({ icon = { color = env.state == "on" and colors.red or colors.text } })
+	end
 end)
 
 --------------------------------------------------------------------------------
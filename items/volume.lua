@@ -2,10 +2,14 @@ local colors = require("colors")
 local icons = require("icons")
 local settings = require("settings")
 local center_popup = require("center_popup")
+local supervisor = require("supervisor")
 
 -- Volume widget with draggable slider and detailed audio info popup.
 -- NOTE: sbar.exec is the SketchyBar Lua API, not Node.js.
--- All commands below are hardcoded osascript/system_profiler calls.
+-- Audio state comes from the audio_info helper (CoreAudio); all commands
+-- below are hardcoded helper invocations.
+
+local audio_info_path = "$CONFIG_DIR/helpers/audio_info/bin/audio_info"
 
 local function clamp_int(n, lo, hi)
   n = tonumber(n)
@@ -141,66 +145,33 @@ local function get_transport_icon(transport)
   return transport or "-"
 end
 
-local function parse_audio_devices(output, callback)
-  local devices = {}
-  local current_device = nil
-  local current_props = {}
-  for line in output:gmatch("[^\r\n]+") do
-    local device_name = line:match("^%s%s%s%s%s%s%s%s(.+):$")
-    if device_name then
-      if current_device then devices[#devices + 1] = { name = current_device, props = current_props } end
-      current_device = device_name; current_props = {}
-    else
-      local key, value = line:match("^%s+(.+):%s*(.+)$")
-      if key and value then current_props[key:gsub("%s+", "")] = value end
-    end
-  end
-  if current_device then devices[#devices + 1] = { name = current_device, props = current_props } end
-  local default_output, default_input = nil, nil
-  for _, dev in ipairs(devices) do
-    if dev.props["DefaultOutputDevice"] == "Yes" then default_output = dev end
-    if dev.props["DefaultInputDevice"] == "Yes" then default_input = dev end
-  end
-  callback(default_output, default_input)
-end
-
 local function update_level_display(v)
   row_level:set({ label = { string = string.format("%d%% (%sdB)", v, vol_to_db(v)) } })
   volume_slider:set({ slider = { percentage = v } })
 end
 
--- Hardcoded osascript commands for volume info (no user input)
-local vol_get_cmd = [[osascript -e 'output volume of (get volume settings)']]
-local mute_get_cmd = [[osascript -e 'output muted of (get volume settings)']]
-local input_vol_cmd = [[osascript -e 'input volume of (get volume settings)']]
-
+-- One helper call returns the volume, mute state and both default devices
 local function fetch_audio_info(callback)
-  sbar.exec(vol_get_cmd, function(vol_out)
-    local vol = tonumber(tostring(vol_out or ""):match("(%d+)")) or 0
-    sbar.exec(mute_get_cmd, function(mute_out)
-      local muted = tostring(mute_out or ""):match("true") ~= nil
-      sbar.exec(input_vol_cmd, function(input_vol_out)
-        local input_vol = tonumber(tostring(input_vol_out or ""):match("(%d+)"))
-        sbar.exec("system_profiler SPAudioDataType 2>/dev/null", function(profiler_out)
-          parse_audio_devices(tostring(profiler_out or ""), function(output_dev, input_dev)
-            local result = { volume = vol, muted = muted, input_volume = input_vol }
-            if output_dev then
-              result.out_device = output_dev.name
-              result.out_transport = output_dev.props["Transport"] or "-"
-              result.out_sample_rate = output_dev.props["CurrentSampleRate"]
-              result.out_channels = output_dev.props["OutputChannels"]
-            end
-            if input_dev then
-              result.in_device = input_dev.name
-              result.in_transport = input_dev.props["Transport"] or "-"
-              result.in_sample_rate = input_dev.props["CurrentSampleRate"]
-              result.in_channels = input_dev.props["InputChannels"]
-            end
-            if callback then callback(result) end
-          end)
-        end)
-      end)
-    end)
+  sbar.exec(audio_info_path, function(info, exit_code)
+    if tonumber(exit_code) ~= 0 or type(info) ~= "table" then return end
+    local function channels(n)
+      if n == nil then return nil end
+      return tostring(math.floor(tonumber(n) or 0))
+    end
+    local result = {
+      volume = clamp_int(info.volume, 0, 100),
+      muted = info.muted == true,
+      input_volume = tonumber(info.input_volume),
+      out_device = info.out_device,
+      out_transport = info.out_transport or "-",
+      out_sample_rate = info.out_sample_rate,
+      out_channels = channels(info.out_channels),
+      in_device = info.in_device,
+      in_transport = info.in_transport or "-",
+      in_sample_rate = info.in_sample_rate,
+      in_channels = channels(info.in_channels),
+    }
+    if callback then callback(result) end
   end)
 end
 
@@ -228,8 +199,8 @@ end
 
 local function set_volume(new_vol)
   new_vol = clamp_int(new_vol, 0, 100)
-  -- Hardcoded osascript command with integer volume value
-  sbar.exec('osascript -e "set volume output volume ' .. tostring(new_vol) .. '"', function()
+  -- Hardcoded helper command with integer volume value
+  sbar.exec(audio_info_path .. " --set-volume " .. tostring(new_vol), function()
     current_volume = new_vol; update_level_display(new_vol); update_volume_widget(new_vol, current_muted)
   end)
 end
@@ -240,8 +211,12 @@ volume_slider:subscribe("mouse.clicked", function(env)
 end)
 
 local function toggle_mute()
-  sbar.exec('osascript -e "set volume output muted (not output muted of (get volume settings))"', function()
-    current_muted = not current_muted
+  sbar.exec(audio_info_path .. " --toggle-mute", function(info)
+    if type(info) == "table" then
+      current_muted = info.muted == true
+    else
+      current_muted = not current_muted
+    end
     row_mute:set({ label = { string = current_muted and "ON [click to unmute]" or "OFF [click to mute]" } })
     update_volume_widget(current_volume, current_muted)
   end)
@@ -286,14 +261,44 @@ end
 volume_item:subscribe("mouse.clicked", volume_on_click)
 volume_item:subscribe("mouse.scrolled", volume_scroll)
 
--- Initial sync (hardcoded osascript commands)
-sbar.exec(vol_get_cmd, function(out, exit_code)
-  if exit_code ~= 0 then return end
-  local v = tonumber(tostring(out or ""):match("(%d+)"))
-  if not v then return end
-  current_volume = clamp_int(v, 0, 100)
-  sbar.exec(mute_get_cmd, function(mute_out)
-    current_muted = tostring(mute_out or ""):match("true") ~= nil
-    update_volume_widget(current_volume, current_muted)
-  end)
-end)
+-- The resident helper triggers audio_change on volume, mute and default
+-- device changes; its first trigger carries the initial state.
+sbar.add("event", "audio_change")
+
+-- CHANGED is a comma separated list; "input" must not match "input_volume"
+local function changed_set(env)
+  local set = {}
+  for token in tostring(env.CHANGED or ""):gmatch("[^,]+") do set[token] = true end
+  return set
+end
+
+-- Device changes seen while suspended, applied together with the latest state
+local deferred_changed = {}
+
+local function on_audio_change(env, changed)
+  changed = changed or changed_set(env)
+  if _G.SKETCHYBAR_SUSPENDED then
+    for token in pairs(changed) do deferred_changed[token] = true end
+    _G.SKETCHYBAR_DEFER("audio", function()
+      local merged = deferred_changed
+      deferred_changed = {}
+      on_audio_change(env, merged)
+    end)
+    return
+  end
+  current_volume = clamp_int(env.VOLUME, 0, 100)
+  current_muted = env.MUTED == "true"
+  update_volume_widget(current_volume, current_muted)
+  if not volume_popup.is_showing() then return end
+
+  if changed.output or changed.input then
+    populate_popup()
+  else
+    update_level_display(current_volume)
+    row_mute:set({ label = { string = current_muted and "ON [click to unmute]" or "OFF [click to mute]" } })
+  end
+end
+
+volume_item:subscribe("audio_change", function(env) on_audio_change(env) end)
+
+supervisor.add("audio_info", audio_info_path .. " --watch audio_change")
@@ -1,14 +1,20 @@
 local colors = require("colors")
 local settings = require("settings")
+local supervisor = require("supervisor")
 
 -- Network widget with hover popup attached directly to the graph item.
 -- NOTE: sbar.exec is the SketchyBar Lua API, NOT Node.js child_process.
 -- All commands below are hardcoded strings with no user input.
-local network_load_cmd =
-	"killall network_load >/dev/null 2>&1; $CONFIG_DIR/helpers/network_load/bin/network_load auto network_update 0.5"
-sbar.exec(network_load_cmd)
+-- Beats every tick; restarted by the supervisor if it stalls (e.g. on wake)
+supervisor.add(
+	"network_load",
+	"$CONFIG_DIR/helpers/network_load/bin/network_load auto network_update 0.5 --sample 0.1 --half-life 0.5",
+	10
+)
 
-local wifi_interface = os.getenv("WIFI_INTERFACE") or "en0"
+local network_info_path =
+	"$CONFIG_DIR/helpers/network_info/bin/SketchyBarNetworkInfoHelper.app/Contents/MacOS/SketchyBarNetworkInfoHelper"
+sbar.add("event", "network_info_change")
 
 local graph_width = 80
 local trailing_gap = 16
@@ -153,26 +159,28 @@ local function update_popup_rates()
 	row_upload:set({ label = { string = format_rate_row(current_up_mbps) } })
 end
 
--- Hardcoded ipconfig command
-local function update_connection_state()
+-- Connection state is pushed by the resident network_info helper, which only
+-- triggers when interface, SSID, address, router or link state change.
+local function on_network_info_change(env)
+	-- Change-only, so an event arriving while suspended is applied on resume
 	if _G.SKETCHYBAR_SUSPENDED then
+		_G.SKETCHYBAR_DEFER("wifi", function()
+			on_network_info_change(env)
+		end)
 		return
 	end
-	-- Hardcoded path, no user input
-	sbar.exec("/usr/sbin/ipconfig getifaddr " .. wifi_interface .. " 2>/dev/null", function(ip)
-		ip = tostring(ip or ""):gsub("%s+$", "")
-		current_connected = (ip ~= "")
-		if wifi_popup_visible then
-			row_status:set({ label = { string = current_connected and "Connected" or "Disconnected" } })
-			row_ip:set({ label = { string = (ip ~= "") and ip or "-" } })
-			update_popup_rates()
-		end
-	end)
+	current_connected = env.connected == "1"
+	if wifi_popup_visible then
+		row_status:set({ label = { string = current_connected and "Connected" or "Disconnected" } })
+		row_ssid:set({ label = { string = (env.ssid and env.ssid ~= "") and env.ssid or "-" } })
+		row_ip:set({ label = { string = (env.ip and env.ip ~= "") and env.ip or "-" } })
+		row_mask:set({ label = { string = (env.subnet_mask and env.subnet_mask ~= "") and env.subnet_mask or "-" } })
+		row_router:set({ label = { string = (env.router and env.router ~= "") and env.router or "-" } })
+		update_popup_rates()
+	end
 end
 
-wifi_net:subscribe({ "forced", "routine", "wifi_change", "system_woke" }, function(_)
-	update_connection_state()
-end)
+wifi_net:subscribe("network_info_change", on_network_info_change)
 
 wifi_net:subscribe("network_update", function(env)
 	if _G.SKETCHYBAR_SUSPENDED then
@@ -200,17 +208,16 @@ wifi_net:subscribe("network_update", function(env)
 	})
 end)
 
+supervisor.add("SketchyBarNetworkInfoHelper", network_info_path .. " auto --watch network_info_change")
+
 -- Hardcoded helper binary path
 local function fetch_wifi_info()
 	sbar.exec(
-		"$CONFIG_DIR/helpers/network_info/bin/SketchyBarNetworkInfoHelper.app/Contents/MacOS/SketchyBarNetworkInfoHelper auto",
+		network_info_path .. " auto",
 		function(info)
 			if type(info) ~= "table" then
 				return
 			end
-			if info.interface and info.interface ~= "" then
-				wifi_interface = tostring(info.interface)
-			end
 			if info.ip and info.ip ~= "" then
 				current_connected = true
 			elseif info.ip == "" then
@@ -259,12 +266,3 @@ end)
 close_btn:subscribe("mouse.clicked", function()
 	hide_popup()
 end)
-
--- Restart helper after sleep to avoid stale/zombie process
-wifi_net:subscribe("system_woke", function(_)
-	sbar.delay(1.5, function()
-		sbar.exec(network_load_cmd)
-	end)
-end)
-
-update_connection_state()
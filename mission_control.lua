@@ -4,9 +4,20 @@
 -- WindowServer and SketchyBar CPU usage. This module detects when Dock becomes
 -- the front app and temporarily disables bar drawing. It also exposes a global
 -- flag so other items can skip heavy updates while Mission Control is active.
+-- Helpers that draw items directly, bypassing the Lua handlers, see the same
+-- state through a flag file that exists while suspended (--suspend-file).
+-- Items fed by change-only events hand them to SKETCHYBAR_DEFER instead of
+-- dropping them, and the latest one per key is applied on resume.
 
 _G.SKETCHYBAR_SUSPENDED = _G.SKETCHYBAR_SUSPENDED or false
 
+-- Per-user temp dir, so the file is not in the shared /tmp
+do
+  local dir = os.getenv("TMPDIR")
+  if not dir or dir == "" then dir = os.getenv("HOME") .. "/Library/Caches" end
+  _G.SKETCHYBAR_SUSPEND_FILE = dir:gsub("/+$", "") .. "/sketchybar_suspended"
+end
+
 local watcher = sbar.add("item", "perf.mission_control", {
   drawing = false,
   updates = true,
@@ -15,11 +26,27 @@ local watcher = sbar.add("item", "perf.mission_control", {
 -- Always start in a non-suspended state to avoid getting "stuck hidden" if a
 -- previous run crashed while suspended.
 _G.SKETCHYBAR_SUSPENDED = false
+os.remove(_G.SKETCHYBAR_SUSPEND_FILE)
 local last_suspended = false
 
 -- Ensure the bar is visible on load (bar "hidden" state persists across reloads).
 sbar.bar({ hidden = "off", drawing = "on" })
 
+-- Latest deferred handler per key, run in arrival order on resume
+local deferred = {}
+local deferred_keys = {}
+
+function _G.SKETCHYBAR_DEFER(key, fn)
+  if not deferred[key] then deferred_keys[#deferred_keys + 1] = key end
+  deferred[key] = fn
+end
+
+local function run_deferred()
+  local keys, fns = deferred_keys, deferred
+  deferred, deferred_keys = {}, {}
+  for _, key in ipairs(keys) do fns[key]() end
+end
+
 local suspend_token = 0
 local timer_armed = false
 local requested_delay = 0.0
@@ -29,8 +56,13 @@ local function apply_state(suspended)
   last_suspended = suspended
   _G.SKETCHYBAR_SUSPENDED = suspended
 
-  if not suspended then
+  if suspended then
+    local file = io.open(_G.SKETCHYBAR_SUSPEND_FILE, "w")
+    if file then file:close() end
+  else
+    os.remove(_G.SKETCHYBAR_SUSPEND_FILE)
     sbar.bar({ hidden = "off", drawing = "on" })
+    run_deferred()
   end
 end
 
@@ -4,6 +4,11 @@ return {
 
   icons = "NerdFont", -- available: NerdFont, sf-symbols
 
+  -- Resident helpers: false, 1 (lower priority, coalesced timer wakeups) or
+  -- "ecores" (also background band, efficiency cores only); see helpers/impact.h.
+  -- Interactive helpers (menus, popup_context) always run at normal priority.
+  helpers_low_impact = false,
+
   -- Shortcuts (right-side compact icon chunk)
   shortcuts_icon_size = 15.0,
 
@@ -0,0 +1,62 @@
+-- Resident helpers are started by one native supervisor (helpers/supervisor)
+-- instead of by each item: it keeps a single instance of every helper and
+-- restarts them with backoff when they exit or, for helpers with a
+-- heartbeat, stop beating (e.g. stalled after wake). helper_restart is
+-- triggered with HELPER, REASON, RESTARTS and RECOVER_MS once a restarted
+-- helper is back.
+-- NOTE: sbar.exec is the SketchyBar Lua API, NOT Node.js child_process.
+-- All commands are hardcoded helper invocations registered by the items.
+
+local settings = require("settings")
+
+local M = {
+  _helpers = {},
+}
+
+local helpers_dir = os.getenv("CONFIG_DIR") .. "/helpers"
+
+sbar.add("event", "helper_restart")
+
+local function quote(text)
+  return "'" .. text:gsub("'", "'\\''") .. "'"
+end
+
+-- name is the process name of the helper; heartbeat the seconds without a
+-- beat after which it is restarted (nil: only restarted when it exits).
+-- interactive helpers answer clicks and popups, so they are kept out of the
+-- low-impact mode (settings.helpers_low_impact).
+function M.add(name, command, heartbeat, interactive)
+  table.insert(M._helpers, {
+    name = name,
+    command = command,
+    heartbeat = heartbeat or 0,
+    interactive = interactive or false,
+  })
+end
+
+-- Called once every item registered its helpers, so their first triggers
+-- find the items subscribed. Replaces a running supervisor; with build set,
+-- the helpers are compiled first.
+function M.start(build)
+  local command = "exec " .. helpers_dir .. "/supervisor/bin/supervisor --event helper_restart"
+  if settings.helpers_low_impact then
+    command = command .. " --low-impact " .. quote(tostring(settings.helpers_low_impact))
+  end
+  for _, helper in ipairs(M._helpers) do
+    local helper_command = helper.command
+    if settings.helpers_low_impact and helper.interactive then
+      -- env execs the helper, so it keeps the pid the supervisor tracks
+      helper_command = "env SKETCHYBAR_LOW_IMPACT=0 " .. helper_command
+    end
+    command = command
+      .. " --helper " .. quote(helper.name)
+      .. " " .. tostring(helper.heartbeat)
+      .. " " .. quote(helper_command)
+  end
+  if build then
+    command = "(cd '" .. helpers_dir .. "' && make) >/dev/null 2>&1; " .. command
+  end
+  sbar.exec(command)
+end
+
+return M